@@ -109,17 +109,17 @@ int main(int argc, char **argv) {
 
   // Then we need a list of adapters (here only one),
   // each consisting of a filter and a printer.
-  CLogAdapter adapters[1] = {{stdoutFilter, stdoutPrinter}};
+  CLogAdapter adapters[1] = {{.messageFilter = stdoutFilter, .onMessage = stdoutPrinter}};
 
-  // The context for the log messages.
+  // The context for the log messages, the optional fields are left zero.
   CLogContext ctx = {
-      adapters,
-      ARRAY_LENGTH(adapters),
-      TagsNames,
-      ARRAY_LENGTH(TagsNames),
-      CLOG_LTRC,
-      buffer,
-      ARRAY_LENGTH(buffer),
+      .adapters = adapters,
+      .adaptersSize = ARRAY_LENGTH(adapters),
+      .tagNames = TagsNames,
+      .numberOfTags = ARRAY_LENGTH(TagsNames),
+      .minLevel = CLOG_LTRC,
+      .messageBuffer = buffer,
+      .messageBufferSize = ARRAY_LENGTH(buffer),
   };
 
   // let's print some messages
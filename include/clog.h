@@ -12,8 +12,9 @@
  *
  * # Introduction
  * A versatile logging module for C projects. The log function itself if not thread safe. If you want to use the library
- * in multithreaded environemtns you need to use different log contexts for concurring events. The module doesn't
- * allocate any memory during runtime. This allows to use the module in embedded systems with limited resources.
+ * in multithreaded environemtns you need to use different log contexts for concurring events or an asynchronous
+ * context (see clogAsync.h). The module doesn't allocate any memory during runtime. This allows to use the module in
+ * embedded systems with limited resources.
  *
  *
  * # Important Components
@@ -43,11 +44,16 @@
  *
  * @startuml
  *  entity "Function that generates\na log event" as function
- *  participant "CLOG_*\n(log macro)\ninvokes clog_logMessage()" as log
+ *  participant "CLOG_*\n(log macro)\ninvokes clog_logCallSite()" as log
  *  function -> log: pass context and paramters
  *  activate log
  *  log -> log: check paramters
  *  log -> log: prepare CLogMessage
+ *  alt deferred formatting
+ *    log -> log: capture raw arguments
+ *  else
+ *    log -> log: format message text
+ *  end
  *  loop for all adapters in the context
  *    alt messageFilter accepts message
  *      log -> adapter: CLogMessage
@@ -59,6 +65,7 @@
 #ifndef INCLUDE_CLOG_H_
 #define INCLUDE_CLOG_H_
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -199,26 +206,172 @@ typedef enum _CLogLevel {
   typedef enum _##TYPENAME{ELEMENTS(CLOG_ENUM_ELEMENT)}(TYPENAME); \
   const char *const TYPENAME##Names[0 ELEMENTS(CLOG_ENUM_COUNT)] = {ELEMENTS(CLOG_ENUM_NAME)};
 
+/**
+ * @def CLOG_ARGS_SIZE
+ * The number of bytes available to store the raw arguments of a single message (see CLogArgs). Strings are stored
+ * inline, so this is also the limit for the length of all string arguments of a message. If set manually it has to
+ * be set to the same value for the library and all modules using it.
+ */
+#ifndef CLOG_ARGS_SIZE
+#define CLOG_ARGS_SIZE (256U)
+#endif
+
+/**
+ * Compact record of the raw arguments of a message. It holds the format string and a copy of the argument bytes, so
+ * the message text can be produced later (or never, if no adapter asks for it). String arguments are copied into the
+ * record, so it stays valid even if the arguments passed to the log call do not.
+ *
+ * The values are stored unaligned in the order of the arguments, each with the size of its promoted type (e.g. an int
+ * for `%%hhd` and `%%c`, a double for a float). Strings are stored as an uint32_t length followed by the characters
+ * without terminator, NULL strings as CLOG_ARGS_NULL_STRING without characters.
+ */
+typedef struct _CLogArgs {
+  const char *format;                 ///< The format string, must stay valid as long as the record is used.
+  size_t size;                        ///< The number of bytes used in data.
+  bool truncated;                     ///< True if the arguments did not fit into data.
+  unsigned char data[CLOG_ARGS_SIZE]; ///< The argument values in the order given by the format string.
+} CLogArgs;
+
+/**
+ * @def CLOG_ARGS_NULL_STRING
+ * The length stored in CLogArgs in place of a NULL string argument.
+ */
+#define CLOG_ARGS_NULL_STRING (UINT32_MAX)
+
+/**
+ * @def CLOG_SITE_DISABLED
+ * Call site flag: the log statement is disabled (see clogCallSite.h).
+ */
+#define CLOG_SITE_DISABLED (0x01U)
+
+/**
+ * @def CLOG_SITE_FORCED
+ * Call site flag: the log statement is enabled regardless of the minimum level of the context (see clogCallSite.h).
+ */
+#define CLOG_SITE_FORCED (0x02U)
+
+/**
+ * @def CLOG_SITE_NEW
+ * Call site flag: the log statement has not been registered yet, it is registered on its first execution.
+ */
+#define CLOG_SITE_NEW (0x04U)
+
+/**
+ * @def CLOG_SITE_SPECS
+ * The number of conversion specifications cached per call site (see CLogSiteFormat). The format strings of statements
+ * with more conversions are parsed on every call. If set manually it has to be set to the same value for the library
+ * and all modules using it.
+ */
+#ifndef CLOG_SITE_SPECS
+#define CLOG_SITE_SPECS (8U)
+#endif
+
+/**
+ * A parsed conversion specification of a cached format string, internal.
+ */
+typedef struct _CLogSpec {
+  uint16_t start;       ///< The offset of the '%' within the format string.
+  uint16_t end;         ///< The offset of the first character after the specification.
+  int16_t width;        ///< The width, -1 if not given, -2 if it is passed as argument ('*').
+  int16_t precision;    ///< The precision, -1 if not given, -2 if it is passed as argument ('*').
+  unsigned char flags;  ///< The flags ('-', '+', ' ', '#' and '0').
+  unsigned char length; ///< The length modifier.
+  unsigned char type;   ///< The type of the argument.
+  char conversion;      ///< The conversion character.
+} CLogSpec;
+
+/**
+ * The parsed format string of a call site. It is filled on the first execution of the log statement, later messages
+ * only walk the cached specifications: the literal text between them is copied as it is, the argument types and
+ * widths are known without looking at the format string again.
+ */
+typedef struct _CLogSiteFormat {
+  unsigned char state;             ///< Whether the format string has been parsed, internal.
+  unsigned char numberOfSpecs;     ///< The number of conversion specifications.
+  uint16_t length;                 ///< The length of the format string.
+  CLogSpec specs[CLOG_SITE_SPECS]; ///< The conversion specifications in the order of the format string.
+} CLogSiteFormat;
+
+/**
+ * Static description of a single log statement. The CLOG_* macros define one descriptor per call site and pass only
+ * a pointer to it, so the call itself is cheap and every log statement has a stable identity (its address) that can
+ * be used as a key, e.g. for caches or counters. Besides the constant description, the descriptor holds the flags used
+ * to switch the statement on or off at runtime (see clogCallSite.h).
+ */
+typedef struct _CLogCallSite {
+  const char *file;            ///< The name of the file containing the log statement.
+  unsigned int line;           ///< The line number within the file.
+  const char *function;        ///< The function containing the log statement.
+  CLogLevel level;             ///< The log level.
+  size_t tag;                  ///< The tag of the message.
+  const char *format;          ///< The message text / format string.
+  unsigned char flags;         ///< Combination of the CLOG_SITE_* flags, checked inline by the log macros.
+  struct _CLogCallSite *next;  ///< The next registered call site, internal.
+  CLogSiteFormat *formatCache; ///< Static storage for the parsed format string, NULL if it is parsed on every call.
+} CLogCallSite;
+
+/**
+ * @def CLOG_CALL_SITE_FLAGS
+ * Internal macro reading the flags of a call site. They might be changed by another thread at any time.
+ */
+#if defined(__GNUC__)
+#define CLOG_CALL_SITE_FLAGS(SITE) __atomic_load_n(&(SITE).flags, __ATOMIC_RELAXED)
+#else
+#define CLOG_CALL_SITE_FLAGS(SITE) ((SITE).flags)
+#endif
+
 /**
  * Structure containing all parameters for a single
  * log message.
  */
 typedef struct _CLogMessage {
-  const char *file;        ///< The name of the file in which the log message is being
-                           ///< produced.
-  const unsigned int line; ///< The line number where the log message is produced.
-  const char *function;    ///< The function in which the log message is being produced.
-  const char *message;     ///< The formatted message.
-  const CLogLevel level;   ///< The log level.
-  const char *tag;         ///< The tag of the message.
+  const char *file;                   ///< The name of the file in which the log message is being
+                                      ///< produced.
+  const unsigned int line;            ///< The line number where the log message is produced.
+  const char *function;               ///< The function in which the log message is being produced.
+  const char *message;                ///< The formatted message. NULL in deferred mode until formatted,
+                                      ///< use clog_getMessage() to access it.
+  const CLogLevel level;              ///< The log level.
+  const char *tag;                    ///< The tag of the message.
+  const CLogArgs *args;               ///< The raw arguments in deferred mode, NULL otherwise.
+  const struct _CLogContext *context; ///< The context the message has been logged to (needed to format
+                                      ///< deferred messages). Can be NULL.
+  const CLogCallSite *site;           ///< The call site of the message. Static (and therefore a stable identity) for
+                                      ///< messages logged with the CLOG_* macros, NULL for messages logged with
+                                      ///< clog_logMessage().
+  const char *formattedLine;          ///< The complete formatted line, NULL until the first adapter asks for it.
+                                      ///< Use clog_getLine() to access it.
+  int formattedLineLength;            ///< The length of formattedLine.
+  uint64_t timestamp;                 ///< The time the message has been logged in ns, taken once from the clock of
+                                      ///< the context (see CLogContext::clock).
+  uint64_t sequence;                  ///< The number of the message within its context, starting at 1. Messages
+                                      ///< dropped by an asynchronous context take no number (see clog_asyncDropped()).
+                                      ///< Asynchronous contexts with per-thread rings count per ring instead (see
+                                      ///< clogAsync.h), so there the number counts the messages of the thread.
+  uint32_t threadId;                  ///< The id of the thread that has logged the message (see clog_threadId()).
 } CLogMessage;
 
+/**
+ * Function pointer prototype for clocks, see CLogContext::clock and clogClock.h for the built-in ones.
+ * @return uint64_t The current time in ns.
+ */
+typedef uint64_t (*CLogClock)(void);
+
 /**
  * Function pointer prototype for message backends.
  * @param message the message to be handled by the backend.
  */
 typedef void (*LogAdapterOnMessage)(const CLogMessage *message);
 
+/**
+ * Function pointer prototype for batch backends, see CLogAdapter::onMessages. The text of a message of the batch
+ * (clog_getMessage(), clog_getLine()) is formatted into the buffers of the context when it is asked for, so it is only
+ * valid until the text of another message is asked for. Handle the messages one after the other.
+ * @param messages the messages to be handled by the backend, in the order they have been logged.
+ * @param count the number of messages, at least one.
+ */
+typedef void (*LogAdapterOnMessages)(const CLogMessage messages[], size_t count);
+
 /**
  * Function pointer prototype for message filters.
  * @param message The message to be filtered or not.
@@ -233,10 +386,21 @@ typedef bool (*LogAdapterFilter)(const CLogMessage *message);
  * during runtime.
  */
 typedef struct _CLogAdapter {
-  LogAdapterFilter messageFilter; /**< Pointer to the filter function. Filters can be used to supress messages
-                                       dynamically (can be changed during runtime). Can be set to NULL if not needed. */
-  LogAdapterOnMessage onMessage;  /**< Pointer to the backend function. Must not be NULL. The function is called to
-                                       process (e.g. print to stdout) the messages. */
+  LogAdapterFilter messageFilter;  /**< Pointer to the filter function. Filters can be used to supress messages
+                                        dynamically (can be changed during runtime). Can be NULL if not needed. */
+  LogAdapterOnMessage onMessage;   /**< Pointer to the backend function. Can only be NULL if onMessages is set. The
+                                        function is called to process (e.g. print to stdout) the messages. */
+  CLogLevel minLevel;              /**< Messages with a lower level are not passed to the adapter. Change it with
+                                        clog_setAdapterMinLevel() at runtime, writing it directly is not supported. */
+  uint64_t excludedTags;           /**< Bit mask of tags (bit n for tag n) not passed to the adapter, zero to accept
+                                        all tags. Only the first 64 tags can be excluded. Change it with
+                                        clog_setAdapterExcludedTags() at runtime, writing it directly is not
+                                        supported. */
+  LogAdapterOnMessages onMessages; /**< Optional batch backend. The dispatcher of an asynchronous context (see
+                                        clogAsync.h) passes the messages it takes out of the ring in batches to it
+                                        instead of calling onMessage per message, so the backend can e.g. write them
+                                        with a single system call. Synchronous contexts call onMessage, or onMessages
+                                        with a single message if onMessage is NULL. */
 } CLogAdapter;
 
 /**
@@ -244,14 +408,16 @@ typedef struct _CLogAdapter {
  * one logging instance. A single context cannot be used in a multithreaded
  * environment without external synchronisation as the message buffer is
  * being reused for all messages. So if there are multiple messages logged
- * at the "same" time the message buffer might get corrupted.
+ * at the "same" time the message buffer might get corrupted. Asynchronous
+ * contexts (see clogAsync.h) can be shared by multiple threads.
  *
  * Different tags can be used to separate log messages by their origin. E.g. a
  * communication module and a storage module can use different tags in their messages.
  */
 typedef struct _CLogContext {
-  const CLogAdapter *const adapters; /**< Pointer to the array of log adapters. At least one is needed. */
-  const size_t adaptersSize;         /**< The size of the array of log adapters. */
+  const CLogAdapter *adapters;       /**< Pointer to the array of log adapters. At least one is needed. Change it
+                                          with clog_setAdapters() at runtime. */
+  size_t adaptersSize;               /**< The size of the array of log adapters. */
   const char *const *tagNames;       /**< The array containing all tag names. Can be set to NULL if not needed. */
   const size_t numberOfTags;         /**< The size of the array containing the tag names. */
   CLogLevel minLevel;                /**< The minimum log level at runtime (messages with a
@@ -259,14 +425,137 @@ typedef struct _CLogContext {
   char *const messageBuffer;         /**< The char buffer to hold the formatted message
                                           (message text and message parameters). */
   const size_t messageBufferSize;    /**< The size of the message buffer. */
+  bool deferredFormatting;           /**< If set, the message text is only formatted when an adapter asks for it
+                                          using clog_getMessage(). Until then only the raw arguments are
+                                          captured (see CLogArgs). */
+  struct _CLogAsync *async;          /**< The state of an asynchronous context, NULL for synchronous contexts.
+                                          Set by clog_asyncStart() (see clogAsync.h). */
+  CLogLevel *tagMinLevels;           /**< Optional array (sized numberOfTags) holding the minimum level of each tag.
+                                          If set, it replaces minLevel for the tags it covers. clog_setMinLevel()
+                                          sets all entries, clog_setTagMinLevel() a single one. Can be NULL. */
+  CLogLevel adapterMinLevel;         /**< The lowest minimum level of all adapters. Messages below it are not
+                                          accepted by any adapter. Maintained by clog_updateAdapters(). */
+  uint64_t rejectedTags;             /**< The tags excluded by all adapters. Maintained by clog_updateAdapters(). */
+  bool validated;                    /**< Set once the context has been checked, so it isn't checked for every
+                                          message. Set by clog_initContext() or on the first message. */
+  char *lineBuffer;                  /**< Optional buffer holding the complete formatted line of the current message
+                                          (see clog_getLine()). If set, the line is formatted only once, no matter
+                                          how many adapters ask for it. Can be NULL. */
+  size_t lineBufferSize;             /**< The size of lineBuffer. */
+  const struct _CLogLayout *layout;  /**< Optional compiled layout of the complete line (without the trailing end of
+                                          line, see clogLayout.h) used by clog_formatMessage() and clog_getLine().
+                                          NULL for the default line format. */
+  bool shortestFloats;               /**< If set, the floating point conversions without precision (e.g. `%%f`,
+                                          `%%e`, `%%g`) print the shortest digits reading back as the same double
+                                          instead of six digits, e.g. `0.1` instead of `0.100000`. `%%g` uses the
+                                          exponential notation if the exponent is below -4 or above 16 then. Faster
+                                          than printf with `%%g`, but slower than six digits, as up to 17 digits are
+                                          generated while checking the neighbouring doubles. */
+  CLogClock clock;                   /**< The clock stamping the messages (see CLogMessage::timestamp), e.g. one of
+                                          clogClock.h. NULL for clog_clockMonotonic(). */
+  bool headerTime;                   /**< If set, the default line header (see clog_formatLineHeader()) starts with
+                                          the local date and time of the message, e.g. `2019-09-16 12:34:56.789`. */
+  uint64_t sequence;                 /**< The number of the last message logged to the context (see
+                                          CLogMessage::sequence), internal. */
 } CLogContext;
 
+/**
+ * Checks whether a message would pass the minimum level of a context (see CLogContext::minLevel and
+ * CLogContext::tagMinLevels) and would be accepted by at least one adapter by its level and tag (see
+ * CLogAdapter::minLevel and CLogAdapter::excludedTags). Used inline by the log macros, so messages of disabled tags
+ * are dropped before any function of the library is called.
+ *
+ * @param ctx    The context. If NULL, all messages are enabled.
+ * @param tag    The tag of the message.
+ * @param level  The log level of the message.
+ * @return true  If the message is enabled.
+ * @return false If the level of the message is too low.
+ */
+static inline bool clog_isLevelEnabled(const CLogContext *const ctx, const size_t tag, const CLogLevel level) {
+  if (NULL == ctx) {
+    return true;
+  }
+  // updated atomically by the setters of the adapters
+  const CLogLevel adapterMinLevel = __atomic_load_n(&ctx->adapterMinLevel, __ATOMIC_RELAXED);
+  const uint64_t rejectedTags = __atomic_load_n(&ctx->rejectedTags, __ATOMIC_RELAXED);
+  if (level < adapterMinLevel || (tag < 64U && 0U != (rejectedTags & (((uint64_t)1U) << tag)))) {
+    // no adapter would accept the message
+    return false;
+  }
+  if (NULL != ctx->tagMinLevels && tag < ctx->numberOfTags) {
+    return level >= ctx->tagMinLevels[tag];
+  }
+  return level >= ctx->minLevel;
+}
+
 /**
  * @def VA_ARGS
  * Internal macro needed to handle variable numbers of arguments in the log macros
  */
 #define VA_ARGS(...) , ##__VA_ARGS__
 
+/**
+ * @def CLOG_CALL_SITE_CONSTANT
+ * Internal macro providing the value of a call site field (level, tag or format) for the static initializer of the
+ * descriptor. With GCC and Clang a VALUE that is not a constant expression (e.g. a level held in a variable) yields
+ * OTHERWISE, so the statement still compiles in C. Other compilers require a constant expression in C.
+ */
+#if defined(__GNUC__)
+#define CLOG_CALL_SITE_CONSTANT(VALUE, OTHERWISE) (__builtin_constant_p(VALUE) ? (VALUE) : (OTHERWISE))
+#else
+#define CLOG_CALL_SITE_CONSTANT(VALUE, OTHERWISE) (VALUE)
+#endif
+
+/**
+ * @def CLOG_CALL_SITE_LOG
+ * Internal macro defining a static CLogCallSite (and the storage for its parsed format string) for the statement and
+ * passing it to the log function LOG (clog_logCallSite() for the C macros). Needed as MESSAGE might still contain the
+ * additional parameters when passed through CLOG_MESSAGE. A disabled statement costs a single load and branch. New
+ * statements are registered on their first execution without evaluating the parameters, which are only evaluated if
+ * the message is enabled. LEVEL, TAG and MESSAGE are passed to LOG as well, as they might change from one execution to
+ * the next. A MESSAGE that is not a constant expression leaves the format of the call site NULL (see
+ * CLOG_CALL_SITE_CONSTANT).
+ */
+#define CLOG_CALL_SITE_LOG(LOG, CTX, LEVEL, TAG, MESSAGE, ...)                                                         \
+  {                                                                                                                    \
+    static CLogSiteFormat clog_siteFormat;                                                                             \
+    static CLogCallSite clog_callSite = {CLOG_FILE,                                                                    \
+                                         CLOG_LINE,                                                                    \
+                                         CLOG_FUNC,                                                                    \
+                                         CLOG_CALL_SITE_CONSTANT(LEVEL, CLOG_LUKN),                                    \
+                                         CLOG_CALL_SITE_CONSTANT((size_t)(TAG), SIZE_MAX),                             \
+                                         CLOG_CALL_SITE_CONSTANT(MESSAGE, NULL),                                       \
+                                         CLOG_SITE_NEW,                                                                \
+                                         NULL,                                                                         \
+                                         &clog_siteFormat};                                                            \
+    unsigned char clog_flags = CLOG_CALL_SITE_FLAGS(clog_callSite);                                                    \
+    if (0U != (clog_flags & CLOG_SITE_NEW)) {                                                                          \
+      clog_flags = clog_registerCallSite(&clog_callSite);                                                              \
+    }                                                                                                                  \
+    if (0U == (clog_flags & CLOG_SITE_DISABLED) &&                                                                     \
+        (0U != (clog_flags & CLOG_SITE_FORCED) || clog_isLevelEnabled(CTX, TAG, LEVEL))) {                             \
+      LOG(CTX, &clog_callSite, LEVEL, TAG, MESSAGE VA_ARGS(__VA_ARGS__));                                              \
+    }                                                                                                                  \
+  }
+
+/**
+ * @def CLOG_CALL_SITE_MESSAGE
+ * Internal macro logging a message through a static CLogCallSite, see CLOG_CALL_SITE_LOG. The message text and its
+ * parameters are passed on as they are, so they are split into MESSAGE and the parameters again.
+ */
+#define CLOG_CALL_SITE_MESSAGE(CTX, LEVEL, TAG, ...) CLOG_CALL_SITE_LOG(clog_logCallSite, CTX, LEVEL, TAG, __VA_ARGS__)
+
+/**
+ * @def CLOG_CALL_SITES
+ * Set it to 0 before including this header to let the C macros call clog_logMessage() directly instead of defining a
+ * static CLogCallSite per statement (see CLOG_MESSAGE). Needed e.g. in inline functions with external linkage, which
+ * must not define modifiable static objects (C99 6.7.4p3). The statements can't be found or changed through
+ * clogCallSite.h then.
+ */
+#ifndef CLOG_CALL_SITES
+#define CLOG_CALL_SITES 1
+#endif
+
 /**
  * @def CLOG_MESSAGE
  * @param CTX     The log context to be used.
@@ -274,12 +563,27 @@ typedef struct _CLogContext {
  * @param TAG     The tag of the message.
  * @param MESSAGE The message text / format string
  * @param ...     The additional parameters to be used when formatting the message.
- * The macro to log an arbitrary message.
- */
-#define CLOG_MESSAGE(CTX, LEVEL, TAG, MESSAGE, ...)                                                  \
-  if (LEVEL >= clog_getMinLevel(CTX)) {                                                              \
-    clog_logMessage(CTX, LEVEL, TAG, CLOG_FILE, CLOG_LINE, CLOG_FUNC, MESSAGE VA_ARGS(__VA_ARGS__)); \
+ * The macro to log an arbitrary message. Each statement gets its own static CLogCallSite, so only a pointer to it is
+ * passed on.
+ *
+ * LEVEL, TAG and MESSAGE may be given at runtime (e.g. in a variable) with GCC and Clang, other compilers require
+ * constant expressions in C. The call site holds the level, tag and format it has been defined with (see
+ * CLOG_CALL_SITE_CONSTANT, in C++ the ones of its first execution). Messages with a different level, tag or format are
+ * logged through a temporary descriptor like clog_logMessage() does, so they have no CLogMessage::site and the rules of
+ * clogCallSite.h filtering by level or tag don't match them. Set CLOG_CALL_SITES to 0 to use the macros in inline
+ * functions with external linkage.
+ */
+#if CLOG_CALL_SITES
+#define CLOG_MESSAGE(CTX, LEVEL, TAG, MESSAGE, ...) \
+  CLOG_CALL_SITE_MESSAGE(CTX, LEVEL, TAG, MESSAGE VA_ARGS(__VA_ARGS__))
+#else
+#define CLOG_MESSAGE(CTX, LEVEL, TAG, MESSAGE, ...)                                                    \
+  {                                                                                                    \
+    if (LEVEL >= clog_getTagMinLevel(CTX, TAG)) {                                                      \
+      clog_logMessage(CTX, LEVEL, TAG, CLOG_FILE, CLOG_LINE, CLOG_FUNC, MESSAGE VA_ARGS(__VA_ARGS__)); \
+    }                                                                                                  \
   }
+#endif
 
 #if CLOG_GLOBAL_MIN_LEVEL <= CLOG_MLTRC
 /**
@@ -386,6 +690,109 @@ void clog_logMessage(CLogContext *const ctx,
                      const char *const function,
                      const char *const message,
                      ...);
+
+/**
+ * The log function used by the log macros. Avoid using this function directly. New call sites are registered (see
+ * clogCallSite.h), disabled ones are ignored and forced ones are logged regardless of the minimum level of the
+ * context.
+ *
+ * @param ctx    The log context to be used.
+ * @param site   The call site describing the message. Must be static.
+ * @param level  The log level of the message. If it differs from the level of the call site (see CLOG_MESSAGE), the
+ *               message is logged through a temporary copy of the call site.
+ * @param tag    The tag of the message, like level.
+ * @param format The message text / format string. If it isn't the one of the call site (see CLOG_MESSAGE), the message
+ *               is logged through a temporary copy of the call site as well.
+ * @param ...    The additional parameters to be used when formatting the message.
+ */
+void clog_logCallSite(CLogContext *const ctx,
+                      CLogCallSite *const site,
+                      const CLogLevel level,
+                      const size_t tag,
+                      const char *const format,
+                      ...);
+
+/**
+ * Registers a new call site, so it can be found by clog_setCallSites() and clog_findCallSites() (see clogCallSite.h).
+ * The rules set so far are applied to the call site. Does nothing if the call site has already been registered. Used
+ * by the log macros on the first execution of a statement, avoid using this function directly.
+ *
+ * @param site           The call site.
+ * @return unsigned char The flags of the call site after registration.
+ */
+unsigned char clog_registerCallSite(CLogCallSite *const site);
+
+/**
+ * Logs a message whose arguments have already been captured, e.g. by the C++ front end (see clog.hpp). Otherwise it
+ * behaves like clog_logCallSite(): new call sites are registered, disabled ones are ignored and forced ones are logged
+ * regardless of the minimum level of the context.
+ *
+ * @param ctx   The log context to be used.
+ * @param site  The call site describing the message. Must be static.
+ * @param level The log level of the message, see clog_logCallSite().
+ * @param tag   The tag of the message, see clog_logCallSite().
+ * @param args  The captured arguments. If args->format isn't the format string of the call site, the message is logged
+ *              through a temporary copy of the call site.
+ */
+void clog_logArgs(CLogContext *const ctx,
+                  CLogCallSite *const site,
+                  const CLogLevel level,
+                  const size_t tag,
+                  const CLogArgs *const args);
+
+/**
+ * Returns the formatted text of a message. In deferred mode the text is formatted into the message buffer of the
+ * context on the first call, so filters that don't need the text never pay for formatting. Adapters that might be
+ * used with deferred contexts must use this function instead of accessing CLogMessage::message directly.
+ *
+ * @param msg          The message.
+ * @return const char* The message text, NULL if msg is NULL or the text is not available.
+ */
+const char *clog_getMessage(const CLogMessage *const msg);
+
+/**
+ * Captures the raw arguments of a message into a record. The format string is parsed to find the type of each
+ * argument. Strings are copied into the record, like printf at most precision chars of them (e.g. `%.*s` of a buffer
+ * that isn't terminated). Positional arguments (e.g. `%1$d`) are not supported. If the format string contains a
+ * specification whose arguments can't be told (e.g. the `'` flag or `%m`), the message is formatted right away and the
+ * record holds the text with the format `%s` instead.
+ *
+ * @param args   The record to be filled.
+ * @param format The format string.
+ * @param list   The arguments.
+ * @return true  If all arguments have been captured.
+ * @return false If any parameter is invalid or the arguments did not fit (args->truncated is set then).
+ */
+bool clog_captureArgs(CLogArgs *const args, const char *const format, va_list list);
+
+/**
+ * Formats a record of captured arguments, like vsnprintf() would do with the original arguments. The function ensures
+ * a terminating null byte if bufferSize is at least one. If the arguments have been truncated while capturing, `..` is
+ * appended to the text.
+ *
+ * @param buffer     The buffer to fill the text into.
+ * @param bufferSize The size of buffer.
+ * @param args       The captured arguments.
+ * @return size_t    The length of the complete text. If it is equal or greater than bufferSize the text has been
+ *                   truncated.
+ */
+size_t clog_formatArgs(char buffer[], const size_t bufferSize, const CLogArgs *const args);
+
+/**
+ * Formats a message text like vsnprintf() does. The conversions used most in log messages (integers, pointers,
+ * strings, characters and doubles) are converted by CLog itself, anything else (e.g. `%%Lf`, `%%a`, `%%ls`) is left to
+ * vsnprintf(). Doubles are rounded exactly like glibc does (half to even on the exact binary value). The function
+ * ensures a terminating null byte if bufferSize is at least one.
+ *
+ * @param buffer     The buffer to fill the text into.
+ * @param bufferSize The size of buffer.
+ * @param format     The format string.
+ * @param list       The arguments.
+ * @return size_t    The length of the complete text. If it is equal or greater than bufferSize the text has been
+ *                   truncated.
+ */
+size_t clog_vformat(char buffer[], const size_t bufferSize, const char *const format, va_list list);
+
 /**
  * @param level        The log level.
  * @return const char* The text representation of the log level.
@@ -407,7 +814,8 @@ const char *clog_getColor(const CLogLevel level);
  * of any invalid parameters (e.g. null pointers) it will silently return. The length of the buffer must be at least one
  * character. The function ensures a terminating null byte either at the end of the formatted line header or in the last
  * character of the buffer. You can use this function if you don't want to implement your own formatting of the line
- * header.
+ * header. If the context of the message has CLogContext::headerTime set, the line header starts with the local date
+ * and time of the message (e.g. "2019-09-16 12:34:56.789 ").
  * @param buffer        The buffer to fill the line header into.
  * @param bufferLength  In: The maximum size of buffer. Out: The number of characters actually used.
  * @param msg           The message to be formatted.
@@ -419,7 +827,9 @@ void clog_formatLineHeader(char buffer[], int *const bufferLength, const CLogMes
  * of any invalid parameters (e.g. null pointers) it will silently return. The length of the buffer must be at least two
  * characters. The function ensures a terminating null byte either at the end of the formatted message or in the
  * last character of the buffer.
- * You can use this function if you don't want to implement your own formatter.
+ * You can use this function if you don't want to implement your own formatter. If the context has a line buffer, the
+ * line formatted by clog_getLine() is copied instead of formatting it again. If the context has a layout (see
+ * CLogContext::layout), it replaces the default line format.
  *
  * @param buffer        The buffer to fill the message into.
  * @param bufferLength  In: The maximum size of buffer. Out: The number of characters actually used.
@@ -427,6 +837,16 @@ void clog_formatLineHeader(char buffer[], int *const bufferLength, const CLogMes
  */
 void clog_formatMessage(char buffer[], int *const bufferLength, const CLogMessage *const msg);
 
+/**
+ * Returns the complete formatted line of a message (like clog_formatMessage() produces it). The line is formatted into
+ * the line buffer of the context on the first call, all further calls (e.g. by other adapters) return the same bytes.
+ *
+ * @param msg          The message.
+ * @param length       Out: The length of the line (without the terminating null byte). Can be NULL.
+ * @return const char* The line. NULL if msg is NULL or the context of the message has no line buffer.
+ */
+const char *clog_getLine(const CLogMessage *const msg, int *const length);
+
 /**
  * Returns the minimum log level for the given context. If no context is given
  * the function will return trace (so gracefully all messages will be handled).
@@ -440,12 +860,96 @@ CLogLevel clog_getMinLevel(CLogContext *ctx);
 /**
  * Sets the minimum log level for the given context.
  * All messages with a lower level shall not be handed to the backend.
+ * If the context has per-tag levels, all of them are set to the new level as well.
  *
  * @param ctx   The context.
  * @param level The new minimum level.
  */
 void clog_setMinLevel(CLogContext *ctx, CLogLevel level);
 
+/**
+ * Returns the minimum log level of a tag. If the context has no per-tag levels or the tag is out of range, the minimum
+ * level of the context is returned. If no context is given the function will return trace.
+ *
+ * @param ctx        The context.
+ * @param tag        The tag.
+ * @return CLogLevel The minimum level for messages of this tag.
+ */
+CLogLevel clog_getTagMinLevel(const CLogContext *ctx, const size_t tag);
+
+/**
+ * Sets the minimum log level of a single tag. Requires CLogContext::tagMinLevels to be set.
+ *
+ * @param ctx    The context.
+ * @param tag    The tag.
+ * @param level  The new minimum level of the tag.
+ * @return true  If the level has been set.
+ * @return false If the context has no per-tag levels or the tag is out of range.
+ */
+bool clog_setTagMinLevel(CLogContext *ctx, const size_t tag, const CLogLevel level);
+
+/**
+ * Sets the minimum level of an adapter of a context (see CLogAdapter::minLevel) and recomputes the levels accepted by
+ * the adapters of the context (see CLogContext::adapterMinLevel), so the log macros don't drop messages the adapter
+ * now accepts. The context keeps its adapters const, so the adapter has to be passed as an element of the modifiable
+ * array the context has been set up with. The fields are stored atomically, so it may be called while other threads
+ * log to the context, but not concurrently with the other setters of the adapters.
+ *
+ * @param ctx     The context.
+ * @param adapter The adapter, an element of CLogContext::adapters.
+ * @param level   The new minimum level of the adapter.
+ * @return true   If the level has been set.
+ * @return false  If any parameter is NULL or the adapter is not one of the context.
+ */
+bool clog_setAdapterMinLevel(CLogContext *ctx, CLogAdapter *const adapter, const CLogLevel level);
+
+/**
+ * Sets the tags excluded by an adapter of a context (see CLogAdapter::excludedTags) and recomputes the tags rejected by
+ * all adapters of the context (see CLogContext::rejectedTags), like clog_setAdapterMinLevel().
+ *
+ * @param ctx          The context.
+ * @param adapter      The adapter, an element of CLogContext::adapters.
+ * @param excludedTags Bit mask of the tags (bit n for tag n) not to be passed to the adapter.
+ * @return true        If the tags have been set.
+ * @return false       If any parameter is NULL or the adapter is not one of the context.
+ */
+bool clog_setAdapterExcludedTags(CLogContext *ctx, CLogAdapter *const adapter, const uint64_t excludedTags);
+
+/**
+ * Recomputes the levels and tags accepted by the adapters of a context (see CLogContext::adapterMinLevel and
+ * CLogContext::rejectedTags). Called by clog_initContext(), clog_setAdapters(), clog_setAdapterMinLevel() and
+ * clog_setAdapterExcludedTags(), so there is no need to call it directly.
+ *
+ * @param ctx The context.
+ */
+void clog_updateAdapters(CLogContext *ctx);
+
+/**
+ * Checks a context once and prepares it for logging (see CLogContext::validated and clog_updateAdapters()). Calling
+ * it is optional, otherwise it is done on the first message. Afterwards the context is not checked again for every
+ * message, so change the adapters only with clog_setAdapters(), clog_setAdapterMinLevel() or
+ * clog_setAdapterExcludedTags().
+ *
+ * @param ctx    The context.
+ * @return true  If the context is valid.
+ * @return false If any of the fields is not set up properly.
+ */
+bool clog_initContext(CLogContext *ctx);
+
+/**
+ * Replaces the adapters of a context. The new adapters are checked first, if they are invalid the context is left
+ * unchanged. Don't use it while another thread is logging to the context. It is refused while the context is
+ * asynchronous, as the dispatcher reads the adapters without a lock: stop it first (see clog_asyncStop()).
+ *
+ * @param ctx          The context.
+ * @param adapters     The new array of adapters. At least one is needed.
+ * @param adaptersSize The size of the array.
+ * @return true        If the adapters have been replaced.
+ * @return false       If any parameter is invalid, e.g. an adapter without onMessage function, or the context is
+ *                     asynchronous.
+ */
+bool clog_setAdapters(CLogContext *ctx, const CLogAdapter *const adapters, const size_t adaptersSize);
+
 /**
  * Function that checks a log context. Returns true if all requirements are met.
  *
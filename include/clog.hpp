@@ -0,0 +1,694 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Type safe C++ front end.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * The CLOGXX_* macros log to the same contexts and adapters as the CLOG_* macros, but they are checked at compile time:
+ * the format string is parsed by the compiler and every conversion is matched against the type of its argument. A
+ * wrong type, a missing or a surplus argument fails to compile instead of printing garbage (or crashing) at runtime.
+ *
+ * The arguments are not passed as variable argument list. They are written straight into a CLogArgs record by the
+ * serializer of their type and passed to clog_logArgs(), so there is no format string parsing to find the argument
+ * types at runtime. Only statements passing char or wchar_t pointers scan the format string, for the precisions
+ * bounding these strings like printf does (e.g. `%%.*s` of a buffer that isn't terminated). The record takes the same
+ * way as the captured arguments of the C macros: it is formatted by the library (eagerly or deferred, see
+ * CLogContext::deferredFormatting) or queued as it is by asynchronous contexts.
+ *
+ * @code
+ * CLOGXX_INF(&ctx, IO, "read %zu bytes from %s", bytes, name);         // name may be a std::string
+ * CLOGXX_INF(&ctx, IO, "read %d bytes", bytes);                        // fails to compile, bytes is a size_t
+ * @endcode
+ *
+ * The conversions are matched like this (integers and unscoped enums are promoted first, signedness is ignored):
+ * - `%%d`, `%%i`, `%%u`, `%%o`, `%%x`, `%%X`: int (`h`, `hh` or no length modifier), long (`l`), long long (`ll`),
+ *   intmax_t (`j`), size_t (`z`) or ptrdiff_t (`t`). `%%c` takes an int, `%%lc` a wint_t.
+ * - `%%e`, `%%f`, `%%g`, `%%a` (and the upper case ones): float or double, long double with `L`.
+ * - `%%s`: char strings (including std::string), `%%ls` wchar_t strings (including std::wstring).
+ * - `%%p`: any other object pointer or nullptr. Cast char pointers to `const void *` to print their address.
+ * - `*` as width or precision: int.
+ *
+ * `%%n`, positional arguments (`%%1$d`) and unknown conversions are rejected.
+ */
+
+#ifndef INCLUDE_CLOG_HPP_
+#define INCLUDE_CLOG_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "clog.h"
+
+namespace clogxx {
+
+/**
+ * The result of checking a format string against the types of its arguments.
+ */
+enum class FormatError {
+  NONE,               ///< The arguments match the format string.
+  TYPE_MISMATCH,      ///< An argument does not match its conversion.
+  TOO_FEW_ARGUMENTS,  ///< The format string has more conversions than there are arguments.
+  TOO_MANY_ARGUMENTS, ///< There are arguments left after the last conversion.
+  UNSUPPORTED,        ///< The format string is malformed or uses an unsupported conversion.
+};
+
+namespace detail {
+
+/**
+ * The argument classes told apart by the format checker, matching the types stored in CLogArgs.
+ */
+enum class Kind {
+  NONE,    ///< Not an argument of a log message.
+  INT,     ///< int
+  LONG,    ///< long
+  LLONG,   ///< long long
+  DOUBLE,  ///< double
+  LDOUBLE, ///< long double
+  STRING,  ///< char string
+  WSTRING, ///< wchar_t string
+  POINTER, ///< void *
+};
+
+/**
+ * The class of a promoted integer type.
+ */
+template <typename T>
+constexpr Kind integerKind() {
+  using Signed = typename std::make_signed<T>::type;
+  return std::is_same<Signed, int>::value
+             ? Kind::INT
+             : std::is_same<Signed, long>::value ? Kind::LONG
+                                                 : std::is_same<Signed, long long>::value ? Kind::LLONG : Kind::NONE;
+}
+
+/**
+ * Appends a value to a record of captured arguments like clog_captureArgs() does.
+ */
+inline bool put(CLogArgs &args, const void *value, const size_t size) {
+  if (args.size + size > sizeof(args.data)) {
+    args.truncated = true;
+    return false;
+  }
+  std::memcpy(&args.data[args.size], value, size);
+  args.size += size;
+  return true;
+}
+
+/**
+ * Appends a string to a record of captured arguments, truncating it to the remaining space.
+ */
+inline bool putString(CLogArgs &args, const void *string, const size_t length, const size_t unitSize) {
+  uint32_t storedLength = static_cast<uint32_t>(length);
+  size_t available = sizeof(args.data) - args.size;
+
+  if (available < sizeof(storedLength)) {
+    args.truncated = true;
+    return false;
+  }
+  available -= sizeof(storedLength);
+
+  if (length * unitSize > available) {
+    storedLength = static_cast<uint32_t>(available / unitSize);
+    args.truncated = true;
+  }
+
+  put(args, &storedLength, sizeof(storedLength));
+  put(args, string, storedLength * unitSize);
+  return !args.truncated;
+}
+
+/**
+ * Appends a string that might be NULL. Like printf, at most precision chars are read, a negative precision reads up to
+ * the terminator. The precision of `%%ls` counts the bytes of the output, but every wide char converts to at least one
+ * byte, so printf doesn't read more wide chars either.
+ */
+template <typename Char>
+inline bool putString(CLogArgs &args, const Char *string, const int precision) {
+  if (nullptr == string) {
+    const uint32_t marker = CLOG_ARGS_NULL_STRING;
+    return put(args, &marker, sizeof(marker));
+  }
+  size_t length;
+  if (precision < 0) {
+    length = std::char_traits<Char>::length(string);
+  } else {
+    const Char *const terminator = std::char_traits<Char>::find(string, static_cast<size_t>(precision), Char());
+    length = (nullptr != terminator) ? static_cast<size_t>(terminator - string) : static_cast<size_t>(precision);
+  }
+  return putString(args, string, length, sizeof(Char));
+}
+
+/**
+ * Describes how an argument type is checked and stored. The types not specialized below can't be logged.
+ */
+template <typename T, typename Enable = void>
+struct Argument {
+  static constexpr Kind kind = Kind::NONE;
+};
+
+/**
+ * Integers and unscoped enums, stored as their promoted type.
+ */
+template <typename T>
+struct Argument<T,
+                typename std::enable_if<std::is_integral<T>::value ||
+                                        (std::is_enum<T>::value && std::is_convertible<T, int>::value)>::type> {
+  using Stored = decltype(+std::declval<T>());
+  static constexpr Kind kind = integerKind<Stored>();
+
+  static bool put(CLogArgs &args, const T value) {
+    const Stored stored = +value;
+    return detail::put(args, &stored, sizeof(stored));
+  }
+};
+
+/**
+ * Floating point numbers, float is promoted to double.
+ */
+template <typename T>
+struct Argument<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  using Stored = typename std::conditional<std::is_same<T, long double>::value, long double, double>::type;
+  static constexpr Kind kind = std::is_same<Stored, double>::value ? Kind::DOUBLE : Kind::LDOUBLE;
+
+  static bool put(CLogArgs &args, const T value) {
+    const Stored stored = value;
+    return detail::put(args, &stored, sizeof(stored));
+  }
+};
+
+/**
+ * Tells char and wchar_t pointers (strings) from other pointers.
+ */
+template <typename T>
+struct IsString {
+  using Pointee = typename std::remove_cv<typename std::remove_pointer<T>::type>::type;
+  static constexpr bool value =
+      std::is_pointer<T>::value && (std::is_same<Pointee, char>::value || std::is_same<Pointee, wchar_t>::value);
+};
+
+/**
+ * Object pointers (and nullptr) for `%%p`. Char pointers are strings.
+ */
+template <typename T>
+struct Argument<T,
+                typename std::enable_if<std::is_null_pointer<T>::value ||
+                                        (std::is_pointer<T>::value && !IsString<T>::value &&
+                                         !std::is_function<typename std::remove_pointer<T>::type>::value)>::type> {
+  static constexpr Kind kind = Kind::POINTER;
+
+  static bool put(CLogArgs &args, const T value) {
+    const void *const stored = value;
+    return detail::put(args, &stored, sizeof(stored));
+  }
+};
+
+/**
+ * Char pointers, read up to the precision of their conversion (see putString()).
+ */
+template <>
+struct Argument<const char *> {
+  static constexpr Kind kind = Kind::STRING;
+
+  static bool put(CLogArgs &args, const char *const value, const int precision) {
+    return putString(args, value, precision);
+  }
+};
+
+template <>
+struct Argument<char *> : Argument<const char *> {};
+
+template <>
+struct Argument<std::string> {
+  static constexpr Kind kind = Kind::STRING;
+
+  static bool put(CLogArgs &args, const std::string &value) {
+    return putString(args, value.data(), value.size(), sizeof(char));
+  }
+};
+
+template <>
+struct Argument<const wchar_t *> {
+  static constexpr Kind kind = Kind::WSTRING;
+
+  static bool put(CLogArgs &args, const wchar_t *const value, const int precision) {
+    return putString(args, value, precision);
+  }
+};
+
+template <>
+struct Argument<wchar_t *> : Argument<const wchar_t *> {};
+
+template <>
+struct Argument<std::wstring> {
+  static constexpr Kind kind = Kind::WSTRING;
+
+  static bool put(CLogArgs &args, const std::wstring &value) {
+    return putString(args, value.data(), value.size(), sizeof(wchar_t));
+  }
+};
+
+/**
+ * Carries the argument types of a log statement from an unevaluated expression to the format checker.
+ */
+template <typename... A>
+struct Types {};
+
+/**
+ * Only used in unevaluated context by CLOGXX_MESSAGE, the first parameter allows empty argument lists.
+ */
+template <typename... A>
+Types<typename std::decay<A>::type...> argumentTypes(int, A &&...);
+
+/**
+ * The length modifiers of a conversion specification.
+ */
+enum class Length { NONE, HH, H, L, LL, J, Z, T, BIG_L };
+
+/**
+ * The argument class expected by a conversion, Kind::NONE if the conversion is not supported.
+ */
+constexpr Kind expectedKind(const char conversion, const Length length) {
+  switch (conversion) {
+  case 'd':
+  case 'i':
+  case 'u':
+  case 'o':
+  case 'x':
+  case 'X':
+    switch (length) {
+    case Length::NONE:
+    case Length::HH:
+    case Length::H:
+      return Kind::INT;
+    case Length::L:
+      return Kind::LONG;
+    case Length::LL:
+      return Kind::LLONG;
+    case Length::J:
+      return integerKind<intmax_t>();
+    case Length::Z:
+      return integerKind<size_t>();
+    case Length::T:
+      return integerKind<ptrdiff_t>();
+    default:
+      return Kind::NONE;
+    }
+  case 'c':
+    return (Length::NONE == length) ? Kind::INT : (Length::L == length) ? integerKind<wint_t>() : Kind::NONE;
+  case 's':
+    return (Length::NONE == length) ? Kind::STRING : (Length::L == length) ? Kind::WSTRING : Kind::NONE;
+  case 'p':
+    return (Length::NONE == length) ? Kind::POINTER : Kind::NONE;
+  case 'e':
+  case 'E':
+  case 'f':
+  case 'F':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+    return (Length::NONE == length || Length::L == length)
+               ? Kind::DOUBLE
+               : (Length::BIG_L == length) ? Kind::LDOUBLE : Kind::NONE;
+  default:
+    return Kind::NONE;
+  }
+}
+
+/**
+ * Parses a length modifier.
+ */
+constexpr Length parseLength(const char *&p) {
+  switch (*p) {
+  case 'h':
+    return ('h' == *++p) ? (++p, Length::HH) : Length::H;
+  case 'l':
+    return ('l' == *++p) ? (++p, Length::LL) : Length::L;
+  case 'q':
+    return (++p, Length::LL);
+  case 'j':
+    return (++p, Length::J);
+  case 'z':
+    return (++p, Length::Z);
+  case 't':
+    return (++p, Length::T);
+  case 'L':
+    return (++p, Length::BIG_L);
+  default:
+    return Length::NONE;
+  }
+}
+
+/**
+ * Matches the conversions of a format string against the classes of the arguments.
+ *
+ * @param p     The format string.
+ * @param kinds The classes of the arguments.
+ * @param count The number of arguments.
+ */
+constexpr FormatError checkKinds(const char *p, const Kind *const kinds, const size_t count) {
+  size_t index = 0U;
+
+  while (0 != *p) {
+    if ('%' != *p++) {
+      continue;
+    }
+
+    while ('-' == *p || '+' == *p || ' ' == *p || '#' == *p || '0' == *p) {
+      p++;
+    }
+
+    for (int field = 0; field < 2; field++) {
+      // the width and then the precision
+      if (1 == field) {
+        if ('.' != *p) {
+          break;
+        }
+        p++;
+      }
+      if ('*' == *p) {
+        if (index >= count) {
+          return FormatError::TOO_FEW_ARGUMENTS;
+        }
+        if (Kind::INT != kinds[index++]) {
+          return FormatError::TYPE_MISMATCH;
+        }
+        p++;
+      } else {
+        while (*p >= '0' && *p <= '9') {
+          p++;
+        }
+      }
+      if ('$' == *p) {
+        return FormatError::UNSUPPORTED;
+      }
+    }
+
+    const Length length = parseLength(p);
+    const char conversion = *p;
+    if (0 == conversion) {
+      return FormatError::UNSUPPORTED;
+    }
+    p++;
+    if ('%' == conversion) {
+      continue;
+    }
+
+    const Kind expected = expectedKind(conversion, length);
+    if (Kind::NONE == expected) {
+      return FormatError::UNSUPPORTED;
+    }
+    if (index >= count) {
+      return FormatError::TOO_FEW_ARGUMENTS;
+    }
+    if (expected != kinds[index++]) {
+      return FormatError::TYPE_MISMATCH;
+    }
+  }
+
+  return (index < count) ? FormatError::TOO_MANY_ARGUMENTS : FormatError::NONE;
+}
+
+/**
+ * Checks a format string against a list of argument types.
+ */
+template <typename... A>
+constexpr FormatError checkTypes(const char *const format, Types<A...>) {
+  const Kind kinds[] = {Argument<A>::kind..., Kind::NONE};
+  return checkKinds(format, kinds, sizeof...(A));
+}
+
+/**
+ * Tells whether any of the argument types is a char or wchar_t pointer.
+ */
+template <typename... A>
+constexpr bool hasStrings() {
+  const bool strings[] = {false, IsString<A>::value...};
+  for (const bool string : strings) {
+    if (string) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * The precision of each argument of a checked format string: the literal precision, PrecisionArgument if it is passed
+ * as the previous argument (`*`) or -1 if there is none.
+ */
+constexpr int PrecisionArgument = -2;
+
+/**
+ * Finds the precisions of the arguments of a format string that has been checked against them (see checkKinds()).
+ *
+ * @param p          The format string.
+ * @param precisions The precision of each argument.
+ * @param count      The number of arguments.
+ */
+inline void findPrecisions(const char *p, int precisions[], const size_t count) {
+  size_t index = 0U;
+
+  for (size_t i = 0; i < count; i++) {
+    precisions[i] = -1;
+  }
+
+  while (0 != *p && index < count) {
+    if ('%' != *p++) {
+      continue;
+    }
+
+    while ('-' == *p || '+' == *p || ' ' == *p || '#' == *p || '0' == *p) {
+      p++;
+    }
+
+    int precision = -1;
+    for (int field = 0; field < 2; field++) {
+      // the width and then the precision
+      if (1 == field) {
+        if ('.' != *p) {
+          break;
+        }
+        p++;
+        precision = 0;
+      }
+      if ('*' == *p) {
+        if (index < count) {
+          precisions[index++] = -1;
+        }
+        if (1 == field) {
+          precision = PrecisionArgument;
+        }
+        p++;
+      }
+      for (; *p >= '0' && *p <= '9'; p++) {
+        // larger precisions don't bound the string anyway
+        if (1 == field && precision >= 0 && precision < 100000000) {
+          precision = precision * 10 + (*p - '0');
+        }
+      }
+    }
+
+    parseLength(p);
+    const char conversion = *p;
+    if (0 == conversion) {
+      return;
+    }
+    p++;
+    if ('%' != conversion && index < count) {
+      precisions[index++] = precision;
+    }
+  }
+}
+
+/**
+ * Stores an argument that isn't a string pointer, the precision doesn't matter.
+ */
+template <typename T, typename V>
+bool putArgument(CLogArgs &args, const V &value, int, std::false_type) {
+  return Argument<T>::put(args, value);
+}
+
+/**
+ * Stores a string pointer up to its precision. A precision passed as argument has just been stored before it.
+ */
+template <typename T, typename V>
+bool putArgument(CLogArgs &args, const V &value, int precision, std::true_type) {
+  if (PrecisionArgument == precision) {
+    std::memcpy(&precision, &args.data[args.size - sizeof(precision)], sizeof(precision));
+  }
+  return Argument<T>::put(args, value, precision);
+}
+
+} // namespace detail
+
+/**
+ * Checks a format string against the types of its arguments, at compile time if used in a constant expression.
+ *
+ * @tparam A            The types of the arguments.
+ * @param format        The format string.
+ * @return FormatError  FormatError::NONE if the arguments match the format string.
+ */
+template <typename... A>
+constexpr FormatError checkFormat(const char *const format) {
+  return detail::checkTypes(format, detail::Types<typename std::decay<A>::type...>{});
+}
+
+/**
+ * Writes the arguments of a message into a record. Like clog_captureArgs(), the record is marked as truncated and the
+ * remaining arguments are dropped if they don't fit.
+ *
+ * @param args   The record to be filled.
+ * @param format The format string, must have been checked against the arguments (see checkFormat()).
+ * @param values The arguments.
+ * @return true  If all arguments have been captured.
+ */
+template <typename... A>
+bool captureArgs(CLogArgs &args, const char *const format, const A &... values) {
+  bool ok = true;
+  int precisions[sizeof...(A) + 1U] = {};
+  size_t index = 0U;
+
+  args.format = format;
+  args.size = 0U;
+  args.truncated = false;
+
+  if (detail::hasStrings<typename std::decay<A>::type...>()) {
+    detail::findPrecisions(format, precisions, sizeof...(A));
+  }
+
+  using Expand = int[];
+  (void)Expand{0,
+               (ok = ok && detail::putArgument<typename std::decay<A>::type>(
+                               args,
+                               values,
+                               precisions[index++],
+                               std::integral_constant<bool, detail::IsString<typename std::decay<A>::type>::value>{}),
+                0)...};
+  (void)index;
+  return ok;
+}
+
+/**
+ * The log function used by the CLOGXX_* macros. Avoid using this function directly.
+ *
+ * @param ctx    The log context to be used.
+ * @param site   The call site describing the message. Must be static.
+ * @param level  The log level of the message, see clog_logCallSite().
+ * @param tag    The tag of the message, see clog_logCallSite().
+ * @param format The format string, see clog_logCallSite().
+ * @param values The arguments, must have been checked against the format string.
+ */
+template <typename... A>
+void logCallSite(CLogContext *const ctx,
+                 CLogCallSite *const site,
+                 const CLogLevel level,
+                 const size_t tag,
+                 const char *const format,
+                 const A &... values) {
+  CLogArgs args;
+  captureArgs(args, format, values...);
+  clog_logArgs(ctx, site, level, tag, &args);
+}
+
+} // namespace clogxx
+
+/**
+ * @def CLOGXX_CALL_SITE_MESSAGE
+ * Internal macro checking the format string against the arguments and logging the message through a static
+ * CLogCallSite (see CLOG_CALL_SITE_LOG).
+ */
+#define CLOGXX_CALL_SITE_MESSAGE(CTX, LEVEL, TAG, MESSAGE, ...)                                                        \
+  {                                                                                                                    \
+    static_assert(::clogxx::FormatError::NONE ==                                                                       \
+                      ::clogxx::detail::checkTypes(                                                                    \
+                          MESSAGE, decltype(::clogxx::detail::argumentTypes(0 VA_ARGS(__VA_ARGS__))){}),               \
+                  "CLog: the format string does not match the arguments");                                             \
+    CLOG_CALL_SITE_LOG(::clogxx::logCallSite, CTX, LEVEL, TAG, MESSAGE, ##__VA_ARGS__)                                 \
+  }
+
+/**
+ * @def CLOGXX_MESSAGE
+ * @param CTX     The log context to be used.
+ * @param LEVEL   The log level of the message.
+ * @param TAG     The tag of the message.
+ * @param ...     The message text / format string (a string literal) and the additional parameters to be used when
+ *                formatting the message.
+ * The macro to log an arbitrary message from C++. The format string is checked against the arguments at compile time.
+ * Like CLOG_MESSAGE, the arguments are only evaluated if the message is enabled, and LEVEL and TAG may be given at
+ * runtime.
+ */
+#define CLOGXX_MESSAGE(CTX, LEVEL, TAG, ...) CLOGXX_CALL_SITE_MESSAGE(CTX, LEVEL, TAG, __VA_ARGS__)
+
+#if CLOG_GLOBAL_MIN_LEVEL <= CLOG_MLTRC
+/**
+ * @def CLOGXX_TRC
+ * Macro to log a checked message at trace level, see CLOGXX_MESSAGE.
+ */
+#define CLOGXX_TRC(CTX, TAG, ...) CLOGXX_MESSAGE(CTX, CLOG_LTRC, TAG, __VA_ARGS__)
+#else
+#define CLOGXX_TRC(CTX, TAG, ...)
+#endif
+
+#if CLOG_GLOBAL_MIN_LEVEL <= CLOG_MLDBG
+/**
+ * @def CLOGXX_DBG
+ * Macro to log a checked message at debug level, see CLOGXX_MESSAGE.
+ */
+#define CLOGXX_DBG(CTX, TAG, ...) CLOGXX_MESSAGE(CTX, CLOG_LDBG, TAG, __VA_ARGS__)
+#else
+#define CLOGXX_DBG(CTX, TAG, ...)
+#endif
+
+#if CLOG_GLOBAL_MIN_LEVEL <= CLOG_MLINF
+/**
+ * @def CLOGXX_INF
+ * Macro to log a checked message at info level, see CLOGXX_MESSAGE.
+ */
+#define CLOGXX_INF(CTX, TAG, ...) CLOGXX_MESSAGE(CTX, CLOG_LINF, TAG, __VA_ARGS__)
+#else
+#define CLOGXX_INF(CTX, TAG, ...)
+#endif
+
+#if CLOG_GLOBAL_MIN_LEVEL <= CLOG_MLWRN
+/**
+ * @def CLOGXX_WRN
+ * Macro to log a checked message at warning level, see CLOGXX_MESSAGE.
+ */
+#define CLOGXX_WRN(CTX, TAG, ...) CLOGXX_MESSAGE(CTX, CLOG_LWRN, TAG, __VA_ARGS__)
+#else
+#define CLOGXX_WRN(CTX, TAG, ...)
+#endif
+
+#if CLOG_GLOBAL_MIN_LEVEL <= CLOG_MLERR
+/**
+ * @def CLOGXX_ERR
+ * Macro to log a checked message at error level, see CLOGXX_MESSAGE.
+ */
+#define CLOGXX_ERR(CTX, TAG, ...) CLOGXX_MESSAGE(CTX, CLOG_LERR, TAG, __VA_ARGS__)
+#else
+#define CLOGXX_ERR(CTX, TAG, ...)
+#endif
+
+#if CLOG_GLOBAL_MIN_LEVEL <= CLOG_MLFTL
+/**
+ * @def CLOGXX_FTL
+ * Macro to log a checked message at fatal level, see CLOGXX_MESSAGE.
+ */
+#define CLOGXX_FTL(CTX, TAG, ...) CLOGXX_MESSAGE(CTX, CLOG_LFTL, TAG, __VA_ARGS__)
+#else
+#define CLOGXX_FTL(CTX, TAG, ...)
+#endif
+
+#endif /* INCLUDE_CLOG_HPP_ */
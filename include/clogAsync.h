@@ -0,0 +1,218 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Asynchronous log contexts.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * An asynchronous context decouples the threads producing log messages from the adapters. Producers only capture the
+ * raw message arguments (see CLogArgs) into a slot of a lock-free multi-producer single-consumer ring and return at
+ * once. A single dispatcher thread takes the messages out of the ring and runs the filter / onMessage chain of the
+ * adapters. As only the dispatcher thread formats messages and calls adapters, a single CLogContext can be shared by
+ * any number of threads and slow adapters (e.g. writing files) are taken off the request path.
+ *
+ * Like the rest of the module, the asynchronous context doesn't allocate memory. The slots have to be provided by the
+ * user. If the ring is full the message is dropped and counted (see clog_asyncDropped()).
+ *
+ * On machines with many cores the tail of a single shared ring becomes a point of contention. If rings are provided
+ * (see CLogAsync::rings), the slots are split into single-producer rings instead. Each thread logging to the context
+ * claims a ring of its own on its first message (remembered in thread-local storage) and gives it back when it exits,
+ * so producers never write to the same cache lines. The dispatcher merges the rings by the timestamp of the messages.
+ * Messages of different rings with the same timestamp (e.g. within a tick of clog_clockMonotonicCoarse()) are taken
+ * in the order of the rings, so use a precise clock (e.g. clog_clockTsc()) if their order matters. If there are more
+ * threads than rings, the messages of the threads without a ring are dropped.
+ *
+ * The messages are numbered (see CLogMessage::sequence) by the slots they reserve, so the messages dropped because
+ * the ring was full take no number, they are counted by clog_asyncDropped(). With a shared ring the number is the
+ * position of the slot in the ring, continuing the numbers of the context: it costs no atomic operation besides the
+ * reservation and the messages are dispatched in this order. With per-thread rings the numbers count the messages per
+ * ring, starting at 1 when a thread claims it, so they don't need a counter shared by the producers.
+ *
+ * The dispatcher takes the messages out of the ring(s) in batches. Adapters implementing CLogAdapter::onMessages get
+ * a whole batch per call, so e.g. a file adapter (see clogFile.h) writes a log storm with one system call per batch
+ * instead of one per message.
+ *
+ * @startuml
+ *  entity "Producer threads" as producer
+ *  queue "CLogAsync\n(ring of slots)" as ring
+ *  participant "Dispatcher thread" as dispatcher
+ *  entity "Adapters" as adapter
+ *  producer -> ring: reserve slot, capture arguments
+ *  dispatcher -> ring: take batch of messages
+ *  loop for all adapters in the context
+ *    alt batch backend
+ *      dispatcher -> adapter: CLogMessage[] accepted by messageFilter
+ *    else for all messages accepted by messageFilter
+ *      dispatcher -> adapter: CLogMessage
+ *    end
+ *  end
+ * @enduml
+ */
+
+#ifndef INCLUDE_CLOGASYNC_H_
+#define INCLUDE_CLOGASYNC_H_
+
+#include <pthread.h>
+
+#include "clog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_CACHE_LINE_SIZE
+ * The size of a cache line. Used to keep data written by different threads apart.
+ */
+#ifndef CLOG_CACHE_LINE_SIZE
+#define CLOG_CACHE_LINE_SIZE (64U)
+#endif
+
+/**
+ * @def CLOG_ASYNC_BATCH_SIZE
+ * The maximum number of messages the dispatcher takes out of the ring(s) at once. Adapters with a batch backend (see
+ * CLogAdapter::onMessages) get up to this many messages per call. The slots of a batch are handed back to the
+ * producers after the batch has been passed to all adapters.
+ */
+#ifndef CLOG_ASYNC_BATCH_SIZE
+#define CLOG_ASYNC_BATCH_SIZE (64U)
+#endif
+
+/**
+ * @def CLOG_ASYNC_NAME_SIZE
+ * The size of the buffers of a slot holding the file and function name of a message logged with clog_logMessage().
+ * They are copied, as they only have to be valid during the call. Longer names are cut at the front, so the end of a
+ * long path is kept.
+ */
+#ifndef CLOG_ASYNC_NAME_SIZE
+#define CLOG_ASYNC_NAME_SIZE (64U)
+#endif
+
+/**
+ * A single message waiting in the ring of an asynchronous context.
+ */
+typedef struct _CLogAsyncSlot {
+  uint64_t sequence;                   ///< Internal state of the slot, do not touch.
+  uint64_t timestamp;                  ///< The time of the message (see CLogMessage::timestamp), used to merge
+                                       ///< per-thread rings.
+  uint64_t number;                     ///< The sequence number of the message (see CLogMessage::sequence).
+  uint32_t threadId;                   ///< The id of the logging thread.
+  const CLogCallSite *site;            ///< The call site of the message.
+  CLogCallSite callSite;               ///< Copy of a temporary call site (see clog_logMessage()), site points to it
+                                       ///< then.
+  bool temporary;                      ///< Set if the call site is a temporary copy.
+  CLogArgs args;                       ///< The captured message arguments. The text of temporary call sites is
+                                       ///< formatted right away, as their format string might not outlive the call.
+  char file[CLOG_ASYNC_NAME_SIZE];     ///< Copy of the file name of a temporary call site.
+  char function[CLOG_ASYNC_NAME_SIZE]; ///< Copy of the function name of a temporary call site.
+} CLogAsyncSlot;
+
+/**
+ * State of a single-producer ring used in per-thread mode. Initialize with zero.
+ */
+typedef struct _CLogAsyncRing {
+  uint64_t tail;                                                  /**< Next slot to be written by the owning thread. */
+  uint64_t number;                                                /**< The number of the last message of the owning
+                                                                       thread (see CLogMessage::sequence). */
+  char tailPadding[CLOG_CACHE_LINE_SIZE - 2U * sizeof(uint64_t)]; /**< Keeps tail and head apart. */
+  uint64_t head;                                                  /**< Next slot to be taken by the dispatcher. */
+  int owner;                                                      /**< Ownership state of the ring. */
+  char headPadding[CLOG_CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(int)]; /**< Keeps the rings apart. */
+} CLogAsyncRing;
+
+/**
+ * Structure holding the state of an asynchronous context. Set slots and numberOfSlots (and optionally rings and
+ * numberOfRings) and initialize all other fields with zero, then pass it to clog_asyncStart().
+ */
+typedef struct _CLogAsync {
+  CLogAsyncSlot *slots; /**< The slots of the ring(s). */
+  size_t numberOfSlots; /**< The number of slots, must be a power of two. */
+  CLogAsyncRing *rings; /**< The per-thread rings. If NULL all threads share a single ring. */
+  size_t numberOfRings; /**< The number of per-thread rings. numberOfSlots / numberOfRings must be a power of two. */
+
+  // Internal state, do not touch.
+  uint64_t tail;                                             /**< Next slot to be reserved by a producer. */
+  char tailPadding[CLOG_CACHE_LINE_SIZE - sizeof(uint64_t)]; /**< Keeps tail and head apart. */
+  uint64_t head;                                             /**< Next slot to be taken by the dispatcher. */
+  char headPadding[CLOG_CACHE_LINE_SIZE - sizeof(uint64_t)]; /**< Keeps head and the rest apart. */
+  uint64_t dropped;                                          /**< Number of messages dropped. */
+  int sleeping;                                              /**< Set while the dispatcher is waiting. */
+  bool running;                                              /**< Set while the dispatcher shall run. */
+  CLogContext *context;                                      /**< The context served by the dispatcher. */
+  pthread_t thread;                                          /**< The dispatcher thread. */
+  pthread_mutex_t mutex;                                     /**< Protects sleeping / wakeup. */
+  pthread_cond_t wakeup;                                     /**< Used to wake the dispatcher up. */
+  pthread_key_t ringKey;                                     /**< Thread-local ring of a producer. */
+  size_t slotsPerRing;                                       /**< The number of slots of each per-thread ring. */
+} CLogAsync;
+
+/**
+ * Makes a context asynchronous and starts the dispatcher thread. From now on all messages logged to the context are
+ * queued and passed to the adapters by the dispatcher thread.
+ *
+ * @param ctx    The context.
+ * @param async  The state of the asynchronous context.
+ * @return true  If the dispatcher has been started.
+ * @return false If any parameter is invalid, the context is already asynchronous or the thread could not be started.
+ */
+bool clog_asyncStart(CLogContext *const ctx, CLogAsync *const async);
+
+/**
+ * Stops the dispatcher thread of a context after all queued messages have been passed to the adapters. From now on
+ * the context is synchronous again. The caller has to make sure no other thread is logging to the context while it is
+ * being stopped.
+ *
+ * @param ctx The context.
+ */
+void clog_asyncStop(CLogContext *const ctx);
+
+/**
+ * Returns the number of messages that have been dropped because the ring was full.
+ *
+ * @param async     The state of the asynchronous context.
+ * @return uint64_t The number of dropped messages.
+ */
+uint64_t clog_asyncDropped(const CLogAsync *const async);
+
+/**
+ * Queues a message. This function is called by clog_logMessage() and clog_logCallSite() for asynchronous contexts,
+ * there is no need to call it directly.
+ *
+ * @param async     The state of the asynchronous context.
+ * @param site      The call site of the message.
+ * @param temporary Set if the call site is only valid during the call. It is copied into the slot then, including the
+ *                  file and function name, and the message text is formatted right away.
+ * @param list      The additional parameters to be used when formatting the message.
+ * @return true     If the message has been queued.
+ * @return false    If the ring is full or no per-thread ring is available.
+ */
+bool clog_asyncPush(CLogAsync *const async, const CLogCallSite *const site, const bool temporary, va_list list);
+
+/**
+ * Queues a message whose arguments have already been captured, like clog_asyncPush(). Called by clog_logArgs() for
+ * asynchronous contexts.
+ *
+ * @param async     The state of the asynchronous context.
+ * @param site      The call site of the message.
+ * @param temporary Set if the call site is only valid during the call. It is copied into the slot then, including the
+ *                  file and function name. The format string of args must still be static.
+ * @param args      The captured arguments, copied into the slot.
+ * @return true     If the message has been queued.
+ * @return false    If the ring is full or no per-thread ring is available.
+ */
+bool clog_asyncPushArgs(CLogAsync *const async,
+                        const CLogCallSite *const site,
+                        const bool temporary,
+                        const CLogArgs *const args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGASYNC_H_ */
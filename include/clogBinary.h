@@ -0,0 +1,163 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Binary log encoding.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * Instead of text, messages can be written as compact binary records that are turned back into text offline by the
+ * `clog-decode` tool. A record holds the id of the call site, the level, a timestamp and the raw argument bytes (see
+ * CLogArgs). The file name, function name, tag and format string of a call site are written only once, as a
+ * dictionary record in front of the first message of the call site.
+ *
+ * Together with deferred formatting (see CLogContext::deferredFormatting) or an asynchronous context (see
+ * clogAsync.h) no message is ever formatted by the application, printf is only called by the decoder.
+ *
+ * @startuml
+ *  participant "Application" as app
+ *  participant "Adapter" as adapter
+ *  participant "clog_binaryWrite()" as writer
+ *  database "Log file" as file
+ *  participant "clog-decode" as decoder
+ *  app -> adapter: message (raw arguments)
+ *  adapter -> writer: message
+ *  writer -> file: call site record (first message of the call site only)
+ *  writer -> file: message record
+ *  file -> decoder: records
+ *  decoder -> decoder: clog_formatMessage()
+ * @enduml
+ *
+ * The raw arguments are stored in the byte order and with the type sizes of the writing machine. The file header
+ * records both, the decoder refuses files it cannot read. The call site record keeps the formatting options of the
+ * context (see CLogContext::shortestFloats), so the decoder prints the same text as the application would.
+ *
+ * A minimal adapter writing to a file looks like this:
+ * ```.c
+ * static CLogBinaryWriter writer;
+ *
+ * static void binaryAdapter(const CLogMessage *msg) {
+ *   clog_binaryWrite(&writer, msg);
+ * }
+ *
+ * // during initialization
+ * clog_binaryOpen(&writer, fopen("app.clog", "wb"));
+ * ```
+ *
+ * With an index (see clog_binaryIndex() and clogIndex.h) every block starts with the file header and an empty call
+ * site dictionary, so `clog-query` can decode any block without reading the ones in front of it.
+ */
+
+#ifndef INCLUDE_CLOGBINARY_H_
+#define INCLUDE_CLOGBINARY_H_
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "clog.h"
+#include "clogIndex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_BINARY_SITES
+ * The number of call sites a writer keeps in its dictionary, must be a power of two. Messages of further call sites
+ * are written with their file, function, tag and text inline.
+ */
+#ifndef CLOG_BINARY_SITES
+#define CLOG_BINARY_SITES (1024U)
+#endif
+
+/**
+ * @def CLOG_BINARY_MAGIC
+ * The first bytes of a binary log (and of every block of an indexed one), followed by the format version.
+ */
+#define CLOG_BINARY_MAGIC 'C', 'L', 'O', 'G', 'B', 'I', 'N'
+
+/**
+ * State of a binary writer. Initialize it with clog_binaryOpen().
+ */
+typedef struct _CLogBinaryWriter {
+  FILE *file;                                   ///< The file the records are written to.
+  pthread_mutex_t lock;                         ///< Serializes the records of concurrent messages.
+  const CLogCallSite *sites[CLOG_BINARY_SITES]; ///< The call sites written so far (hash table).
+  uint32_t ids[CLOG_BINARY_SITES];              ///< The ids of the call sites in sites.
+  uint32_t numberOfSites;                       ///< The number of call sites written so far.
+  uint64_t lastTimestamp;                       ///< The timestamp of the last record (records store the difference).
+  uint64_t written;                             ///< The number of bytes written so far.
+  CLogIndex *index;                             ///< The index of the log, NULL if none.
+} CLogBinaryWriter;
+
+/**
+ * Called for every message read by clog_binaryRead().
+ *
+ * @param msg       The message. The text is formatted on demand, use clog_getMessage() or clog_formatMessage().
+ * @param timestamp The time of the message itself (CLogMessage::timestamp converted to nanoseconds since the epoch by
+ *                  clog_wallClockTime() when the record was written), not the time of the record.
+ * @param userData  The pointer passed to clog_binaryRead().
+ */
+typedef void (*CLogBinaryCallback)(const CLogMessage *msg, uint64_t timestamp, void *userData);
+
+/**
+ * Initializes a writer and writes the file header.
+ *
+ * @param writer The writer.
+ * @param file   The file to write to, opened in binary mode. Not closed by the writer.
+ * @return true  If the header has been written.
+ * @return false If any parameter is invalid or writing failed.
+ */
+bool clog_binaryOpen(CLogBinaryWriter *const writer, FILE *const file);
+
+/**
+ * Writes a message. Call it from the onMessage function of an adapter. The raw arguments are written if the message
+ * has them (deferred formatting or asynchronous context), otherwise the formatted text. Thread safe.
+ *
+ * @param writer The writer.
+ * @param msg    The message.
+ * @return true  If the record has been written.
+ * @return false If any parameter is invalid or writing failed.
+ */
+bool clog_binaryWrite(CLogBinaryWriter *const writer, const CLogMessage *const msg);
+
+/**
+ * Starts indexing the records of a writer (see clogIndex.h). The records written so far become a block matching every
+ * query. The index is closed with the writer. Thread safe.
+ *
+ * @param writer The writer.
+ * @param index  The index, opened with clog_indexOpen().
+ * @return true  If the index has been attached.
+ * @return false If any parameter is invalid or the writer already has an index.
+ */
+bool clog_binaryIndex(CLogBinaryWriter *const writer, CLogIndex *const index);
+
+/**
+ * Flushes the file and releases the resources of a writer (and closes its index). The file is not closed.
+ *
+ * @param writer The writer.
+ */
+void clog_binaryClose(CLogBinaryWriter *const writer);
+
+/**
+ * Reads all records of a binary log file.
+ *
+ * @param file     The file to read, opened in binary mode.
+ * @param callback Called for every message.
+ * @param userData Passed to callback.
+ * @return true    If the whole file has been read.
+ * @return false   If any parameter is invalid, the file is not a binary log of a compatible machine or it is
+ *                 corrupted. The messages up to the error have been passed to callback.
+ */
+bool clog_binaryRead(FILE *const file, const CLogBinaryCallback callback, void *const userData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGBINARY_H_ */
@@ -0,0 +1,129 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Runtime switches for single log statements.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * Every log statement written with the CLOG_* macros has its own call site descriptor (see CLogCallSite). Its flags
+ * are checked inline by the macro, so single statements can be switched at runtime without touching the minimum level
+ * of the context:
+ * - disabled statements are skipped at the cost of a single load and branch,
+ * - forced statements are logged even if their level is below the minimum level of the context (e.g. to turn on a
+ *   single trace message in production).
+ *
+ * Call sites are selected by queries (file and function glob patterns, line range, levels and tags). A call site is
+ * registered on its first execution, so clog_setCallSites() stores the query as a rule that is also applied to the
+ * call sites registered later on. Rules are applied in the order they have been set, the last matching rule wins. A
+ * rule replaces the stored one with the same query (the same patterns, lines, levels and tags), so a call site can be
+ * switched on and off any number of times. CLOG_SITE_DEFAULT rules are dropped once no other rules are stored.
+ *
+ * @startuml
+ *  entity "Operator" as user
+ *  participant "clog_setCallSites()" as set
+ *  collections "Registered call sites" as sites
+ *  user -> set: query, mode
+ *  set -> set: store rule
+ *  set -> sites: update flags of matching sites
+ * @enduml
+ */
+
+#ifndef INCLUDE_CLOGCALLSITE_H_
+#define INCLUDE_CLOGCALLSITE_H_
+
+#include "clog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_CALL_SITE_RULES
+ * The maximum number of rules stored by clog_setCallSites().
+ */
+#ifndef CLOG_CALL_SITE_RULES
+#define CLOG_CALL_SITE_RULES (16U)
+#endif
+
+/**
+ * @def CLOG_LEVEL_MASK
+ * Produces the bit of a level in CLogCallSiteQuery::levels.
+ */
+#define CLOG_LEVEL_MASK(LEVEL) (1U << (LEVEL))
+
+/**
+ * @def CLOG_TAG_MASK
+ * Produces the bit of a tag in CLogCallSiteQuery::tags. Only the first 64 tags can be selected.
+ */
+#define CLOG_TAG_MASK(TAG) (((uint64_t)1U) << (TAG))
+
+/**
+ * The state to be set for the selected call sites.
+ */
+typedef enum _CLogCallSiteMode {
+  CLOG_SITE_DEFAULT, /**< The minimum level of the context decides. */
+  CLOG_SITE_DISABLE, /**< The statements are never logged. */
+  CLOG_SITE_ENABLE,  /**< The statements are always logged, regardless of the minimum level of the context. */
+} CLogCallSiteMode;
+
+/**
+ * Selects call sites. All criteria have to match, fields set to zero / NULL match all call sites.
+ */
+typedef struct _CLogCallSiteQuery {
+  const char *file;       /**< Glob pattern (`*` and `?`) for the file name (as given by CLOG_FILE). Must stay valid
+                               as long as the rule is used. */
+  const char *function;   /**< Glob pattern for the function name. Must stay valid as long as the rule is used. */
+  unsigned int firstLine; /**< The first line of the range. */
+  unsigned int lastLine;  /**< The last line of the range, zero for no upper limit. */
+  unsigned int levels;    /**< Combination of CLOG_LEVEL_MASK() values. */
+  uint64_t tags;          /**< Combination of CLOG_TAG_MASK() values. */
+} CLogCallSiteQuery;
+
+/**
+ * Sets the state of all matching call sites, including the ones registered later on. Replaces the rule with the same
+ * query, see the introduction.
+ *
+ * @param query  The query selecting the call sites.
+ * @param mode   The state to be set.
+ * @return true  If the rule has been set.
+ * @return false If any parameter is invalid or there is no space left for the rule (see CLOG_CALL_SITE_RULES).
+ */
+bool clog_setCallSites(const CLogCallSiteQuery *const query, const CLogCallSiteMode mode);
+
+/**
+ * Removes all rules and sets all registered call sites back to CLOG_SITE_DEFAULT.
+ */
+void clog_resetCallSites(void);
+
+/**
+ * Finds the registered call sites matching a query.
+ *
+ * @param query   The query selecting the call sites.
+ * @param sites   The array to be filled with the matching call sites. Can be NULL if size is zero.
+ * @param size    The size of sites.
+ * @return size_t The number of matching call sites. If it is greater than size only the first size call sites have
+ *                been stored.
+ */
+size_t clog_findCallSites(const CLogCallSiteQuery *const query, const CLogCallSite *sites[], const size_t size);
+
+/**
+ * Matches a text against a glob pattern. `*` matches any sequence of characters, `?` matches a single character.
+ *
+ * @param pattern The pattern.
+ * @param text    The text.
+ * @return true   If the text matches.
+ * @return false  Otherwise or if any parameter is NULL.
+ */
+bool clog_matchGlob(const char *pattern, const char *text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGCALLSITE_H_ */
@@ -0,0 +1,81 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Clocks stamping the messages.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * Each message is stamped once when it is logged, before it is filtered, formatted or queued: it gets a timestamp
+ * from the clock of the context (see CLogContext::clock), a sequence number counting the messages of the context
+ * and the id of the thread (see CLogMessage). Adapters and asynchronous contexts use these instead of reading
+ * the clock again.
+ *
+ * The clocks differ in cost and meaning:
+ * - clog_clockMonotonic(): CLOCK_MONOTONIC, the default.
+ * - clog_clockMonotonicCoarse(): CLOCK_MONOTONIC_COARSE, much cheaper but only as precise as the scheduler tick
+ *   (1-4 ms). Equal to clog_clockMonotonic() where it is not available.
+ * - clog_clockRealtime(): CLOCK_REALTIME, the wall-clock time since the epoch. It might step back.
+ * - clog_clockTsc(): the time stamp counter of the CPU, calibrated against CLOCK_MONOTONIC on its first call. The
+ *   cheapest clock, it doesn't enter the kernel or the vDSO. Falls back to clog_clockMonotonic() on CPUs without an
+ *   invariant TSC.
+ *
+ * Any function returning nanoseconds can be used as clock, too (e.g. a simulated time in tests).
+ */
+
+#ifndef INCLUDE_CLOGCLOCK_H_
+#define INCLUDE_CLOGCLOCK_H_
+
+#include "clog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Reads CLOCK_MONOTONIC.
+ *
+ * @return uint64_t The time in ns.
+ */
+uint64_t clog_clockMonotonic(void);
+
+/**
+ * Reads CLOCK_MONOTONIC_COARSE.
+ *
+ * @return uint64_t The time in ns.
+ */
+uint64_t clog_clockMonotonicCoarse(void);
+
+/**
+ * Reads CLOCK_REALTIME.
+ *
+ * @return uint64_t The time in ns since the epoch.
+ */
+uint64_t clog_clockRealtime(void);
+
+/**
+ * Reads the time stamp counter and converts it to ns. The counter is calibrated on the first call (taking a few
+ * milliseconds), the result uses the time base of clog_clockMonotonic(). A counter lagging behind the one of the
+ * calibrating core reads as the end of the calibration instead of wrapping around.
+ *
+ * @return uint64_t The time in ns.
+ */
+uint64_t clog_clockTsc(void);
+
+/**
+ * Returns the id of the calling thread. It is looked up once per thread and cached.
+ *
+ * @return uint32_t The kernel thread id on Linux, a number counting the threads otherwise.
+ */
+uint32_t clog_threadId(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGCLOCK_H_ */
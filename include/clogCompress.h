@@ -0,0 +1,213 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Streaming block compression of log output.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * Log output is highly repetitive (the line headers, the format strings of the call sites), so it compresses well even
+ * with a simple LZ77 compressor. The compressor collects the output of a file (see clog_fileCompress()) or binary
+ * writer (see clog_compressorStream()) in blocks of CLogCompressor::blockSize bytes. Full blocks are compressed and
+ * written by a background thread, the writing thread only copies the bytes into the current block and waits only if
+ * all blocks are still being compressed.
+ *
+ * Every block becomes a frame that can be decompressed on its own:
+ * - the magic `CLZ1`,
+ * - the frame type: CLOG_COMPRESS_FRAME_LZ for compressed, CLOG_COMPRESS_FRAME_STORED for incompressible data,
+ * - the uncompressed and the stored size (uint32, little endian each),
+ * - the stored data.
+ *
+ * As frames are independent, a compressed log can be appended to and a damaged frame only loses its own lines.
+ * `clog-decode` (see tools/clogDecode.c) decompresses the files with clog_decompressStream().
+ *
+ * The compressed data is a sequence of LZ4 like sequences: a token (the number of literals in the high, the length of
+ * the match minus CLOG_COMPRESS_MIN_MATCH in the low nibble, 15 meaning more length bytes follow, each adding up to
+ * 255), the literals, the offset of the match (uint16, little endian) and the additional match length bytes. The last
+ * sequence only has literals.
+ *
+ * ```.c
+ * static char blocks[4][65536];
+ * static char frame[CLOG_COMPRESS_FRAME_SIZE(65536)];
+ * static CLogCompressor compressor = {.blocks = &blocks[0][0],
+ *                                     .blockSize = sizeof(blocks[0]),
+ *                                     .numberOfBlocks = 4U,
+ *                                     .frame = frame};
+ *
+ * // during initialization
+ * clog_fileOpen(&file, "app.log.clz", &policy);
+ * clog_fileCompress(&file, &compressor);
+ * ```
+ *
+ * The lines reach the file when a block is full, when clog_fileFlush() is called and when the file is closed.
+ */
+
+#ifndef INCLUDE_CLOGCOMPRESS_H_
+#define INCLUDE_CLOGCOMPRESS_H_
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "clog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_COMPRESS_MAX_BLOCKS
+ * The maximum number of blocks of a compressor.
+ */
+#ifndef CLOG_COMPRESS_MAX_BLOCKS
+#define CLOG_COMPRESS_MAX_BLOCKS (16U)
+#endif
+
+#define CLOG_COMPRESS_MIN_MATCH (4U)            ///< The shortest match of the compressor.
+#define CLOG_COMPRESS_MAX_OFFSET (65535U)       ///< The largest distance of a match.
+#define CLOG_COMPRESS_MAX_BLOCK_SIZE (1U << 24) ///< The largest uncompressed size of a frame.
+#define CLOG_COMPRESS_FRAME_HEADER_SIZE (13U)   ///< The size of a frame header.
+#define CLOG_COMPRESS_FRAME_LZ ('L')            ///< Frame type of compressed data.
+#define CLOG_COMPRESS_FRAME_STORED ('S')        ///< Frame type of uncompressed data.
+
+/**
+ * @def CLOG_COMPRESS_BOUND
+ * The maximum compressed size of size bytes.
+ */
+#define CLOG_COMPRESS_BOUND(size) ((size) + (size) / 255U + 16U)
+
+/**
+ * @def CLOG_COMPRESS_FRAME_SIZE
+ * The maximum size of the frame of a block.
+ */
+#define CLOG_COMPRESS_FRAME_SIZE(blockSize) (CLOG_COMPRESS_FRAME_HEADER_SIZE + CLOG_COMPRESS_BOUND(blockSize))
+
+/**
+ * State of a compressor. Set blocks, blockSize, numberOfBlocks and frame, initialize all other fields with zero, then
+ * pass it to clog_compressorOpen() (or clog_fileCompress()).
+ */
+typedef struct _CLogCompressor {
+  char *blocks;          /**< The blocks, numberOfBlocks * blockSize bytes. */
+  size_t blockSize;      /**< The uncompressed size of a frame, up to CLOG_COMPRESS_MAX_BLOCK_SIZE. */
+  size_t numberOfBlocks; /**< The number of blocks, 2 to CLOG_COMPRESS_MAX_BLOCKS. */
+  char *frame;           /**< Holds the frame being written, CLOG_COMPRESS_FRAME_SIZE(blockSize) bytes. */
+
+  uint64_t frames;   /**< The number of frames written so far. */
+  uint64_t bytesIn;  /**< The number of uncompressed bytes written so far. */
+  uint64_t bytesOut; /**< The number of compressed bytes (including the frame headers) written so far. */
+  uint64_t waits;    /**< The number of times the writer had to wait for a free block. */
+  uint64_t errors;   /**< The number of frames that could not be written. */
+
+  // Internal state, do not touch.
+  int fd;                                   /**< The file descriptor the frames are written to. */
+  FILE *stream;                             /**< The stream of clog_compressorStream(), NULL if none. */
+  size_t current;                           /**< The block being filled. */
+  size_t used;                              /**< The number of bytes in the current block. */
+  size_t next;                              /**< The block compressed next. */
+  size_t lengths[CLOG_COMPRESS_MAX_BLOCKS]; /**< The lengths of the full blocks, zero if free. Protected by mutex. */
+  bool stopping;                            /**< Asks the compressor thread to stop. Protected by mutex. */
+  pthread_t thread;                         /**< Compresses and writes the full blocks. */
+  pthread_mutex_t mutex;                    /**< Protects lengths and stopping. */
+  pthread_cond_t filled;                    /**< Signaled when a block is full. */
+  pthread_cond_t freed;                     /**< Signaled when a block has been written. */
+} CLogCompressor;
+
+/**
+ * Compresses a block.
+ *
+ * @param source      The data to be compressed.
+ * @param size        The size of the data.
+ * @param destination Receives the compressed data.
+ * @param capacity    The size of destination, CLOG_COMPRESS_BOUND(size) is always enough.
+ * @return            The size of the compressed data, zero if it doesn't fit into destination.
+ */
+size_t clog_compress(const void *const source, const size_t size, void *const destination, const size_t capacity);
+
+/**
+ * Decompresses a block compressed by clog_compress().
+ *
+ * @param source      The compressed data.
+ * @param size        The size of the compressed data.
+ * @param destination Receives the data.
+ * @param capacity    The size of destination.
+ * @param length      Receives the size of the data.
+ * @return true       If the data has been decompressed.
+ * @return false      If the compressed data is corrupted or doesn't fit into destination.
+ */
+bool clog_decompress(const void *const source,
+                     const size_t size,
+                     void *const destination,
+                     const size_t capacity,
+                     size_t *const length);
+
+/**
+ * Starts a compressor writing its frames to a file descriptor.
+ *
+ * @param compressor The compressor.
+ * @param fd         The file descriptor, not closed by the compressor.
+ * @return true      If the compressor thread has been started.
+ * @return false     If any parameter is invalid or the thread cannot be started.
+ */
+bool clog_compressorOpen(CLogCompressor *const compressor, const int fd);
+
+/**
+ * Copies data into the blocks, handing full blocks to the compressor thread. Not thread safe.
+ *
+ * @param compressor The compressor.
+ * @param data       The data.
+ * @param size       The size of the data.
+ */
+void clog_compressorWrite(CLogCompressor *const compressor, const void *const data, const size_t size);
+
+/**
+ * Hands the current block to the compressor thread, even if it isn't full, e.g. when a flush policy asks for a write.
+ * Only waits if all blocks are still being compressed. Not thread safe.
+ *
+ * @param compressor The compressor.
+ */
+void clog_compressorSubmit(CLogCompressor *const compressor);
+
+/**
+ * Hands the current block to the compressor thread and waits until all frames have been written.
+ *
+ * @param compressor The compressor.
+ */
+void clog_compressorFlush(CLogCompressor *const compressor);
+
+/**
+ * Writes all data (closing the stream of clog_compressorStream() first) and stops the compressor thread.
+ *
+ * @param compressor The compressor.
+ */
+void clog_compressorClose(CLogCompressor *const compressor);
+
+/**
+ * Returns a stream writing into a compressor, e.g. for clog_binaryOpen(). The stream is closed by
+ * clog_compressorClose(), which must be called after the last write, e.g. after clog_binaryClose().
+ *
+ * @param compressor The compressor.
+ * @return           The stream, NULL if the compressor isn't open or the stream cannot be created.
+ */
+FILE *clog_compressorStream(CLogCompressor *const compressor);
+
+/**
+ * Returns a stream reading the decompressed frames of a file. Data that doesn't start with a frame is passed on as is,
+ * so uncompressed files can be read the same way. Reading fails (with EIO) at a corrupted frame.
+ *
+ * If file is seekable, so is the stream (fseek() with SEEK_SET and SEEK_CUR, offsets in the decompressed data). Frames
+ * in front of the new position are skipped by their headers, so seeking reads 13 bytes per skipped frame.
+ *
+ * @param file The compressed file, not closed with the stream.
+ * @return     The stream, close it with fclose(). NULL if file is NULL or memory is exhausted.
+ */
+FILE *clog_decompressStream(FILE *const file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGCOMPRESS_H_ */
@@ -0,0 +1,263 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Buffered file adapter.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * The file adapter appends the formatted lines (see clog_formatMessage()) of the messages to a file (opened with
+ * O_APPEND, so several processes can share it). The lines are collected in the buffer of the adapter, which is part of
+ * CLogFile (no memory is allocated), and written with a single system call when the flush policy (see
+ * CLogFilePolicy) asks for it:
+ * - size: the buffer holds CLogFilePolicy::size bytes or more,
+ * - time: the oldest buffered line is CLogFilePolicy::interval old, measured by the timestamps of the messages,
+ * - level: a message has CLogFilePolicy::level or higher, e.g. errors are written at once.
+ *
+ * The buffer is also written if the next line might not fit, by clog_fileFlush() and by clog_fileClose(). Without a
+ * policy every call writes its lines at once. A batch of messages (see CLogAdapter::onMessages) is always written with
+ * a single system call, so even then an asynchronous context (see clogAsync.h) writes a log storm with one system call
+ * per CLOG_ASYNC_BATCH_SIZE messages instead of one per message.
+ *
+ * As the interval is only checked when a message is written, lines may stay in the buffer longer while no messages
+ * are logged. Call clog_fileFlush() periodically (e.g. from the main loop) if that matters.
+ *
+ * Lines longer than CLOG_FILE_LINE_SIZE are truncated like clog_formatMessage() truncates them.
+ *
+ * A minimal adapter looks like this:
+ * ```.c
+ * static CLogFile file;
+ *
+ * static void fileAdapter(const CLogMessage messages[], size_t count) {
+ *   clog_fileWriteBatch(&file, messages, count);
+ * }
+ *
+ * // during initialization: write full buffers, but at least once per second and errors at once
+ * const CLogFilePolicy policy = {CLOG_FILE_BUFFER_SIZE, 1000000000U, CLOG_LERR};
+ * clog_fileOpen(&file, "app.log", &policy);
+ * CLogAdapter adapters[] = {{NULL, NULL, CLOG_LTRC, 0U, fileAdapter}};
+ * ```
+ *
+ * The functions are not thread safe. Use a file from a single adapter of an asynchronous context (its dispatcher is
+ * the only thread calling the adapter) or synchronize the calls.
+ *
+ * # Rotation
+ * clog_fileStartRotation() lets the file rotate itself when it reaches CLogFileRotation::size bytes or its first line
+ * is CLogFileRotation::interval old (again by the timestamps of the messages). The slow parts run on a background
+ * thread of the file, ahead of time:
+ * 1. The thread opens the next file as `<path>.next` (see CLOG_FILE_SPARE_SUFFIX) and publishes its descriptor.
+ * 2. When a write finds the rotation due, it writes the buffered lines to the current file, then swaps the descriptor
+ *    of the next file in and hands the old one to the thread in one step. Nothing else happens on the logging thread.
+ * 3. The thread renames the rotated files (`<path>.1` to `<path>.2` and so on, the oldest one is dropped), renames
+ *    `<path>` to `<path>.1` and `<path>.next` to `<path>`, closes the old descriptor and only then opens the next
+ *    spare file.
+ *
+ * Renaming keeps the descriptors valid, so no line is lost or written twice. If the next file isn't ready yet (the
+ * thread is still busy with the previous rotation or cannot create the file) the rotation is postponed to a later
+ * write and counted in CLogFile::postponed. The names of the rotated files are given by a printf() pattern, see
+ * CLogFileRotation::pattern. As the file renames itself, only one process may rotate a file.
+ *
+ * # Compression
+ * clog_fileCompress() passes the written buffers to a compressor (see clogCompress.h) instead of the file. The
+ * compressor writes the file in frames of CLogCompressor::blockSize bytes, from its own thread. If the interval or the
+ * level of the flush policy asks for a write, the partial block is compressed and written as a smaller frame. The size
+ * of the policy only bounds the buffer of the file. A compressed file cannot be rotated.
+ *
+ * # Index
+ * clog_fileIndex() writes an index of the lines (see clogIndex.h) next to the file, so `clog-query` only reads the
+ * blocks that might hold the lines it looks for. An indexed file cannot be rotated. A compressed file should be new
+ * when it is indexed, as the index counts the bytes of the file so far as uncompressed data.
+ *
+ * ```.c
+ * // keep 5 files of at most 10 MB, a new file at least once a day
+ * const CLogFileRotation rotation = {10000000U, 86400000000000U, 5U, "%s.%u"};
+ * clog_fileOpen(&file, "app.log", &policy);
+ * clog_fileStartRotation(&file, &rotation);
+ * ```
+ */
+
+#ifndef INCLUDE_CLOGFILE_H_
+#define INCLUDE_CLOGFILE_H_
+
+#include "clog.h"
+#include "clogCompress.h"
+#include "clogIndex.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_FILE_BUFFER_SIZE
+ * The size of the buffer collecting the lines of a batch. A batch that doesn't fit is written in several parts.
+ */
+#ifndef CLOG_FILE_BUFFER_SIZE
+#define CLOG_FILE_BUFFER_SIZE (65536U)
+#endif
+
+/**
+ * @def CLOG_FILE_LINE_SIZE
+ * The maximum size of a line including the terminating null byte. Longer lines are truncated.
+ */
+#ifndef CLOG_FILE_LINE_SIZE
+#define CLOG_FILE_LINE_SIZE (1024U)
+#endif
+
+/**
+ * @def CLOG_FILE_PATH_SIZE
+ * The maximum size of the path of a rotating file and the names of its rotated files, including the null byte.
+ */
+#ifndef CLOG_FILE_PATH_SIZE
+#define CLOG_FILE_PATH_SIZE (256U)
+#endif
+
+/**
+ * @def CLOG_FILE_SPARE_SUFFIX
+ * Appended to the path of a rotating file to name the next file while it is prepared.
+ */
+#ifndef CLOG_FILE_SPARE_SUFFIX
+#define CLOG_FILE_SPARE_SUFFIX ".next"
+#endif
+
+#if CLOG_FILE_BUFFER_SIZE < CLOG_FILE_LINE_SIZE
+#error "CLOG_FILE_BUFFER_SIZE must hold at least one line"
+#endif
+
+/**
+ * Decides when the buffered lines of a file are written.
+ */
+typedef struct _CLogFilePolicy {
+  size_t size;       ///< Write when this many bytes are buffered. Zero writes the lines of every call at once.
+  uint64_t interval; ///< Write when the oldest buffered line is this many ns old (by timestamp), zero to disable.
+  CLogLevel level;   ///< Write at once when a message of this level or higher arrives, CLOG_LOFF to disable.
+} CLogFilePolicy;
+
+/**
+ * Decides when a file is rotated and how the rotated files are named.
+ */
+typedef struct _CLogFileRotation {
+  uint64_t size;       ///< Rotate when the file has this many bytes, zero to disable.
+  uint64_t interval;   ///< Rotate when the first line of the file is this many ns old (by timestamp), zero to disable.
+  unsigned int keep;   ///< The number of rotated files kept, zero deletes a file when it is rotated.
+  const char *pattern; ///< Names the rotated files: one %s (the path) followed by one %u (1 to keep), NULL for "%s.%u".
+} CLogFileRotation;
+
+/**
+ * State of an open log file. Initialize it with clog_fileOpen().
+ */
+typedef struct _CLogFile {
+  int fd;                             ///< The file descriptor of the file.
+  CLogFilePolicy policy;              ///< The flush policy.
+  uint64_t writes;                    ///< The number of write system calls made so far.
+  uint64_t errors;                    ///< The number of failed writes, the lines are lost.
+  uint64_t oldest;                    ///< The timestamp of the oldest buffered line.
+  size_t used;                        ///< The number of bytes in buffer.
+  char buffer[CLOG_FILE_BUFFER_SIZE]; ///< Collects the lines to be written.
+
+  CLogFileRotation rotation;      ///< The rotation settings, see clog_fileStartRotation().
+  uint64_t rotations;             ///< The number of rotations so far.
+  uint64_t postponed;             ///< The number of times a due rotation waited for the next file.
+  uint64_t size;                  ///< The number of bytes in the current file.
+  uint64_t started;               ///< The timestamp of the first line of the current file, UINT64_MAX if none.
+  bool rotating;                  ///< Set while the rotation thread runs.
+  bool stopping;                  ///< Asks the rotation thread to stop, protected by mutex.
+  int spare;                      ///< The descriptor of the next file, -1 while it is prepared. Protected by mutex.
+  int retired;                    ///< The descriptor of the rotated file, -1 if none. Protected by mutex.
+  char path[CLOG_FILE_PATH_SIZE]; ///< The path of the file, empty if it is too long to rotate.
+  pthread_t thread;               ///< Renames the rotated files and opens the next one.
+  pthread_mutex_t mutex;          ///< Protects stopping, spare and retired.
+  pthread_cond_t wakeup;          ///< Wakes the rotation thread up.
+  CLogCompressor *compressor;     ///< Compresses the written buffers, NULL if the file isn't compressed.
+  CLogIndex *index;               ///< Indexes the written lines, NULL if the file isn't indexed.
+} CLogFile;
+
+/**
+ * Opens a log file for appending, creating it if needed.
+ *
+ * @param file   The file.
+ * @param path   The path of the file.
+ * @param policy The flush policy, copied. NULL writes the lines of every call at once.
+ * @return true  If the file can be used.
+ * @return false If any parameter is invalid or the file cannot be opened.
+ */
+bool clog_fileOpen(CLogFile *const file, const char *const path, const CLogFilePolicy *const policy);
+
+/**
+ * Appends the line of a single message and writes the buffer if the policy asks for it. Call it from the onMessage
+ * function of an adapter.
+ *
+ * @param file The file.
+ * @param msg  The message.
+ */
+void clog_fileWrite(CLogFile *const file, const CLogMessage *const msg);
+
+/**
+ * Appends the lines of a batch of messages and writes the buffer if the policy asks for it. The lines of a batch are
+ * written with a single system call (several ones if they don't fit into the buffer). Call it from the onMessages
+ * function of an adapter.
+ *
+ * @param file     The file.
+ * @param messages The messages.
+ * @param count    The number of messages.
+ */
+void clog_fileWriteBatch(CLogFile *const file, const CLogMessage messages[], const size_t count);
+
+/**
+ * Writes all buffered lines, also the data of the compressor of a compressed file.
+ *
+ * @param file The file.
+ */
+void clog_fileFlush(CLogFile *const file);
+
+/**
+ * Starts rotating an open file, see the introduction. The rotation thread is stopped by clog_fileClose().
+ *
+ * @param file     The file.
+ * @param rotation The rotation settings, copied.
+ * @return true    If the rotation thread has been started.
+ * @return false   If any parameter is invalid (no threshold, a bad pattern or names longer than CLOG_FILE_PATH_SIZE),
+ *                 the file already rotates, is compressed or indexed or the thread cannot be started.
+ */
+bool clog_fileStartRotation(CLogFile *const file, const CLogFileRotation *const rotation);
+
+/**
+ * Compresses all lines written from now on, see clogCompress.h. Call it right after clog_fileOpen(), as the file
+ * should either be compressed or not.
+ *
+ * @param file       The file.
+ * @param compressor The compressor, opened on the file. It is closed by clog_fileClose().
+ * @return true      If the compressor has been opened.
+ * @return false     If any parameter is invalid, the file rotates or is compressed already or the compressor cannot
+ *                   be opened.
+ */
+bool clog_fileCompress(CLogFile *const file, CLogCompressor *const compressor);
+
+/**
+ * Indexes all lines written from now on, see clogIndex.h. The lines written so far become a block matching every
+ * query.
+ *
+ * @param file   The file.
+ * @param index  The index, opened with clog_indexOpen(). It is closed by clog_fileClose().
+ * @return true  If the index has been attached.
+ * @return false If any parameter is invalid or the file rotates or is indexed already.
+ */
+bool clog_fileIndex(CLogFile *const file, CLogIndex *const index);
+
+/**
+ * Writes all buffered lines and closes the file (and its index). Stops the rotation, finishing a pending one.
+ *
+ * @param file The file.
+ */
+void clog_fileClose(CLogFile *const file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGFILE_H_ */
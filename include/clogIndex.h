@@ -0,0 +1,196 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Block index of log files.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * Searching a large log for the messages of an incident means reading all of it. An index written next to the log (a
+ * sidecar file, e.g. `app.log.idx`) allows skipping most of it: the log is split into blocks of about
+ * CLogIndex::blockSize bytes (always at message boundaries) and for every block the index has an entry (see
+ * CLogIndexEntry) holding
+ * - the time range of its messages,
+ * - the number of its messages per level,
+ * - a bloom filter of its tags and call sites (file and line).
+ *
+ * A query (see CLogIndexQuery) then only reads the blocks that might contain matching messages, `clog-query` (see
+ * tools/clogQuery.c) does that for the command line, e.g. `clog-query -l ERR -t COMM -f 10:02 -u 10:05 app.clog`.
+ *
+ * The file adapter (see clog_fileIndex()) and the binary writer (see clog_binaryIndex()) feed the index. The offsets
+ * are offsets of the uncompressed data, clog_decompressStream() seeks to them in compressed logs (see clogCompress.h).
+ * Every block of an indexed binary log starts with the file header and an empty call site dictionary, so each block
+ * can be decoded on its own.
+ *
+ * The entries are written with the byte order of the writing machine, after a header (the magic `CLOGIDX1`, the byte
+ * order marker and the size of an entry).
+ *
+ * ```.c
+ * static CLogIndex index;
+ *
+ * // during initialization
+ * clog_fileOpen(&file, "app.log", &policy);
+ * clog_indexOpen(&index, "app.log.idx", 65536U);
+ * clog_fileIndex(&file, &index);
+ * ```
+ */
+
+#ifndef INCLUDE_CLOGINDEX_H_
+#define INCLUDE_CLOGINDEX_H_
+
+#include <stdio.h>
+
+#include "clog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_INDEX_BLOOM_BITS
+ * The size of the bloom filter of an entry in bits, a power of two and a multiple of 64.
+ */
+#ifndef CLOG_INDEX_BLOOM_BITS
+#define CLOG_INDEX_BLOOM_BITS (256U)
+#endif
+
+/**
+ * @def CLOG_INDEX_BLOOM_HASHES
+ * The number of bits set in the bloom filter per tag or call site.
+ */
+#ifndef CLOG_INDEX_BLOOM_HASHES
+#define CLOG_INDEX_BLOOM_HASHES (3U)
+#endif
+
+/**
+ * The summary of a block of a log.
+ */
+typedef struct _CLogIndexEntry {
+  uint64_t offset;                             ///< The offset of the block in the (uncompressed) log.
+  uint64_t length;                             ///< The length of the block.
+  uint64_t first;                              ///< The earliest time of its messages (ns since the epoch).
+  uint64_t last;                               ///< The latest time of its messages.
+  uint32_t counts[CLOG_LOFF];                  ///< The number of messages per level.
+  uint64_t bloom[CLOG_INDEX_BLOOM_BITS / 64U]; ///< The tags and call sites of its messages.
+} CLogIndexEntry;
+
+/**
+ * Selects messages. All criteria have to match, fields set to zero / NULL match all messages.
+ */
+typedef struct _CLogIndexQuery {
+  uint64_t from;           ///< The earliest time (ns since the epoch, inclusive).
+  uint64_t until;          ///< The latest time (exclusive), zero for no limit.
+  CLogLevel level;         ///< The minimum level.
+  const char *const *tags; ///< The names of the tags, a message needs to have one of them.
+  size_t numberOfTags;     ///< The number of tags.
+  const char *file;        ///< The file of the call site.
+  unsigned int line;       ///< The line of the call site, only checked if file is set.
+} CLogIndexQuery;
+
+/**
+ * State of an index being written. Initialize it with clog_indexOpen().
+ */
+typedef struct _CLogIndex {
+  int fd;               ///< The file descriptor of the index file.
+  uint64_t blockSize;   ///< A block is finished when it has this many bytes.
+  uint64_t entries;     ///< The number of entries written so far.
+  uint64_t errors;      ///< The number of entries that could not be written.
+  CLogIndexEntry entry; ///< The entry of the current block.
+} CLogIndex;
+
+/**
+ * Called for every entry read by clog_indexRead().
+ *
+ * @param entry    The entry.
+ * @param userData The pointer passed to clog_indexRead().
+ */
+typedef void (*CLogIndexCallback)(const CLogIndexEntry *entry, void *userData);
+
+/**
+ * Creates (or truncates) an index file and writes its header.
+ *
+ * @param index     The index.
+ * @param path      The path of the index file.
+ * @param blockSize The size of the blocks.
+ * @return true     If the index can be used.
+ * @return false    If any parameter is invalid or the file cannot be written.
+ */
+bool clog_indexOpen(CLogIndex *const index, const char *const path, const size_t blockSize);
+
+/**
+ * Adds the record of a message to the current block, finishing the block if it is full. Called by the writers.
+ *
+ * @param index The index.
+ * @param msg   The message, NULL for data without messages (e.g. a file header).
+ * @param time  The time of the message (ns since the epoch).
+ * @param size  The size of the record.
+ */
+void clog_indexAdd(CLogIndex *const index, const CLogMessage *const msg, const uint64_t time, const size_t size);
+
+/**
+ * Adds data whose messages are unknown (e.g. written before the index has been opened) as a block matching every
+ * query.
+ *
+ * @param index The index.
+ * @param size  The size of the data.
+ */
+void clog_indexAddUnknown(CLogIndex *const index, const size_t size);
+
+/**
+ * Checks whether the next record starts a new block after the first one. Writers that need to repeat their header at
+ * the start of every block (like the binary writer) check it before writing a record.
+ *
+ * @param index The index.
+ * @return true If the current block is empty and not the first one.
+ */
+bool clog_indexIsBlockStart(const CLogIndex *const index);
+
+/**
+ * Writes the entry of the last block and closes the index file.
+ *
+ * @param index The index.
+ */
+void clog_indexClose(CLogIndex *const index);
+
+/**
+ * Reads all entries of an index file.
+ *
+ * @param file     The index file, opened in binary mode.
+ * @param callback Called for every entry.
+ * @param userData Passed to callback.
+ * @return true    If the whole file has been read.
+ * @return false   If any parameter is invalid, the file is not an index of a compatible machine or it is truncated.
+ */
+bool clog_indexRead(FILE *const file, const CLogIndexCallback callback, void *const userData);
+
+/**
+ * Checks whether a block might contain messages selected by a query. Blocks that don't are skipped.
+ *
+ * @param entry  The entry of the block.
+ * @param query  The query.
+ * @return true  If the block has to be read.
+ * @return false If the block has no matching message.
+ */
+bool clog_indexMayMatch(const CLogIndexEntry *const entry, const CLogIndexQuery *const query);
+
+/**
+ * Checks whether a message is selected by a query.
+ *
+ * @param query  The query.
+ * @param msg    The message.
+ * @param time   The time of the message (ns since the epoch).
+ * @return true  If the message matches.
+ * @return false Otherwise.
+ */
+bool clog_indexMatches(const CLogIndexQuery *const query, const CLogMessage *const msg, const uint64_t time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGINDEX_H_ */
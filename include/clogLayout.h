@@ -0,0 +1,115 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Compiled pattern layouts for formatting message lines.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * A layout describes how a message line is formatted, e.g. `"%L %T %F:%l(%f) %m"`. The pattern is compiled once into a
+ * short list of operations, so formatting a message only copies the fields and converts the line number, no printf
+ * format is parsed per message. Set CLogContext::layout to change the lines produced by clog_formatMessage() and
+ * clog_getLine() at runtime.
+ *
+ * The following conversions are supported:
+ * | Conversion | Output                                          |
+ * |------------|-------------------------------------------------|
+ * | `%%L`      | the level (e.g. `WRN`)                          |
+ * | `%%C`      | the color code of the level (ANSI escape code)  |
+ * | `%%T`      | the tag                                         |
+ * | `%%F`      | the file name                                   |
+ * | `%%l`      | the line number                                 |
+ * | `%%f`      | the function name                               |
+ * | `%%m`      | the message text                                |
+ * | `%%d`      | the local date and time, e.g. `2019-09-16 12:34:56.789` |
+ * | `%%D`      | the same with microseconds, e.g. `2019-09-16 12:34:56.789012` |
+ * | `%%%`      | a percent sign                                  |
+ *
+ * All other characters are copied as they are.
+ *
+ * The date and time are taken from CLogMessage::timestamp. The timestamps of the monotonic clocks of clogClock.h are
+ * converted into the wall-clock time, all other ones are taken as time since the epoch. Each thread caches the text of
+ * the last second it has formatted, so localtime_r() and strftime() are called once per second only and formatting
+ * the time of a message just appends the fraction of the second.
+ */
+
+#ifndef INCLUDE_CLOGLAYOUT_H_
+#define INCLUDE_CLOGLAYOUT_H_
+
+#include "clog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_LAYOUT_OPS
+ * The maximum number of operations of a compiled layout. Every conversion and every run of literal text is one
+ * operation.
+ */
+#ifndef CLOG_LAYOUT_OPS
+#define CLOG_LAYOUT_OPS (32U)
+#endif
+
+/**
+ * @def CLOG_LAYOUT_TEXT
+ * The maximum number of literal characters of a compiled layout.
+ */
+#ifndef CLOG_LAYOUT_TEXT
+#define CLOG_LAYOUT_TEXT (128U)
+#endif
+
+/**
+ * A single operation of a compiled layout.
+ */
+typedef struct _CLogLayoutOp {
+  unsigned char code;    ///< What to output.
+  unsigned char length;  ///< The length of literal text.
+  unsigned short offset; ///< The offset of literal text within CLogLayout::text.
+} CLogLayoutOp;
+
+/**
+ * A compiled layout. Use clog_compileLayout() to fill it.
+ */
+typedef struct _CLogLayout {
+  CLogLayoutOp ops[CLOG_LAYOUT_OPS]; ///< The operations.
+  size_t numberOfOps;                ///< The number of operations used.
+  char text[CLOG_LAYOUT_TEXT];       ///< The literal text of the pattern.
+} CLogLayout;
+
+/**
+ * Compiles a pattern into a layout.
+ *
+ * @param layout  The layout to be filled.
+ * @param pattern The pattern, e.g. `"%L %T %F:%l(%f) %m"`.
+ * @return true   If the pattern has been compiled.
+ * @return false  If any parameter is invalid, the pattern contains an unknown conversion or is too long (see
+ *                CLOG_LAYOUT_OPS and CLOG_LAYOUT_TEXT). The layout is empty then.
+ */
+bool clog_compileLayout(CLogLayout *const layout, const char *const pattern);
+
+/**
+ * Formats a message using a layout. The function ensures a terminating null byte if bufferSize is at least one.
+ *
+ * @param buffer     The buffer to fill the text into.
+ * @param bufferSize The size of buffer.
+ * @param layout     The compiled layout.
+ * @param msg        The message to be formatted.
+ * @return size_t    The length of the complete text. If it is equal or greater than bufferSize the text has been
+ *                   truncated.
+ */
+size_t clog_formatLayout(char buffer[],
+                         const size_t bufferSize,
+                         const CLogLayout *const layout,
+                         const CLogMessage *const msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGLAYOUT_H_ */
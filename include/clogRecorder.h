@@ -0,0 +1,119 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Crash-survivable flight recorder.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * The flight recorder keeps the most recent message lines in a ring of fixed-size slots inside a memory mapped file
+ * (`MAP_SHARED`). Writing a line is a copy into shared memory, there is no system call and no fsync on the hot path.
+ * As the pages belong to the page cache of the file, the lines survive if the process dies (SIGKILL, OOM killer,
+ * segmentation fault), only a power loss or a kernel crash can lose them.
+ *
+ * Every slot has a header holding a sequence number, the length of the line and a checksum. Slots are reserved with an
+ * atomic increment, so threads write concurrently. A slot that was being written while the process died doesn't
+ * match its checksum and is skipped by clog_recorderRead(), which returns the remaining lines in the order they have
+ * been written. The `clog-recorder` tool prints them.
+ *
+ * Lines longer than a slot are truncated like clog_formatMessage() truncates them.
+ *
+ * A minimal adapter looks like this:
+ * ```.c
+ * static CLogRecorder recorder;
+ *
+ * static void recorderAdapter(const CLogMessage *msg) {
+ *   clog_recorderWrite(&recorder, msg);
+ * }
+ *
+ * // during initialization: keep the last 4096 lines of up to 256 bytes
+ * clog_recorderOpen(&recorder, "app.rec", 4096U, 256U);
+ * ```
+ */
+
+#ifndef INCLUDE_CLOGRECORDER_H_
+#define INCLUDE_CLOGRECORDER_H_
+
+#include "clog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * State of an open flight recorder. Initialize it with clog_recorderOpen().
+ */
+typedef struct _CLogRecorder {
+  int fd;                             ///< The file descriptor of the file.
+  void *map;                          ///< The mapping of the whole file.
+  size_t mapSize;                     ///< The size of the mapping.
+  struct _CLogRecorderHeader *header; ///< The file header (within the mapping).
+  unsigned char *slots;               ///< The first slot (within the mapping).
+  size_t numberOfSlots;               ///< The number of slots.
+  size_t slotSize;                    ///< The size of a slot including its header.
+} CLogRecorder;
+
+/**
+ * Called for every line read by clog_recorderRead().
+ *
+ * @param line     The line (null terminated).
+ * @param length   The length of line.
+ * @param sequence The sequence number of the line, gaps indicate overwritten or corrupted slots.
+ * @param userData The pointer passed to clog_recorderRead().
+ */
+typedef void (*CLogRecorderCallback)(const char *line, size_t length, uint64_t sequence, void *userData);
+
+/**
+ * Opens a flight recorder file, creating it if needed. If the file has been written with the same number and size of
+ * slots before, its lines are kept and new lines continue its sequence. Otherwise the file is reinitialized.
+ *
+ * @param recorder      The recorder.
+ * @param path          The path of the file.
+ * @param numberOfSlots The number of lines kept.
+ * @param slotSize      The size of a slot, at least 64 bytes. A slot holds a header (24 bytes) and the line.
+ * @return true         If the recorder can be used.
+ * @return false        If any parameter is invalid or the file cannot be created or mapped.
+ */
+bool clog_recorderOpen(CLogRecorder *const recorder,
+                       const char *const path,
+                       const size_t numberOfSlots,
+                       const size_t slotSize);
+
+/**
+ * Writes the line of a message into the next slot. Call it from the onMessage function of an adapter. Thread safe,
+ * the line is formatted by clog_formatMessage() directly into the mapped file.
+ *
+ * @param recorder The recorder.
+ * @param msg      The message.
+ */
+void clog_recorderWrite(CLogRecorder *const recorder, const CLogMessage *const msg);
+
+/**
+ * Unmaps and closes the file. The lines stay in the file.
+ *
+ * @param recorder The recorder.
+ */
+void clog_recorderClose(CLogRecorder *const recorder);
+
+/**
+ * Reads the valid lines of a flight recorder file in the order they have been written. Slots failing their checksum
+ * (e.g. because the process died while writing them) are skipped.
+ *
+ * @param path     The path of the file.
+ * @param callback Called for every line.
+ * @param userData Passed to callback.
+ * @return true    If the file has been read.
+ * @return false   If any parameter is invalid or the file is not a flight recorder file.
+ */
+bool clog_recorderRead(const char *const path, const CLogRecorderCallback callback, void *const userData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGRECORDER_H_ */
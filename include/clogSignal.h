@@ -0,0 +1,158 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Async-signal-safe logging.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * clog_logMessage() must not be called from signal handlers: it uses vsnprintf(), shares the message buffer of the
+ * context and the adapters may do anything. The functions of this module only use async-signal-safe operations, so
+ * they can be called from signal handlers (e.g. SIGSEGV, SIGTERM) and from callbacks that interrupt arbitrary code:
+ * - the message is formatted by a minimal formatter (see clog_formatSignalSafe()) into a slot of a preallocated ring,
+ *   which is reserved with a lock-free compare and swap. If the ring is full, the message is dropped and counted.
+ * - optionally the line is written immediately to a file descriptor using write(2) only (e.g. STDERR_FILENO or a file
+ *   opened in advance), so it is not lost if the process doesn't survive the signal.
+ *
+ * The adapters of the context are never called from the signal-safe path. The messages queued in the ring are passed
+ * to them by clog_drainSignalSafe(), which has to be called from a normal context (e.g. the main loop).
+ *
+ * @startuml
+ *  participant "Signal handler" as handler
+ *  participant "clog_logSignalSafe()" as log
+ *  queue "Ring" as ring
+ *  participant "clog_drainSignalSafe()" as drain
+ *  participant "Adapters" as adapters
+ *  handler -> log: CLOG_SIGNAL_SAFE()
+ *  log -> log: clog_formatSignalSafe()
+ *  log -> ring: reserve slot (CAS), copy text
+ *  log -> log: write(2) (optional)
+ *  drain -> ring: read slots
+ *  drain -> adapters: clog_logMessage()
+ * @enduml
+ */
+
+#ifndef INCLUDE_CLOGSIGNAL_H_
+#define INCLUDE_CLOGSIGNAL_H_
+
+#include "clog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_SIGNAL_TEXT
+ * The size of the text of a signal-safe message including the terminating null byte. Longer messages are truncated.
+ */
+#ifndef CLOG_SIGNAL_TEXT
+#define CLOG_SIGNAL_TEXT (128U)
+#endif
+
+/**
+ * A message queued by clog_logSignalSafe().
+ */
+typedef struct _CLogSignalSlot {
+  uint64_t sequence;           ///< State of the slot, internal.
+  CLogLevel level;             ///< The log level.
+  size_t tag;                  ///< The tag of the message.
+  const char *file;            ///< The file name.
+  unsigned int line;           ///< The line number.
+  const char *function;        ///< The function name.
+  char text[CLOG_SIGNAL_TEXT]; ///< The formatted message text.
+} CLogSignalSlot;
+
+/**
+ * State of the signal-safe path. Initialize it with clog_initSignalSafe().
+ */
+typedef struct _CLogSignal {
+  CLogContext *context;  ///< The context providing the minimum level and tag names and receiving the messages.
+  int fd;                ///< The file descriptor lines are written to immediately, -1 for none.
+  CLogSignalSlot *slots; ///< The ring of preallocated slots. Can be NULL if fd is set.
+  size_t numberOfSlots;  ///< The number of slots (power of two).
+  uint64_t tail;         ///< The next slot to be reserved, internal.
+  uint64_t head;         ///< The next slot to be drained, internal.
+  uint64_t dropped;      ///< The number of messages dropped because the ring was full.
+} CLogSignal;
+
+/**
+ * @def CLOG_SIGNAL_SAFE
+ * Logs a message from a signal handler, see clog_logSignalSafe(). Only the conversions supported by
+ * clog_formatSignalSafe() can be used.
+ */
+#define CLOG_SIGNAL_SAFE(SIG, LEVEL, TAG, MESSAGE, ...) \
+  clog_logSignalSafe(SIG, LEVEL, TAG, CLOG_FILE, CLOG_LINE, CLOG_FUNC, MESSAGE VA_ARGS(__VA_ARGS__))
+
+/**
+ * Initializes the signal-safe path. Call it from a normal context before the first signal may arrive.
+ *
+ * @param sig           The state to be initialized.
+ * @param ctx           The context the messages are passed to by clog_drainSignalSafe(). Its minimum level and tag
+ *                      names are used by clog_logSignalSafe().
+ * @param slots         The preallocated ring. Can be NULL if only fd is used.
+ * @param numberOfSlots The number of slots, must be a power of two (or zero if slots is NULL).
+ * @param fd            A file descriptor each line is written to immediately, -1 for none.
+ * @return true         If the state has been initialized.
+ * @return false        If any parameter is invalid.
+ */
+bool clog_initSignalSafe(CLogSignal *const sig,
+                         CLogContext *const ctx,
+                         CLogSignalSlot slots[],
+                         const size_t numberOfSlots,
+                         const int fd);
+
+/**
+ * Logs a message using async-signal-safe operations only. Use CLOG_SIGNAL_SAFE() instead of calling it directly.
+ *
+ * @param sig      The state of the signal-safe path.
+ * @param level    The log level.
+ * @param tag      The tag of the message.
+ * @param file     The file name.
+ * @param line     The line number.
+ * @param function The function name.
+ * @param format   The message text, see clog_formatSignalSafe().
+ * @param ...      The parameters.
+ */
+void clog_logSignalSafe(CLogSignal *const sig,
+                        const CLogLevel level,
+                        const size_t tag,
+                        const char *const file,
+                        const unsigned int line,
+                        const char *const function,
+                        const char *const format,
+                        ...);
+
+/**
+ * Passes the queued messages to the adapters of the context. Must not be called from a signal handler. Only one
+ * thread may drain at a time.
+ *
+ * @param sig     The state of the signal-safe path.
+ * @return size_t The number of messages passed.
+ */
+size_t clog_drainSignalSafe(CLogSignal *const sig);
+
+/**
+ * Minimal async-signal-safe formatter. Supports the conversions `%%d`, `%%i`, `%%o`, `%%u`, `%%x`, `%%X`, `%%c`,
+ * `%%s`, `%%p` and `%%%` with the flags `-`, `+`, space, `#` and `0`, a field width and precision (also given as `*`)
+ * and the length modifiers `hh`, `h`, `l`, `ll`, `j`, `z` and `t`. Other conversions (e.g. `%%f`) stop formatting:
+ * the rest of the format string is copied as it is, since the arguments following an unknown one can't be found. The
+ * function ensures a terminating null byte if bufferSize is at least one.
+ *
+ * @param buffer     The buffer to fill the text into.
+ * @param bufferSize The size of buffer.
+ * @param format     The format string.
+ * @param list       The arguments.
+ * @return size_t    The length of the text written (without the terminating null byte).
+ */
+size_t clog_formatSignalSafe(char buffer[], const size_t bufferSize, const char *const format, va_list list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGSIGNAL_H_ */
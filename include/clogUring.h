@@ -0,0 +1,149 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief File writer submitting blocks through io_uring.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * # Introduction
+ * Like the file adapter (see clogFile.h) the io_uring writer collects the formatted lines of the messages and writes
+ * them according to a CLogFilePolicy. It doesn't wait for the writes, though: the lines are copied into the current
+ * block of a small pool of blocks. When the policy asks for a write, the block is submitted to the kernel through
+ * io_uring (as a fixed buffer write, the blocks are registered with the ring) and the next free block is used. The
+ * calling thread only waits if all blocks are still being written, or in clog_uringFlush() and clog_uringClose().
+ *
+ * If the kernel lacks io_uring (or it is blocked, e.g. by a seccomp filter), or CLogUring::plainWrites is set, the
+ * writer falls back to writing the blocks with pwrite() at once, like the file adapter does. CLogUring::native tells
+ * which way is used. If the ring fails later on, the blocks still being written are written again with pwrite() and
+ * the writer continues with the fallback.
+ *
+ * The blocks are written at explicit offsets starting at the end of the file, so the file must not be written by
+ * anybody else at the same time. Like the file adapter the functions are not thread safe.
+ *
+ * ```.c
+ * static char blocks[4][65536] __attribute__((aligned(4096)));
+ * static CLogUring uring = {.blocks = &blocks[0][0],
+ *                          .blockSize = sizeof(blocks[0]),
+ *                          .numberOfBlocks = 4U,
+ *                          .policy = {sizeof(blocks[0]), 1000000000U, CLOG_LERR}};
+ *
+ * static void uringAdapter(const CLogMessage messages[], size_t count) {
+ *   clog_uringWriteBatch(&uring, messages, count);
+ * }
+ *
+ * // during initialization
+ * clog_uringOpen(&uring, "app.log");
+ * ```
+ */
+
+#ifndef INCLUDE_CLOGURING_H_
+#define INCLUDE_CLOGURING_H_
+
+#include "clogFile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def CLOG_URING_MAX_BLOCKS
+ * The maximum number of blocks of a writer.
+ */
+#ifndef CLOG_URING_MAX_BLOCKS
+#define CLOG_URING_MAX_BLOCKS (16U)
+#endif
+
+/**
+ * State of an io_uring writer. Set blocks, blockSize, numberOfBlocks, policy and optionally plainWrites, initialize
+ * all other fields with zero, then pass it to clog_uringOpen().
+ */
+typedef struct _CLogUring {
+  char *blocks;          /**< The blocks, numberOfBlocks * blockSize bytes. Page aligned blocks are faster. */
+  size_t blockSize;      /**< The size of a block, at least CLOG_FILE_LINE_SIZE. */
+  size_t numberOfBlocks; /**< The number of blocks, 2 to CLOG_URING_MAX_BLOCKS. */
+  CLogFilePolicy policy; /**< When a block is submitted, see clogFile.h. A full block is always submitted. */
+  bool plainWrites;      /**< Set to write with pwrite() even if io_uring is available. */
+
+  bool native;     /**< Set by clog_uringOpen() if io_uring is used. */
+  uint64_t writes; /**< The number of blocks written so far. */
+  uint64_t waits;  /**< The number of times the caller had to wait for a free block. */
+  uint64_t errors; /**< The number of failed writes, the lines are lost. */
+
+  // Internal state, do not touch.
+  int fd;                                       /**< The file descriptor of the file. */
+  uint64_t offset;                              /**< The offset the next block is written to. */
+  size_t current;                               /**< The block being filled. */
+  size_t used;                                  /**< The number of bytes in the current block. */
+  uint64_t oldest;                              /**< The timestamp of the oldest line in the current block. */
+  size_t inFlight;                              /**< The number of blocks being written. */
+  uint64_t blockOffsets[CLOG_URING_MAX_BLOCKS]; /**< The offsets of the blocks being written. */
+  size_t blockLengths[CLOG_URING_MAX_BLOCKS];   /**< The lengths of the blocks being written, zero if free. */
+  int ringFd;                                   /**< The file descriptor of the ring. */
+  void *sqRing;                                 /**< The mapping of the submission queue ring. */
+  size_t sqRingSize;                            /**< The size of the submission queue ring mapping. */
+  void *cqRing;                                 /**< The mapping of the completion queue ring (may be sqRing). */
+  size_t cqRingSize;                            /**< The size of the completion queue ring mapping. */
+  void *sqes;                                   /**< The mapping of the submission queue entries. */
+  size_t sqesSize;                              /**< The size of the submission queue entries mapping. */
+  uint32_t *sqTail;                             /**< Tail of the submission queue. */
+  uint32_t sqMask;                              /**< Mask of the submission queue indices. */
+  uint32_t *sqArray;                            /**< Index array of the submission queue. */
+  uint32_t *cqHead;                             /**< Head of the completion queue. */
+  uint32_t *cqTail;                             /**< Tail of the completion queue. */
+  uint32_t cqMask;                              /**< Mask of the completion queue indices. */
+  void *cqes;                                   /**< The completion queue entries. */
+} CLogUring;
+
+/**
+ * Opens a log file for writing at its end, creating it if needed, and sets up the ring.
+ *
+ * @param uring  The writer.
+ * @param path   The path of the file.
+ * @return true  If the writer can be used (natively or with the pwrite() fallback).
+ * @return false If any parameter is invalid or the file cannot be opened.
+ */
+bool clog_uringOpen(CLogUring *const uring, const char *const path);
+
+/**
+ * Appends the line of a single message and submits the block if the policy asks for it. Call it from the onMessage
+ * function of an adapter.
+ *
+ * @param uring The writer.
+ * @param msg   The message.
+ */
+void clog_uringWrite(CLogUring *const uring, const CLogMessage *const msg);
+
+/**
+ * Appends the lines of a batch of messages and submits the block if the policy asks for it. Call it from the
+ * onMessages function of an adapter.
+ *
+ * @param uring    The writer.
+ * @param messages The messages.
+ * @param count    The number of messages.
+ */
+void clog_uringWriteBatch(CLogUring *const uring, const CLogMessage messages[], const size_t count);
+
+/**
+ * Submits the current block and waits until all blocks have been written.
+ *
+ * @param uring The writer.
+ */
+void clog_uringFlush(CLogUring *const uring);
+
+/**
+ * Writes all lines, tears the ring down and closes the file.
+ *
+ * @param uring The writer.
+ */
+void clog_uringClose(CLogUring *const uring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLOGURING_H_ */
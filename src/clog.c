@@ -12,14 +12,18 @@
  */
 
 #include "clog.h"
+#include "clogAsync.h"
+#include "clogInternal.h"
+#include "clogLayout.h"
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 static const char *EmptyTag = "";
 
 static char *levelNames[] = {"TRC", "DBG", "INF", "WRN", "ERR", "FTL", "OFF", "UKN"};
 
-#ifdef CLOG_COLOR
 static const char *levelColors[] = {
     "\x1b[94m", // trace      / light blue
     "\x1b[36m", // debug      / cyan
@@ -31,20 +35,62 @@ static const char *levelColors[] = {
     "\x1b[35m"  // unknown    / magenta
 };
 
-static const char *lineHeaderFormat = "%s%s:%s\x1b[0m \x1b[90m%s:%d(%s)\x1b[0m";
+#ifdef CLOG_COLOR
+#define LINE_HEADER_PATTERN "%C%L:%T\x1b[0m \x1b[90m%F:%l(%f)\x1b[0m"
 #else
-static const char *lineHeaderFormat = "%s%s:%s %s:%d(%s)";
-
-// Declaring clog_getColor "private" in non color mode
-static const char *clog_getColor(const CLogLevel level);
+#define LINE_HEADER_PATTERN "%L:%T %F:%l(%f)"
 #endif
 
-bool clog_checkContext(const CLogContext *ctx) {
-  if (NULL == ctx) {
+static const char *lineHeaderPattern = LINE_HEADER_PATTERN;
+// The line header of contexts with CLogContext::headerTime set, starting with the local time (see clogLayout.h)
+static const char *timeHeaderPattern = "%d " LINE_HEADER_PATTERN;
+
+// The built-in layouts, compiled on first use
+static pthread_once_t defaultLayoutsOnce = PTHREAD_ONCE_INIT;
+static CLogLayout lineHeaderLayout;
+static CLogLayout timeHeaderLayout;
+static CLogLayout messageLayout;
+static CLogLayout newlineLayout;
+
+static void clog_compileDefaultLayouts(void) {
+  clog_compileLayout(&lineHeaderLayout, lineHeaderPattern);
+  clog_compileLayout(&timeHeaderLayout, timeHeaderPattern);
+  clog_compileLayout(&messageLayout, " %m\n");
+  clog_compileLayout(&newlineLayout, "\n");
+}
+
+/**
+ * Terminates the formatted message and indicates a truncation with "..".
+ */
+static void clog_terminateMessage(char buffer[], const size_t bufferSize, const size_t size) {
+  if (size >= bufferSize && bufferSize >= 3) {
+    // buffer overflow, let's indicate this
+    buffer[bufferSize - 3] = '.';
+    buffer[bufferSize - 2] = '.';
+  }
+
+  buffer[bufferSize - 1] = 0;
+}
+
+/**
+ * Checks an array of adapters.
+ */
+static bool clog_checkAdapters(const CLogAdapter *adapters, const size_t adaptersSize) {
+  if (NULL == adapters || 0U == adaptersSize) {
     return false;
   }
 
-  if (NULL == ctx->adapters || 0U == ctx->adaptersSize) {
+  for (size_t i = 0; i < adaptersSize; i++) {
+    if (!adapters[i].onMessage && !adapters[i].onMessages) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool clog_checkContext(const CLogContext *ctx) {
+  if (NULL == ctx) {
     return false;
   }
 
@@ -56,12 +102,27 @@ bool clog_checkContext(const CLogContext *ctx) {
     return false;
   }
 
-  for (size_t i = 0; i < ctx->adaptersSize; i++) {
-    if (!ctx->adapters[i].onMessage) {
-      return false;
-    }
+  return clog_checkAdapters(ctx->adapters, ctx->adaptersSize);
+}
+
+bool clog_initContext(CLogContext *ctx) {
+  if (false == clog_checkContext(ctx)) {
+    return false;
+  }
+
+  clog_updateAdapters(ctx);
+  ctx->validated = true;
+  return true;
+}
+
+bool clog_setAdapters(CLogContext *ctx, const CLogAdapter *const adapters, const size_t adaptersSize) {
+  if (NULL == ctx || NULL != ctx->async || false == clog_checkAdapters(adapters, adaptersSize)) {
+    return false;
   }
 
+  ctx->adapters = adapters;
+  ctx->adaptersSize = adaptersSize;
+  clog_updateAdapters(ctx);
   return true;
 }
 
@@ -77,6 +138,255 @@ void clog_setMinLevel(CLogContext *ctx, CLogLevel level) {
     return;
   }
   ctx->minLevel = level;
+
+  if (NULL != ctx->tagMinLevels) {
+    for (size_t i = 0; i < ctx->numberOfTags; i++) {
+      ctx->tagMinLevels[i] = level;
+    }
+  }
+}
+
+CLogLevel clog_getTagMinLevel(const CLogContext *ctx, const size_t tag) {
+  if (NULL == ctx) {
+    return CLOG_LTRC;
+  }
+  if (NULL != ctx->tagMinLevels && tag < ctx->numberOfTags) {
+    return ctx->tagMinLevels[tag];
+  }
+  return ctx->minLevel;
+}
+
+bool clog_setTagMinLevel(CLogContext *ctx, const size_t tag, const CLogLevel level) {
+  if (NULL == ctx || NULL == ctx->tagMinLevels || tag >= ctx->numberOfTags) {
+    return false;
+  }
+  ctx->tagMinLevels[tag] = level;
+  return true;
+}
+
+void clog_updateAdapters(CLogContext *ctx) {
+  if (NULL == ctx || NULL == ctx->adapters) {
+    return;
+  }
+
+  CLogLevel minLevel = CLOG_LUKN;
+  uint64_t rejectedTags = UINT64_MAX;
+
+  for (size_t i = 0; i < ctx->adaptersSize; i++) {
+    const CLogLevel level = __atomic_load_n(&ctx->adapters[i].minLevel, __ATOMIC_RELAXED);
+    if (level < minLevel) {
+      minLevel = level;
+    }
+    rejectedTags &= __atomic_load_n(&ctx->adapters[i].excludedTags, __ATOMIC_RELAXED);
+  }
+
+  if (0U == ctx->adaptersSize) {
+    minLevel = CLOG_LTRC;
+    rejectedTags = 0U;
+  }
+
+  // the log macros and the dispatcher of an asynchronous context read them concurrently
+  __atomic_store_n(&ctx->adapterMinLevel, minLevel, __ATOMIC_RELAXED);
+  __atomic_store_n(&ctx->rejectedTags, rejectedTags, __ATOMIC_RELAXED);
+}
+
+/**
+ * Checks whether an adapter is one of the adapters of a context.
+ */
+static bool clog_isContextAdapter(const CLogContext *ctx, const CLogAdapter *adapter) {
+  if (NULL == ctx || NULL == ctx->adapters || NULL == adapter) {
+    return false;
+  }
+
+  for (size_t i = 0; i < ctx->adaptersSize; i++) {
+    if (&ctx->adapters[i] == adapter) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool clog_setAdapterMinLevel(CLogContext *ctx, CLogAdapter *const adapter, const CLogLevel level) {
+  if (!clog_isContextAdapter(ctx, adapter)) {
+    return false;
+  }
+  __atomic_store_n(&adapter->minLevel, level, __ATOMIC_RELAXED);
+  clog_updateAdapters(ctx);
+  return true;
+}
+
+bool clog_setAdapterExcludedTags(CLogContext *ctx, CLogAdapter *const adapter, const uint64_t excludedTags) {
+  if (!clog_isContextAdapter(ctx, adapter)) {
+    return false;
+  }
+  __atomic_store_n(&adapter->excludedTags, excludedTags, __ATOMIC_RELAXED);
+  clog_updateAdapters(ctx);
+  return true;
+}
+
+/**
+ * Checks the level and tags declared by an adapter.
+ */
+static bool clog_isAccepted(const CLogAdapter *adapter, const CLogCallSite *site) {
+  if (site->level < __atomic_load_n(&adapter->minLevel, __ATOMIC_RELAXED)) {
+    return false;
+  }
+  const uint64_t excludedTags = __atomic_load_n(&adapter->excludedTags, __ATOMIC_RELAXED);
+  return site->tag >= 64U || 0U == (excludedTags & (((uint64_t)1U) << site->tag));
+}
+
+/**
+ * Resolves the name of a tag.
+ */
+static const char *clog_getTagName(const CLogContext *ctx, const size_t tag) {
+  if (tag < ctx->numberOfTags) {
+    return ctx->tagNames[tag];
+  }
+  return EmptyTag;
+}
+
+/**
+ * Maps the levels that must not be used in messages to unknown.
+ */
+static CLogLevel clog_getFinalLevel(const CLogLevel level) {
+  return (level < CLOG_LOFF) ? level : CLOG_LUKN;
+}
+
+/**
+ * Passes a message to all adapters of the context that accept it.
+ */
+static void clog_dispatchMessage(const CLogContext *ctx, const CLogCallSite *site, const CLogMessage *msg) {
+  for (size_t i = 0; i < ctx->adaptersSize; i++) {
+    if (!clog_isAccepted(&ctx->adapters[i], site)) {
+      continue;
+    }
+    if (!ctx->adapters[i].messageFilter || ctx->adapters[i].messageFilter(msg)) {
+      if (ctx->adapters[i].onMessage) {
+        ctx->adapters[i].onMessage(msg);
+      } else {
+        ctx->adapters[i].onMessages(msg, 1U);
+      }
+    }
+  }
+}
+
+/**
+ * Forgets the text formatted for a message with captured arguments, so it is formatted again if asked for. Used for
+ * batches, as all messages share the buffers of the context.
+ */
+static void clog_forgetText(CLogMessage *msg) {
+  msg->message = NULL;
+  msg->formattedLine = NULL;
+  msg->formattedLineLength = 0;
+}
+
+/**
+ * Passes the accepted messages of a batch to a batch adapter, consecutive accepted messages at once.
+ */
+static void clog_dispatchToBatchAdapter(const CLogAdapter *adapter,
+                                        CLogMessage messages[],
+                                        const CLogCallSite *const sites[],
+                                        const size_t count) {
+  size_t first = 0U;
+
+  for (size_t i = 0; i <= count; i++) {
+    bool accepted = false;
+    if (i < count) {
+      clog_forgetText(&messages[i]);
+      accepted = clog_isAccepted(adapter, sites[i]) &&
+                 (!adapter->messageFilter || adapter->messageFilter(&messages[i]));
+      // the filter might have formatted the text, which is overwritten by the next message
+      clog_forgetText(&messages[i]);
+    }
+
+    if (!accepted) {
+      if (i > first) {
+        adapter->onMessages(&messages[first], i - first);
+      }
+      first = i + 1U;
+    }
+  }
+}
+
+/**
+ * Checks whether a message described by a call site has to be logged to a context. The context is validated on its
+ * first message.
+ */
+static bool clog_acceptSite(CLogContext *const ctx, const CLogCallSite *const site) {
+  // drop messages no adapter would accept before anything else
+  if (!clog_isLevelEnabled(ctx, site->tag, site->level) && 0U == (CLOG_CALL_SITE_FLAGS(*site) & CLOG_SITE_FORCED)) {
+    return false;
+  }
+
+  if (NULL == ctx || (!ctx->validated && false == clog_initContext(ctx))) {
+    return false;
+  }
+
+  return NULL != site->format;
+}
+
+/**
+ * Registers a new call site and checks whether it is enabled.
+ */
+static bool clog_isSiteEnabled(CLogCallSite *const site) {
+  unsigned char flags = CLOG_CALL_SITE_FLAGS(*site);
+  if (0U != (flags & CLOG_SITE_NEW)) {
+    flags = clog_registerCallSite(site);
+  }
+
+  return 0U == (flags & CLOG_SITE_DISABLED);
+}
+
+/**
+ * Logs a message described by a call site.
+ *
+ * @param ctx       The log context to be used.
+ * @param site      The call site.
+ * @param temporary Set if the call site is only valid during the call.
+ * @param args      The additional parameters to be used when formatting the message.
+ */
+static void clog_logSite(CLogContext *const ctx, const CLogCallSite *const site, const bool temporary, va_list args) {
+  if (!clog_acceptSite(ctx, site)) {
+    return;
+  }
+
+  if (NULL != ctx->async) {
+    // the dispatcher thread of the asynchronous context takes care of the rest
+    clog_asyncPush(ctx->async, site, temporary, args);
+    return;
+  }
+
+  CLogStamp stamp;
+  clog_stamp(ctx, &ctx->sequence, &stamp);
+
+  if (ctx->deferredFormatting) {
+    // only capture the arguments, the text is formatted by clog_getMessage() if needed
+    CLogArgs deferredArgs;
+    clog_captureArgsWith(&deferredArgs, site, site->format, args);
+    clog_dispatchArgs(ctx, site, temporary, &stamp, &deferredArgs);
+    return;
+  }
+
+  CLogMessage msg = {site->file,
+                     site->line,
+                     site->function,
+                     ctx->messageBuffer,
+                     clog_getFinalLevel(site->level),
+                     clog_getTagName(ctx, site->tag),
+                     NULL,
+                     ctx,
+                     temporary ? NULL : site,
+                     NULL,
+                     0,
+                     stamp.timestamp,
+                     stamp.sequence,
+                     stamp.threadId};
+
+  size_t size =
+      clog_vformatWith(ctx->messageBuffer, ctx->messageBufferSize, ctx->shortestFloats, site, site->format, args);
+  clog_terminateMessage(ctx->messageBuffer, ctx->messageBufferSize, size);
+
+  clog_dispatchMessage(ctx, site, &msg);
 }
 
 void clog_logMessage(CLogContext *const ctx,
@@ -87,74 +397,223 @@ void clog_logMessage(CLogContext *const ctx,
                      const char *const function,
                      const char *const message,
                      ...) {
+  const CLogCallSite site = {file, line, function, level, tag, message, 0U, NULL, NULL};
+  va_list args;
 
-  if (false == clog_checkContext(ctx)) {
-    return;
+  va_start(args, message);
+  clog_logSite(ctx, &site, true, args);
+  va_end(args);
+}
+
+/**
+ * Fills a temporary copy of a call site for a message whose level, tag or format differs from the one of the call site
+ * (see CLOG_MESSAGE). Returns the call site itself if they match.
+ */
+static const CLogCallSite *clog_siteWith(const CLogCallSite *const site,
+                                         const CLogLevel level,
+                                         const size_t tag,
+                                         const char *const format,
+                                         CLogCallSite *const temporarySite) {
+  const bool sameFormat = format == site->format;
+  if (level == site->level && tag == site->tag && sameFormat) {
+    return site;
   }
 
-  if (level < ctx->minLevel) {
+  const CLogCallSite copy = {site->file,
+                             site->line,
+                             site->function,
+                             level,
+                             tag,
+                             format,
+                             CLOG_CALL_SITE_FLAGS(*site),
+                             NULL,
+                             sameFormat ? site->formatCache : NULL};
+  *temporarySite = copy;
+  return temporarySite;
+}
+
+void clog_logCallSite(CLogContext *const ctx,
+                      CLogCallSite *const site,
+                      const CLogLevel level,
+                      const size_t tag,
+                      const char *const format,
+                      ...) {
+  if (NULL == site || !clog_isSiteEnabled(site)) {
     return;
   }
 
-  if (NULL == message) {
+  CLogCallSite temporarySite;
+  const CLogCallSite *messageSite = clog_siteWith(site, level, tag, format, &temporarySite);
+  va_list args;
+
+  va_start(args, format);
+  clog_logSite(ctx, messageSite, messageSite != site, args);
+  va_end(args);
+}
+
+void clog_logArgs(CLogContext *const ctx,
+                  CLogCallSite *const site,
+                  const CLogLevel level,
+                  const size_t tag,
+                  const CLogArgs *const args) {
+  if (NULL == site || NULL == args || !clog_isSiteEnabled(site)) {
     return;
   }
 
-  const char *tagName = NULL;
+  CLogCallSite temporarySite;
+  const CLogCallSite *messageSite = clog_siteWith(site, level, tag, args->format, &temporarySite);
+  const bool temporary = messageSite != site;
 
-  if (tag < ctx->numberOfTags) {
-    tagName = ctx->tagNames[tag];
-  } else {
-    tagName = EmptyTag;
+  if (!clog_acceptSite(ctx, messageSite)) {
+    return;
   }
 
-  const CLogLevel finalLevel = (level < CLOG_LOFF) ? level : CLOG_LUKN;
+  if (NULL != ctx->async) {
+    clog_asyncPushArgs(ctx->async, messageSite, temporary, args);
+    return;
+  }
 
-  CLogMessage msg = {file, line, function, ctx->messageBuffer, finalLevel, tagName};
+  CLogStamp stamp;
+  clog_stamp(ctx, &ctx->sequence, &stamp);
+  clog_dispatchArgs(ctx, messageSite, temporary, &stamp, args);
+}
 
-  va_list args;
-  size_t size;
+void clog_dispatchArgs(const CLogContext *const ctx,
+                       const CLogCallSite *const site,
+                       const bool temporary,
+                       const CLogStamp *const stamp,
+                       const CLogArgs *const args) {
+  CLogMessage msg;
+  clog_initMessage(&msg, ctx, site, temporary, stamp, args);
 
-  va_start(args, message);
-  size = vsnprintf(ctx->messageBuffer, ctx->messageBufferSize, message, args);
-  va_end(args);
+  if (!ctx->deferredFormatting) {
+    clog_getMessage(&msg);
+  }
 
-  if(size >= ctx->messageBufferSize && ctx->messageBufferSize >= 3) {
-    // buffer overflow, let's indicate this
-    ctx->messageBuffer[ctx->messageBufferSize - 3] = '.';
-    ctx->messageBuffer[ctx->messageBufferSize - 2] = '.';
+  clog_dispatchMessage(ctx, site, &msg);
+}
+
+void clog_initMessage(CLogMessage *const msg,
+                      const CLogContext *const ctx,
+                      const CLogCallSite *const site,
+                      const bool temporary,
+                      const CLogStamp *const stamp,
+                      const CLogArgs *const args) {
+  const CLogMessage init = {site->file,
+                            site->line,
+                            site->function,
+                            NULL,
+                            clog_getFinalLevel(site->level),
+                            clog_getTagName(ctx, site->tag),
+                            args,
+                            ctx,
+                            temporary ? NULL : site,
+                            NULL,
+                            0,
+                            stamp->timestamp,
+                            stamp->sequence,
+                            stamp->threadId};
+
+  // CLogMessage has const members, so it can only be initialized as a whole
+  memcpy(msg, &init, sizeof(init));
+}
+
+void clog_dispatchBatch(const CLogContext *const ctx,
+                        CLogMessage messages[],
+                        const CLogCallSite *const sites[],
+                        const size_t count) {
+  bool singleAdapters = false;
+  for (size_t i = 0; i < ctx->adaptersSize; i++) {
+    singleAdapters = singleAdapters || NULL == ctx->adapters[i].onMessages;
   }
 
-  ctx->messageBuffer[ctx->messageBufferSize - 1] = 0;
+  // adapters without batch support get the messages one by one, formatted as usual
+  for (size_t m = 0; singleAdapters && m < count; m++) {
+    if (!ctx->deferredFormatting) {
+      clog_getMessage(&messages[m]);
+    }
+
+    for (size_t i = 0; i < ctx->adaptersSize; i++) {
+      const CLogAdapter *adapter = &ctx->adapters[i];
+      if (NULL == adapter->onMessages && clog_isAccepted(adapter, sites[m]) &&
+          (!adapter->messageFilter || adapter->messageFilter(&messages[m]))) {
+        adapter->onMessage(&messages[m]);
+      }
+    }
+  }
 
   for (size_t i = 0; i < ctx->adaptersSize; i++) {
-    if (!ctx->adapters[i].messageFilter || ctx->adapters[i].messageFilter(&msg)) {
-      ctx->adapters[i].onMessage(&msg);
+    if (NULL != ctx->adapters[i].onMessages) {
+      clog_dispatchToBatchAdapter(&ctx->adapters[i], messages, sites, count);
     }
   }
 }
 
+const char *clog_getMessage(const CLogMessage *const msg) {
+  if (NULL == msg) {
+    return NULL;
+  }
+
+  if (NULL == msg->message && NULL != msg->args && NULL != msg->context) {
+    const CLogContext *ctx = msg->context;
+    size_t size =
+        clog_formatArgsWith(ctx->messageBuffer, ctx->messageBufferSize, ctx->shortestFloats, msg->site, msg->args);
+    clog_terminateMessage(ctx->messageBuffer, ctx->messageBufferSize, size);
+
+    // Deferred messages are created by clog_logMessage(), so the object itself is not const.
+    ((CLogMessage *)msg)->message = ctx->messageBuffer;
+  }
+
+  return msg->message;
+}
+
+/**
+ * Returns the default line header layout for a message, see CLogContext::headerTime.
+ */
+static const CLogLayout *clog_lineHeaderLayout(const CLogMessage *const msg) {
+  return (NULL != msg->context && msg->context->headerTime) ? &timeHeaderLayout : &lineHeaderLayout;
+}
+
 void clog_formatLineHeader(char buffer[], int *const bufferLength, const CLogMessage *const msg) {
 
   if (NULL == buffer || NULL == bufferLength || *bufferLength < 1 || NULL == msg) {
     return;
   }
 
+  pthread_once(&defaultLayoutsOnce, clog_compileDefaultLayouts);
+
   int maxLength = *bufferLength;
+  size_t length = clog_formatLayout(buffer, maxLength, clog_lineHeaderLayout(msg), msg);
 
-  *bufferLength = snprintf(buffer,
-                           *bufferLength,
-                           lineHeaderFormat,
-                           clog_getColor(msg->level),
-                           clog_getLevel(msg->level),
-                           msg->tag,
-                           msg->file,
-                           msg->line,
-                           msg->function);
+  *bufferLength = (length > (size_t)maxLength) ? maxLength : (int)length;
+}
 
-  if (*bufferLength > maxLength) {
-    *bufferLength = maxLength;
+/**
+ * Formats a complete message line, see clog_formatMessage(). Uses the layout of the context if set.
+ */
+static void clog_formatLine(char buffer[], int *const bufferLength, const CLogMessage *const msg) {
+  pthread_once(&defaultLayoutsOnce, clog_compileDefaultLayouts);
+
+  const CLogLayout *head = clog_lineHeaderLayout(msg);
+  const CLogLayout *tail = &messageLayout;
+  if (NULL != msg->context && NULL != msg->context->layout) {
+    head = msg->context->layout;
+    tail = &newlineLayout;
+  }
+
+  size_t maxLength = (size_t)*bufferLength;
+  size_t usedBytes = clog_formatLayout(buffer, maxLength, head, msg);
+  if (usedBytes < maxLength) {
+    usedBytes += clog_formatLayout(&buffer[usedBytes], maxLength - usedBytes, tail, msg);
+  } else if (tail == &messageLayout) {
+    // the default line header doesn't fit, no end of line is added (as before layouts existed)
+    *bufferLength = (int)maxLength;
+    return;
   }
+
+  *bufferLength = (int)usedBytes;
+  buffer[maxLength - 2] = '\n';
+  buffer[maxLength - 1] = 0U;
 }
 
 void clog_formatMessage(char buffer[], int *const bufferLength, const CLogMessage *const msg) {
@@ -163,20 +622,49 @@ void clog_formatMessage(char buffer[], int *const bufferLength, const CLogMessag
   }
 
   int maxLength = *bufferLength;
+  int length = 0;
+  const char *line = clog_getLine(msg, &length);
+
+  // the cached line can only be reused if it is complete (it might have been truncated if it fills the whole line
+  // buffer) and fits
+  if (NULL != line && NULL != msg->context && length < (int)msg->context->lineBufferSize - 1 && length < maxLength) {
+    memcpy(buffer, line, length + 1);
+    *bufferLength = length;
+    buffer[maxLength - 2] = '\n';
+    buffer[maxLength - 1] = 0U;
+    return;
+  }
 
-  clog_formatLineHeader(buffer, bufferLength, msg);
+  clog_formatLine(buffer, bufferLength, msg);
+}
 
-  int usedBytes = *bufferLength;
-  if (*bufferLength >= maxLength) {
-    *bufferLength = maxLength;
-    return;
+const char *clog_getLine(const CLogMessage *const msg, int *const length) {
+  if (NULL == msg) {
+    return NULL;
   }
 
-  *bufferLength = snprintf(&buffer[usedBytes], (maxLength - usedBytes), " %s\n", msg->message);
+  if (NULL == msg->formattedLine) {
+    const CLogContext *ctx = msg->context;
+    if (NULL == ctx || NULL == ctx->lineBuffer || ctx->lineBufferSize < 2U) {
+      return NULL;
+    }
 
-  *bufferLength += usedBytes;
-  buffer[maxLength - 2] = '\n';
-  buffer[maxLength - 1] = 0U;
+    int size = (int)ctx->lineBufferSize;
+    clog_formatLine(ctx->lineBuffer, &size, msg);
+    if (size >= (int)ctx->lineBufferSize) {
+      // truncated
+      size = (int)ctx->lineBufferSize - 1;
+    }
+
+    // Messages are created by clog_logMessage(), so the object itself is not const.
+    ((CLogMessage *)msg)->formattedLine = ctx->lineBuffer;
+    ((CLogMessage *)msg)->formattedLineLength = size;
+  }
+
+  if (NULL != length) {
+    *length = msg->formattedLineLength;
+  }
+  return msg->formattedLine;
 }
 
 const char *clog_getLevel(const CLogLevel level) {
@@ -186,18 +674,15 @@ const char *clog_getLevel(const CLogLevel level) {
   return levelNames[level];
 }
 
-#ifdef CLOG_COLOR
-const char *clog_getColor(const CLogLevel level) {
+const char *clog_getLevelColor(const CLogLevel level) {
   if (level < 0 || level >= sizeof(levelColors) / sizeof(levelColors[0])) {
     return levelColors[CLOG_LUKN];
   }
   return levelColors[level];
 }
-#else
-static const char *clog_getColor(const CLogLevel level) {
-  // Suppress unused parameter warning
-  (void)(level);
 
-  return EmptyTag;
+#ifdef CLOG_COLOR
+const char *clog_getColor(const CLogLevel level) {
+  return clog_getLevelColor(level);
 }
 #endif
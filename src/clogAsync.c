@@ -0,0 +1,560 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Asynchronous log contexts.
+ * @date 2019-09-16
+ *
+ * @file
+ */
+
+#include "clogAsync.h"
+#include "clogInternal.h"
+#include <string.h>
+#include <time.h>
+
+// The dispatcher checks the ring at least this often, even if no producer wakes it up.
+#define WAIT_TIMEOUT_NS (100000000L)
+
+/**
+ * Ownership states of a per-thread ring.
+ */
+typedef enum _RingOwner {
+  RING_FREE,     ///< The ring can be claimed by a thread.
+  RING_OWNED,    ///< The ring is used by a thread.
+  RING_ORPHANED, ///< The owning thread has exited, the ring is freed as soon as it is empty.
+} RingOwner;
+
+static bool isPowerOfTwo(const size_t value) {
+  return (0U != value) && (0U == (value & (value - 1U)));
+}
+
+/**
+ * Messages taken out of the ring(s) but not yet passed to the adapters. The slots are handed back to the producers
+ * after the batch has been dispatched.
+ */
+typedef struct _Batch {
+  CLogMessage messages[CLOG_ASYNC_BATCH_SIZE];
+  const CLogCallSite *sites[CLOG_ASYNC_BATCH_SIZE];
+  size_t count;
+} Batch;
+
+static void addSlot(CLogAsync *async, Batch *batch, const CLogAsyncSlot *slot) {
+  const CLogStamp stamp = {slot->timestamp, slot->number, slot->threadId};
+  clog_initMessage(&batch->messages[batch->count], async->context, slot->site, slot->temporary, &stamp, &slot->args);
+  batch->sites[batch->count] = slot->site;
+  batch->count++;
+}
+
+static void dispatchBatch(CLogAsync *async, Batch *batch) {
+  if (batch->count > 0U) {
+    clog_dispatchBatch(async->context, batch->messages, batch->sites, batch->count);
+    batch->count = 0U;
+  }
+}
+
+/**
+ * Returns the next slot of the shared ring holding a message or NULL if the ring is empty. Only used by the
+ * dispatcher.
+ */
+static CLogAsyncSlot *peekSharedSlot(CLogAsync *async, const uint64_t head) {
+  CLogAsyncSlot *slot = &async->slots[head & (async->numberOfSlots - 1U)];
+
+  if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != head + 1U) {
+    return NULL;
+  }
+  return slot;
+}
+
+/**
+ * Passes all messages queued in the shared ring to the adapters, in batches of up to CLOG_ASYNC_BATCH_SIZE messages.
+ *
+ * @return size_t The number of messages processed.
+ */
+static size_t drainShared(CLogAsync *async) {
+  Batch batch;
+  size_t count = 0U;
+
+  batch.count = 0U;
+  for (;;) {
+    CLogAsyncSlot *slot = NULL;
+    if (batch.count < CLOG_ASYNC_BATCH_SIZE) {
+      slot = peekSharedSlot(async, async->head + batch.count);
+    }
+    if (NULL != slot) {
+      addSlot(async, &batch, slot);
+      continue;
+    }
+    if (0U == batch.count) {
+      return count;
+    }
+
+    const size_t dispatched = batch.count;
+    dispatchBatch(async, &batch);
+
+    // hand the slots back to the producers
+    for (size_t i = 0; i < dispatched; i++) {
+      slot = &async->slots[async->head & (async->numberOfSlots - 1U)];
+      __atomic_store_n(&slot->sequence, async->head + async->numberOfSlots, __ATOMIC_RELEASE);
+      async->head++;
+    }
+    count += dispatched;
+  }
+}
+
+static CLogAsyncSlot *ringSlot(CLogAsync *async, size_t ring, uint64_t position) {
+  return &async->slots[ring * async->slotsPerRing + (position & (async->slotsPerRing - 1U))];
+}
+
+/**
+ * Checks whether the next message of ring first has to be dispatched before the one of ring second: ordered by their
+ * timestamp, messages with the same timestamp by the index of their ring.
+ */
+static bool isBefore(CLogAsync *async, const uint64_t next[], size_t first, size_t second) {
+  const uint64_t firstTimestamp = ringSlot(async, first, next[first])->timestamp;
+  const uint64_t secondTimestamp = ringSlot(async, second, next[second])->timestamp;
+  return firstTimestamp < secondTimestamp || (firstTimestamp == secondTimestamp && first < second);
+}
+
+/**
+ * Restores the heap property of the rings (ordered by their next message, see isBefore()) below index.
+ */
+static void siftDown(CLogAsync *async, const uint64_t next[], size_t heap[], size_t heapSize, size_t index) {
+  for (;;) {
+    size_t smallest = index;
+    const size_t left = 2U * index + 1U;
+    const size_t right = left + 1U;
+
+    if (left < heapSize && isBefore(async, next, heap[left], heap[smallest])) {
+      smallest = left;
+    }
+    if (right < heapSize && isBefore(async, next, heap[right], heap[smallest])) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      return;
+    }
+
+    const size_t swap = heap[index];
+    heap[index] = heap[smallest];
+    heap[smallest] = swap;
+    index = smallest;
+  }
+}
+
+/**
+ * Dispatches a batch taken out of the per-thread rings and hands the slots back to the producers.
+ */
+static void dispatchRingBatch(CLogAsync *async, Batch *batch, const uint64_t next[]) {
+  dispatchBatch(async, batch);
+  for (size_t i = 0; i < async->numberOfRings; i++) {
+    if (next[i] != async->rings[i].head) {
+      __atomic_store_n(&async->rings[i].head, next[i], __ATOMIC_RELEASE);
+    }
+  }
+}
+
+/**
+ * Passes all messages queued in the per-thread rings to the adapters, in batches of up to CLOG_ASYNC_BATCH_SIZE
+ * messages. The messages that are available when the function is called are merged by their timestamp (k-way merge
+ * using a binary heap of the rings, see isBefore()).
+ *
+ * @return size_t The number of messages processed.
+ */
+static size_t drainRings(CLogAsync *async) {
+  size_t heap[async->numberOfRings];
+  uint64_t available[async->numberOfRings];
+  uint64_t next[async->numberOfRings];
+  size_t heapSize = 0U;
+  size_t count = 0U;
+  Batch batch;
+
+  batch.count = 0U;
+
+  for (size_t i = 0; i < async->numberOfRings; i++) {
+    CLogAsyncRing *ring = &async->rings[i];
+
+    // read the owner first, so that all messages of an orphaned ring are visible
+    const int owner = __atomic_load_n(&ring->owner, __ATOMIC_ACQUIRE);
+    available[i] = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - ring->head;
+    next[i] = ring->head;
+
+    if (available[i] > 0U) {
+      heap[heapSize++] = i;
+    } else if (RING_ORPHANED == owner) {
+      // the owner has gone and everything has been dispatched, so the ring can be reused
+      ring->head = 0U;
+      ring->tail = 0U;
+      ring->number = 0U;
+      next[i] = 0U;
+      __atomic_store_n(&ring->owner, RING_FREE, __ATOMIC_RELEASE);
+    }
+  }
+
+  for (size_t i = heapSize; i > 0U; i--) {
+    siftDown(async, next, heap, heapSize, i - 1U);
+  }
+
+  while (heapSize > 0U) {
+    const size_t i = heap[0];
+
+    addSlot(async, &batch, ringSlot(async, i, next[i]));
+    next[i]++;
+    count++;
+
+    if (0U == --available[i]) {
+      heap[0] = heap[--heapSize];
+    }
+    siftDown(async, next, heap, heapSize, 0U);
+
+    if (CLOG_ASYNC_BATCH_SIZE == batch.count) {
+      dispatchRingBatch(async, &batch, next);
+    }
+  }
+
+  dispatchRingBatch(async, &batch, next);
+  return count;
+}
+
+static size_t drain(CLogAsync *async) {
+  if (NULL != async->rings) {
+    return drainRings(async);
+  }
+  return drainShared(async);
+}
+
+static bool isEmpty(CLogAsync *async) {
+  if (NULL != async->rings) {
+    for (size_t i = 0; i < async->numberOfRings; i++) {
+      if (__atomic_load_n(&async->rings[i].tail, __ATOMIC_ACQUIRE) != async->rings[i].head) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return NULL == peekSharedSlot(async, async->head);
+}
+
+/**
+ * Called when a thread owning a ring exits.
+ */
+static void releaseRing(void *value) {
+  CLogAsyncRing *ring = (CLogAsyncRing *)value;
+  __atomic_store_n(&ring->owner, RING_ORPHANED, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns the ring of the calling thread, claims a free one on the first call.
+ */
+static CLogAsyncRing *threadRing(CLogAsync *async) {
+  CLogAsyncRing *ring = (CLogAsyncRing *)pthread_getspecific(async->ringKey);
+  if (NULL != ring) {
+    return ring;
+  }
+
+  for (size_t i = 0; i < async->numberOfRings; i++) {
+    int expected = RING_FREE;
+    if (__atomic_compare_exchange_n(
+            &async->rings[i].owner, &expected, RING_OWNED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      ring = &async->rings[i];
+      pthread_setspecific(async->ringKey, ring);
+      return ring;
+    }
+  }
+
+  return NULL;
+}
+
+static void *dispatcher(void *arg) {
+  CLogAsync *async = (CLogAsync *)arg;
+
+  while (__atomic_load_n(&async->running, __ATOMIC_ACQUIRE)) {
+    if (drain(async) > 0U) {
+      continue;
+    }
+
+    // Nothing to do, so wait for a producer. The producers check sleeping after publishing a message, the dispatcher
+    // checks the ring after setting sleeping, so at least one of them sees the other.
+    pthread_mutex_lock(&async->mutex);
+    __atomic_store_n(&async->sleeping, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (isEmpty(async) && __atomic_load_n(&async->running, __ATOMIC_ACQUIRE)) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += WAIT_TIMEOUT_NS;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&async->wakeup, &async->mutex, &deadline);
+    }
+
+    __atomic_store_n(&async->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&async->mutex);
+  }
+
+  drain(async);
+  return NULL;
+}
+
+static void wakeDispatcher(CLogAsync *async) {
+  pthread_mutex_lock(&async->mutex);
+  pthread_cond_signal(&async->wakeup);
+  pthread_mutex_unlock(&async->mutex);
+}
+
+bool clog_asyncStart(CLogContext *const ctx, CLogAsync *const async) {
+  if (false == clog_initContext(ctx) || NULL != ctx->async) {
+    return false;
+  }
+
+  if (NULL == async || NULL == async->slots || !isPowerOfTwo(async->numberOfSlots)) {
+    return false;
+  }
+
+  if (NULL != async->rings) {
+    if (0U == async->numberOfRings || !isPowerOfTwo(async->numberOfSlots / async->numberOfRings)) {
+      return false;
+    }
+
+    async->slotsPerRing = async->numberOfSlots / async->numberOfRings;
+    for (size_t i = 0; i < async->numberOfRings; i++) {
+      async->rings[i].head = 0U;
+      async->rings[i].tail = 0U;
+      async->rings[i].number = 0U;
+      async->rings[i].owner = RING_FREE;
+    }
+
+    if (0 != pthread_key_create(&async->ringKey, releaseRing)) {
+      return false;
+    }
+  }
+
+  // a shared ring numbers the messages by their positions, so it starts at the number of the last message
+  const uint64_t first = (NULL != async->rings) ? 0U : ctx->sequence;
+  for (size_t i = 0; i < async->numberOfSlots; i++) {
+    async->slots[(first + i) & (async->numberOfSlots - 1U)].sequence = first + i;
+  }
+
+  async->head = first;
+  async->tail = first;
+  async->dropped = 0U;
+  async->sleeping = 0;
+  async->running = true;
+  async->context = ctx;
+
+  bool mutexCreated = (0 == pthread_mutex_init(&async->mutex, NULL));
+  bool condCreated = mutexCreated && (0 == pthread_cond_init(&async->wakeup, NULL));
+
+  if (!condCreated || 0 != pthread_create(&async->thread, NULL, dispatcher, async)) {
+    if (condCreated) {
+      pthread_cond_destroy(&async->wakeup);
+    }
+    if (mutexCreated) {
+      pthread_mutex_destroy(&async->mutex);
+    }
+    if (NULL != async->rings) {
+      pthread_key_delete(async->ringKey);
+    }
+    return false;
+  }
+
+  ctx->async = async;
+  return true;
+}
+
+void clog_asyncStop(CLogContext *const ctx) {
+  if (NULL == ctx || NULL == ctx->async) {
+    return;
+  }
+
+  CLogAsync *async = ctx->async;
+
+  __atomic_store_n(&async->running, false, __ATOMIC_RELEASE);
+  wakeDispatcher(async);
+  pthread_join(async->thread, NULL);
+
+  pthread_cond_destroy(&async->wakeup);
+  pthread_mutex_destroy(&async->mutex);
+  if (NULL != async->rings) {
+    pthread_key_delete(async->ringKey);
+  } else {
+    ctx->sequence = async->tail;
+  }
+
+  ctx->async = NULL;
+}
+
+uint64_t clog_asyncDropped(const CLogAsync *const async) {
+  if (NULL == async) {
+    return 0U;
+  }
+  return __atomic_load_n(&async->dropped, __ATOMIC_RELAXED);
+}
+
+/**
+ * Reserves a slot in the shared ring.
+ *
+ * @param position Out: the position of the slot.
+ * @return CLogAsyncSlot* The slot or NULL if the ring is full.
+ */
+static CLogAsyncSlot *reserveSharedSlot(CLogAsync *async, uint64_t *position) {
+  const uint64_t mask = async->numberOfSlots - 1U;
+  *position = __atomic_load_n(&async->tail, __ATOMIC_RELAXED);
+
+  for (;;) {
+    CLogAsyncSlot *slot = &async->slots[*position & mask];
+    const uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    const int64_t difference = (int64_t)(sequence - *position);
+
+    if (0 == difference) {
+      if (__atomic_compare_exchange_n(
+              &async->tail, position, *position + 1U, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return slot;
+      }
+    } else if (difference < 0) {
+      return NULL;
+    } else {
+      *position = __atomic_load_n(&async->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/**
+ * Copies the name of a temporary call site into a buffer of a slot, cutting it at the front if it is too long.
+ */
+static const char *copyName(char buffer[CLOG_ASYNC_NAME_SIZE], const char *name) {
+  if (NULL == name) {
+    return NULL;
+  }
+
+  size_t length = strlen(name);
+  if (length >= CLOG_ASYNC_NAME_SIZE) {
+    name += length - (CLOG_ASYNC_NAME_SIZE - 1U);
+    length = CLOG_ASYNC_NAME_SIZE - 1U;
+  }
+  memcpy(buffer, name, length);
+  buffer[length] = 0;
+  return buffer;
+}
+
+/**
+ * Reserves a slot for a message, either in the ring of the calling thread or in the shared ring, and fills in the stamp
+ * and the call site. The message is numbered before, so a dropped message leaves a gap in the numbers. Counts the
+ * message as dropped if there is no slot available.
+ *
+ * @param ring     Out: the ring of the calling thread, NULL for the shared ring.
+ * @param position Out: the position of the slot.
+ * @return CLogAsyncSlot* The slot or NULL if the message has been dropped.
+ */
+static CLogAsyncSlot *reserveSlot(CLogAsync *const async,
+                                  const CLogCallSite *const site,
+                                  const bool temporary,
+                                  CLogAsyncRing **ring,
+                                  uint64_t *position) {
+  CLogAsyncSlot *slot = NULL;
+  CLogStamp stamp;
+
+  *ring = NULL;
+  if (NULL != async->rings) {
+    *ring = threadRing(async);
+    if (NULL != *ring) {
+      *position = (*ring)->tail;
+      if (*position - __atomic_load_n(&(*ring)->head, __ATOMIC_ACQUIRE) < async->slotsPerRing) {
+        slot = ringSlot(async, (size_t)(*ring - async->rings), *position);
+      }
+    }
+  } else {
+    slot = reserveSharedSlot(async, position);
+  }
+
+  if (NULL == slot) {
+    __atomic_fetch_add(&async->dropped, 1U, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  if (NULL != *ring) {
+    // only the owning thread writes the tail and the number
+    clog_stamp(async->context, &(*ring)->number, &stamp);
+  } else {
+    // the position continues the numbers of the context, see clog_asyncStart()
+    clog_stamp(async->context, NULL, &stamp);
+    stamp.sequence = *position + 1U;
+  }
+
+  slot->timestamp = stamp.timestamp;
+  slot->number = stamp.sequence;
+  slot->threadId = stamp.threadId;
+  if (temporary) {
+    slot->callSite = *site;
+    slot->callSite.file = copyName(slot->file, site->file);
+    slot->callSite.function = copyName(slot->function, site->function);
+    slot->callSite.formatCache = NULL;
+    slot->site = &slot->callSite;
+  } else {
+    slot->site = site;
+  }
+  slot->temporary = temporary;
+  return slot;
+}
+
+/**
+ * Publishes a filled slot to the dispatcher and wakes it up if it is sleeping.
+ */
+static void publishSlot(CLogAsync *const async, CLogAsyncRing *ring, CLogAsyncSlot *slot, const uint64_t position) {
+  if (NULL != ring) {
+    __atomic_store_n(&ring->tail, position + 1U, __ATOMIC_RELEASE);
+  } else {
+    __atomic_store_n(&slot->sequence, position + 1U, __ATOMIC_RELEASE);
+  }
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&async->sleeping, __ATOMIC_RELAXED)) {
+    wakeDispatcher(async);
+  }
+}
+
+bool clog_asyncPush(CLogAsync *const async, const CLogCallSite *const site, const bool temporary, va_list list) {
+  CLogAsyncRing *ring;
+  uint64_t position = 0U;
+  CLogAsyncSlot *slot = reserveSlot(async, site, temporary, &ring, &position);
+
+  if (NULL == slot) {
+    return false;
+  }
+
+  if (temporary) {
+    // the format string might not outlive the call
+    clog_captureFormatted(&slot->args, async->context->shortestFloats, site->format, list);
+    slot->callSite.format = slot->args.format;
+  } else {
+    clog_captureArgsWith(&slot->args, site, site->format, list);
+  }
+  publishSlot(async, ring, slot, position);
+  return true;
+}
+
+bool clog_asyncPushArgs(CLogAsync *const async,
+                        const CLogCallSite *const site,
+                        const bool temporary,
+                        const CLogArgs *const args) {
+  CLogAsyncRing *ring;
+  uint64_t position = 0U;
+  CLogAsyncSlot *slot = reserveSlot(async, site, temporary, &ring, &position);
+
+  if (NULL == slot) {
+    return false;
+  }
+
+  // only the used part of the argument bytes
+  slot->args.format = args->format;
+  slot->args.size = args->size;
+  slot->args.truncated = args->truncated;
+  memcpy(slot->args.data, args->data, args->size);
+  publishSlot(async, ring, slot, position);
+  return true;
+}
@@ -0,0 +1,562 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Binary log encoding.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * File layout (all numbers are unsigned LEB128 varints unless noted otherwise):
+ * - header: `CLOGBIN` and the format version (one byte each), the byte order marker (native uint16), the number of
+ *   type sizes and the sizes of the argument types (one byte each), the start time (native uint64, nanoseconds since
+ *   the epoch),
+ * - call site record: `S`, id, level (byte), tag index, line, message buffer size, flags (byte), file, function, tag
+ *   and format string (each as length and characters). The flags hold the formatting options of the context
+ *   (SITE_SHORTEST_FLOATS),
+ * - message record: `M`, call site id, level (byte), timestamp difference (zigzag), flags (byte), the number of bytes
+ *   and the raw argument bytes (or the message text if RECORD_TEXT_ARGS is set),
+ * - inline record for messages without call site record: `T`, level (byte), line, timestamp difference (zigzag), file,
+ *   function, tag and message text.
+ *
+ * The header is repeated at the start of every block of an indexed log (see clogIndex.h). It empties the call site
+ * dictionary (the ids start at zero again) and sets the time the following records are relative to.
+ */
+
+#include "clogBinary.h"
+#include "clogInternal.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#define FORMAT_VERSION ('2')
+#define BYTE_ORDER_MARKER (0x0102U)
+
+#define RECORD_SITE ('S')
+#define RECORD_MESSAGE ('M')
+#define RECORD_TEXT ('T')
+
+// Call site record flags
+#define SITE_SHORTEST_FLOATS (0x01U)
+
+// Message record flags
+#define RECORD_TRUNCATED (0x01U)
+#define RECORD_TEXT_ARGS (0x02U)
+
+// Used if a message record has been written without a context
+#define DEFAULT_MESSAGE_BUFFER_SIZE (1024U)
+// Larger message buffer sizes are considered as corruption
+#define MAX_MESSAGE_BUFFER_SIZE (1024U * 1024U)
+
+static const char Magic[] = {CLOG_BINARY_MAGIC, FORMAT_VERSION};
+
+// The sizes of all types captured by clog_captureArgs(), the raw arguments can only be decoded if they match
+static const unsigned char TypeSizes[] = {sizeof(int),
+                                          sizeof(long),
+                                          sizeof(long long),
+                                          sizeof(intmax_t),
+                                          sizeof(size_t),
+                                          sizeof(ptrdiff_t),
+                                          sizeof(double),
+                                          sizeof(long double),
+                                          sizeof(void *),
+                                          sizeof(wint_t),
+                                          sizeof(wchar_t)};
+
+// The size of the file header: magic, byte order marker, type sizes and start time
+#define HEADER_SIZE (sizeof(Magic) + sizeof(uint16_t) + 1U + sizeof(TypeSizes) + sizeof(uint64_t))
+
+/**
+ * Collects the bytes of a record, so it is passed to the file in as few writes as possible.
+ */
+typedef struct _Output {
+  FILE *file;
+  unsigned char data[512];
+  size_t size;
+  size_t written;
+  bool ok;
+} Output;
+
+/**
+ * Reads the records of a file.
+ */
+typedef struct _Input {
+  FILE *file;
+  bool ok;
+} Input;
+
+/**
+ * A call site read from a call site record.
+ */
+typedef struct _Entry {
+  CLogCallSite site;
+  char *tag;
+  size_t messageBufferSize;
+  bool shortestFloats;
+} Entry;
+
+static uint64_t realtime(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+
+static void initOutput(Output *output, FILE *file) {
+  output->file = file;
+  output->size = 0U;
+  output->written = 0U;
+  output->ok = true;
+}
+
+static void flush(Output *output) {
+  if (output->ok && output->size > 0U) {
+    output->ok = (fwrite(output->data, 1U, output->size, output->file) == output->size);
+  }
+  output->written += output->size;
+  output->size = 0U;
+}
+
+static void putBytes(Output *output, const void *data, size_t size) {
+  if (output->size + size > sizeof(output->data)) {
+    flush(output);
+    if (size > sizeof(output->data)) {
+      output->ok = output->ok && (fwrite(data, 1U, size, output->file) == size);
+      output->written += size;
+      return;
+    }
+  }
+  memcpy(&output->data[output->size], data, size);
+  output->size += size;
+}
+
+static void putByte(Output *output, unsigned char value) {
+  putBytes(output, &value, 1U);
+}
+
+static void putVarint(Output *output, uint64_t value) {
+  unsigned char bytes[10];
+  size_t size = 0U;
+
+  do {
+    bytes[size] = (unsigned char)(value & 0x7FU);
+    value >>= 7U;
+    if (0U != value) {
+      bytes[size] |= 0x80U;
+    }
+    size++;
+  } while (0U != value);
+
+  putBytes(output, bytes, size);
+}
+
+static void putString(Output *output, const char *text) {
+  size_t length = (NULL != text) ? strlen(text) : 0U;
+  putVarint(output, length);
+  putBytes(output, text, length);
+}
+
+/**
+ * Stores the wall-clock time of the message (see CLogMessage::timestamp) as difference to the last record, zigzag
+ * encoded as the messages of different threads might be written out of order.
+ *
+ * @return The time of the record.
+ */
+static uint64_t putTimestamp(Output *output, CLogBinaryWriter *writer, const CLogMessage *msg) {
+  uint64_t now = clog_wallClockTime(msg);
+  int64_t delta = (int64_t)(now - writer->lastTimestamp);
+  writer->lastTimestamp = now;
+  putVarint(output, ((uint64_t)delta << 1U) ^ (uint64_t)(delta >> 63));
+  return now;
+}
+
+/**
+ * Writes the file header, the timestamps of the following records are relative to CLogBinaryWriter::lastTimestamp.
+ */
+static void putHeader(Output *output, const CLogBinaryWriter *writer) {
+  const uint16_t byteOrder = BYTE_ORDER_MARKER;
+  putBytes(output, Magic, sizeof(Magic));
+  putBytes(output, &byteOrder, sizeof(byteOrder));
+  putByte(output, sizeof(TypeSizes));
+  putBytes(output, TypeSizes, sizeof(TypeSizes));
+  putBytes(output, &writer->lastTimestamp, sizeof(writer->lastTimestamp));
+}
+
+static size_t siteSlot(const CLogCallSite *site) {
+  return (size_t)((((uintptr_t)site) >> 3U) * 2654435761U) & (CLOG_BINARY_SITES - 1U);
+}
+
+/**
+ * Finds the id of a call site, writes the call site record if it is new.
+ *
+ * @return false If the dictionary is full.
+ */
+static bool siteId(CLogBinaryWriter *writer, Output *output, const CLogMessage *msg, uint32_t *id) {
+  const CLogCallSite *site = msg->site;
+  size_t slot = siteSlot(site);
+
+  while (NULL != writer->sites[slot]) {
+    if (site == writer->sites[slot]) {
+      *id = writer->ids[slot];
+      return true;
+    }
+    slot = (slot + 1U) & (CLOG_BINARY_SITES - 1U);
+  }
+
+  // keep some free slots to find the end of the probe sequences
+  if (writer->numberOfSites >= CLOG_BINARY_SITES - CLOG_BINARY_SITES / 4U) {
+    return false;
+  }
+
+  *id = writer->numberOfSites++;
+  writer->sites[slot] = site;
+  writer->ids[slot] = *id;
+
+  putByte(output, RECORD_SITE);
+  putVarint(output, *id);
+  putByte(output, (unsigned char)site->level);
+  putVarint(output, site->tag);
+  putVarint(output, site->line);
+  putVarint(output, (NULL != msg->context) ? msg->context->messageBufferSize : DEFAULT_MESSAGE_BUFFER_SIZE);
+  putByte(output, (NULL != msg->context && msg->context->shortestFloats) ? SITE_SHORTEST_FLOATS : 0U);
+  putString(output, site->file);
+  putString(output, site->function);
+  putString(output, msg->tag);
+  putString(output, site->format);
+  return true;
+}
+
+bool clog_binaryOpen(CLogBinaryWriter *const writer, FILE *const file) {
+  if (NULL == writer || NULL == file) {
+    return false;
+  }
+
+  memset(writer, 0, sizeof(*writer));
+  writer->file = file;
+  writer->lastTimestamp = realtime();
+  pthread_mutex_init(&writer->lock, NULL);
+
+  Output output;
+  initOutput(&output, file);
+  putHeader(&output, writer);
+  flush(&output);
+  writer->written = output.written;
+  return output.ok;
+}
+
+bool clog_binaryWrite(CLogBinaryWriter *const writer, const CLogMessage *const msg) {
+  if (NULL == writer || NULL == writer->file || NULL == msg) {
+    return false;
+  }
+
+  Output output;
+  initOutput(&output, writer->file);
+  uint32_t id = 0U;
+  uint64_t time = 0U;
+
+  pthread_mutex_lock(&writer->lock);
+
+  // every block of an indexed log starts with a header and an empty dictionary
+  if (clog_indexIsBlockStart(writer->index)) {
+    memset(writer->sites, 0, sizeof(writer->sites));
+    writer->numberOfSites = 0U;
+    putHeader(&output, writer);
+  }
+
+  if (NULL != msg->site && siteId(writer, &output, msg, &id)) {
+    putByte(&output, RECORD_MESSAGE);
+    putVarint(&output, id);
+    putByte(&output, (unsigned char)msg->level);
+    time = putTimestamp(&output, writer, msg);
+
+    // records holding the eagerly formatted text (see clog_captureArgs()) don't match the format of the site
+    if (NULL != msg->args && msg->args->format == msg->site->format) {
+      putByte(&output, msg->args->truncated ? RECORD_TRUNCATED : 0U);
+      putVarint(&output, msg->args->size);
+      putBytes(&output, msg->args->data, msg->args->size);
+    } else {
+      const char *text = clog_getMessage(msg);
+      size_t length = (NULL != text) ? strlen(text) : 0U;
+      putByte(&output, RECORD_TEXT_ARGS);
+      putVarint(&output, length);
+      putBytes(&output, text, length);
+    }
+  } else {
+    putByte(&output, RECORD_TEXT);
+    putByte(&output, (unsigned char)msg->level);
+    putVarint(&output, msg->line);
+    time = putTimestamp(&output, writer, msg);
+    putString(&output, msg->file);
+    putString(&output, msg->function);
+    putString(&output, msg->tag);
+    putString(&output, clog_getMessage(msg));
+  }
+
+  flush(&output);
+  writer->written += output.written;
+  clog_indexAdd(writer->index, msg, time, output.written);
+
+  pthread_mutex_unlock(&writer->lock);
+  return output.ok;
+}
+
+bool clog_binaryIndex(CLogBinaryWriter *const writer, CLogIndex *const index) {
+  if (NULL == writer || NULL == writer->file || NULL == index || index->fd < 0) {
+    return false;
+  }
+
+  pthread_mutex_lock(&writer->lock);
+  const bool ok = (NULL == writer->index);
+  if (ok) {
+    // the records written so far are unknown to the index, the header has no messages
+    if (writer->written > HEADER_SIZE) {
+      clog_indexAddUnknown(index, (size_t)writer->written);
+    } else {
+      clog_indexAdd(index, NULL, 0U, (size_t)writer->written);
+    }
+    writer->index = index;
+  }
+  pthread_mutex_unlock(&writer->lock);
+  return ok;
+}
+
+void clog_binaryClose(CLogBinaryWriter *const writer) {
+  if (NULL == writer || NULL == writer->file) {
+    return;
+  }
+
+  fflush(writer->file);
+  clog_indexClose(writer->index);
+  writer->index = NULL;
+  writer->file = NULL;
+  pthread_mutex_destroy(&writer->lock);
+}
+
+static void getBytes(Input *input, void *data, size_t size) {
+  if (input->ok && fread(data, 1U, size, input->file) != size) {
+    input->ok = false;
+  }
+}
+
+static unsigned char getByte(Input *input) {
+  unsigned char value = 0U;
+  getBytes(input, &value, 1U);
+  return value;
+}
+
+static uint64_t getVarint(Input *input) {
+  uint64_t value = 0U;
+
+  for (unsigned int shift = 0U; input->ok && shift < 64U; shift += 7U) {
+    unsigned char byte = getByte(input);
+    value |= (uint64_t)(byte & 0x7FU) << shift;
+    if (0U == (byte & 0x80U)) {
+      return value;
+    }
+  }
+
+  input->ok = false;
+  return 0U;
+}
+
+static int64_t getTimestampDelta(Input *input) {
+  uint64_t value = getVarint(input);
+  return (int64_t)(value >> 1U) ^ -(int64_t)(value & 1U);
+}
+
+/**
+ * Reads a string into a new buffer, which has to be freed by the caller.
+ */
+static char *getString(Input *input) {
+  uint64_t length = getVarint(input);
+  if (!input->ok || length >= MAX_MESSAGE_BUFFER_SIZE) {
+    input->ok = false;
+    return NULL;
+  }
+
+  char *text = malloc((size_t)length + 1U);
+  if (NULL == text) {
+    input->ok = false;
+    return NULL;
+  }
+
+  getBytes(input, text, (size_t)length);
+  text[length] = 0;
+  return text;
+}
+
+static void freeEntry(Entry *entry) {
+  free((void *)entry->site.file);
+  free((void *)entry->site.function);
+  free((void *)entry->site.format);
+  free(entry->tag);
+}
+
+static bool readHeader(Input *input, uint64_t *timestamp) {
+  char magic[sizeof(Magic)];
+  uint16_t byteOrder = 0U;
+  unsigned char typeSizes[sizeof(TypeSizes)];
+
+  getBytes(input, magic, sizeof(magic));
+  getBytes(input, &byteOrder, sizeof(byteOrder));
+  if (!input->ok || 0 != memcmp(magic, Magic, sizeof(Magic)) || BYTE_ORDER_MARKER != byteOrder ||
+      sizeof(TypeSizes) != getByte(input)) {
+    return false;
+  }
+
+  getBytes(input, typeSizes, sizeof(typeSizes));
+  getBytes(input, timestamp, sizeof(*timestamp));
+  return input->ok && 0 == memcmp(typeSizes, TypeSizes, sizeof(TypeSizes));
+}
+
+static bool readSite(Input *input, Entry **entries, size_t *numberOfEntries) {
+  uint64_t id = getVarint(input);
+  if (!input->ok || id != *numberOfEntries) {
+    return false;
+  }
+
+  Entry *resized = realloc(*entries, (*numberOfEntries + 1U) * sizeof(Entry));
+  if (NULL == resized) {
+    return false;
+  }
+  *entries = resized;
+
+  Entry *entry = &resized[*numberOfEntries];
+  memset(entry, 0, sizeof(*entry));
+  entry->site.level = (CLogLevel)getByte(input);
+  entry->site.tag = (size_t)getVarint(input);
+  entry->site.line = (unsigned int)getVarint(input);
+  entry->messageBufferSize = (size_t)getVarint(input);
+  entry->shortestFloats = (0U != (getByte(input) & SITE_SHORTEST_FLOATS));
+  entry->site.file = getString(input);
+  entry->site.function = getString(input);
+  entry->tag = getString(input);
+  entry->site.format = getString(input);
+  (*numberOfEntries)++;
+
+  if (0U == entry->messageBufferSize || entry->messageBufferSize > MAX_MESSAGE_BUFFER_SIZE) {
+    input->ok = false;
+  }
+  return input->ok;
+}
+
+bool clog_binaryRead(FILE *const file, const CLogBinaryCallback callback, void *const userData) {
+  if (NULL == file || NULL == callback) {
+    return false;
+  }
+
+  Input input = {file, true};
+  uint64_t timestamp = 0U;
+  if (!readHeader(&input, &timestamp)) {
+    return false;
+  }
+
+  Entry *entries = NULL;
+  size_t numberOfEntries = 0U;
+  char *messageBuffer = malloc(MAX_MESSAGE_BUFFER_SIZE);
+  CLogArgs *args = malloc(sizeof(CLogArgs));
+  bool ok = (NULL != messageBuffer && NULL != args);
+
+  while (ok) {
+    int type = fgetc(file);
+    if (EOF == type) {
+      break;
+    }
+
+    if (Magic[0] == type) {
+      // a repeated header starts a new block with an empty dictionary
+      ungetc(type, file);
+      ok = readHeader(&input, &timestamp);
+      for (size_t i = 0; i < numberOfEntries; i++) {
+        freeEntry(&entries[i]);
+      }
+      numberOfEntries = 0U;
+    } else if (RECORD_SITE == type) {
+      ok = readSite(&input, &entries, &numberOfEntries);
+    } else if (RECORD_MESSAGE == type) {
+      uint64_t id = getVarint(&input);
+      CLogLevel level = (CLogLevel)getByte(&input);
+      timestamp += (uint64_t)getTimestampDelta(&input);
+      unsigned char flags = getByte(&input);
+      uint64_t size = getVarint(&input);
+
+      if (!input.ok || id >= numberOfEntries || size >= MAX_MESSAGE_BUFFER_SIZE ||
+          (0U == (flags & RECORD_TEXT_ARGS) && size > CLOG_ARGS_SIZE)) {
+        ok = false;
+        break;
+      }
+
+      const Entry *entry = &entries[id];
+      const char *text = NULL;
+      if (0U != (flags & RECORD_TEXT_ARGS)) {
+        getBytes(&input, messageBuffer, (size_t)size);
+        messageBuffer[size] = 0;
+        text = messageBuffer;
+      } else {
+        args->format = entry->site.format;
+        args->size = (size_t)size;
+        args->truncated = (0U != (flags & RECORD_TRUNCATED));
+        getBytes(&input, args->data, (size_t)size);
+      }
+
+      CLogContext context = {.minLevel = CLOG_LTRC,
+                             .messageBuffer = messageBuffer,
+                             .messageBufferSize = entry->messageBufferSize,
+                             .shortestFloats = entry->shortestFloats};
+      CLogMessage msg = {.file = entry->site.file,
+                         .line = entry->site.line,
+                         .function = entry->site.function,
+                         .message = text,
+                         .level = level,
+                         .tag = entry->tag,
+                         .args = (NULL == text) ? args : NULL,
+                         .context = &context,
+                         .site = &entry->site,
+                         .timestamp = timestamp};
+      ok = input.ok;
+      if (ok) {
+        callback(&msg, timestamp, userData);
+      }
+    } else if (RECORD_TEXT == type) {
+      CLogLevel level = (CLogLevel)getByte(&input);
+      unsigned int line = (unsigned int)getVarint(&input);
+      timestamp += (uint64_t)getTimestampDelta(&input);
+      char *fileName = getString(&input);
+      char *function = getString(&input);
+      char *tag = getString(&input);
+      char *text = getString(&input);
+
+      CLogMessage msg = {.file = fileName,
+                         .line = line,
+                         .function = function,
+                         .message = text,
+                         .level = level,
+                         .tag = tag,
+                         .timestamp = timestamp};
+      ok = input.ok;
+      if (ok) {
+        callback(&msg, timestamp, userData);
+      }
+
+      free(fileName);
+      free(function);
+      free(tag);
+      free(text);
+    } else {
+      ok = false;
+    }
+  }
+
+  for (size_t i = 0; i < numberOfEntries; i++) {
+    freeEntry(&entries[i]);
+  }
+  free(entries);
+  free(messageBuffer);
+  free(args);
+  return ok;
+}
@@ -0,0 +1,223 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Runtime switches for single log statements.
+ * @date 2019-09-16
+ *
+ * @file
+ */
+
+#include "clogCallSite.h"
+#include "clogInternal.h"
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * A query together with the mode to be set for the matching call sites.
+ */
+typedef struct _Rule {
+  CLogCallSiteQuery query;
+  CLogCallSiteMode mode;
+} Rule;
+
+// Protects all of the following. Only taken when call sites are registered or the rules change.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static CLogCallSite *registeredSites = NULL;
+static Rule rules[CLOG_CALL_SITE_RULES];
+static size_t numberOfRules = 0U;
+
+bool clog_matchGlob(const char *pattern, const char *text) {
+  if (NULL == pattern || NULL == text) {
+    return false;
+  }
+
+  // position after the last `*` seen in the pattern and the text it is currently matched against
+  const char *starPattern = NULL;
+  const char *starText = NULL;
+
+  while (0 != *text) {
+    if ('*' == *pattern) {
+      starPattern = ++pattern;
+      starText = text;
+    } else if ('?' == *pattern || *pattern == *text) {
+      pattern++;
+      text++;
+    } else if (NULL != starPattern) {
+      // let the last `*` swallow one more character
+      pattern = starPattern;
+      text = ++starText;
+    } else {
+      return false;
+    }
+  }
+
+  while ('*' == *pattern) {
+    pattern++;
+  }
+
+  return 0 == *pattern;
+}
+
+static bool matches(const CLogCallSiteQuery *query, const CLogCallSite *site) {
+  if (NULL != query->file && !clog_matchGlob(query->file, site->file)) {
+    return false;
+  }
+
+  if (NULL != query->function && !clog_matchGlob(query->function, site->function)) {
+    return false;
+  }
+
+  if (site->line < query->firstLine || (0U != query->lastLine && site->line > query->lastLine)) {
+    return false;
+  }
+
+  if (0U != query->levels && (site->level >= 32U || 0U == (query->levels & CLOG_LEVEL_MASK(site->level)))) {
+    return false;
+  }
+
+  if (0U != query->tags && (site->tag >= 64U || 0U == (query->tags & CLOG_TAG_MASK(site->tag)))) {
+    return false;
+  }
+
+  return true;
+}
+
+static unsigned char modeFlags(const CLogCallSiteMode mode) {
+  switch (mode) {
+  case CLOG_SITE_DISABLE:
+    return CLOG_SITE_DISABLED;
+  case CLOG_SITE_ENABLE:
+    return CLOG_SITE_FORCED;
+  default:
+    return 0U;
+  }
+}
+
+static void setFlags(CLogCallSite *site, const unsigned char flags) {
+  __atomic_store_n(&site->flags, flags, __ATOMIC_RELAXED);
+}
+
+/**
+ * Applies the rules to a call site, the last matching rule wins.
+ */
+static unsigned char ruleFlags(const CLogCallSite *site) {
+  unsigned char flags = 0U;
+  for (size_t i = 0; i < numberOfRules; i++) {
+    if (matches(&rules[i].query, site)) {
+      flags = modeFlags(rules[i].mode);
+    }
+  }
+  return flags;
+}
+
+static bool isSamePattern(const char *first, const char *second) {
+  return (NULL == first || NULL == second) ? first == second : 0 == strcmp(first, second);
+}
+
+static bool isSameQuery(const CLogCallSiteQuery *first, const CLogCallSiteQuery *second) {
+  return isSamePattern(first->file, second->file) && isSamePattern(first->function, second->function) &&
+         first->firstLine == second->firstLine && first->lastLine == second->lastLine &&
+         first->levels == second->levels && first->tags == second->tags;
+}
+
+/**
+ * Removes the rule with the same query, if there is one.
+ */
+static void removeRule(const CLogCallSiteQuery *query) {
+  for (size_t i = 0; i < numberOfRules; i++) {
+    if (isSameQuery(&rules[i].query, query)) {
+      // keep the order of the other rules
+      memmove(&rules[i], &rules[i + 1U], (numberOfRules - i - 1U) * sizeof(rules[0]));
+      numberOfRules--;
+      return;
+    }
+  }
+}
+
+unsigned char clog_registerCallSite(CLogCallSite *const site) {
+  pthread_mutex_lock(&lock);
+
+  unsigned char flags = site->flags;
+  if (0U != (flags & CLOG_SITE_NEW)) {
+    flags = ruleFlags(site);
+    site->next = registeredSites;
+    registeredSites = site;
+    setFlags(site, flags);
+  }
+
+  pthread_mutex_unlock(&lock);
+  return flags;
+}
+
+bool clog_setCallSites(const CLogCallSiteQuery *const query, const CLogCallSiteMode mode) {
+  if (NULL == query || mode > CLOG_SITE_ENABLE) {
+    return false;
+  }
+
+  pthread_mutex_lock(&lock);
+
+  // toggling the same call sites on and off doesn't fill up the rules
+  removeRule(query);
+  if (numberOfRules >= CLOG_CALL_SITE_RULES) {
+    pthread_mutex_unlock(&lock);
+    return false;
+  }
+  rules[numberOfRules].query = *query;
+  rules[numberOfRules].mode = mode;
+  numberOfRules++;
+
+  // default rules only matter to override other rules
+  bool overriding = false;
+  for (size_t i = 0; i < numberOfRules; i++) {
+    overriding = overriding || CLOG_SITE_DEFAULT != rules[i].mode;
+  }
+  if (!overriding) {
+    numberOfRules = 0U;
+  }
+
+  for (CLogCallSite *site = registeredSites; NULL != site; site = site->next) {
+    if (matches(query, site)) {
+      setFlags(site, ruleFlags(site));
+    }
+  }
+
+  pthread_mutex_unlock(&lock);
+  return true;
+}
+
+void clog_resetCallSites(void) {
+  pthread_mutex_lock(&lock);
+
+  numberOfRules = 0U;
+  for (CLogCallSite *site = registeredSites; NULL != site; site = site->next) {
+    setFlags(site, 0U);
+  }
+
+  pthread_mutex_unlock(&lock);
+}
+
+size_t clog_findCallSites(const CLogCallSiteQuery *const query, const CLogCallSite *sites[], const size_t size) {
+  if (NULL == query || (NULL == sites && 0U != size)) {
+    return 0U;
+  }
+
+  size_t count = 0U;
+
+  pthread_mutex_lock(&lock);
+
+  for (const CLogCallSite *site = registeredSites; NULL != site; site = site->next) {
+    if (matches(query, site)) {
+      if (count < size) {
+        sites[count] = site;
+      }
+      count++;
+    }
+  }
+
+  pthread_mutex_unlock(&lock);
+  return count;
+}
@@ -0,0 +1,132 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Clocks stamping the messages.
+ * @date 2019-09-16
+ *
+ * @file
+ */
+
+#include "clogClock.h"
+#include "clogInternal.h"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define CLOG_HAS_TSC
+#endif
+
+// How long the time stamp counter is compared with CLOCK_MONOTONIC during calibration
+#define TSC_CALIBRATION_NS (5000000U)
+
+static uint64_t readClock(clockid_t clock) {
+  struct timespec now;
+  clock_gettime(clock, &now);
+  return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+
+uint64_t clog_clockMonotonic(void) {
+  return readClock(CLOCK_MONOTONIC);
+}
+
+uint64_t clog_clockMonotonicCoarse(void) {
+#if defined(CLOCK_MONOTONIC_COARSE)
+  return readClock(CLOCK_MONOTONIC_COARSE);
+#else
+  return readClock(CLOCK_MONOTONIC);
+#endif
+}
+
+uint64_t clog_clockRealtime(void) {
+  return readClock(CLOCK_REALTIME);
+}
+
+#if defined(CLOG_HAS_TSC)
+
+static pthread_once_t tscOnce = PTHREAD_ONCE_INIT;
+static bool tscUsable;        ///< Set if the counter is invariant (constant rate, not stopped in sleep states).
+static uint64_t tscBaseTicks; ///< The counter at the end of the calibration.
+static uint64_t tscBaseTime;  ///< CLOCK_MONOTONIC at the end of the calibration.
+static uint64_t tscScale;     ///< ns per tick as 32.32 fixed point number.
+
+/**
+ * Measures the rate of the time stamp counter against CLOCK_MONOTONIC.
+ */
+static void calibrateTsc(void) {
+  unsigned int eax, ebx, ecx, edx;
+
+  // CPUID.80000007H:EDX[8] is the invariant TSC flag
+  if (0 == __get_cpuid(0x80000007U, &eax, &ebx, &ecx, &edx) || 0U == (edx & (1U << 8U))) {
+    return;
+  }
+
+  const uint64_t startTime = clog_clockMonotonic();
+  const uint64_t startTicks = __rdtsc();
+  uint64_t endTime;
+  uint64_t endTicks;
+  do {
+    endTime = clog_clockMonotonic();
+    endTicks = __rdtsc();
+  } while (endTime - startTime < TSC_CALIBRATION_NS);
+
+  if (endTicks <= startTicks) {
+    return;
+  }
+
+  tscScale = ((endTime - startTime) << 32U) / (endTicks - startTicks);
+  tscBaseTicks = endTicks;
+  tscBaseTime = endTime;
+  tscUsable = true;
+}
+
+uint64_t clog_clockTsc(void) {
+  pthread_once(&tscOnce, calibrateTsc);
+  if (!tscUsable) {
+    return clog_clockMonotonic();
+  }
+
+  // the counter of another core might lag a few ticks behind the base, don't let the difference wrap around
+  const uint64_t now = __rdtsc();
+  const uint64_t ticks = (now > tscBaseTicks) ? now - tscBaseTicks : 0U;
+  // ticks * scale >> 32 without overflowing 64 bits
+  return tscBaseTime + (ticks >> 32U) * tscScale + (((ticks & 0xFFFFFFFFU) * tscScale) >> 32U);
+}
+
+#else
+
+uint64_t clog_clockTsc(void) {
+  return clog_clockMonotonic();
+}
+
+#endif
+
+uint32_t clog_threadId(void) {
+  static __thread uint32_t threadId;
+
+  if (0U == threadId) {
+#if defined(__linux__)
+    threadId = (uint32_t)syscall(SYS_gettid);
+#else
+    static uint32_t numberOfThreads;
+    threadId = __atomic_add_fetch(&numberOfThreads, 1U, __ATOMIC_RELAXED);
+#endif
+  }
+  return threadId;
+}
+
+void clog_stamp(const CLogContext *const ctx, uint64_t *const counter, CLogStamp *const stamp) {
+  stamp->timestamp = (NULL != ctx->clock) ? ctx->clock() : clog_clockMonotonic();
+  stamp->sequence = (NULL != counter) ? __atomic_add_fetch(counter, 1U, __ATOMIC_RELAXED) : 0U;
+  stamp->threadId = clog_threadId();
+}
@@ -0,0 +1,696 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Streaming block compression of log output.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * The compressor finds matches with a hash table of the last position of every 4 byte sequence (no chains), which is
+ * fast and finds most repetitions of log output. The streams are cookie streams (see fopencookie()).
+ */
+
+// for fopencookie()
+#define _GNU_SOURCE
+
+#include "clogCompress.h"
+#include "clogInternal.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define HASH_BITS (12U)
+#define LENGTH_MASK (15U)
+
+static const unsigned char FrameMagic[] = {'C', 'L', 'Z', '1'};
+
+/**
+ * Reads a decompressed stream.
+ */
+typedef struct _Decompressor {
+  FILE *file;
+  long base;             // the position of file when the stream has been created, -1 if it cannot seek
+  bool compressed;       // false if the data is passed on as is
+  bool magicRead;        // the magic of the next frame has been read already
+  unsigned char *data;   // the data of the current frame
+  size_t dataSize;       // the size of the data buffer
+  size_t position;       // the read position within data
+  size_t length;         // the length of data
+  uint64_t next;         // the offset (in the decompressed data) following data
+  unsigned char *stored; // the stored data of the current frame
+  size_t storedSize;     // the size of the stored buffer
+} Decompressor;
+
+static uint32_t read32(const unsigned char *data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static size_t hashOf(uint32_t value) {
+  return (size_t)((value * 2654435761U) >> (32U - HASH_BITS));
+}
+
+static void putLittleEndian32(unsigned char *data, uint32_t value) {
+  for (size_t i = 0; i < 4U; i++) {
+    data[i] = (unsigned char)(value >> (8U * i));
+  }
+}
+
+static uint32_t getLittleEndian32(const unsigned char *data) {
+  uint32_t value = 0U;
+  for (size_t i = 0; i < 4U; i++) {
+    value |= (uint32_t)data[i] << (8U * i);
+  }
+  return value;
+}
+
+/**
+ * Writes the part of a length that doesn't fit into the token.
+ */
+static bool putLength(unsigned char *out, size_t *used, size_t capacity, size_t length) {
+  for (; length >= 255U; length -= 255U) {
+    if (*used >= capacity) {
+      return false;
+    }
+    out[(*used)++] = 255U;
+  }
+  if (*used >= capacity) {
+    return false;
+  }
+  out[(*used)++] = (unsigned char)length;
+  return true;
+}
+
+static bool getLength(const unsigned char *in, size_t *position, size_t size, size_t *length) {
+  unsigned char byte;
+  do {
+    if (*position >= size || *length > SIZE_MAX / 2U) {
+      return false;
+    }
+    byte = in[(*position)++];
+    *length += byte;
+  } while (255U == byte);
+  return true;
+}
+
+/**
+ * Writes a sequence of literals and an optional match (matchLength is zero for the last sequence).
+ */
+static bool putSequence(unsigned char *out,
+                        size_t *used,
+                        size_t capacity,
+                        const unsigned char *literals,
+                        size_t literalLength,
+                        size_t matchLength,
+                        size_t offset) {
+  const size_t literalCode = (literalLength < LENGTH_MASK) ? literalLength : LENGTH_MASK;
+  size_t matchCode = 0U;
+  if (matchLength > 0U) {
+    matchCode = matchLength - CLOG_COMPRESS_MIN_MATCH;
+    matchCode = (matchCode < LENGTH_MASK) ? matchCode : LENGTH_MASK;
+  }
+
+  if (*used >= capacity) {
+    return false;
+  }
+  out[(*used)++] = (unsigned char)((literalCode << 4U) | matchCode);
+  if (LENGTH_MASK == literalCode && !putLength(out, used, capacity, literalLength - LENGTH_MASK)) {
+    return false;
+  }
+
+  if (capacity - *used < literalLength) {
+    return false;
+  }
+  memcpy(&out[*used], literals, literalLength);
+  *used += literalLength;
+  if (0U == matchLength) {
+    return true;
+  }
+
+  if (capacity - *used < 2U) {
+    return false;
+  }
+  out[(*used)++] = (unsigned char)(offset & 0xFFU);
+  out[(*used)++] = (unsigned char)(offset >> 8U);
+  return LENGTH_MASK != matchCode ||
+         putLength(out, used, capacity, matchLength - CLOG_COMPRESS_MIN_MATCH - LENGTH_MASK);
+}
+
+size_t clog_compress(const void *const source, const size_t size, void *const destination, const size_t capacity) {
+  if (NULL == source || NULL == destination || size > CLOG_COMPRESS_MAX_BLOCK_SIZE) {
+    return 0U;
+  }
+
+  const unsigned char *in = (const unsigned char *)source;
+  unsigned char *out = (unsigned char *)destination;
+  // positions + 1 of the last occurrence of a hash, zero if none
+  uint32_t table[1U << HASH_BITS];
+  memset(table, 0, sizeof(table));
+  size_t used = 0U;
+  size_t anchor = 0U;
+  size_t i = 0U;
+
+  while (i + CLOG_COMPRESS_MIN_MATCH <= size) {
+    const uint32_t value = read32(&in[i]);
+    const size_t hash = hashOf(value);
+    const size_t candidate = table[hash];
+    table[hash] = (uint32_t)(i + 1U);
+
+    if (0U == candidate || i - (candidate - 1U) > CLOG_COMPRESS_MAX_OFFSET || read32(&in[candidate - 1U]) != value) {
+      i++;
+      continue;
+    }
+
+    const size_t match = candidate - 1U;
+    size_t length = CLOG_COMPRESS_MIN_MATCH;
+    while (i + length < size && in[match + length] == in[i + length]) {
+      length++;
+    }
+    if (!putSequence(out, &used, capacity, &in[anchor], i - anchor, length, i - match)) {
+      return 0U;
+    }
+    i += length;
+    anchor = i;
+  }
+
+  if (!putSequence(out, &used, capacity, &in[anchor], size - anchor, 0U, 0U)) {
+    return 0U;
+  }
+  return used;
+}
+
+bool clog_decompress(const void *const source,
+                     const size_t size,
+                     void *const destination,
+                     const size_t capacity,
+                     size_t *const length) {
+  if (NULL == source || NULL == destination || NULL == length) {
+    return false;
+  }
+
+  const unsigned char *in = (const unsigned char *)source;
+  unsigned char *out = (unsigned char *)destination;
+  size_t position = 0U;
+  size_t used = 0U;
+
+  while (true) {
+    if (position >= size) {
+      return false;
+    }
+    const unsigned char token = in[position++];
+
+    size_t literalLength = token >> 4U;
+    if (LENGTH_MASK == literalLength && !getLength(in, &position, size, &literalLength)) {
+      return false;
+    }
+    if (size - position < literalLength || capacity - used < literalLength) {
+      return false;
+    }
+    memcpy(&out[used], &in[position], literalLength);
+    position += literalLength;
+    used += literalLength;
+
+    // the last sequence has no match
+    if (position == size) {
+      break;
+    }
+
+    if (size - position < 2U) {
+      return false;
+    }
+    const size_t offset = (size_t)in[position] | ((size_t)in[position + 1U] << 8U);
+    position += 2U;
+    size_t matchLength = token & LENGTH_MASK;
+    if (LENGTH_MASK == matchLength && !getLength(in, &position, size, &matchLength)) {
+      return false;
+    }
+    matchLength += CLOG_COMPRESS_MIN_MATCH;
+    if (0U == offset || offset > used || capacity - used < matchLength) {
+      return false;
+    }
+
+    // byte by byte, the match may overlap the bytes being written
+    for (size_t i = 0; i < matchLength; i++) {
+      out[used + i] = out[used - offset + i];
+    }
+    used += matchLength;
+  }
+
+  *length = used;
+  return true;
+}
+
+static char *block(CLogCompressor *compressor, size_t index) {
+  return &compressor->blocks[index * compressor->blockSize];
+}
+
+/**
+ * Compresses a block into the frame buffer and writes it, see clog_writeAll().
+ */
+static void writeFrame(CLogCompressor *compressor, const char *data, size_t length) {
+  unsigned char *frame = (unsigned char *)compressor->frame;
+  size_t stored = clog_compress(data,
+                                length,
+                                &frame[CLOG_COMPRESS_FRAME_HEADER_SIZE],
+                                CLOG_COMPRESS_BOUND(compressor->blockSize));
+
+  memcpy(frame, FrameMagic, sizeof(FrameMagic));
+  if (0U == stored || stored >= length) {
+    stored = length;
+    frame[4] = CLOG_COMPRESS_FRAME_STORED;
+    memcpy(&frame[CLOG_COMPRESS_FRAME_HEADER_SIZE], data, length);
+  } else {
+    frame[4] = CLOG_COMPRESS_FRAME_LZ;
+  }
+  putLittleEndian32(&frame[5], (uint32_t)length);
+  putLittleEndian32(&frame[9], (uint32_t)stored);
+
+  const size_t size = CLOG_COMPRESS_FRAME_HEADER_SIZE + stored;
+  if (clog_writeAll(compressor->fd, frame, size, -1, NULL) < size) {
+    compressor->errors++;
+    return;
+  }
+
+  compressor->frames++;
+  compressor->bytesOut += size;
+}
+
+/**
+ * The compressor thread: writes the full blocks in order.
+ */
+static void *compressorThread(void *arg) {
+  CLogCompressor *compressor = (CLogCompressor *)arg;
+
+  pthread_mutex_lock(&compressor->mutex);
+  while (true) {
+    while (0U == compressor->lengths[compressor->next] && !compressor->stopping) {
+      pthread_cond_wait(&compressor->filled, &compressor->mutex);
+    }
+    if (0U == compressor->lengths[compressor->next]) {
+      break;
+    }
+
+    const size_t index = compressor->next;
+    const size_t length = compressor->lengths[index];
+    pthread_mutex_unlock(&compressor->mutex);
+    writeFrame(compressor, block(compressor, index), length);
+    pthread_mutex_lock(&compressor->mutex);
+
+    compressor->lengths[index] = 0U;
+    compressor->next = (index + 1U) % compressor->numberOfBlocks;
+    pthread_cond_broadcast(&compressor->freed);
+  }
+  pthread_mutex_unlock(&compressor->mutex);
+  return NULL;
+}
+
+/**
+ * Hands the current block to the compressor thread, waiting for the next block if it is still in use.
+ */
+static void submit(CLogCompressor *compressor) {
+  if (0U == compressor->used) {
+    return;
+  }
+
+  pthread_mutex_lock(&compressor->mutex);
+  compressor->lengths[compressor->current] = compressor->used;
+  pthread_cond_signal(&compressor->filled);
+
+  compressor->current = (compressor->current + 1U) % compressor->numberOfBlocks;
+  if (0U != compressor->lengths[compressor->current]) {
+    compressor->waits++;
+    while (0U != compressor->lengths[compressor->current]) {
+      pthread_cond_wait(&compressor->freed, &compressor->mutex);
+    }
+  }
+  pthread_mutex_unlock(&compressor->mutex);
+  compressor->used = 0U;
+}
+
+bool clog_compressorOpen(CLogCompressor *const compressor, const int fd) {
+  if (NULL == compressor || NULL == compressor->blocks || NULL == compressor->frame || fd < 0) {
+    return false;
+  }
+  if (0U == compressor->blockSize || compressor->blockSize > CLOG_COMPRESS_MAX_BLOCK_SIZE ||
+      compressor->numberOfBlocks < 2U || compressor->numberOfBlocks > CLOG_COMPRESS_MAX_BLOCKS) {
+    return false;
+  }
+
+  compressor->frames = 0U;
+  compressor->bytesIn = 0U;
+  compressor->bytesOut = 0U;
+  compressor->waits = 0U;
+  compressor->errors = 0U;
+  compressor->fd = fd;
+  compressor->stream = NULL;
+  compressor->current = 0U;
+  compressor->used = 0U;
+  compressor->next = 0U;
+  memset(compressor->lengths, 0, sizeof(compressor->lengths));
+  compressor->stopping = false;
+
+  bool mutexCreated = (0 == pthread_mutex_init(&compressor->mutex, NULL));
+  bool filledCreated = mutexCreated && (0 == pthread_cond_init(&compressor->filled, NULL));
+  bool freedCreated = filledCreated && (0 == pthread_cond_init(&compressor->freed, NULL));
+
+  if (!freedCreated || 0 != pthread_create(&compressor->thread, NULL, compressorThread, compressor)) {
+    if (freedCreated) {
+      pthread_cond_destroy(&compressor->freed);
+    }
+    if (filledCreated) {
+      pthread_cond_destroy(&compressor->filled);
+    }
+    if (mutexCreated) {
+      pthread_mutex_destroy(&compressor->mutex);
+    }
+    compressor->fd = -1;
+    return false;
+  }
+  return true;
+}
+
+void clog_compressorWrite(CLogCompressor *const compressor, const void *const data, const size_t size) {
+  if (NULL == compressor || compressor->fd < 0 || NULL == data) {
+    return;
+  }
+
+  const char *bytes = (const char *)data;
+  size_t remaining = size;
+  while (remaining > 0U) {
+    const size_t space = compressor->blockSize - compressor->used;
+    const size_t length = (remaining < space) ? remaining : space;
+    memcpy(&block(compressor, compressor->current)[compressor->used], bytes, length);
+    compressor->used += length;
+    bytes += length;
+    remaining -= length;
+    if (compressor->used == compressor->blockSize) {
+      submit(compressor);
+    }
+  }
+  compressor->bytesIn += size;
+}
+
+void clog_compressorSubmit(CLogCompressor *const compressor) {
+  if (NULL == compressor || compressor->fd < 0) {
+    return;
+  }
+
+  if (NULL != compressor->stream) {
+    fflush(compressor->stream);
+  }
+  submit(compressor);
+}
+
+void clog_compressorFlush(CLogCompressor *const compressor) {
+  if (NULL == compressor || compressor->fd < 0) {
+    return;
+  }
+
+  if (NULL != compressor->stream) {
+    fflush(compressor->stream);
+  }
+  submit(compressor);
+
+  pthread_mutex_lock(&compressor->mutex);
+  for (size_t i = 0; i < compressor->numberOfBlocks; i++) {
+    while (0U != compressor->lengths[i]) {
+      pthread_cond_wait(&compressor->freed, &compressor->mutex);
+    }
+  }
+  pthread_mutex_unlock(&compressor->mutex);
+}
+
+void clog_compressorClose(CLogCompressor *const compressor) {
+  if (NULL == compressor || compressor->fd < 0) {
+    return;
+  }
+
+  if (NULL != compressor->stream) {
+    fclose(compressor->stream);
+    compressor->stream = NULL;
+  }
+  submit(compressor);
+
+  pthread_mutex_lock(&compressor->mutex);
+  compressor->stopping = true;
+  pthread_cond_signal(&compressor->filled);
+  pthread_mutex_unlock(&compressor->mutex);
+  pthread_join(compressor->thread, NULL);
+
+  pthread_cond_destroy(&compressor->freed);
+  pthread_cond_destroy(&compressor->filled);
+  pthread_mutex_destroy(&compressor->mutex);
+  compressor->fd = -1;
+}
+
+static ssize_t writeStream(void *cookie, const char *data, size_t size) {
+  clog_compressorWrite((CLogCompressor *)cookie, data, size);
+  return (ssize_t)size;
+}
+
+FILE *clog_compressorStream(CLogCompressor *const compressor) {
+  if (NULL == compressor || compressor->fd < 0) {
+    return NULL;
+  }
+
+  if (NULL == compressor->stream) {
+    const cookie_io_functions_t functions = {NULL, writeStream, NULL, NULL};
+    compressor->stream = fopencookie(compressor, "w", functions);
+  }
+  return compressor->stream;
+}
+
+/**
+ * Makes sure a buffer of the decompressor holds size bytes.
+ */
+static bool reserve(unsigned char **buffer, size_t *bufferSize, size_t size) {
+  if (size <= *bufferSize) {
+    return true;
+  }
+
+  unsigned char *resized = realloc(*buffer, size);
+  if (NULL == resized) {
+    return false;
+  }
+  *buffer = resized;
+  *bufferSize = size;
+  return true;
+}
+
+/**
+ * Reads and checks the header of the next frame.
+ *
+ * @return 1 if a header has been read, 0 at the end of the file, -1 if the frame is corrupted.
+ */
+static int readFrameHeader(Decompressor *decompressor, unsigned char *type, size_t *length, size_t *stored) {
+  unsigned char header[CLOG_COMPRESS_FRAME_HEADER_SIZE];
+  size_t offset = 0U;
+
+  if (decompressor->magicRead) {
+    memcpy(header, FrameMagic, sizeof(FrameMagic));
+    offset = sizeof(FrameMagic);
+    decompressor->magicRead = false;
+  }
+
+  const size_t size = fread(&header[offset], 1U, sizeof(header) - offset, decompressor->file);
+  if (0U == offset && 0U == size) {
+    return 0;
+  }
+  if (sizeof(header) - offset != size || 0 != memcmp(header, FrameMagic, sizeof(FrameMagic))) {
+    return -1;
+  }
+
+  *type = header[4];
+  *length = getLittleEndian32(&header[5]);
+  *stored = getLittleEndian32(&header[9]);
+  if (*length > CLOG_COMPRESS_MAX_BLOCK_SIZE || *stored > CLOG_COMPRESS_BOUND(*length)) {
+    return -1;
+  }
+  return 1;
+}
+
+/**
+ * Reads and decompresses the frame whose header has just been read.
+ */
+static bool readFrame(Decompressor *decompressor, unsigned char type, size_t length, size_t stored) {
+  if (!reserve(&decompressor->data, &decompressor->dataSize, length) ||
+      !reserve(&decompressor->stored, &decompressor->storedSize, stored) ||
+      fread(decompressor->stored, 1U, stored, decompressor->file) != stored) {
+    return false;
+  }
+
+  decompressor->position = 0U;
+  decompressor->length = 0U;
+  if (CLOG_COMPRESS_FRAME_STORED == type && stored == length) {
+    memcpy(decompressor->data, decompressor->stored, length);
+  } else if (CLOG_COMPRESS_FRAME_LZ != type ||
+             !clog_decompress(decompressor->stored, stored, decompressor->data, length, &decompressor->length) ||
+             decompressor->length != length) {
+    return false;
+  }
+
+  decompressor->length = length;
+  decompressor->next += length;
+  return true;
+}
+
+/**
+ * The offset of the next byte read from the stream.
+ */
+static uint64_t readPosition(const Decompressor *decompressor) {
+  return decompressor->next - (decompressor->length - decompressor->position);
+}
+
+static ssize_t readStream(void *cookie, char *data, size_t size) {
+  Decompressor *decompressor = (Decompressor *)cookie;
+
+  while (decompressor->position == decompressor->length) {
+    if (!decompressor->compressed) {
+      const size_t length = fread(data, 1U, size, decompressor->file);
+      decompressor->next += length;
+      return (ssize_t)length;
+    }
+
+    unsigned char type = 0U;
+    size_t length = 0U;
+    size_t stored = 0U;
+    const int result = readFrameHeader(decompressor, &type, &length, &stored);
+    if (0 == result) {
+      return 0;
+    }
+    if (result < 0 || !readFrame(decompressor, type, length, stored)) {
+      errno = EIO;
+      return -1;
+    }
+  }
+
+  const size_t available = decompressor->length - decompressor->position;
+  const size_t length = (size < available) ? size : available;
+  memcpy(data, &decompressor->data[decompressor->position], length);
+  decompressor->position += length;
+  return (ssize_t)length;
+}
+
+/**
+ * Moves to an offset of the decompressed data. Frames before it are skipped by their headers, without being read.
+ */
+static int seekStream(void *cookie, off64_t *offset, int whence) {
+  Decompressor *decompressor = (Decompressor *)cookie;
+  const uint64_t current = readPosition(decompressor);
+  const uint64_t start = decompressor->next - decompressor->length;
+  const int64_t target = (SEEK_SET == whence) ? (int64_t)*offset : (int64_t)current + (int64_t)*offset;
+
+  if ((SEEK_SET != whence && SEEK_CUR != whence) || target < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // within the current frame
+  if ((uint64_t)target >= start && (uint64_t)target <= decompressor->next) {
+    decompressor->position = (size_t)((uint64_t)target - start);
+    *offset = target;
+    return 0;
+  }
+
+  if (decompressor->base < 0) {
+    errno = ESPIPE;
+    return -1;
+  }
+
+  decompressor->position = 0U;
+  decompressor->length = 0U;
+  if (!decompressor->compressed) {
+    if (0 != fseek(decompressor->file, decompressor->base + (long)target, SEEK_SET)) {
+      return -1;
+    }
+    decompressor->next = (uint64_t)target;
+    *offset = target;
+    return 0;
+  }
+
+  if ((uint64_t)target < start) {
+    if (0 != fseek(decompressor->file, decompressor->base, SEEK_SET)) {
+      return -1;
+    }
+    decompressor->next = 0U;
+    decompressor->magicRead = false;
+  }
+
+  while (true) {
+    unsigned char type = 0U;
+    size_t length = 0U;
+    size_t stored = 0U;
+    const int result = readFrameHeader(decompressor, &type, &length, &stored);
+    if (0 == result) {
+      // beyond the end, reading returns EOF
+      break;
+    }
+    if (result < 0) {
+      errno = EIO;
+      return -1;
+    }
+
+    if ((uint64_t)target < decompressor->next + length) {
+      if (!readFrame(decompressor, type, length, stored)) {
+        errno = EIO;
+        return -1;
+      }
+      decompressor->position = (size_t)((uint64_t)target - (decompressor->next - length));
+      break;
+    }
+    if (0 != fseek(decompressor->file, (long)stored, SEEK_CUR)) {
+      return -1;
+    }
+    decompressor->next += length;
+  }
+
+  *offset = (off64_t)readPosition(decompressor);
+  return 0;
+}
+
+static int closeStream(void *cookie) {
+  Decompressor *decompressor = (Decompressor *)cookie;
+  free(decompressor->data);
+  free(decompressor->stored);
+  free(decompressor);
+  return 0;
+}
+
+FILE *clog_decompressStream(FILE *const file) {
+  if (NULL == file) {
+    return NULL;
+  }
+
+  Decompressor *decompressor = calloc(1U, sizeof(Decompressor));
+  if (NULL == decompressor || !reserve(&decompressor->data, &decompressor->dataSize, sizeof(FrameMagic))) {
+    free(decompressor);
+    return NULL;
+  }
+  decompressor->file = file;
+  decompressor->base = ftell(file);
+
+  // uncompressed data is passed on, starting with the bytes read to check the magic
+  const size_t size = fread(decompressor->data, 1U, sizeof(FrameMagic), file);
+  if (sizeof(FrameMagic) == size && 0 == memcmp(decompressor->data, FrameMagic, sizeof(FrameMagic))) {
+    decompressor->compressed = true;
+    decompressor->magicRead = true;
+  } else {
+    decompressor->length = size;
+    decompressor->next = size;
+  }
+
+  const cookie_io_functions_t functions = {readStream, NULL, seekStream, closeStream};
+  FILE *stream = fopencookie(decompressor, "r", functions);
+  if (NULL == stream) {
+    closeStream(decompressor);
+  }
+  return stream;
+}
@@ -0,0 +1,462 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Buffered file adapter.
+ * @date 2019-09-16
+ *
+ * @file
+ */
+
+#include "clogFile.h"
+#include "clogInternal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The permissions of created log files.
+ */
+#define FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+/**
+ * How long the rotation thread waits before it tries again to create the next file.
+ */
+#define RETRY_TIMEOUT_S (1)
+
+/**
+ * Writes the buffer to the file, see clog_writeAll().
+ */
+static void flush(CLogFile *file) {
+  if (NULL != file->compressor) {
+    if (file->used > 0U) {
+      clog_compressorWrite(file->compressor, file->buffer, file->used);
+      file->writes++;
+      file->size += file->used;
+    }
+    file->used = 0U;
+    return;
+  }
+
+  const size_t written = clog_writeAll(file->fd, file->buffer, file->used, -1, &file->writes);
+  if (written < file->used) {
+    file->errors++;
+  }
+
+  file->size += written;
+  file->used = 0U;
+}
+
+/**
+ * Writes the buffer if the flush policy asks for it. If the interval or the level of the policy asks for it, the
+ * current block of a compressed file is compressed and written as well, otherwise the lines would only be collected in
+ * it. The size of the policy only bounds the buffer, the compressor writes full blocks anyway.
+ */
+static void flushIfDue(CLogFile *file, const CLogMessage messages[], const size_t count) {
+  if (!clog_isFlushDue(&file->policy, file->used, file->oldest, messages, count)) {
+    return;
+  }
+
+  CLogFilePolicy urgent = file->policy;
+  urgent.size = SIZE_MAX;
+  const bool submit = NULL != file->compressor && clog_isFlushDue(&urgent, 0U, file->oldest, messages, count);
+
+  flush(file);
+  if (submit) {
+    clog_compressorSubmit(file->compressor);
+  }
+}
+
+/**
+ * Formats the line of a message into the buffer, writing the buffer first if the line might not fit.
+ */
+static void appendLine(CLogFile *file, const CLogMessage *msg) {
+  if (CLOG_FILE_BUFFER_SIZE - file->used < CLOG_FILE_LINE_SIZE) {
+    flush(file);
+  }
+  if (0U == file->used) {
+    file->oldest = msg->timestamp;
+  }
+  if (UINT64_MAX == file->started) {
+    file->started = msg->timestamp;
+  }
+
+  const size_t length = clog_formatFileLine(&file->buffer[file->used], msg);
+  file->used += length;
+  clog_indexAdd(file->index, msg, clog_wallClockTime(msg), length);
+}
+
+/**
+ * Swaps the next file in if the rotation is due and it is ready, handing the current file to the rotation thread. The
+ * buffered lines are written to the current file first, they belong to it.
+ */
+static void rotateIfDue(CLogFile *file, const uint64_t timestamp) {
+  if (!file->rotating) {
+    return;
+  }
+
+  const bool bySize = 0U != file->rotation.size && file->size >= file->rotation.size;
+  const bool byTime = 0U != file->rotation.interval && UINT64_MAX != file->started &&
+                      timestamp - file->started >= file->rotation.interval;
+  if (!bySize && !byTime) {
+    return;
+  }
+
+  // the rotation thread opens the next file only after it has finished the previous rotation
+  pthread_mutex_lock(&file->mutex);
+  const int spare = file->spare;
+  if (spare < 0) {
+    pthread_mutex_unlock(&file->mutex);
+    file->postponed++;
+    return;
+  }
+  flush(file);
+  __atomic_store_n(&file->spare, -1, __ATOMIC_RELEASE);
+  file->retired = file->fd;
+  pthread_cond_signal(&file->wakeup);
+  pthread_mutex_unlock(&file->mutex);
+
+  file->fd = spare;
+  file->size = 0U;
+  file->started = UINT64_MAX;
+  file->rotations++;
+}
+
+/**
+ * Checks that a pattern has a %s followed by a %u and no other conversions.
+ */
+static bool isValidPattern(const char *pattern) {
+  const char expected[] = {'s', 'u'};
+  size_t found = 0U;
+
+  for (const char *c = pattern; '\0' != *c; c++) {
+    if ('%' != *c) {
+      continue;
+    }
+    c++;
+    if ('%' == *c) {
+      continue;
+    }
+    if (found >= sizeof(expected) || expected[found] != *c) {
+      return false;
+    }
+    found++;
+  }
+  return sizeof(expected) == found;
+}
+
+/**
+ * Formats the name of a rotated file.
+ */
+static bool rotatedName(const CLogFile *file, char name[CLOG_FILE_PATH_SIZE], const unsigned int index) {
+  const int length = snprintf(name, CLOG_FILE_PATH_SIZE, file->rotation.pattern, file->path, index);
+  return length >= 0 && length < (int)CLOG_FILE_PATH_SIZE;
+}
+
+/**
+ * Formats the name of the next file.
+ */
+static bool spareName(const CLogFile *file, char name[CLOG_FILE_PATH_SIZE]) {
+  const int length = snprintf(name, CLOG_FILE_PATH_SIZE, "%s" CLOG_FILE_SPARE_SUFFIX, file->path);
+  return length >= 0 && length < (int)CLOG_FILE_PATH_SIZE;
+}
+
+/**
+ * Renames the rotated files, then the next file to the path. The descriptors stay valid.
+ */
+static void renameFiles(const CLogFile *file) {
+  char from[CLOG_FILE_PATH_SIZE];
+  char to[CLOG_FILE_PATH_SIZE];
+
+  if (file->rotation.keep > 0U) {
+    for (unsigned int i = file->rotation.keep - 1U; i > 0U; i--) {
+      rotatedName(file, from, i);
+      rotatedName(file, to, i + 1U);
+      rename(from, to);
+    }
+    rotatedName(file, to, 1U);
+    rename(file->path, to);
+  }
+
+  // replaces the path if keep is zero
+  spareName(file, from);
+  rename(from, file->path);
+}
+
+/**
+ * The rotation thread: finishes rotations and keeps the next file ready.
+ */
+static void *rotator(void *arg) {
+  CLogFile *file = (CLogFile *)arg;
+  char name[CLOG_FILE_PATH_SIZE];
+
+  spareName(file, name);
+  pthread_mutex_lock(&file->mutex);
+  while (true) {
+    if (file->retired >= 0) {
+      const int retired = file->retired;
+      pthread_mutex_unlock(&file->mutex);
+      renameFiles(file);
+      close(retired);
+      pthread_mutex_lock(&file->mutex);
+      file->retired = -1;
+      continue;
+    }
+    if (file->stopping) {
+      break;
+    }
+
+    // no write can swap the next file in while it is missing, so the one opened here is never in use
+    if (file->spare < 0) {
+      pthread_mutex_unlock(&file->mutex);
+      const int spare = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, FILE_MODE);
+      pthread_mutex_lock(&file->mutex);
+      __atomic_store_n(&file->spare, spare, __ATOMIC_RELEASE);
+      if (spare >= 0 || file->stopping) {
+        continue;
+      }
+
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += RETRY_TIMEOUT_S;
+      pthread_cond_timedwait(&file->wakeup, &file->mutex, &deadline);
+      continue;
+    }
+
+    pthread_cond_wait(&file->wakeup, &file->mutex);
+  }
+  pthread_mutex_unlock(&file->mutex);
+  return NULL;
+}
+
+/**
+ * Stops the rotation thread and removes the next file.
+ */
+static void stopRotation(CLogFile *file) {
+  pthread_mutex_lock(&file->mutex);
+  file->stopping = true;
+  pthread_cond_signal(&file->wakeup);
+  pthread_mutex_unlock(&file->mutex);
+  pthread_join(file->thread, NULL);
+
+  pthread_cond_destroy(&file->wakeup);
+  pthread_mutex_destroy(&file->mutex);
+  file->rotating = false;
+
+  const int spare = __atomic_exchange_n(&file->spare, -1, __ATOMIC_ACQ_REL);
+  if (spare >= 0) {
+    char name[CLOG_FILE_PATH_SIZE];
+    spareName(file, name);
+    unlink(name);
+    close(spare);
+  }
+}
+
+size_t clog_formatFileLine(char buffer[], const CLogMessage *const msg) {
+  int length = (int)CLOG_FILE_LINE_SIZE;
+  clog_formatMessage(buffer, &length, msg);
+  if (length >= (int)CLOG_FILE_LINE_SIZE) {
+    // truncated, clog_formatMessage() has terminated the line with '\n' anyway
+    length = (int)CLOG_FILE_LINE_SIZE - 1;
+  }
+  return (size_t)length;
+}
+
+bool clog_isFlushDue(const CLogFilePolicy *const policy,
+                     const size_t used,
+                     const uint64_t oldest,
+                     const CLogMessage messages[],
+                     const size_t count) {
+  if (used >= policy->size) {
+    return true;
+  }
+  if (0U != policy->interval && messages[count - 1U].timestamp - oldest >= policy->interval) {
+    return true;
+  }
+
+  for (size_t i = 0; policy->level < CLOG_LOFF && i < count; i++) {
+    if (messages[i].level >= policy->level) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t clog_writeAll(const int fd, const void *const data, const size_t length, const int64_t offset, uint64_t *calls) {
+  const char *bytes = (const char *)data;
+  size_t written = 0U;
+
+  while (written < length) {
+    const ssize_t result = (offset < 0) ? write(fd, &bytes[written], length - written)
+                                        : pwrite(fd, &bytes[written], length - written, (off_t)offset + (off_t)written);
+    if (NULL != calls) {
+      (*calls)++;
+    }
+    if (result < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      break;
+    }
+    written += (size_t)result;
+  }
+  return written;
+}
+
+bool clog_fileOpen(CLogFile *const file, const char *const path, const CLogFilePolicy *const policy) {
+  if (NULL == file || NULL == path) {
+    return false;
+  }
+
+  file->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, FILE_MODE);
+  if (NULL != policy) {
+    file->policy = *policy;
+  } else {
+    file->policy.size = 0U;
+    file->policy.interval = 0U;
+    file->policy.level = CLOG_LOFF;
+  }
+  file->writes = 0U;
+  file->errors = 0U;
+  file->oldest = 0U;
+  file->used = 0U;
+
+  struct stat status;
+  file->size = (file->fd >= 0 && 0 == fstat(file->fd, &status)) ? (uint64_t)status.st_size : 0U;
+  file->started = UINT64_MAX;
+  file->rotations = 0U;
+  file->postponed = 0U;
+  file->rotating = false;
+  file->spare = -1;
+  file->retired = -1;
+  file->compressor = NULL;
+  file->index = NULL;
+  if (strlen(path) < sizeof(file->path)) {
+    strcpy(file->path, path);
+  } else {
+    file->path[0] = '\0';
+  }
+  return file->fd >= 0;
+}
+
+void clog_fileWrite(CLogFile *const file, const CLogMessage *const msg) {
+  if (NULL == file || file->fd < 0 || NULL == msg) {
+    return;
+  }
+
+  appendLine(file, msg);
+  flushIfDue(file, msg, 1U);
+  rotateIfDue(file, msg->timestamp);
+}
+
+void clog_fileWriteBatch(CLogFile *const file, const CLogMessage messages[], const size_t count) {
+  if (NULL == file || file->fd < 0 || NULL == messages || 0U == count) {
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    appendLine(file, &messages[i]);
+  }
+  flushIfDue(file, messages, count);
+  rotateIfDue(file, messages[count - 1U].timestamp);
+}
+
+void clog_fileFlush(CLogFile *const file) {
+  if (NULL == file || file->fd < 0) {
+    return;
+  }
+
+  flush(file);
+  clog_compressorFlush(file->compressor);
+}
+
+bool clog_fileCompress(CLogFile *const file, CLogCompressor *const compressor) {
+  if (NULL == file || file->fd < 0 || file->rotating || NULL != file->compressor) {
+    return false;
+  }
+
+  flush(file);
+  if (!clog_compressorOpen(compressor, file->fd)) {
+    return false;
+  }
+  file->compressor = compressor;
+  return true;
+}
+
+bool clog_fileIndex(CLogFile *const file, CLogIndex *const index) {
+  if (NULL == file || file->fd < 0 || file->rotating || NULL != file->index || NULL == index || index->fd < 0) {
+    return false;
+  }
+
+  // the lines written so far are unknown to the index
+  clog_indexAddUnknown(index, (size_t)(file->size + file->used));
+  file->index = index;
+  return true;
+}
+
+bool clog_fileStartRotation(CLogFile *const file, const CLogFileRotation *const rotation) {
+  if (NULL == file || file->fd < 0 || file->rotating || NULL != file->compressor || NULL != file->index ||
+      NULL == rotation) {
+    return false;
+  }
+  if (0U == rotation->size && 0U == rotation->interval) {
+    return false;
+  }
+
+  file->rotation = *rotation;
+  if (NULL == file->rotation.pattern) {
+    file->rotation.pattern = "%s.%u";
+  }
+
+  char name[CLOG_FILE_PATH_SIZE];
+  if ('\0' == file->path[0] || !isValidPattern(file->rotation.pattern) || !spareName(file, name) ||
+      !rotatedName(file, name, file->rotation.keep)) {
+    return false;
+  }
+
+  file->stopping = false;
+  file->spare = -1;
+  file->retired = -1;
+
+  bool mutexCreated = (0 == pthread_mutex_init(&file->mutex, NULL));
+  bool condCreated = mutexCreated && (0 == pthread_cond_init(&file->wakeup, NULL));
+
+  if (!condCreated || 0 != pthread_create(&file->thread, NULL, rotator, file)) {
+    if (condCreated) {
+      pthread_cond_destroy(&file->wakeup);
+    }
+    if (mutexCreated) {
+      pthread_mutex_destroy(&file->mutex);
+    }
+    return false;
+  }
+
+  file->rotating = true;
+  return true;
+}
+
+void clog_fileClose(CLogFile *const file) {
+  if (NULL == file || file->fd < 0) {
+    return;
+  }
+
+  flush(file);
+  if (file->rotating) {
+    stopRotation(file);
+  }
+  if (NULL != file->compressor) {
+    clog_compressorClose(file->compressor);
+    file->compressor = NULL;
+  }
+  clog_indexClose(file->index);
+  file->index = NULL;
+  close(file->fd);
+  file->fd = -1;
+}
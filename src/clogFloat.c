@@ -0,0 +1,665 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Decimal digits of doubles, exactly rounded like glibc does.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * A double is m * 2^e. Its digits are taken from the exact value of r / s, where r and s are integers:
+ * - as long as r and s fit into 128 bits, the digits rounded at the requested position are computed with a single
+ *   division (the common case for the magnitudes and precisions used in log messages),
+ * - otherwise the digits are generated one by one using big integers (Steele & White / Dragon4).
+ *
+ * The shortest digits reading back as the same double are generated with the algorithm of Burger & Dybvig, which
+ * tracks the distance to the neighbouring doubles in addition. It runs on 128 bit integers as long as the numbers fit
+ * (again the common case), on big integers otherwise.
+ */
+
+#include "clogInternal.h"
+#include <string.h>
+
+// The number of 32 bit limbs of a big integer, enough for 10^340 * 2^64 and 2^1080 * 10
+#define LIMBS (40U)
+
+/**
+ * Unsigned big integer.
+ */
+typedef struct _BigInt {
+  size_t size;           ///< The number of limbs used, no leading zero limbs.
+  uint32_t limbs[LIMBS]; ///< The limbs, least significant first.
+} BigInt;
+
+static const uint64_t Pow10[] = {1ULL,
+                                 10ULL,
+                                 100ULL,
+                                 1000ULL,
+                                 10000ULL,
+                                 100000ULL,
+                                 1000000ULL,
+                                 10000000ULL,
+                                 100000000ULL,
+                                 1000000000ULL,
+                                 10000000000ULL,
+                                 100000000000ULL,
+                                 1000000000000ULL,
+                                 10000000000000ULL,
+                                 100000000000000ULL,
+                                 1000000000000000ULL,
+                                 10000000000000000ULL,
+                                 100000000000000000ULL,
+                                 1000000000000000000ULL,
+                                 10000000000000000000ULL};
+
+#define MAX_POW10 (19)
+
+static void bigSet(BigInt *b, uint64_t value) {
+  b->size = 0U;
+  while (0U != value) {
+    b->limbs[b->size++] = (uint32_t)value;
+    value >>= 32U;
+  }
+}
+
+static void bigMultiply(BigInt *b, const uint32_t factor) {
+  uint64_t carry = 0U;
+  for (size_t i = 0; i < b->size; i++) {
+    carry += (uint64_t)b->limbs[i] * factor;
+    b->limbs[i] = (uint32_t)carry;
+    carry >>= 32U;
+  }
+  if (0U != carry) {
+    b->limbs[b->size++] = (uint32_t)carry;
+  }
+}
+
+static void bigMultiplyPow10(BigInt *b, unsigned int exponent) {
+  while (exponent >= 9U) {
+    bigMultiply(b, 1000000000U);
+    exponent -= 9U;
+  }
+  if (0U != exponent) {
+    bigMultiply(b, (uint32_t)Pow10[exponent]);
+  }
+}
+
+static void bigShiftLeft(BigInt *b, unsigned int bits) {
+  if (0U == b->size) {
+    return;
+  }
+
+  const size_t words = bits / 32U;
+  bits %= 32U;
+
+  if (0U != bits) {
+    const uint32_t top = b->limbs[b->size - 1U] >> (32U - bits);
+    for (size_t i = b->size - 1U; i > 0U; i--) {
+      b->limbs[i] = (b->limbs[i] << bits) | (b->limbs[i - 1U] >> (32U - bits));
+    }
+    b->limbs[0] <<= bits;
+    if (0U != top) {
+      b->limbs[b->size++] = top;
+    }
+  }
+
+  if (0U != words) {
+    memmove(&b->limbs[words], b->limbs, b->size * sizeof(b->limbs[0]));
+    memset(b->limbs, 0, words * sizeof(b->limbs[0]));
+    b->size += words;
+  }
+}
+
+static int bigCompare(const BigInt *a, const BigInt *b) {
+  if (a->size != b->size) {
+    return (a->size < b->size) ? -1 : 1;
+  }
+  for (size_t i = a->size; i-- > 0U;) {
+    if (a->limbs[i] != b->limbs[i]) {
+      return (a->limbs[i] < b->limbs[i]) ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Compares a + b with c.
+ */
+static int bigCompareSum(const BigInt *a, const BigInt *b, const BigInt *c) {
+  BigInt sum;
+  const size_t size = (a->size > b->size) ? a->size : b->size;
+  uint64_t carry = 0U;
+
+  for (size_t i = 0; i < size; i++) {
+    carry += (i < a->size) ? a->limbs[i] : 0U;
+    carry += (i < b->size) ? b->limbs[i] : 0U;
+    sum.limbs[i] = (uint32_t)carry;
+    carry >>= 32U;
+  }
+  sum.size = size;
+  if (0U != carry) {
+    sum.limbs[sum.size++] = (uint32_t)carry;
+  }
+  return bigCompare(&sum, c);
+}
+
+/**
+ * Subtracts b from a, a must not be less than b.
+ */
+static void bigSubtract(BigInt *a, const BigInt *b) {
+  uint64_t borrow = 0U;
+  for (size_t i = 0; i < a->size; i++) {
+    const uint64_t difference = (uint64_t)a->limbs[i] - ((i < b->size) ? b->limbs[i] : 0U) - borrow;
+    a->limbs[i] = (uint32_t)difference;
+    borrow = (difference >> 32U) & 1U;
+  }
+  while (a->size > 0U && 0U == a->limbs[a->size - 1U]) {
+    a->size--;
+  }
+}
+
+/**
+ * Divides r by s, leaving the remainder in r. The quotient must be less than 10.
+ */
+static unsigned int bigDivide(BigInt *r, const BigInt *s) {
+  unsigned int quotient = 0U;
+  while (bigCompare(r, s) >= 0) {
+    bigSubtract(r, s);
+    quotient++;
+  }
+  return quotient;
+}
+
+static unsigned int bitLength(uint64_t value) {
+  return (0U == value) ? 0U : 64U - (unsigned int)__builtin_clzll(value);
+}
+
+/**
+ * Returns floor(log10(2^exponent)) or one less, but never more.
+ */
+static int floorLog10Pow2(const int exponent) {
+  // 78913 / 2^18 is slightly below log10(2), 78914 / 2^18 slightly above
+  if (exponent >= 0) {
+    return (int)(((unsigned int)exponent * 78913U) >> 18U);
+  }
+  return -(int)(((unsigned int)-exponent * 78914U + 262143U) >> 18U);
+}
+
+/**
+ * Estimates the decimal exponent k with 10^(k-1) <= m * 2^e < 10^k. The estimate is never too big.
+ */
+static int estimateExponent(const uint64_t m, const int e) {
+  return floorLog10Pow2((int)bitLength(m) + e - 1) + 1;
+}
+
+/**
+ * Writes the decimal digits of value, returns their number.
+ */
+static size_t toDecimal(char digits[], uint64_t value) {
+  char text[20];
+  size_t length = 0U;
+  while (0U != value) {
+    text[length++] = (char)('0' + value % 10U);
+    value /= 10U;
+  }
+  for (size_t i = 0; i < length; i++) {
+    digits[i] = text[length - 1U - i];
+  }
+  return length;
+}
+
+/**
+ * Adds one to the last digit. If all digits are nines, the digits become "100..." and the exponent grows.
+ */
+static void roundUp(char digits[], size_t *length, int *exponent, const bool keepLength) {
+  for (size_t i = *length; i-- > 0U;) {
+    if ('9' != digits[i]) {
+      digits[i]++;
+      return;
+    }
+    digits[i] = '0';
+  }
+
+  digits[0] = '1';
+  (*exponent)++;
+  if (0U == *length) {
+    *length = 1U;
+  } else if (!keepLength) {
+    // the digits keep their position relative to the decimal point, so there is one more
+    digits[*length] = '0';
+    (*length)++;
+  }
+}
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 UInt128;
+
+/**
+ * Computes round(m * 2^e * 10^position) using 128 bit integers. Returns false if the numbers don't fit.
+ */
+static bool fastRound(const uint64_t m, const int e, const int position, UInt128 *quotient) {
+  const unsigned int bits = bitLength(m);
+  const UInt128 limit = (UInt128)1U << 126U;
+  UInt128 numerator = m;
+  UInt128 denominator = 1U;
+
+  if (position > MAX_POW10 || position < -MAX_POW10 || e > 126 - (int)bits || e < -125) {
+    return false;
+  }
+
+  if (e >= 0) {
+    numerator <<= (unsigned int)e;
+  }
+
+  if (position >= 0) {
+    if (numerator > limit / Pow10[position]) {
+      return false;
+    }
+    numerator *= Pow10[position];
+  } else {
+    denominator = Pow10[-position];
+  }
+
+  UInt128 remainder;
+  if (e >= 0) {
+    *quotient = numerator / denominator;
+    remainder = numerator % denominator;
+  } else if (1U == denominator) {
+    // a power of two, no division needed
+    denominator = (UInt128)1U << (unsigned int)-e;
+    *quotient = numerator >> (unsigned int)-e;
+    remainder = numerator & (denominator - 1U);
+  } else {
+    if (denominator > limit >> (unsigned int)-e) {
+      return false;
+    }
+    denominator <<= (unsigned int)-e;
+    *quotient = numerator / denominator;
+    remainder = numerator % denominator;
+  }
+
+  // round half to even
+  remainder <<= 1U;
+  if (remainder > denominator || (remainder == denominator && 0U != (*quotient & 1U))) {
+    (*quotient)++;
+  }
+  return true;
+}
+
+/**
+ * Writes the decimal digits of a 128 bit value below 2^127, returns their number.
+ */
+static size_t toDecimal128(char digits[], const UInt128 value) {
+  if (value <= UINT64_MAX) {
+    return toDecimal(digits, (uint64_t)value);
+  }
+
+  const uint64_t high = (uint64_t)(value / Pow10[MAX_POW10]);
+  uint64_t low = (uint64_t)(value % Pow10[MAX_POW10]);
+  size_t length = toDecimal(digits, high);
+  for (size_t i = length + MAX_POW10; i-- > length;) {
+    digits[i] = (char)('0' + low % 10U);
+    low /= 10U;
+  }
+  return length + MAX_POW10;
+}
+
+/**
+ * Generates rounded digits using 128 bit integers. Returns false if the numbers don't fit.
+ */
+static bool fastDigits(char digits[],
+                       size_t *length,
+                       const uint64_t m,
+                       const int e,
+                       const CLogDigitsMode mode,
+                       const int count,
+                       int *exponent) {
+  UInt128 quotient;
+
+  if (CLOG_DIGITS_FRACTION == mode) {
+    if (!fastRound(m, e, count, &quotient)) {
+      return false;
+    }
+    *length = (0U != quotient) ? toDecimal128(digits, quotient) : 0U;
+    *exponent = (int)*length - count;
+    return true;
+  }
+
+  if (count > MAX_POW10) {
+    return false;
+  }
+
+  int k = estimateExponent(m, e);
+  for (;;) {
+    if (!fastRound(m, e, count - k, &quotient)) {
+      return false;
+    }
+    if (quotient <= Pow10[count]) {
+      break;
+    }
+    // the estimate was one too small
+    k++;
+  }
+
+  *length = toDecimal128(digits, quotient);
+  if (*length > (size_t)count) {
+    // rounded up to the next power of ten
+    *length = (size_t)count;
+    k++;
+  }
+  *exponent = k;
+  return true;
+}
+
+/**
+ * Generates the shortest digits like shortestDigits() does, but using 128 bit integers. Returns false if the numbers
+ * don't fit, which is the case for magnitudes far below 10^-15 or far above 10^30.
+ */
+static bool fastShortestDigits(char digits[],
+                               size_t *length,
+                               const uint64_t m,
+                               const int e,
+                               const bool lowerGap,
+                               int *exponent) {
+  // s stays below 2^122, so neither 10 * r nor 10 * (r + plus) overflow while the digits are generated
+  const UInt128 limit = (UInt128)1U << 122U;
+  const bool even = 0U == (m & 1U);
+  const unsigned int shift = lowerGap ? 2U : 1U;
+
+  if (e > 122 - (int)(bitLength(m) + shift) || (int)shift - e > 122) {
+    return false;
+  }
+
+  // v = r / s, the rounding interval is (r - minus) / s to (r + plus) / s
+  UInt128 r = (UInt128)m << shift;
+  UInt128 s = (UInt128)1U << shift;
+  UInt128 plus = (UInt128)1U << (shift - 1U);
+  UInt128 minus = 1U;
+  if (e >= 0) {
+    r <<= (unsigned int)e;
+    plus <<= (unsigned int)e;
+    minus <<= (unsigned int)e;
+  } else {
+    s <<= (unsigned int)-e;
+  }
+
+  int k = estimateExponent(m, e);
+  if (k > MAX_POW10 || k < -MAX_POW10) {
+    return false;
+  }
+  if (k >= 0) {
+    if (s > limit / Pow10[k]) {
+      return false;
+    }
+    s *= Pow10[k];
+  } else {
+    if (r > limit / Pow10[-k]) {
+      return false;
+    }
+    r *= Pow10[-k];
+    plus *= Pow10[-k];
+    minus *= Pow10[-k];
+  }
+  while (r + plus > s || (r + plus == s && even)) {
+    if (s > limit / 10U) {
+      return false;
+    }
+    s *= 10U;
+    k++;
+  }
+
+  size_t count = 0U;
+  for (;;) {
+    r *= 10U;
+    plus *= 10U;
+    minus *= 10U;
+    unsigned int digit = (unsigned int)(r / s);
+    r %= s;
+
+    const bool low = r < minus || (r == minus && even);
+    const bool high = r + plus > s || (r + plus == s && even);
+
+    if (!low && !high) {
+      digits[count++] = (char)('0' + digit);
+      continue;
+    }
+
+    if (low && high) {
+      // both digits are within the interval, take the closer one
+      const UInt128 twice = r << 1U;
+      if (twice > s || (twice == s && 0U != (digit & 1U))) {
+        digit++;
+      }
+    } else if (high) {
+      digit++;
+    }
+    digits[count++] = (char)('0' + digit);
+    break;
+  }
+
+  *length = count;
+  *exponent = k;
+  return true;
+}
+#endif
+
+/**
+ * Sets r / s to m * 2^e / 10^k with 0.1 <= r / s < 1, returns k.
+ */
+static int bigScale(BigInt *r, BigInt *s, const uint64_t m, const int e) {
+  bigSet(r, m);
+  bigSet(s, 1U);
+  if (e >= 0) {
+    bigShiftLeft(r, (unsigned int)e);
+  } else {
+    bigShiftLeft(s, (unsigned int)-e);
+  }
+
+  int k = estimateExponent(m, e);
+  if (k >= 0) {
+    bigMultiplyPow10(s, (unsigned int)k);
+  } else {
+    bigMultiplyPow10(r, (unsigned int)-k);
+  }
+  while (bigCompare(r, s) >= 0) {
+    bigMultiply(s, 10U);
+    k++;
+  }
+  return k;
+}
+
+/**
+ * Generates rounded digits one by one using big integers.
+ */
+static size_t bigDigits(char digits[], const uint64_t m, const int e, const CLogDigitsMode mode, const int count,
+                        int *exponent) {
+  BigInt r;
+  BigInt s;
+  int k = bigScale(&r, &s, m, e);
+
+  const int wanted = (CLOG_DIGITS_FRACTION == mode) ? k + count : count;
+  if (wanted < 0) {
+    // below half of the last digit, rounds to zero
+    *exponent = -count;
+    return 0U;
+  }
+
+  size_t length = 0U;
+  for (int i = 0; i < wanted; i++) {
+    bigMultiply(&r, 10U);
+    digits[length++] = (char)('0' + bigDivide(&r, &s));
+  }
+
+  // round half to even
+  bigShiftLeft(&r, 1U);
+  const int half = bigCompare(&r, &s);
+  if (half > 0 || (0 == half && length > 0U && 0 != ((digits[length - 1U] - '0') & 1))) {
+    roundUp(digits, &length, &k, CLOG_DIGITS_FRACTION != mode);
+  }
+
+  *exponent = k;
+  return length;
+}
+
+/**
+ * Generates the shortest digits reading back as the same double (Burger & Dybvig).
+ */
+static size_t shortestDigits(char digits[], const uint64_t m, const int e, const bool lowerGap, int *exponent) {
+  // the boundaries of the rounding interval belong to it if the mantissa is even (round half to even on reading)
+  const bool even = 0U == (m & 1U);
+
+  if (e <= 0 && e > -53 && 0U == (m & ((1ULL << (unsigned int)-e) - 1U))) {
+    // an integer below 2^53: no shorter number is within half a unit in the last place
+    size_t length = toDecimal(digits, m >> (unsigned int)-e);
+    *exponent = (int)length;
+    while (length > 1U && '0' == digits[length - 1U]) {
+      length--;
+    }
+    return length;
+  }
+
+  size_t length;
+#ifdef __SIZEOF_INT128__
+  if (fastShortestDigits(digits, &length, m, e, lowerGap, exponent)) {
+    return length;
+  }
+#endif
+
+  // v = r / s, the rounding interval is (r - minus) / s to (r + plus) / s
+  BigInt r;
+  BigInt s;
+  BigInt plus;
+  BigInt minus;
+  bigSet(&r, m);
+  bigSet(&s, 1U);
+  bigSet(&plus, 1U);
+  bigSet(&minus, 1U);
+
+  // the next lower double is closer if m is the smallest mantissa of its exponent
+  const unsigned int shift = lowerGap ? 2U : 1U;
+  bigShiftLeft(&r, shift);
+  bigShiftLeft(&s, shift);
+  bigShiftLeft(&plus, shift - 1U);
+  if (e >= 0) {
+    bigShiftLeft(&r, (unsigned int)e);
+    bigShiftLeft(&plus, (unsigned int)e);
+    bigShiftLeft(&minus, (unsigned int)e);
+  } else {
+    bigShiftLeft(&s, (unsigned int)-e);
+  }
+
+  int k = estimateExponent(m, e);
+  if (k >= 0) {
+    bigMultiplyPow10(&s, (unsigned int)k);
+  } else {
+    bigMultiplyPow10(&r, (unsigned int)-k);
+    bigMultiplyPow10(&plus, (unsigned int)-k);
+    bigMultiplyPow10(&minus, (unsigned int)-k);
+  }
+  for (;;) {
+    const int high = bigCompareSum(&r, &plus, &s);
+    if (high < 0 || (0 == high && !even)) {
+      break;
+    }
+    bigMultiply(&s, 10U);
+    k++;
+  }
+
+  length = 0U;
+  for (;;) {
+    bigMultiply(&r, 10U);
+    bigMultiply(&plus, 10U);
+    bigMultiply(&minus, 10U);
+    unsigned int digit = bigDivide(&r, &s);
+
+    const int lowCompare = bigCompare(&r, &minus);
+    const int highCompare = bigCompareSum(&r, &plus, &s);
+    const bool low = lowCompare < 0 || (0 == lowCompare && even);
+    const bool high = highCompare > 0 || (0 == highCompare && even);
+
+    if (!low && !high) {
+      digits[length++] = (char)('0' + digit);
+      continue;
+    }
+
+    if (low && high) {
+      // both digits are within the interval, take the closer one
+      BigInt twice = r;
+      bigShiftLeft(&twice, 1U);
+      const int half = bigCompare(&twice, &s);
+      if (half > 0 || (0 == half && 0U != (digit & 1U))) {
+        digit++;
+      }
+    } else if (high) {
+      digit++;
+    }
+    digits[length++] = (char)('0' + digit);
+    break;
+  }
+
+  *exponent = k;
+  return length;
+}
+
+/**
+ * Splits a double into m * 2^e, returns false for zero.
+ */
+static bool decompose(const double value, uint64_t *m, int *e, unsigned int *biased) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  *biased = (unsigned int)(bits >> 52U) & 0x7FFU;
+  *m = bits & ((1ULL << 52U) - 1U);
+  *e = -1074;
+  if (0U != *biased) {
+    *m |= 1ULL << 52U;
+    *e = (int)*biased - 1075;
+  }
+  return 0U != *m;
+}
+
+int clog_floatExponent(const double value) {
+  uint64_t m;
+  int e;
+  unsigned int biased;
+  BigInt r;
+  BigInt s;
+
+  return decompose(value, &m, &e, &biased) ? bigScale(&r, &s, m, e) : 0;
+}
+
+size_t clog_floatDigits(char digits[CLOG_FLOAT_DIGITS],
+                        const double value,
+                        const CLogDigitsMode mode,
+                        const int count,
+                        int *const exponent) {
+  uint64_t m;
+  int e;
+  unsigned int biased;
+
+  *exponent = 0;
+  if (!decompose(value, &m, &e, &biased)) {
+    return 0U;
+  }
+
+  if (CLOG_DIGITS_SHORTEST == mode) {
+    return shortestDigits(digits, m, e, (1ULL << 52U) == m && biased > 1U, exponent);
+  }
+
+  // the trailing zero bits don't change the value, but make the numbers smaller
+  const unsigned int zeros = (unsigned int)__builtin_ctzll(m);
+  m >>= zeros;
+  e += (int)zeros;
+
+#ifdef __SIZEOF_INT128__
+  size_t length;
+  if (fastDigits(digits, &length, m, e, mode, count, exponent)) {
+    return length;
+  }
+#endif
+
+  return bigDigits(digits, m, e, mode, count, exponent);
+}
@@ -0,0 +1,1620 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Capturing of raw message arguments and formatting of captured arguments.
+ * @date 2019-09-16
+ *
+ * @file
+ */
+
+#include "clog.h"
+#include "clogInternal.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <wchar.h>
+
+// The longest conversion specification we rebuild for snprintf, e.g. "%-+ #0123456789.123456789llx"
+#define SPEC_TEXT_SIZE (32U)
+
+/**
+ * Flags of a conversion specification.
+ */
+typedef enum _SpecFlag {
+  FLAG_MINUS = 1U << 0U, ///< '-' left justify
+  FLAG_PLUS = 1U << 1U,  ///< '+' always print a sign
+  FLAG_SPACE = 1U << 2U, ///< ' ' print a space instead of a plus sign
+  FLAG_HASH = 1U << 3U,  ///< '#' alternative form
+  FLAG_ZERO = 1U << 4U,  ///< '0' pad with zeros
+} SpecFlag;
+
+/**
+ * Length modifiers of a conversion specification.
+ */
+typedef enum _SpecLength {
+  LENGTH_NONE,
+  LENGTH_HH,
+  LENGTH_H,
+  LENGTH_L,
+  LENGTH_LL,
+  LENGTH_J,
+  LENGTH_Z,
+  LENGTH_T,
+  LENGTH_BIG_L,
+} SpecLength;
+
+/**
+ * The representation of a single argument within CLogArgs.
+ */
+typedef enum _ArgType {
+  ARG_NONE,    ///< the conversion does not consume an argument (e.g. %%)
+  ARG_SKIP,    ///< the argument is consumed but not stored (%n)
+  ARG_INT,     ///< int (also char and short as they are promoted)
+  ARG_LONG,    ///< long
+  ARG_LLONG,   ///< long long
+  ARG_INTMAX,  ///< intmax_t
+  ARG_SIZE,    ///< size_t
+  ARG_PTRDIFF, ///< ptrdiff_t
+  ARG_DOUBLE,  ///< double (float is promoted)
+  ARG_LDOUBLE, ///< long double
+  ARG_PTR,     ///< void *
+  ARG_STR,     ///< char string, stored inline with its length
+  ARG_WINT,    ///< wint_t
+  ARG_WSTR,    ///< wchar_t string, stored inline with its length
+} ArgType;
+
+/**
+ * A parsed conversion specification.
+ */
+typedef struct _Spec {
+  const char *start; ///< Points to the '%' starting the specification.
+  unsigned int flags;
+  int width;     ///< The width, -1 if not given, -2 if it is passed as argument ('*').
+  int precision; ///< The precision, -1 if not given, -2 if it is passed as argument ('*').
+  SpecLength length;
+  char conversion;
+  ArgType type; ///< The type of the argument.
+} Spec;
+
+/**
+ * Writer keeping track of the output position. The position keeps counting
+ * after the buffer is full in order to detect truncation.
+ */
+typedef struct _Writer {
+  char *buffer;
+  size_t size;
+  size_t position;
+  bool shortestFloats; ///< See CLogContext::shortestFloats.
+} Writer;
+
+/**
+ * Reader for the values stored in CLogArgs.
+ */
+typedef struct _Reader {
+  const unsigned char *data;
+  size_t size;
+  size_t position;
+} Reader;
+
+static ArgType integerType(SpecLength length) {
+  switch (length) {
+  case LENGTH_L:
+    return ARG_LONG;
+  case LENGTH_LL:
+    return ARG_LLONG;
+  case LENGTH_J:
+    return ARG_INTMAX;
+  case LENGTH_Z:
+    return ARG_SIZE;
+  case LENGTH_T:
+    return ARG_PTRDIFF;
+  default:
+    return ARG_INT;
+  }
+}
+
+static ArgType argType(const Spec *spec) {
+  switch (spec->conversion) {
+  case 'd':
+  case 'i':
+  case 'o':
+  case 'u':
+  case 'x':
+  case 'X':
+    return integerType(spec->length);
+  case 'c':
+    return (LENGTH_L == spec->length) ? ARG_WINT : ARG_INT;
+  case 's':
+    return (LENGTH_L == spec->length) ? ARG_WSTR : ARG_STR;
+  case 'p':
+    return ARG_PTR;
+  case 'n':
+    return ARG_SKIP;
+  case 'e':
+  case 'E':
+  case 'f':
+  case 'F':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+    return (LENGTH_BIG_L == spec->length) ? ARG_LDOUBLE : ARG_DOUBLE;
+  default:
+    return ARG_NONE;
+  }
+}
+
+static int parseNumber(const char **p) {
+  int value = 0;
+  while (**p >= '0' && **p <= '9') {
+    if (value < 100000) {
+      value = value * 10 + (**p - '0');
+    }
+    (*p)++;
+  }
+  return value;
+}
+
+/**
+ * Parses a conversion specification.
+ *
+ * @param p     Points to the character after the '%'.
+ * @param spec  The specification to be filled.
+ * @return const char* The first character after the specification or NULL if the specification is malformed.
+ */
+static const char *parseSpec(const char *p, Spec *spec) {
+  spec->flags = 0U;
+  spec->width = -1;
+  spec->precision = -1;
+  spec->length = LENGTH_NONE;
+
+  for (;; p++) {
+    if ('-' == *p) {
+      spec->flags |= FLAG_MINUS;
+    } else if ('+' == *p) {
+      spec->flags |= FLAG_PLUS;
+    } else if (' ' == *p) {
+      spec->flags |= FLAG_SPACE;
+    } else if ('#' == *p) {
+      spec->flags |= FLAG_HASH;
+    } else if ('0' == *p) {
+      spec->flags |= FLAG_ZERO;
+    } else {
+      break;
+    }
+  }
+
+  if ('*' == *p) {
+    spec->width = -2;
+    p++;
+  } else if (*p >= '1' && *p <= '9') {
+    spec->width = parseNumber(&p);
+  }
+
+  if ('.' == *p) {
+    p++;
+    if ('*' == *p) {
+      spec->precision = -2;
+      p++;
+    } else {
+      spec->precision = parseNumber(&p);
+    }
+  }
+
+  switch (*p) {
+  case 'h':
+    p++;
+    if ('h' == *p) {
+      spec->length = LENGTH_HH;
+      p++;
+    } else {
+      spec->length = LENGTH_H;
+    }
+    break;
+  case 'l':
+    p++;
+    if ('l' == *p) {
+      spec->length = LENGTH_LL;
+      p++;
+    } else {
+      spec->length = LENGTH_L;
+    }
+    break;
+  case 'q':
+    spec->length = LENGTH_LL;
+    p++;
+    break;
+  case 'j':
+    spec->length = LENGTH_J;
+    p++;
+    break;
+  case 'z':
+    spec->length = LENGTH_Z;
+    p++;
+    break;
+  case 't':
+    spec->length = LENGTH_T;
+    p++;
+    break;
+  case 'L':
+    spec->length = LENGTH_BIG_L;
+    p++;
+    break;
+  default:
+    break;
+  }
+
+  if (0 == *p) {
+    return NULL;
+  }
+
+  spec->conversion = *p;
+  spec->type = argType(spec);
+  return p + 1;
+}
+
+/**
+ * Walks the conversion specifications of a format string. They are either parsed on the fly or taken from the parsed
+ * format string of a call site.
+ */
+typedef struct _Cursor {
+  const char *format;          ///< The format string.
+  const CLogSiteFormat *cache; ///< The parsed format string, NULL to parse it.
+  const char *p;               ///< The position after the last specification.
+  size_t index;                ///< The index of the next cached specification.
+} Cursor;
+
+// The states of CLogSiteFormat
+#define SITE_FORMAT_NEW (0U)
+#define SITE_FORMAT_PARSING (1U)
+#define SITE_FORMAT_READY (2U)
+#define SITE_FORMAT_UNCACHED (3U)
+
+// Results of nextSpec()
+#define CURSOR_SPEC (1)
+#define CURSOR_END (0)
+#define CURSOR_MALFORMED (-1)
+
+/**
+ * Moves to the next conversion specification.
+ *
+ * @param cursor        The cursor.
+ * @param literal       Receives the text in front of the specification (or up to the end of the format string).
+ * @param literalLength Receives the length of the text.
+ * @param spec          Receives the specification.
+ * @param end           Receives the first character after the specification.
+ * @return int          CURSOR_SPEC, CURSOR_END if there is none left or CURSOR_MALFORMED if the rest of the format
+ *                      string (starting at cursor->p) is no valid specification.
+ */
+static int nextSpec(Cursor *cursor, const char **literal, size_t *literalLength, Spec *spec, const char **end) {
+  *literal = cursor->p;
+
+  if (NULL != cursor->cache) {
+    const CLogSiteFormat *cache = cursor->cache;
+    if (cursor->index >= cache->numberOfSpecs) {
+      *literalLength = (size_t)(&cursor->format[cache->length] - cursor->p);
+      return CURSOR_END;
+    }
+
+    const CLogSpec *cached = &cache->specs[cursor->index++];
+    *literalLength = (size_t)(&cursor->format[cached->start] - cursor->p);
+    spec->start = &cursor->format[cached->start];
+    spec->flags = cached->flags;
+    spec->width = cached->width;
+    spec->precision = cached->precision;
+    spec->length = (SpecLength)cached->length;
+    spec->conversion = cached->conversion;
+    spec->type = (ArgType)cached->type;
+    *end = &cursor->format[cached->end];
+    cursor->p = *end;
+    return CURSOR_SPEC;
+  }
+
+  const char *p = cursor->p;
+  while (*p && '%' != *p) {
+    p++;
+  }
+  *literalLength = (size_t)(p - cursor->p);
+  cursor->p = p;
+
+  if (0 == *p) {
+    return CURSOR_END;
+  }
+
+  spec->start = p;
+  *end = parseSpec(p + 1, spec);
+  if (NULL == *end) {
+    return CURSOR_MALFORMED;
+  }
+  cursor->p = *end;
+  return CURSOR_SPEC;
+}
+
+/**
+ * Parses a format string into the cache of a call site. Returns false if it can't be cached.
+ */
+static bool parseSiteFormat(CLogSiteFormat *cache, const char *format) {
+  const size_t length = strlen(format);
+  if (length > UINT16_MAX) {
+    return false;
+  }
+
+  Cursor cursor = {format, NULL, format, 0U};
+  const char *literal;
+  size_t literalLength;
+  Spec spec;
+  const char *end;
+  int result;
+
+  cache->numberOfSpecs = 0U;
+  cache->length = (uint16_t)length;
+
+  while (CURSOR_SPEC == (result = nextSpec(&cursor, &literal, &literalLength, &spec, &end))) {
+    if (cache->numberOfSpecs >= CLOG_SITE_SPECS || spec.width > INT16_MAX || spec.precision > INT16_MAX) {
+      return false;
+    }
+    CLogSpec *cached = &cache->specs[cache->numberOfSpecs++];
+    cached->start = (uint16_t)(spec.start - format);
+    cached->end = (uint16_t)(end - format);
+    cached->width = (int16_t)spec.width;
+    cached->precision = (int16_t)spec.precision;
+    cached->flags = (unsigned char)spec.flags;
+    cached->length = (unsigned char)spec.length;
+    cached->type = (unsigned char)spec.type;
+    cached->conversion = spec.conversion;
+  }
+
+  return CURSOR_END == result;
+}
+
+/**
+ * Provides the parsed format string of a call site, parsing it on the first call. Returns NULL if the call site has
+ * no cache, the format string can't be cached or another thread is parsing it right now.
+ */
+static const CLogSiteFormat *siteFormat(const CLogCallSite *site, const char *format) {
+  if (NULL == site || NULL == site->formatCache || NULL == format || site->format != format) {
+    return NULL;
+  }
+
+  CLogSiteFormat *cache = site->formatCache;
+  unsigned char state = __atomic_load_n(&cache->state, __ATOMIC_ACQUIRE);
+  if (SITE_FORMAT_READY == state) {
+    return cache;
+  }
+  if (SITE_FORMAT_NEW != state ||
+      !__atomic_compare_exchange_n(
+          &cache->state, &state, SITE_FORMAT_PARSING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+
+  const bool ok = parseSiteFormat(cache, format);
+  __atomic_store_n(&cache->state, ok ? SITE_FORMAT_READY : SITE_FORMAT_UNCACHED, __ATOMIC_RELEASE);
+  return ok ? cache : NULL;
+}
+
+static bool put(CLogArgs *args, const void *value, size_t size) {
+  if (args->size + size > sizeof(args->data)) {
+    args->truncated = true;
+    return false;
+  }
+  memcpy(&args->data[args->size], value, size);
+  args->size += size;
+  return true;
+}
+
+static bool putString(CLogArgs *args, const void *string, size_t length, size_t unitSize) {
+  uint32_t storedLength = (uint32_t)length;
+  size_t available = sizeof(args->data) - args->size;
+
+  if (available < sizeof(storedLength)) {
+    args->truncated = true;
+    return false;
+  }
+  available -= sizeof(storedLength);
+
+  // truncate long strings to the remaining space, the message will be truncated anyway
+  if (length * unitSize > available) {
+    storedLength = (uint32_t)(available / unitSize);
+    args->truncated = true;
+  }
+
+  put(args, &storedLength, sizeof(storedLength));
+  put(args, string, storedLength * unitSize);
+  return !args->truncated;
+}
+
+/**
+ * Returns the length of a string, but reads at most maxLength chars like printf does with a precision. A negative
+ * maxLength reads up to the terminator.
+ */
+static size_t boundedLength(const char *string, int maxLength) {
+  if (maxLength < 0) {
+    return strlen(string);
+  }
+  const char *terminator = memchr(string, '\0', (size_t)maxLength);
+  return (NULL != terminator) ? (size_t)(terminator - string) : (size_t)maxLength;
+}
+
+/**
+ * Like boundedLength() for wide strings. The precision of %ls counts bytes of the output, but every wide char
+ * converts to at least one byte, so printf reads at most as many wide chars.
+ */
+static size_t boundedWideLength(const wchar_t *string, int maxLength) {
+  if (maxLength < 0) {
+    return wcslen(string);
+  }
+  size_t length = 0U;
+  while (length < (size_t)maxLength && 0 != string[length]) {
+    length++;
+  }
+  return length;
+}
+
+/**
+ * Stores the next argument of the given type. Strings are read up to the precision, -1 if there is none.
+ */
+static bool captureValue(CLogArgs *args, ArgType type, int precision, va_list *list) {
+  switch (type) {
+  case ARG_NONE:
+    return true;
+  case ARG_SKIP: {
+    void *ignored = va_arg(*list, void *);
+    (void)ignored;
+    return true;
+  }
+  case ARG_INT: {
+    int value = va_arg(*list, int);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_LONG: {
+    long value = va_arg(*list, long);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_LLONG: {
+    long long value = va_arg(*list, long long);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_INTMAX: {
+    intmax_t value = va_arg(*list, intmax_t);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_SIZE: {
+    size_t value = va_arg(*list, size_t);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_PTRDIFF: {
+    ptrdiff_t value = va_arg(*list, ptrdiff_t);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_DOUBLE: {
+    double value = va_arg(*list, double);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_LDOUBLE: {
+    long double value = va_arg(*list, long double);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_PTR: {
+    void *value = va_arg(*list, void *);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_STR: {
+    const char *value = va_arg(*list, const char *);
+    if (NULL == value) {
+      uint32_t marker = CLOG_ARGS_NULL_STRING;
+      return put(args, &marker, sizeof(marker));
+    }
+    return putString(args, value, boundedLength(value, precision), sizeof(char));
+  }
+  case ARG_WINT: {
+    wint_t value = va_arg(*list, wint_t);
+    return put(args, &value, sizeof(value));
+  }
+  case ARG_WSTR: {
+    const wchar_t *value = va_arg(*list, const wchar_t *);
+    if (NULL == value) {
+      uint32_t marker = CLOG_ARGS_NULL_STRING;
+      return put(args, &marker, sizeof(marker));
+    }
+    return putString(args, value, boundedWideLength(value, precision), sizeof(wchar_t));
+  }
+  }
+  return false;
+}
+
+// The format of a record holding the eagerly formatted message text
+static const char EagerFormat[] = "%s";
+
+/**
+ * Formats a message right away and stores the text as the only argument of the record, for format strings whose
+ * arguments can't be captured.
+ */
+static bool captureText(CLogArgs *args, const char *format, va_list list) {
+  char text[CLOG_ARGS_SIZE];
+  va_list copy;
+  va_copy(copy, list);
+  const int length = vsnprintf(text, sizeof(text), format, copy);
+  va_end(copy);
+
+  args->format = EagerFormat;
+  args->size = 0U;
+  args->truncated = false;
+  // a text not fitting into the buffer doesn't fit into the record either and is truncated by putString()
+  return putString(args, text, (length > 0) ? (size_t)length : 0U, sizeof(char));
+}
+
+bool clog_captureFormatted(CLogArgs *const args, const bool shortestFloats, const char *const format, va_list list) {
+  char text[CLOG_ARGS_SIZE];
+  va_list copy;
+  va_copy(copy, list);
+  const size_t length = clog_vformatWith(text, sizeof(text), shortestFloats, NULL, format, copy);
+  va_end(copy);
+
+  args->format = EagerFormat;
+  args->size = 0U;
+  args->truncated = false;
+  return putString(args, text, length, sizeof(char)) && !args->truncated;
+}
+
+bool clog_captureArgsWith(CLogArgs *const args,
+                          const CLogCallSite *const site,
+                          const char *const format,
+                          va_list list) {
+  if (NULL == args) {
+    return false;
+  }
+
+  args->format = format;
+  args->size = 0U;
+  args->truncated = false;
+
+  if (NULL == format) {
+    return false;
+  }
+
+  // copy the list, so that it can be passed around by pointer
+  va_list copy;
+  va_copy(copy, list);
+
+  Cursor cursor = {format, siteFormat(site, format), format, 0U};
+  const char *literal;
+  size_t literalLength;
+  Spec spec;
+  const char *end;
+  bool capturable = true;
+
+  while (CURSOR_SPEC == nextSpec(&cursor, &literal, &literalLength, &spec, &end)) {
+    if (ARG_NONE == spec.type && '%' != spec.conversion) {
+      // unknown flags or conversions (e.g. %'d, %m) can't be told from the arguments they consume
+      capturable = false;
+      break;
+    }
+    bool ok = true;
+    int precision = spec.precision;
+    if (-2 == spec.width) {
+      ok = captureValue(args, ARG_INT, -1, &copy);
+    }
+    if (ok && -2 == precision) {
+      // a negative precision argument is taken as if it was omitted
+      precision = va_arg(copy, int);
+      ok = put(args, &precision, sizeof(precision));
+    }
+    if (!ok || !captureValue(args, spec.type, precision, &copy)) {
+      break;
+    }
+  }
+
+  va_end(copy);
+  if (!capturable) {
+    return captureText(args, format, list);
+  }
+  return !args->truncated;
+}
+
+bool clog_captureArgs(CLogArgs *const args, const char *const format, va_list list) {
+  return clog_captureArgsWith(args, NULL, format, list);
+}
+
+static void append(Writer *writer, const char *text, size_t length) {
+  if (writer->position < writer->size) {
+    size_t available = writer->size - writer->position - 1U;
+    memcpy(&writer->buffer[writer->position], text, (length < available) ? length : available);
+  }
+  writer->position += length;
+}
+
+static bool get(Reader *reader, void *value, size_t size) {
+  if (reader->position + size > reader->size) {
+    return false;
+  }
+  memcpy(value, &reader->data[reader->position], size);
+  reader->position += size;
+  return true;
+}
+
+// Two decimal digits per table lookup halve the number of divisions
+static const char DigitPairs[] = "00010203040506070809"
+                                 "10111213141516171819"
+                                 "20212223242526272829"
+                                 "30313233343536373839"
+                                 "40414243444546474849"
+                                 "50515253545556575859"
+                                 "60616263646566676869"
+                                 "70717273747576777879"
+                                 "80818283848586878889"
+                                 "90919293949596979899";
+
+static const char LowerHexDigits[] = "0123456789abcdef";
+static const char UpperHexDigits[] = "0123456789ABCDEF";
+
+// Enough for the octal digits of a 64 bit value
+#define DIGITS_SIZE (24U)
+
+static void appendRepeated(Writer *writer, char c, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (writer->position + 1U < writer->size) {
+      writer->buffer[writer->position] = c;
+    }
+    writer->position++;
+  }
+}
+
+/**
+ * Converts a value to digits, filling digits from the end. Returns the number of digits.
+ */
+static size_t toDigits(char digits[DIGITS_SIZE], unsigned long long value, const char conversion) {
+  char *p = &digits[DIGITS_SIZE];
+
+  switch (conversion) {
+  case 'x':
+  case 'X': {
+    const char *hex = ('X' == conversion) ? UpperHexDigits : LowerHexDigits;
+    do {
+      *--p = hex[value & 0xFU];
+      value >>= 4U;
+    } while (0U != value);
+    break;
+  }
+  case 'o':
+    do {
+      *--p = (char)('0' + (value & 7U));
+      value >>= 3U;
+    } while (0U != value);
+    break;
+  default:
+    while (value >= 100U) {
+      const unsigned int pair = (unsigned int)(value % 100U) * 2U;
+      value /= 100U;
+      *--p = DigitPairs[pair + 1U];
+      *--p = DigitPairs[pair];
+    }
+    if (value >= 10U) {
+      *--p = DigitPairs[value * 2U + 1U];
+      *--p = DigitPairs[value * 2U];
+    } else {
+      *--p = (char)('0' + value);
+    }
+    break;
+  }
+
+  return (size_t)(&digits[DIGITS_SIZE] - p);
+}
+
+/**
+ * Formats an integer conversion (d, i, o, u, x, X) like printf does, including all flags, width and precision.
+ */
+static void formatInteger(Writer *writer,
+                          const unsigned int flags,
+                          const int width,
+                          const int precision,
+                          const char conversion,
+                          const unsigned long long magnitude,
+                          const bool negative) {
+  char digits[DIGITS_SIZE];
+  size_t count = 0U;
+  if (0 != precision || 0U != magnitude) {
+    count = toDigits(digits, magnitude, conversion);
+  }
+
+  char prefix[2];
+  size_t prefixLength = 0U;
+  size_t zeros = (precision > (int)count) ? (size_t)precision - count : 0U;
+  if ('d' == conversion || 'i' == conversion) {
+    if (negative) {
+      prefix[prefixLength++] = '-';
+    } else if (flags & FLAG_PLUS) {
+      prefix[prefixLength++] = '+';
+    } else if (flags & FLAG_SPACE) {
+      prefix[prefixLength++] = ' ';
+    }
+  } else if (flags & FLAG_HASH) {
+    if ('o' == conversion) {
+      // the alternative form of octal numbers starts with a zero
+      if (0U == zeros && (0U == count || '0' != digits[DIGITS_SIZE - count])) {
+        zeros = 1U;
+      }
+    } else if (('x' == conversion || 'X' == conversion) && 0U != magnitude) {
+      prefix[prefixLength++] = '0';
+      prefix[prefixLength++] = conversion;
+    }
+  }
+
+  const size_t length = prefixLength + zeros + count;
+  const size_t padding = (width > (int)length) ? (size_t)width - length : 0U;
+
+  if (flags & FLAG_MINUS) {
+    append(writer, prefix, prefixLength);
+    appendRepeated(writer, '0', zeros);
+    append(writer, &digits[DIGITS_SIZE - count], count);
+    appendRepeated(writer, ' ', padding);
+  } else if ((flags & FLAG_ZERO) && precision < 0) {
+    append(writer, prefix, prefixLength);
+    appendRepeated(writer, '0', padding + zeros);
+    append(writer, &digits[DIGITS_SIZE - count], count);
+  } else {
+    appendRepeated(writer, ' ', padding);
+    append(writer, prefix, prefixLength);
+    appendRepeated(writer, '0', zeros);
+    append(writer, &digits[DIGITS_SIZE - count], count);
+  }
+}
+
+/**
+ * Formats an integer argument, which has been read as the type given by integerType(), applying the length modifier
+ * of the specification.
+ */
+static void formatIntegerValue(Writer *writer,
+                               const Spec *spec,
+                               const int width,
+                               const int precision,
+                               const unsigned long long bits) {
+  if ('d' == spec->conversion || 'i' == spec->conversion) {
+    long long value;
+    switch (spec->length) {
+    case LENGTH_HH:
+      value = (signed char)bits;
+      break;
+    case LENGTH_H:
+      value = (short)bits;
+      break;
+    case LENGTH_NONE:
+      value = (int)bits;
+      break;
+    case LENGTH_L:
+      value = (long)bits;
+      break;
+    case LENGTH_Z:
+      value = (ssize_t)bits;
+      break;
+    default:
+      value = (long long)bits;
+      break;
+    }
+    const unsigned long long magnitude = (value < 0) ? 0U - (unsigned long long)value : (unsigned long long)value;
+    formatInteger(writer, spec->flags, width, precision, spec->conversion, magnitude, value < 0);
+    return;
+  }
+
+  unsigned long long value;
+  switch (spec->length) {
+  case LENGTH_HH:
+    value = (unsigned char)bits;
+    break;
+  case LENGTH_H:
+    value = (unsigned short)bits;
+    break;
+  case LENGTH_NONE:
+    value = (unsigned int)bits;
+    break;
+  case LENGTH_L:
+    value = (unsigned long)bits;
+    break;
+  case LENGTH_Z:
+  case LENGTH_T:
+    value = (size_t)bits;
+    break;
+  default:
+    value = bits;
+    break;
+  }
+  formatInteger(writer, spec->flags, width, precision, spec->conversion, value, false);
+}
+
+static bool isIntegerConversion(const char conversion) {
+  return NULL != strchr("diouxX", conversion);
+}
+
+/**
+ * Formats a pointer like glibc does. Only the '-' flag and the width are supported.
+ */
+static void formatPointer(Writer *writer, const unsigned int flags, const int width, const void *pointer) {
+  if (NULL == pointer) {
+    const size_t padding = (width > 5) ? (size_t)width - 5U : 0U;
+    if (0U == (flags & FLAG_MINUS)) {
+      appendRepeated(writer, ' ', padding);
+    }
+    append(writer, "(nil)", 5U);
+    if (flags & FLAG_MINUS) {
+      appendRepeated(writer, ' ', padding);
+    }
+    return;
+  }
+
+  formatInteger(writer, (flags & FLAG_MINUS) | FLAG_HASH, width, -1, 'x', (uintptr_t)pointer, false);
+}
+
+static bool isSimplePointer(const Spec *spec) {
+  return 0U == (spec->flags & ~(unsigned int)FLAG_MINUS) && spec->precision < 0 && LENGTH_NONE == spec->length;
+}
+
+static bool isFloatConversion(const char conversion) {
+  return NULL != strchr("fFeEgG", conversion);
+}
+
+// The most significant digits printed in fixed notation by %g in shortest mode (like %.17g)
+#define SHORTEST_FIXED_DIGITS (17)
+
+// The longest text of a double without sign and padding, e.g. %f of 5e-324 in shortest mode
+#define FLOAT_TEXT_SIZE (CLOG_FLOAT_DIGITS + 16U)
+
+/**
+ * Lays out digits (0.d1d2d3... * 10^exponent) in fixed notation. Positions without digit are zeros.
+ */
+static size_t fixedText(char text[FLOAT_TEXT_SIZE],
+                        const char digits[],
+                        const size_t length,
+                        const int exponent,
+                        const int precision,
+                        const bool point) {
+  size_t position = 0U;
+
+  if (0U == length || exponent <= 0) {
+    text[position++] = '0';
+  } else {
+    for (int i = 0; i < exponent; i++) {
+      text[position++] = ((size_t)i < length) ? digits[i] : '0';
+    }
+  }
+
+  if (precision > 0 || point) {
+    text[position++] = '.';
+  }
+  for (int i = 0; i < precision; i++) {
+    const int index = exponent + i;
+    text[position++] = (index >= 0 && (size_t)index < length) ? digits[index] : '0';
+  }
+  return position;
+}
+
+/**
+ * Lays out digits in exponential notation (d.ddd * 10^exponent), the exponent has at least two digits.
+ */
+static size_t exponentialText(char text[FLOAT_TEXT_SIZE],
+                              const char digits[],
+                              const size_t length,
+                              const int exponent,
+                              const int precision,
+                              const bool point,
+                              const char e) {
+  size_t position = 0U;
+
+  text[position++] = (0U != length) ? digits[0] : '0';
+  if (precision > 0 || point) {
+    text[position++] = '.';
+  }
+  for (int i = 1; i <= precision; i++) {
+    text[position++] = ((size_t)i < length) ? digits[i] : '0';
+  }
+
+  text[position++] = e;
+  text[position++] = (exponent < 0) ? '-' : '+';
+  const unsigned int magnitude = (exponent < 0) ? (unsigned int)-exponent : (unsigned int)exponent;
+  if (magnitude >= 100U) {
+    text[position++] = (char)('0' + magnitude / 100U);
+  }
+  text[position++] = DigitPairs[(magnitude % 100U) * 2U];
+  text[position++] = DigitPairs[(magnitude % 100U) * 2U + 1U];
+  return position;
+}
+
+/**
+ * Formats a double for the conversions f, F, e, E, g and G like glibc does. The precision must not exceed
+ * CLOG_FLOAT_PRECISION.
+ */
+static void formatDouble(Writer *writer,
+                         const unsigned int flags,
+                         const int width,
+                         int precision,
+                         const char conversion,
+                         const double value) {
+  const bool upper = conversion >= 'A' && conversion <= 'Z';
+  const bool point = 0U != (flags & FLAG_HASH);
+  bool zeros = 0U != (flags & FLAG_ZERO) && 0U == (flags & FLAG_MINUS);
+  char sign = 0;
+  char text[FLOAT_TEXT_SIZE];
+  size_t length;
+
+  if (signbit(value)) {
+    sign = '-';
+  } else if (flags & FLAG_PLUS) {
+    sign = '+';
+  } else if (flags & FLAG_SPACE) {
+    sign = ' ';
+  }
+
+  if (isnan(value) || isinf(value)) {
+    memcpy(text, isnan(value) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf"), 3U);
+    length = 3U;
+    zeros = false;
+  } else {
+    char digits[CLOG_FLOAT_DIGITS];
+    int exponent;
+    size_t count;
+    const bool shortest = writer->shortestFloats && precision < 0;
+    if (precision < 0) {
+      precision = 6;
+    }
+
+    switch (conversion) {
+    case 'f':
+    case 'F':
+      if (shortest) {
+        count = clog_floatDigits(digits, value, CLOG_DIGITS_SHORTEST, 0, &exponent);
+        precision = ((int)count > exponent) ? (int)count - exponent : 0;
+      } else {
+        count = clog_floatDigits(digits, value, CLOG_DIGITS_FRACTION, precision, &exponent);
+      }
+      length = fixedText(text, digits, count, exponent, precision, point);
+      break;
+    case 'e':
+    case 'E':
+      if (shortest) {
+        count = clog_floatDigits(digits, value, CLOG_DIGITS_SHORTEST, 0, &exponent);
+        precision = (count > 0U) ? (int)count - 1 : 0;
+      } else {
+        count = clog_floatDigits(digits, value, CLOG_DIGITS_SIGNIFICANT, precision + 1, &exponent);
+      }
+      length =
+          exponentialText(text, digits, count, (count > 0U) ? exponent - 1 : 0, precision, point, upper ? 'E' : 'e');
+      break;
+    default: {
+      // %g: the style depends on the exponent, the trailing zeros are removed unless the '#' flag is given
+      const int significant = (0 == precision) ? 1 : precision;
+      const bool keepZeros = point && !shortest;
+      count = clog_floatDigits(digits,
+                               value,
+                               shortest ? CLOG_DIGITS_SHORTEST : CLOG_DIGITS_SIGNIFICANT,
+                               significant,
+                               &exponent);
+      if (0U == count) {
+        exponent = 1;
+      }
+      while (!keepZeros && count > 1U && '0' == digits[count - 1U]) {
+        count--;
+      }
+
+      const int x = exponent - 1;
+      if (x >= -4 && x < (shortest ? SHORTEST_FIXED_DIGITS : significant)) {
+        if (keepZeros) {
+          precision = significant - 1 - x;
+        } else {
+          precision = ((int)count > exponent) ? (int)count - exponent : 0;
+        }
+        length = fixedText(text, digits, count, exponent, precision, point);
+      } else {
+        precision = keepZeros ? significant - 1 : (int)count - 1;
+        if (keepZeros && x == significant && clog_floatExponent(value) == significant) {
+          // glibc quirk: if rounding carries over to the exponential notation, no zeros are kept
+          precision = 0;
+        }
+        length = exponentialText(text, digits, count, x, precision, point, upper ? 'E' : 'e');
+      }
+      break;
+    }
+    }
+  }
+
+  const size_t total = length + ((0 != sign) ? 1U : 0U);
+  const size_t padding = (width > 0 && (size_t)width > total) ? (size_t)width - total : 0U;
+
+  if (0U == (flags & FLAG_MINUS) && !zeros) {
+    appendRepeated(writer, ' ', padding);
+  }
+  if (0 != sign) {
+    append(writer, &sign, 1U);
+  }
+  if (zeros) {
+    appendRepeated(writer, '0', padding);
+  }
+  append(writer, text, length);
+  if (flags & FLAG_MINUS) {
+    appendRepeated(writer, ' ', padding);
+  }
+}
+
+/**
+ * Rebuilds the text of a specification with resolved width and precision, e.g. "%-*d" -> "%-5d".
+ */
+static void specText(char text[SPEC_TEXT_SIZE], const Spec *spec, int width, int precision, const char *end) {
+  // copy the length modifier and the conversion from the original format
+  const char *modifier = end - 1;
+  while (modifier > spec->start && NULL != strchr("hlqjztL", modifier[-1])) {
+    modifier--;
+  }
+
+  int used = snprintf(text,
+                      SPEC_TEXT_SIZE,
+                      "%%%s%s%s%s%s",
+                      (spec->flags & FLAG_MINUS) ? "-" : "",
+                      (spec->flags & FLAG_PLUS) ? "+" : "",
+                      (spec->flags & FLAG_SPACE) ? " " : "",
+                      (spec->flags & FLAG_HASH) ? "#" : "",
+                      (spec->flags & FLAG_ZERO) ? "0" : "");
+  if (width >= 0) {
+    used += snprintf(&text[used], SPEC_TEXT_SIZE - used, "%d", width);
+  }
+  if (precision >= 0) {
+    used += snprintf(&text[used], SPEC_TEXT_SIZE - used, ".%d", precision);
+  }
+  snprintf(&text[used], SPEC_TEXT_SIZE - used, "%.*s", (int)(end - modifier), modifier);
+}
+
+/**
+ * Formats a single value. Returns false if the value is missing in the argument data.
+ */
+static bool formatValue(Writer *writer, Reader *reader, Spec *spec, const char *end) {
+  int width = spec->width;
+  int precision = spec->precision;
+
+  if (-2 == width) {
+    if (!get(reader, &width, sizeof(width))) {
+      return false;
+    }
+    if (width < 0) {
+      // a negative width argument is taken as '-' flag followed by a positive width
+      width = -width;
+      spec->flags |= FLAG_MINUS;
+    }
+  }
+
+  if (-2 == precision && !get(reader, &precision, sizeof(precision))) {
+    return false;
+  }
+
+  const ArgType type = spec->type;
+
+  if (isIntegerConversion(spec->conversion) && ARG_NONE != type) {
+    unsigned long long bits = 0U;
+    bool ok = false;
+    switch (type) {
+    case ARG_INT: {
+      int value;
+      ok = get(reader, &value, sizeof(value));
+      bits = (unsigned long long)(long long)value;
+      break;
+    }
+    case ARG_LONG: {
+      long value;
+      ok = get(reader, &value, sizeof(value));
+      bits = (unsigned long long)(long long)value;
+      break;
+    }
+    case ARG_LLONG: {
+      long long value;
+      ok = get(reader, &value, sizeof(value));
+      bits = (unsigned long long)value;
+      break;
+    }
+    case ARG_INTMAX: {
+      intmax_t value;
+      ok = get(reader, &value, sizeof(value));
+      bits = (unsigned long long)value;
+      break;
+    }
+    case ARG_SIZE: {
+      size_t value;
+      ok = get(reader, &value, sizeof(value));
+      bits = value;
+      break;
+    }
+    case ARG_PTRDIFF: {
+      ptrdiff_t value;
+      ok = get(reader, &value, sizeof(value));
+      bits = (unsigned long long)(long long)value;
+      break;
+    }
+    default:
+      break;
+    }
+    if (ok) {
+      formatIntegerValue(writer, spec, width, precision, bits);
+    }
+    return ok;
+  }
+
+  if (ARG_PTR == type && isSimplePointer(spec)) {
+    void *value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    formatPointer(writer, spec->flags, width, value);
+    return true;
+  }
+
+  if (ARG_DOUBLE == type && isFloatConversion(spec->conversion) && precision <= CLOG_FLOAT_PRECISION) {
+    double value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    formatDouble(writer, spec->flags, width, precision, spec->conversion, value);
+    return true;
+  }
+
+  char text[SPEC_TEXT_SIZE];
+  specText(text, spec, width, precision, end);
+
+  char *target = NULL;
+  size_t available = 0U;
+  if (writer->position < writer->size) {
+    target = &writer->buffer[writer->position];
+    available = writer->size - writer->position;
+  }
+
+  int length = 0;
+
+  switch (type) {
+  case ARG_NONE:
+    if ('%' == spec->conversion) {
+      append(writer, "%", 1U);
+    } else {
+      // unknown conversion, print it as it is
+      append(writer, spec->start, (size_t)(end - spec->start));
+    }
+    return true;
+  case ARG_SKIP:
+    return true;
+  case ARG_INT: {
+    int value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_WINT: {
+    wint_t value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_LONG: {
+    long value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_LLONG: {
+    long long value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_INTMAX: {
+    intmax_t value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_SIZE: {
+    size_t value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_PTRDIFF: {
+    ptrdiff_t value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_DOUBLE: {
+    double value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_LDOUBLE: {
+    long double value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_PTR: {
+    void *value;
+    if (!get(reader, &value, sizeof(value))) {
+      return false;
+    }
+    length = snprintf(target, available, text, value);
+    break;
+  }
+  case ARG_STR: {
+    uint32_t stringLength;
+    if (!get(reader, &stringLength, sizeof(stringLength))) {
+      return false;
+    }
+    if (CLOG_ARGS_NULL_STRING == stringLength) {
+      length = snprintf(target, available, text, (const char *)NULL);
+      break;
+    }
+    if (reader->position + stringLength > reader->size) {
+      return false;
+    }
+    // the stored string is not terminated, so limit the precision to its length
+    const char *string = (const char *)&reader->data[reader->position];
+    reader->position += stringLength;
+    if (precision < 0 || (uint32_t)precision > stringLength) {
+      precision = (int)stringLength;
+    }
+    specText(text, spec, width, precision, end);
+    length = snprintf(target, available, text, string);
+    break;
+  }
+  case ARG_WSTR: {
+    uint32_t stringLength;
+    if (!get(reader, &stringLength, sizeof(stringLength))) {
+      return false;
+    }
+    if (CLOG_ARGS_NULL_STRING == stringLength) {
+      length = snprintf(target, available, text, (const wchar_t *)NULL);
+      break;
+    }
+    if (reader->position + stringLength * sizeof(wchar_t) > reader->size) {
+      return false;
+    }
+    // copy to get the alignment and the terminator right
+    wchar_t string[CLOG_ARGS_SIZE / sizeof(wchar_t) + 1U];
+    memcpy(string, &reader->data[reader->position], stringLength * sizeof(wchar_t));
+    string[stringLength] = 0;
+    reader->position += stringLength * sizeof(wchar_t);
+    length = snprintf(target, available, text, string);
+    break;
+  }
+  }
+
+  if (length > 0) {
+    writer->position += (size_t)length;
+  }
+  return true;
+}
+
+size_t clog_formatArgsWith(char buffer[],
+                           const size_t bufferSize,
+                           const bool shortestFloats,
+                           const CLogCallSite *const site,
+                           const CLogArgs *const args) {
+  if (NULL == buffer || bufferSize < 1U) {
+    return 0U;
+  }
+
+  buffer[0] = 0;
+
+  if (NULL == args || NULL == args->format) {
+    return 0U;
+  }
+
+  Writer writer = {buffer, bufferSize, 0U, shortestFloats};
+  Reader reader = {args->data, args->size, 0U};
+  Cursor cursor = {args->format, siteFormat(site, args->format), args->format, 0U};
+
+  for (;;) {
+    const char *literal;
+    size_t literalLength;
+    Spec spec;
+    const char *end;
+    const int result = nextSpec(&cursor, &literal, &literalLength, &spec, &end);
+    append(&writer, literal, literalLength);
+
+    if (CURSOR_MALFORMED == result) {
+      // malformed specification at the end of the format, print it as it is
+      append(&writer, cursor.p, strlen(cursor.p));
+      break;
+    }
+    if (CURSOR_END == result || !formatValue(&writer, &reader, &spec, end)) {
+      break;
+    }
+  }
+
+  if (args->truncated) {
+    // the arguments have been truncated during capturing, let's indicate this
+    append(&writer, "..", 2U);
+  }
+
+  buffer[(writer.position < bufferSize) ? writer.position : bufferSize - 1U] = 0;
+  return writer.position;
+}
+
+size_t clog_formatArgs(char buffer[], const size_t bufferSize, const CLogArgs *const args) {
+  return clog_formatArgsWith(buffer, bufferSize, false, NULL, args);
+}
+
+/**
+ * Formats a string conversion without length modifier. Returns false for the cases left to snprintf().
+ */
+static bool formatString(Writer *writer, const Spec *spec, const int width, const int precision, const char *text) {
+  if (NULL == text) {
+    if (precision >= 0) {
+      // libc specific, e.g. glibc prints nothing if the precision is too small for "(null)"
+      return false;
+    }
+    text = "(null)";
+  }
+
+  size_t length;
+  if (precision >= 0) {
+    const char *nul = memchr(text, 0, (size_t)precision);
+    length = (NULL != nul) ? (size_t)(nul - text) : (size_t)precision;
+  } else {
+    length = strlen(text);
+  }
+
+  const size_t padding = (width > (int)length) ? (size_t)width - length : 0U;
+  if (0U == (spec->flags & FLAG_MINUS)) {
+    appendRepeated(writer, ' ', padding);
+  }
+  append(writer, text, length);
+  if (spec->flags & FLAG_MINUS) {
+    appendRepeated(writer, ' ', padding);
+  }
+  return true;
+}
+
+/**
+ * Formats a single value with snprintf(), for the conversions the writer doesn't handle itself.
+ */
+static void printfValue(Writer *writer, const Spec *spec, int width, int precision, const char *end, ...) {
+  char text[SPEC_TEXT_SIZE];
+  specText(text, spec, width, precision, end);
+
+  char *target = NULL;
+  size_t available = 0U;
+  if (writer->position < writer->size) {
+    target = &writer->buffer[writer->position];
+    available = writer->size - writer->position;
+  }
+
+  va_list list;
+  va_start(list, end);
+  const int length = vsnprintf(target, available, text, list);
+  va_end(list);
+  if (length > 0) {
+    writer->position += (size_t)length;
+  }
+}
+
+/**
+ * Formats a single conversion taking its argument from the list with snprintf() (long doubles, wide characters, ...).
+ * Returns false for the conversions only vsnprintf() can handle with the complete format string, i.e. unknown ones and
+ * %n.
+ */
+static bool printfListValue(
+    Writer *writer, const Spec *spec, int width, int precision, const char *end, va_list *list) {
+  switch (spec->type) {
+  case ARG_INT:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, int));
+    return true;
+  case ARG_LONG:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, long));
+    return true;
+  case ARG_LLONG:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, long long));
+    return true;
+  case ARG_INTMAX:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, intmax_t));
+    return true;
+  case ARG_SIZE:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, size_t));
+    return true;
+  case ARG_PTRDIFF:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, ptrdiff_t));
+    return true;
+  case ARG_DOUBLE:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, double));
+    return true;
+  case ARG_LDOUBLE:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, long double));
+    return true;
+  case ARG_PTR:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, void *));
+    return true;
+  case ARG_STR:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, const char *));
+    return true;
+  case ARG_WINT:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, wint_t));
+    return true;
+  case ARG_WSTR:
+    printfValue(writer, spec, width, precision, end, va_arg(*list, const wchar_t *));
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * Formats a single conversion taking its arguments from the list. Returns false for the cases left to vsnprintf().
+ */
+static bool formatListValue(Writer *writer, Spec *spec, const char *end, va_list *list) {
+  int width = spec->width;
+  int precision = spec->precision;
+
+  if (-2 == width) {
+    width = va_arg(*list, int);
+    if (width < 0) {
+      // a negative width argument is taken as '-' flag followed by a positive width
+      width = -width;
+      spec->flags |= FLAG_MINUS;
+    }
+  }
+  if (-2 == precision) {
+    precision = va_arg(*list, int);
+    if (precision < 0) {
+      precision = -1;
+    }
+  }
+
+  if (isIntegerConversion(spec->conversion) && LENGTH_BIG_L != spec->length) {
+    unsigned long long bits;
+    switch (integerType(spec->length)) {
+    case ARG_LONG:
+      bits = (unsigned long long)(long long)va_arg(*list, long);
+      break;
+    case ARG_LLONG:
+      bits = (unsigned long long)va_arg(*list, long long);
+      break;
+    case ARG_INTMAX:
+      bits = (unsigned long long)va_arg(*list, intmax_t);
+      break;
+    case ARG_SIZE:
+      bits = va_arg(*list, size_t);
+      break;
+    case ARG_PTRDIFF:
+      bits = (unsigned long long)(long long)va_arg(*list, ptrdiff_t);
+      break;
+    default:
+      bits = (unsigned long long)(long long)va_arg(*list, int);
+      break;
+    }
+    formatIntegerValue(writer, spec, width, precision, bits);
+    return true;
+  }
+
+  if (isFloatConversion(spec->conversion)) {
+    // 'l' has no effect on doubles, long doubles are left to snprintf()
+    if ((LENGTH_NONE != spec->length && LENGTH_L != spec->length) || precision > CLOG_FLOAT_PRECISION) {
+      return printfListValue(writer, spec, width, precision, end, list);
+    }
+    formatDouble(writer, spec->flags, width, precision, spec->conversion, va_arg(*list, double));
+    return true;
+  }
+
+  switch (spec->conversion) {
+  case 'c': {
+    if (LENGTH_NONE != spec->length) {
+      return printfListValue(writer, spec, width, precision, end, list);
+    }
+    const char c = (char)va_arg(*list, int);
+    const size_t padding = (width > 1) ? (size_t)width - 1U : 0U;
+    if (0U == (spec->flags & FLAG_MINUS)) {
+      appendRepeated(writer, ' ', padding);
+    }
+    append(writer, &c, 1U);
+    if (spec->flags & FLAG_MINUS) {
+      appendRepeated(writer, ' ', padding);
+    }
+    return true;
+  }
+  case 's': {
+    if (LENGTH_NONE != spec->length) {
+      return printfListValue(writer, spec, width, precision, end, list);
+    }
+    const char *text = va_arg(*list, const char *);
+    if (!formatString(writer, spec, width, precision, text)) {
+      printfValue(writer, spec, width, precision, end, text);
+    }
+    return true;
+  }
+  case 'p':
+    if (!isSimplePointer(spec) || -2 == spec->precision) {
+      return printfListValue(writer, spec, width, precision, end, list);
+    }
+    formatPointer(writer, spec->flags, width, va_arg(*list, const void *));
+    return true;
+  case '%':
+    if (end - spec->start != 2) {
+      return false;
+    }
+    append(writer, "%", 1U);
+    return true;
+  default:
+    return printfListValue(writer, spec, width, precision, end, list);
+  }
+}
+
+size_t clog_vformatWith(char buffer[],
+                        const size_t bufferSize,
+                        const bool shortestFloats,
+                        const CLogCallSite *const site,
+                        const char *const format,
+                        va_list list) {
+  if (NULL == buffer || bufferSize < 1U) {
+    return 0U;
+  }
+
+  buffer[0] = 0;
+
+  if (NULL == format) {
+    return 0U;
+  }
+
+  Writer writer = {buffer, bufferSize, 0U, shortestFloats};
+  bool done = true;
+
+  // copy the list, so the original one is still available for vsnprintf
+  va_list copy;
+  va_copy(copy, list);
+
+  Cursor cursor = {format, siteFormat(site, format), format, 0U};
+
+  for (;;) {
+    const char *literal;
+    size_t literalLength;
+    Spec spec;
+    const char *end;
+    const int result = nextSpec(&cursor, &literal, &literalLength, &spec, &end);
+    append(&writer, literal, literalLength);
+
+    if (CURSOR_END == result) {
+      break;
+    }
+    if (CURSOR_MALFORMED == result || !formatListValue(&writer, &spec, end, &copy)) {
+      done = false;
+      break;
+    }
+  }
+
+  va_end(copy);
+
+  if (!done) {
+    // unknown conversions and %n are left to the C library
+    int length = vsnprintf(buffer, bufferSize, format, list);
+    return (length > 0) ? (size_t)length : 0U;
+  }
+
+  buffer[(writer.position < bufferSize) ? writer.position : bufferSize - 1U] = 0;
+  return writer.position;
+}
+
+size_t clog_vformat(char buffer[], const size_t bufferSize, const char *const format, va_list list) {
+  return clog_vformatWith(buffer, bufferSize, false, NULL, format, list);
+}
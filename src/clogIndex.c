@@ -0,0 +1,255 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Block index of log files.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * The keys of the bloom filters are the FNV-1a hashes of the tag names and of the file names and lines of the call
+ * sites (prefixed by a byte telling both apart). The bits are derived from a single hash by double hashing.
+ */
+
+#include "clogIndex.h"
+#include "clogInternal.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BYTE_ORDER_MARKER (0x0102U)
+#define FNV_OFFSET (14695981039346656037ULL)
+#define FNV_PRIME (1099511628211ULL)
+
+#define KEY_TAG ('T')
+#define KEY_SITE ('S')
+
+static const char Magic[] = {'C', 'L', 'O', 'G', 'I', 'D', 'X', '1'};
+
+/**
+ * The header of an index file.
+ */
+typedef struct _Header {
+  char magic[sizeof(Magic)];
+  uint16_t byteOrder;
+  uint16_t entrySize;
+} Header;
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint64_t tagKey(const char *tag) {
+  const unsigned char kind = KEY_TAG;
+  return hashBytes(hashBytes(FNV_OFFSET, &kind, 1U), tag, strlen(tag));
+}
+
+static uint64_t siteKey(const char *file, unsigned int line) {
+  const unsigned char kind = KEY_SITE;
+  const uint64_t hash = hashBytes(hashBytes(FNV_OFFSET, &kind, 1U), file, strlen(file));
+  return hashBytes(hash, &line, sizeof(line));
+}
+
+/**
+ * The bit of the n-th hash of a key.
+ */
+static size_t bloomBit(uint64_t key, size_t n) {
+  const uint64_t step = (key >> 32U) | 1U;
+  return (size_t)((key + n * step) & (CLOG_INDEX_BLOOM_BITS - 1U));
+}
+
+static void addKey(CLogIndexEntry *entry, uint64_t key) {
+  for (size_t n = 0; n < CLOG_INDEX_BLOOM_HASHES; n++) {
+    const size_t bit = bloomBit(key, n);
+    entry->bloom[bit / 64U] |= (uint64_t)1U << (bit % 64U);
+  }
+}
+
+static bool hasKey(const CLogIndexEntry *entry, uint64_t key) {
+  for (size_t n = 0; n < CLOG_INDEX_BLOOM_HASHES; n++) {
+    const size_t bit = bloomBit(key, n);
+    if (0U == (entry->bloom[bit / 64U] & ((uint64_t)1U << (bit % 64U)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Starts an empty entry at an offset.
+ */
+static void resetEntry(CLogIndexEntry *entry, uint64_t offset) {
+  memset(entry, 0, sizeof(*entry));
+  entry->offset = offset;
+  entry->first = UINT64_MAX;
+}
+
+/**
+ * Writes the current entry and starts the next one behind it.
+ */
+static void finishEntry(CLogIndex *index) {
+  if (clog_writeAll(index->fd, &index->entry, sizeof(index->entry), -1, NULL) < sizeof(index->entry)) {
+    index->errors++;
+  }
+
+  index->entries++;
+  resetEntry(&index->entry, index->entry.offset + index->entry.length);
+}
+
+bool clog_indexOpen(CLogIndex *const index, const char *const path, const size_t blockSize) {
+  if (NULL == index || NULL == path || 0U == blockSize) {
+    return false;
+  }
+
+  index->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  index->blockSize = blockSize;
+  index->entries = 0U;
+  index->errors = 0U;
+  resetEntry(&index->entry, 0U);
+  if (index->fd < 0) {
+    return false;
+  }
+
+  Header header;
+  memcpy(header.magic, Magic, sizeof(Magic));
+  header.byteOrder = BYTE_ORDER_MARKER;
+  header.entrySize = sizeof(CLogIndexEntry);
+  if (write(index->fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+    close(index->fd);
+    index->fd = -1;
+    return false;
+  }
+  return true;
+}
+
+void clog_indexAdd(CLogIndex *const index, const CLogMessage *const msg, const uint64_t time, const size_t size) {
+  if (NULL == index || index->fd < 0) {
+    return;
+  }
+
+  CLogIndexEntry *entry = &index->entry;
+  entry->length += size;
+  if (NULL != msg) {
+    entry->first = (time < entry->first) ? time : entry->first;
+    entry->last = (time > entry->last) ? time : entry->last;
+    if (msg->level < CLOG_LOFF) {
+      entry->counts[msg->level]++;
+    }
+    if (NULL != msg->tag) {
+      addKey(entry, tagKey(msg->tag));
+    }
+    if (NULL != msg->file) {
+      addKey(entry, siteKey(msg->file, msg->line));
+    }
+  }
+
+  if (entry->length >= index->blockSize) {
+    finishEntry(index);
+  }
+}
+
+void clog_indexAddUnknown(CLogIndex *const index, const size_t size) {
+  if (NULL == index || index->fd < 0 || 0U == size) {
+    return;
+  }
+
+  if (index->entry.length > 0U) {
+    finishEntry(index);
+  }
+
+  CLogIndexEntry *entry = &index->entry;
+  entry->length = size;
+  entry->first = 0U;
+  entry->last = UINT64_MAX;
+  memset(entry->counts, 0xFF, sizeof(entry->counts));
+  memset(entry->bloom, 0xFF, sizeof(entry->bloom));
+  finishEntry(index);
+}
+
+bool clog_indexIsBlockStart(const CLogIndex *const index) {
+  return NULL != index && index->fd >= 0 && 0U == index->entry.length && index->entry.offset > 0U;
+}
+
+void clog_indexClose(CLogIndex *const index) {
+  if (NULL == index || index->fd < 0) {
+    return;
+  }
+
+  if (index->entry.length > 0U) {
+    finishEntry(index);
+  }
+  close(index->fd);
+  index->fd = -1;
+}
+
+bool clog_indexRead(FILE *const file, const CLogIndexCallback callback, void *const userData) {
+  if (NULL == file || NULL == callback) {
+    return false;
+  }
+
+  Header header;
+  if (1U != fread(&header, sizeof(header), 1U, file) || 0 != memcmp(header.magic, Magic, sizeof(Magic)) ||
+      BYTE_ORDER_MARKER != header.byteOrder || sizeof(CLogIndexEntry) != header.entrySize) {
+    return false;
+  }
+
+  CLogIndexEntry entry;
+  size_t size;
+  while (sizeof(entry) == (size = fread(&entry, 1U, sizeof(entry), file))) {
+    callback(&entry, userData);
+  }
+  return 0U == size && 0 == ferror(file);
+}
+
+bool clog_indexMayMatch(const CLogIndexEntry *const entry, const CLogIndexQuery *const query) {
+  if (NULL == entry || NULL == query) {
+    return false;
+  }
+
+  if (entry->last < query->from || (0U != query->until && entry->first >= query->until)) {
+    return false;
+  }
+
+  bool hasLevel = false;
+  for (size_t level = (size_t)query->level; level < CLOG_LOFF; level++) {
+    hasLevel = hasLevel || (entry->counts[level] > 0U);
+  }
+  if (!hasLevel) {
+    return false;
+  }
+
+  bool hasTag = (0U == query->numberOfTags);
+  for (size_t i = 0; !hasTag && i < query->numberOfTags; i++) {
+    hasTag = hasKey(entry, tagKey(query->tags[i]));
+  }
+  return hasTag && (NULL == query->file || hasKey(entry, siteKey(query->file, query->line)));
+}
+
+bool clog_indexMatches(const CLogIndexQuery *const query, const CLogMessage *const msg, const uint64_t time) {
+  if (NULL == query || NULL == msg) {
+    return false;
+  }
+
+  if (time < query->from || (0U != query->until && time >= query->until) || msg->level < query->level) {
+    return false;
+  }
+
+  bool hasTag = (0U == query->numberOfTags);
+  for (size_t i = 0; !hasTag && i < query->numberOfTags; i++) {
+    hasTag = (NULL != msg->tag && 0 == strcmp(msg->tag, query->tags[i]));
+  }
+  if (!hasTag) {
+    return false;
+  }
+
+  return NULL == query->file ||
+         (NULL != msg->file && 0 == strcmp(msg->file, query->file) && msg->line == query->line);
+}
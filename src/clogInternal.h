@@ -0,0 +1,251 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Functions shared between the modules of the library, not part of the API.
+ * @date 2019-09-16
+ *
+ * @file
+ */
+
+#ifndef SRC_CLOGINTERNAL_H_
+#define SRC_CLOGINTERNAL_H_
+
+#include "clog.h"
+
+/**
+ * The stamp of a message, see CLogMessage::timestamp, CLogMessage::sequence and CLogMessage::threadId.
+ */
+typedef struct _CLogStamp {
+  uint64_t timestamp; ///< The time the message has been logged.
+  uint64_t sequence;  ///< The number of the message within its context (or per-thread ring).
+  uint32_t threadId;  ///< The id of the logging thread.
+} CLogStamp;
+
+/**
+ * Stamps a new message: reads the clock of the context and takes the next sequence number of a counter. Thread safe.
+ *
+ * @param ctx     The log context the message is logged to.
+ * @param counter The counter of the messages, CLogContext::sequence or the one of a per-thread ring. NULL leaves the
+ *                sequence number zero, for callers numbering the message themselves.
+ * @param stamp   Receives the stamp.
+ */
+void clog_stamp(const CLogContext *const ctx, uint64_t *const counter, CLogStamp *const stamp);
+
+/**
+ * Passes a message with captured arguments to the adapters of a context. The message text is formatted before
+ * calling the adapters unless the context uses deferred formatting. The context must have been checked before.
+ *
+ * @param ctx       The log context to be used.
+ * @param site      The call site of the message.
+ * @param temporary Set if the call site is not static (CLogMessage::site is NULL then).
+ * @param stamp     The stamp of the message.
+ * @param args      The captured message arguments.
+ */
+void clog_dispatchArgs(const CLogContext *const ctx,
+                       const CLogCallSite *const site,
+                       const bool temporary,
+                       const CLogStamp *const stamp,
+                       const CLogArgs *const args);
+
+/**
+ * Initializes a message with captured arguments, see clog_dispatchArgs(). The text is formatted when asked for.
+ *
+ * @param msg       The message to be initialized.
+ * @param ctx       The log context the message has been logged to.
+ * @param site      The call site of the message.
+ * @param temporary Set if the call site is not static (CLogMessage::site is NULL then).
+ * @param stamp     The stamp of the message.
+ * @param args      The captured message arguments.
+ */
+void clog_initMessage(CLogMessage *const msg,
+                      const CLogContext *const ctx,
+                      const CLogCallSite *const site,
+                      const bool temporary,
+                      const CLogStamp *const stamp,
+                      const CLogArgs *const args);
+
+/**
+ * Passes a batch of messages initialized by clog_initMessage() to the adapters of a context. Adapters with a batch
+ * backend (see CLogAdapter::onMessages) get the accepted messages at once, all others one by one.
+ *
+ * @param ctx      The log context to be used.
+ * @param messages The messages, in the order they have been logged.
+ * @param sites    The call sites of the messages.
+ * @param count    The number of messages.
+ */
+void clog_dispatchBatch(const CLogContext *const ctx,
+                        CLogMessage messages[],
+                        const CLogCallSite *const sites[],
+                        const size_t count);
+
+/**
+ * Provides the color code of a level, regardless of CLOG_COLOR.
+ *
+ * @param level        The level.
+ * @return const char* The ANSI escape code.
+ */
+const char *clog_getLevelColor(const CLogLevel level);
+
+/**
+ * The highest precision of floating point conversions formatted by CLog itself, higher ones are left to the C library.
+ */
+#define CLOG_FLOAT_PRECISION (128)
+
+/**
+ * The size of the digits buffer of clog_floatDigits(): 309 integer digits, CLOG_FLOAT_PRECISION fraction digits and a
+ * carry.
+ */
+#define CLOG_FLOAT_DIGITS (440U)
+
+/**
+ * Selects which digits clog_floatDigits() generates.
+ */
+typedef enum _CLogDigitsMode {
+  CLOG_DIGITS_SIGNIFICANT, ///< The given number of significant digits (%e, %g).
+  CLOG_DIGITS_FRACTION,    ///< All digits down to the given position after the decimal point (%f).
+  CLOG_DIGITS_SHORTEST,    ///< The shortest digits reading back as the same double, the count is ignored.
+} CLogDigitsMode;
+
+/**
+ * Generates the decimal digits of a positive finite double, correctly rounded (half to even, like glibc does).
+ *
+ * @param digits   The buffer receiving the digits (not terminated). There are no leading zeros.
+ * @param value    The value, the sign is ignored.
+ * @param mode     Which digits to generate.
+ * @param count    The number of significant digits (1 to CLOG_FLOAT_PRECISION + 1) or the number of fraction digits
+ *                 (0 to CLOG_FLOAT_PRECISION), depending on mode.
+ * @param exponent Receives the decimal exponent: the value is 0.d1d2d3... * 10^exponent.
+ * @return size_t  The number of digits, zero if the (rounded) value is zero.
+ */
+size_t clog_floatDigits(char digits[CLOG_FLOAT_DIGITS],
+                        const double value,
+                        const CLogDigitsMode mode,
+                        const int count,
+                        int *const exponent);
+
+/**
+ * Computes the decimal exponent of a positive finite double, 10^(exponent-1) <= value < 10^exponent.
+ *
+ * @param value The value, the sign is ignored.
+ * @return int  The exponent, zero for zero.
+ */
+int clog_floatExponent(const double value);
+
+/**
+ * Formats a message text like clog_vformat(), optionally printing the shortest representation of doubles.
+ *
+ * @param buffer         The buffer to fill the text into.
+ * @param bufferSize     The size of buffer.
+ * @param shortestFloats See CLogContext::shortestFloats.
+ * @param site           The call site, its parsed format string (see CLogSiteFormat) is used if it has been logged
+ *                       with format. Can be NULL.
+ * @param format         The format string.
+ * @param list           The arguments.
+ * @return size_t        The length of the complete text.
+ */
+size_t clog_vformatWith(char buffer[],
+                        const size_t bufferSize,
+                        const bool shortestFloats,
+                        const CLogCallSite *const site,
+                        const char *const format,
+                        va_list list);
+
+/**
+ * Formats a record of captured arguments like clog_formatArgs(), optionally printing the shortest representation of
+ * doubles.
+ *
+ * @param buffer         The buffer to fill the text into.
+ * @param bufferSize     The size of buffer.
+ * @param shortestFloats See CLogContext::shortestFloats.
+ * @param site           The call site the arguments have been captured for, see clog_vformatWith(). Can be NULL.
+ * @param args           The captured arguments.
+ * @return size_t        The length of the complete text.
+ */
+size_t clog_formatArgsWith(char buffer[],
+                           const size_t bufferSize,
+                           const bool shortestFloats,
+                           const CLogCallSite *const site,
+                           const CLogArgs *const args);
+
+/**
+ * Captures the raw arguments of a message like clog_captureArgs(), taking the argument types from the parsed format
+ * string of the call site if possible.
+ *
+ * @param args   The record to be filled.
+ * @param site   The call site, see clog_vformatWith(). Can be NULL.
+ * @param format The format string.
+ * @param list   The arguments.
+ * @return bool  See clog_captureArgs().
+ */
+bool clog_captureArgsWith(CLogArgs *const args,
+                          const CLogCallSite *const site,
+                          const char *const format,
+                          va_list list);
+
+/**
+ * Formats a message right away and stores the text as the only argument of a record (with the format `%s`), for
+ * messages whose format string is only valid during the call. Texts longer than the record are truncated.
+ *
+ * @param args           The record to be filled.
+ * @param shortestFloats See CLogContext::shortestFloats.
+ * @param format         The format string.
+ * @param list           The arguments.
+ * @return bool          True if the complete text has been stored.
+ */
+bool clog_captureFormatted(CLogArgs *const args, const bool shortestFloats, const char *const format, va_list list);
+
+struct _CLogFilePolicy;
+
+/**
+ * Formats the line of a message for a log file (see clogFile.h), truncating it like clog_formatMessage() does.
+ *
+ * @param buffer  The buffer receiving the line, at least CLOG_FILE_LINE_SIZE bytes.
+ * @param msg     The message.
+ * @return size_t The length of the line, without the terminating null byte.
+ */
+size_t clog_formatFileLine(char buffer[], const CLogMessage *const msg);
+
+/**
+ * Checks whether the flush policy of a log file asks for writing the buffered lines after lines have been appended.
+ *
+ * @param policy   The policy.
+ * @param used     The number of bytes buffered.
+ * @param oldest   The timestamp of the oldest buffered line.
+ * @param messages The messages just appended.
+ * @param count    The number of messages, at least one.
+ * @return true    If the buffer has to be written.
+ * @return false   Otherwise.
+ */
+bool clog_isFlushDue(const struct _CLogFilePolicy *const policy,
+                     const size_t used,
+                     const uint64_t oldest,
+                     const CLogMessage messages[],
+                     const size_t count);
+
+/**
+ * Writes all bytes to a file descriptor, retrying after partial writes and interruptions. The log files, their indexes
+ * and the compressed files are written with it.
+ *
+ * @param fd      The file descriptor.
+ * @param data    The bytes to write.
+ * @param length  The number of bytes.
+ * @param offset  The offset in the file to write at with pwrite(), negative to write at the file position with write().
+ * @param calls   Incremented for every system call made, including the interrupted ones. Can be NULL.
+ * @return size_t The number of bytes written, less than length if a system call failed (errno tells why).
+ */
+size_t clog_writeAll(const int fd, const void *const data, const size_t length, const int64_t offset, uint64_t *calls);
+
+/**
+ * Converts the timestamp of a message into the wall-clock time, like the time conversions of a layout do (see
+ * clogLayout.h).
+ *
+ * @param msg       The message.
+ * @return uint64_t The time in ns since the epoch.
+ */
+uint64_t clog_wallClockTime(const CLogMessage *const msg);
+
+#endif /* SRC_CLOGINTERNAL_H_ */
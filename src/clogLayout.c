@@ -0,0 +1,313 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Compiled pattern layouts for formatting message lines.
+ * @date 2019-09-16
+ *
+ * @file
+ */
+
+#include "clogLayout.h"
+#include "clogClock.h"
+#include "clogInternal.h"
+#include <string.h>
+#include <time.h>
+
+// Printed for NULL strings, like printf does
+static const char NullString[] = "(null)";
+
+/**
+ * The operations of a compiled layout.
+ */
+typedef enum _OpCode {
+  OP_TEXT,     ///< literal text
+  OP_LEVEL,    ///< %L
+  OP_COLOR,    ///< %C
+  OP_TAG,      ///< %T
+  OP_FILE,     ///< %F
+  OP_LINE,     ///< %l
+  OP_FUNCTION, ///< %f
+  OP_MESSAGE,  ///< %m
+  OP_TIME_MS,  ///< %d
+  OP_TIME_US,  ///< %D
+} OpCode;
+
+// The length of "YYYY-MM-DD HH:MM:SS"
+#define TIME_PREFIX_LENGTH (19U)
+
+/**
+ * The rendered date and time of the last second formatted by a thread. Only the fraction of the second is converted
+ * per message, localtime_r() and strftime() are called once per second.
+ */
+typedef struct _TimeCache {
+  bool valid;                            ///< Set once prefix has been rendered.
+  int64_t second;                        ///< The wall-clock second of prefix.
+  char prefix[TIME_PREFIX_LENGTH + 1U];  ///< "YYYY-MM-DD HH:MM:SS" of second.
+  bool offsetValid;                      ///< Set once offset has been measured.
+  uint64_t offsetSecond;                 ///< The monotonic second offset has been measured in.
+  uint64_t offset;                       ///< CLOCK_REALTIME - CLOCK_MONOTONIC.
+} TimeCache;
+
+// Per thread, so formatting never waits for other threads (e.g. the dispatcher of an asynchronous context)
+static __thread TimeCache timeCache;
+
+/**
+ * Writes into a buffer, counting the characters that don't fit.
+ */
+typedef struct _Writer {
+  char *buffer;
+  size_t size;
+  size_t position;
+} Writer;
+
+static void append(Writer *writer, const char *text, size_t length) {
+  if (writer->position < writer->size) {
+    size_t available = writer->size - writer->position - 1U;
+    memcpy(&writer->buffer[writer->position], text, (length < available) ? length : available);
+  }
+  writer->position += length;
+}
+
+static void appendString(Writer *writer, const char *text) {
+  if (NULL == text) {
+    text = NullString;
+  }
+  append(writer, text, strlen(text));
+}
+
+static void appendInt(Writer *writer, int value) {
+  char digits[12];
+  size_t position = sizeof(digits);
+  unsigned int magnitude = (value < 0) ? 0U - (unsigned int)value : (unsigned int)value;
+
+  do {
+    digits[--position] = (char)('0' + (magnitude % 10U));
+    magnitude /= 10U;
+  } while (0U != magnitude);
+
+  if (value < 0) {
+    digits[--position] = '-';
+  }
+
+  append(writer, &digits[position], sizeof(digits) - position);
+}
+
+/**
+ * Converts the timestamp of a message into the wall-clock time. The built-in monotonic clocks (see clogClock.h) are
+ * converted using the offset between CLOCK_REALTIME and CLOCK_MONOTONIC, measured at most once per second. The
+ * timestamps of all other clocks are taken as time since the epoch.
+ */
+static uint64_t wallClockTime(TimeCache *cache, const CLogMessage *msg) {
+  if (NULL == msg->context) {
+    return msg->timestamp;
+  }
+
+  const CLogClock clock = msg->context->clock;
+  if (NULL != clock && clog_clockMonotonic != clock && clog_clockMonotonicCoarse != clock && clog_clockTsc != clock) {
+    return msg->timestamp;
+  }
+
+  const uint64_t second = msg->timestamp / 1000000000U;
+  if (!cache->offsetValid || second != cache->offsetSecond) {
+    cache->offset = clog_clockRealtime() - clog_clockMonotonic();
+    cache->offsetSecond = second;
+    cache->offsetValid = true;
+  }
+  return msg->timestamp + cache->offset;
+}
+
+uint64_t clog_wallClockTime(const CLogMessage *const msg) {
+  return wallClockTime(&timeCache, msg);
+}
+
+/**
+ * Appends the local date and time of a message, e.g. "2019-09-16 12:34:56.789".
+ *
+ * @param digits The number of fraction digits (3 or 6).
+ */
+static void appendTime(Writer *writer, const CLogMessage *msg, unsigned int digits) {
+  TimeCache *cache = &timeCache;
+  const uint64_t time = wallClockTime(cache, msg);
+  const int64_t second = (int64_t)(time / 1000000000U);
+
+  if (!cache->valid || second != cache->second) {
+    const time_t seconds = (time_t)second;
+    struct tm local;
+    if (NULL == localtime_r(&seconds, &local) ||
+        TIME_PREFIX_LENGTH != strftime(cache->prefix, sizeof(cache->prefix), "%Y-%m-%d %H:%M:%S", &local)) {
+      memset(cache->prefix, '?', TIME_PREFIX_LENGTH);
+    }
+    cache->second = second;
+    cache->valid = true;
+  }
+
+  char fraction[7];
+  uint32_t value = (uint32_t)(time % 1000000000U) / ((3U == digits) ? 1000000U : 1000U);
+  fraction[0] = '.';
+  for (unsigned int i = digits; i > 0U; i--) {
+    fraction[i] = (char)('0' + value % 10U);
+    value /= 10U;
+  }
+
+  append(writer, cache->prefix, TIME_PREFIX_LENGTH);
+  append(writer, fraction, digits + 1U);
+}
+
+static bool addOp(CLogLayout *layout, OpCode code, size_t offset, size_t length) {
+  if (layout->numberOfOps >= CLOG_LAYOUT_OPS) {
+    return false;
+  }
+  CLogLayoutOp *op = &layout->ops[layout->numberOfOps++];
+  op->code = (unsigned char)code;
+  op->offset = (unsigned short)offset;
+  op->length = (unsigned char)length;
+  return true;
+}
+
+/**
+ * Adds a literal character, extending the previous text operation if possible.
+ */
+static bool addText(CLogLayout *layout, size_t *textSize, char c) {
+  if (*textSize >= CLOG_LAYOUT_TEXT) {
+    return false;
+  }
+
+  CLogLayoutOp *last = (layout->numberOfOps > 0U) ? &layout->ops[layout->numberOfOps - 1U] : NULL;
+  if (NULL == last || OP_TEXT != last->code || UINT8_MAX == last->length) {
+    if (!addOp(layout, OP_TEXT, *textSize, 0U)) {
+      return false;
+    }
+    last = &layout->ops[layout->numberOfOps - 1U];
+  }
+
+  layout->text[(*textSize)++] = c;
+  last->length++;
+  return true;
+}
+
+static bool conversionCode(char conversion, OpCode *code) {
+  switch (conversion) {
+  case 'L':
+    *code = OP_LEVEL;
+    return true;
+  case 'C':
+    *code = OP_COLOR;
+    return true;
+  case 'T':
+    *code = OP_TAG;
+    return true;
+  case 'F':
+    *code = OP_FILE;
+    return true;
+  case 'l':
+    *code = OP_LINE;
+    return true;
+  case 'f':
+    *code = OP_FUNCTION;
+    return true;
+  case 'm':
+    *code = OP_MESSAGE;
+    return true;
+  case 'd':
+    *code = OP_TIME_MS;
+    return true;
+  case 'D':
+    *code = OP_TIME_US;
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool clog_compileLayout(CLogLayout *const layout, const char *const pattern) {
+  if (NULL == layout) {
+    return false;
+  }
+
+  layout->numberOfOps = 0U;
+  if (NULL == pattern) {
+    return false;
+  }
+
+  size_t textSize = 0U;
+  bool ok = true;
+
+  for (const char *p = pattern; ok && 0 != *p; p++) {
+    OpCode code;
+
+    if ('%' != *p) {
+      ok = addText(layout, &textSize, *p);
+    } else if ('%' == p[1]) {
+      ok = addText(layout, &textSize, '%');
+      p++;
+    } else if (conversionCode(p[1], &code)) {
+      ok = addOp(layout, code, 0U, 0U);
+      p++;
+    } else {
+      ok = false;
+    }
+  }
+
+  if (!ok) {
+    layout->numberOfOps = 0U;
+  }
+  return ok;
+}
+
+size_t clog_formatLayout(char buffer[],
+                         const size_t bufferSize,
+                         const CLogLayout *const layout,
+                         const CLogMessage *const msg) {
+  if (NULL == buffer || 0U == bufferSize) {
+    return 0U;
+  }
+
+  Writer writer = {buffer, bufferSize, 0U};
+
+  if (NULL != layout && NULL != msg) {
+    for (size_t i = 0; i < layout->numberOfOps; i++) {
+      const CLogLayoutOp *op = &layout->ops[i];
+
+      switch ((OpCode)op->code) {
+      case OP_TEXT:
+        append(&writer, &layout->text[op->offset], op->length);
+        break;
+      case OP_LEVEL:
+        appendString(&writer, clog_getLevel(msg->level));
+        break;
+      case OP_COLOR:
+        appendString(&writer, clog_getLevelColor(msg->level));
+        break;
+      case OP_TAG:
+        appendString(&writer, msg->tag);
+        break;
+      case OP_FILE:
+        appendString(&writer, msg->file);
+        break;
+      case OP_LINE:
+        // printed as int, like the former "%d" format did
+        appendInt(&writer, (int)msg->line);
+        break;
+      case OP_FUNCTION:
+        appendString(&writer, msg->function);
+        break;
+      case OP_MESSAGE:
+        appendString(&writer, clog_getMessage(msg));
+        break;
+      case OP_TIME_MS:
+        appendTime(&writer, msg, 3U);
+        break;
+      case OP_TIME_US:
+        appendTime(&writer, msg, 6U);
+        break;
+      }
+    }
+  }
+
+  buffer[(writer.position < bufferSize) ? writer.position : bufferSize - 1U] = 0;
+  return writer.position;
+}
@@ -0,0 +1,241 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Crash-survivable flight recorder.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * File layout: a header of HEADER_SIZE bytes (see CLogRecorderHeader) followed by the slots. Every slot starts with a
+ * Slot header followed by the line. A slot is valid if its magic is set and the checksum matches.
+ */
+
+#include "clogRecorder.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HEADER_SIZE (64U)
+#define SLOT_MAGIC (0x434C5253U) // "CLRS"
+#define MIN_SLOT_SIZE (64U)
+
+static const char Magic[8] = {'C', 'L', 'O', 'G', 'R', 'E', 'C', '1'};
+
+/**
+ * The header of a flight recorder file.
+ */
+typedef struct _CLogRecorderHeader {
+  char magic[8];          ///< Identifies the file format.
+  uint32_t slotSize;      ///< The size of a slot.
+  uint32_t numberOfSlots; ///< The number of slots.
+  uint64_t nextSequence;  ///< The sequence number of the next line, incremented atomically.
+} CLogRecorderHeader;
+
+/**
+ * The header of a slot, followed by the line.
+ */
+typedef struct _Slot {
+  uint32_t magic;    ///< SLOT_MAGIC if the slot has been completely written.
+  uint32_t length;   ///< The length of the line.
+  uint64_t sequence; ///< The sequence number of the line.
+  uint32_t checksum; ///< Checksum of sequence, length and line.
+  uint32_t reserved; ///< Unused, keeps the line 8 byte aligned.
+} Slot;
+
+/**
+ * A valid slot found by clog_recorderRead().
+ */
+typedef struct _Found {
+  uint64_t sequence;
+  const Slot *slot;
+} Found;
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 16777619U;
+  }
+  return hash;
+}
+
+static uint32_t checksum(const uint64_t sequence, const uint32_t length, const char *line) {
+  uint32_t hash = 2166136261U;
+  hash = fnv1a(hash, &sequence, sizeof(sequence));
+  hash = fnv1a(hash, &length, sizeof(length));
+  return fnv1a(hash, line, length);
+}
+
+static bool isSameGeometry(const CLogRecorderHeader *header, const size_t numberOfSlots, const size_t slotSize) {
+  return 0 == memcmp(header->magic, Magic, sizeof(Magic)) && header->numberOfSlots == numberOfSlots &&
+         header->slotSize == slotSize;
+}
+
+bool clog_recorderOpen(CLogRecorder *const recorder,
+                       const char *const path,
+                       const size_t numberOfSlots,
+                       const size_t slotSize) {
+  if (NULL == recorder || NULL == path || 0U == numberOfSlots || numberOfSlots > UINT32_MAX ||
+      slotSize < MIN_SLOT_SIZE || slotSize > UINT32_MAX || 0U != slotSize % sizeof(uint64_t)) {
+    return false;
+  }
+
+  memset(recorder, 0, sizeof(*recorder));
+  recorder->fd = -1;
+
+  const size_t size = HEADER_SIZE + numberOfSlots * slotSize;
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat status;
+  if (0 != fstat(fd, &status) || ((size_t)status.st_size != size && 0 != ftruncate(fd, (off_t)size))) {
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == map) {
+    close(fd);
+    return false;
+  }
+
+  CLogRecorderHeader *header = (CLogRecorderHeader *)map;
+  if (!isSameGeometry(header, numberOfSlots, slotSize)) {
+    // written with different settings (or new), the old slots can't be used
+    memset(map, 0, size);
+    memcpy(header->magic, Magic, sizeof(Magic));
+    header->slotSize = (uint32_t)slotSize;
+    header->numberOfSlots = (uint32_t)numberOfSlots;
+  }
+
+  recorder->fd = fd;
+  recorder->map = map;
+  recorder->mapSize = size;
+  recorder->header = header;
+  recorder->slots = (unsigned char *)map + HEADER_SIZE;
+  recorder->numberOfSlots = numberOfSlots;
+  recorder->slotSize = slotSize;
+  return true;
+}
+
+void clog_recorderWrite(CLogRecorder *const recorder, const CLogMessage *const msg) {
+  if (NULL == recorder || NULL == recorder->header || NULL == msg) {
+    return;
+  }
+
+  const uint64_t sequence = __atomic_fetch_add(&recorder->header->nextSequence, 1U, __ATOMIC_RELAXED);
+  Slot *slot = (Slot *)&recorder->slots[(sequence % recorder->numberOfSlots) * recorder->slotSize];
+  char *line = (char *)(slot + 1);
+  const int lineSize = (int)(recorder->slotSize - sizeof(Slot));
+
+  // invalidate the slot while it is written
+  __atomic_store_n(&slot->magic, 0U, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  int length = lineSize;
+  line[0] = 0;
+  clog_formatMessage(line, &length, msg);
+  if (length >= lineSize) {
+    length = lineSize - 1;
+  }
+
+  slot->length = (uint32_t)length;
+  slot->sequence = sequence;
+  slot->checksum = checksum(sequence, slot->length, line);
+  __atomic_store_n(&slot->magic, SLOT_MAGIC, __ATOMIC_RELEASE);
+}
+
+void clog_recorderClose(CLogRecorder *const recorder) {
+  if (NULL == recorder || NULL == recorder->map) {
+    return;
+  }
+
+  munmap(recorder->map, recorder->mapSize);
+  close(recorder->fd);
+  memset(recorder, 0, sizeof(*recorder));
+  recorder->fd = -1;
+}
+
+static int compareFound(const void *a, const void *b) {
+  const uint64_t first = ((const Found *)a)->sequence;
+  const uint64_t second = ((const Found *)b)->sequence;
+  return (first > second) - (first < second);
+}
+
+bool clog_recorderRead(const char *const path, const CLogRecorderCallback callback, void *const userData) {
+  if (NULL == path || NULL == callback) {
+    return false;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat status;
+  void *map = MAP_FAILED;
+  if (0 == fstat(fd, &status) && (size_t)status.st_size >= HEADER_SIZE) {
+    map = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (MAP_FAILED == map) {
+    return false;
+  }
+
+  const size_t size = (size_t)status.st_size;
+  const CLogRecorderHeader *header = (const CLogRecorderHeader *)map;
+  const size_t numberOfSlots = header->numberOfSlots;
+  const size_t slotSize = header->slotSize;
+
+  if (!isSameGeometry(header, numberOfSlots, slotSize) || slotSize < MIN_SLOT_SIZE ||
+      HEADER_SIZE + numberOfSlots * slotSize != size) {
+    munmap(map, size);
+    return false;
+  }
+
+  Found *found = malloc(numberOfSlots * sizeof(Found));
+  size_t numberFound = 0U;
+  if (NULL == found) {
+    munmap(map, size);
+    return false;
+  }
+
+  const unsigned char *slots = (const unsigned char *)map + HEADER_SIZE;
+  for (size_t i = 0; i < numberOfSlots; i++) {
+    const Slot *slot = (const Slot *)&slots[i * slotSize];
+    const char *line = (const char *)(slot + 1);
+
+    if (SLOT_MAGIC == slot->magic && slot->length < slotSize - sizeof(Slot) &&
+        slot->checksum == checksum(slot->sequence, slot->length, line)) {
+      found[numberFound].sequence = slot->sequence;
+      found[numberFound].slot = slot;
+      numberFound++;
+    }
+  }
+
+  // the slots are reused in a ring, the sequence numbers restore the order
+  qsort(found, numberFound, sizeof(Found), compareFound);
+
+  char *line = malloc(slotSize);
+  if (NULL != line) {
+    for (size_t i = 0; i < numberFound; i++) {
+      const Slot *slot = found[i].slot;
+      memcpy(line, slot + 1, slot->length);
+      line[slot->length] = 0;
+      callback(line, slot->length, slot->sequence, userData);
+    }
+  }
+
+  free(line);
+  free(found);
+  munmap(map, size);
+  return NULL != line;
+}
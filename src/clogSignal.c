@@ -0,0 +1,529 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Async-signal-safe logging.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * Everything reachable from clog_logSignalSafe() must stay async-signal-safe: no locks, no allocation, no stdio, no
+ * locale dependent functions. Only atomics, plain memory accesses and write(2) are used.
+ */
+
+#include "clogSignal.h"
+#include <errno.h>
+#include <unistd.h>
+
+// Printed for NULL strings and pointers, like glibc does
+static const char NullString[] = "(null)";
+static const char NullPointer[] = "(nil)";
+
+// The size of a line written to the file descriptor (header and text)
+#define LINE_SIZE (CLOG_SIGNAL_TEXT + 256U)
+
+// The flags of a conversion specification
+#define FLAG_MINUS (1U)
+#define FLAG_PLUS (2U)
+#define FLAG_SPACE (4U)
+#define FLAG_HASH (8U)
+#define FLAG_ZERO (16U)
+
+// The length modifiers of a conversion specification
+typedef enum _Length { LENGTH_NONE, LENGTH_HH, LENGTH_H, LENGTH_L, LENGTH_LL, LENGTH_J, LENGTH_Z, LENGTH_T } Length;
+
+/**
+ * Writes into a buffer, truncating the text that doesn't fit.
+ */
+typedef struct _Writer {
+  char *buffer;
+  size_t size;
+  size_t position;
+} Writer;
+
+static void putChar(Writer *writer, const char c) {
+  if (writer->position + 1U < writer->size) {
+    writer->buffer[writer->position++] = c;
+  }
+}
+
+static void putChars(Writer *writer, const char *text, size_t length) {
+  while (length-- > 0U) {
+    putChar(writer, *text++);
+  }
+}
+
+static void putString(Writer *writer, const char *text) {
+  if (NULL == text) {
+    text = NullString;
+  }
+  while (0 != *text) {
+    putChar(writer, *text++);
+  }
+}
+
+static void putPadding(Writer *writer, const char pad, const size_t length, const size_t width) {
+  for (size_t i = length; i < width; i++) {
+    putChar(writer, pad);
+  }
+}
+
+/**
+ * Writes a field of prefix, leading zeros and text, padded with spaces to width.
+ */
+static void putField(Writer *writer,
+                     const char *prefix,
+                     const size_t prefixLength,
+                     const size_t zeros,
+                     const char *text,
+                     const size_t length,
+                     const unsigned int flags,
+                     const size_t width) {
+  const size_t total = prefixLength + zeros + length;
+
+  if (0U == (flags & FLAG_MINUS)) {
+    putPadding(writer, ' ', total, width);
+  }
+  putChars(writer, prefix, prefixLength);
+  putPadding(writer, '0', 0U, zeros);
+  putChars(writer, text, length);
+  if (flags & FLAG_MINUS) {
+    putPadding(writer, ' ', total, width);
+  }
+}
+
+/**
+ * Writes an unsigned number like printf() does, with a sign if negative is set.
+ *
+ * @param precision The minimum number of digits, -1 if not given.
+ */
+static void putNumber(Writer *writer,
+                      unsigned long long value,
+                      const unsigned int base,
+                      const bool upper,
+                      const bool negative,
+                      const unsigned int flags,
+                      const size_t width,
+                      const int precision) {
+  const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  const bool zero = (0U == value);
+  char text[24];
+  size_t start = sizeof(text);
+
+  // an explicit precision of zero prints no digits for zero
+  while (0U != value || (sizeof(text) == start && 0 != precision)) {
+    text[--start] = digits[value % base];
+    value /= base;
+  }
+  const size_t length = sizeof(text) - start;
+
+  char prefix[2];
+  size_t prefixLength = 0U;
+  if (negative) {
+    prefix[prefixLength++] = '-';
+  } else if (flags & FLAG_PLUS) {
+    prefix[prefixLength++] = '+';
+  } else if (flags & FLAG_SPACE) {
+    prefix[prefixLength++] = ' ';
+  }
+  if ((flags & FLAG_HASH) && 16U == base && !zero) {
+    prefix[prefixLength++] = '0';
+    prefix[prefixLength++] = upper ? 'X' : 'x';
+  }
+
+  size_t zeros = (precision > 0 && (size_t)precision > length) ? (size_t)precision - length : 0U;
+  if ((flags & FLAG_HASH) && 8U == base && 0U == zeros && (0U == length || '0' != text[start])) {
+    // the alternative form of octal numbers starts with a zero
+    zeros = 1U;
+  }
+  if ((flags & FLAG_ZERO) && 0U == (flags & FLAG_MINUS) && precision < 0 && prefixLength + zeros + length < width) {
+    zeros = width - prefixLength - length;
+  }
+
+  putField(writer, prefix, prefixLength, zeros, &text[start], length, flags, width);
+}
+
+size_t clog_formatSignalSafe(char buffer[], const size_t bufferSize, const char *const format, va_list list) {
+  if (NULL == buffer || 0U == bufferSize) {
+    return 0U;
+  }
+
+  Writer writer = {buffer, bufferSize, 0U};
+  const char *p = (NULL != format) ? format : "";
+
+  // copy the list, so it can be passed around by pointer
+  va_list args;
+  va_copy(args, list);
+
+  while (0 != *p) {
+    if ('%' != *p) {
+      putChar(&writer, *p++);
+      continue;
+    }
+
+    const char *start = p++;
+    unsigned int flags = 0U;
+    size_t width = 0U;
+    int precision = -1;
+    Length length = LENGTH_NONE;
+
+    for (;; p++) {
+      if ('-' == *p) {
+        flags |= FLAG_MINUS;
+      } else if ('+' == *p) {
+        flags |= FLAG_PLUS;
+      } else if (' ' == *p) {
+        flags |= FLAG_SPACE;
+      } else if ('#' == *p) {
+        flags |= FLAG_HASH;
+      } else if ('0' == *p) {
+        flags |= FLAG_ZERO;
+      } else {
+        break;
+      }
+    }
+
+    if ('*' == *p) {
+      const int value = va_arg(args, int);
+      if (value < 0) {
+        // a negative width argument is taken as '-' flag followed by a positive width
+        flags |= FLAG_MINUS;
+      }
+      width = (value < 0) ? 0U - (size_t)value : (size_t)value;
+      p++;
+    } else {
+      while (*p >= '0' && *p <= '9') {
+        width = width * 10U + (size_t)(*p++ - '0');
+      }
+    }
+
+    if ('.' == *p) {
+      p++;
+      if ('*' == *p) {
+        // a negative precision argument is taken as if the precision were omitted
+        precision = va_arg(args, int);
+        precision = (precision < 0) ? -1 : precision;
+        p++;
+      } else {
+        precision = 0;
+        while (*p >= '0' && *p <= '9') {
+          precision = (precision < 100000) ? precision * 10 + (*p - '0') : precision;
+          p++;
+        }
+      }
+    }
+
+    switch (*p) {
+    case 'h':
+      length = ('h' == *++p) ? LENGTH_HH : LENGTH_H;
+      p += (LENGTH_HH == length) ? 1 : 0;
+      break;
+    case 'l':
+      length = ('l' == *++p) ? LENGTH_LL : LENGTH_L;
+      p += (LENGTH_LL == length) ? 1 : 0;
+      break;
+    case 'j':
+      length = LENGTH_J;
+      p++;
+      break;
+    case 'z':
+      length = LENGTH_Z;
+      p++;
+      break;
+    case 't':
+      length = LENGTH_T;
+      p++;
+      break;
+    default:
+      break;
+    }
+
+    switch (*p) {
+    case 'd':
+    case 'i': {
+      long long value;
+      switch (length) {
+      case LENGTH_HH:
+        value = (signed char)va_arg(args, int);
+        break;
+      case LENGTH_H:
+        value = (short)va_arg(args, int);
+        break;
+      case LENGTH_L:
+        value = va_arg(args, long);
+        break;
+      case LENGTH_LL:
+        value = va_arg(args, long long);
+        break;
+      case LENGTH_J:
+        value = va_arg(args, intmax_t);
+        break;
+      case LENGTH_Z:
+        value = (long long)va_arg(args, ssize_t);
+        break;
+      case LENGTH_T:
+        value = va_arg(args, ptrdiff_t);
+        break;
+      default:
+        value = va_arg(args, int);
+        break;
+      }
+      unsigned long long magnitude = (value < 0) ? 0U - (unsigned long long)value : (unsigned long long)value;
+      putNumber(&writer, magnitude, 10U, false, value < 0, flags, width, precision);
+      break;
+    }
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X': {
+      unsigned long long value;
+      switch (length) {
+      case LENGTH_HH:
+        value = (unsigned char)va_arg(args, unsigned int);
+        break;
+      case LENGTH_H:
+        value = (unsigned short)va_arg(args, unsigned int);
+        break;
+      case LENGTH_L:
+        value = va_arg(args, unsigned long);
+        break;
+      case LENGTH_LL:
+        value = va_arg(args, unsigned long long);
+        break;
+      case LENGTH_J:
+        value = va_arg(args, uintmax_t);
+        break;
+      case LENGTH_Z:
+        value = va_arg(args, size_t);
+        break;
+      case LENGTH_T:
+        value = (unsigned long long)va_arg(args, ptrdiff_t);
+        break;
+      default:
+        value = va_arg(args, unsigned int);
+        break;
+      }
+      const unsigned int base = ('o' == *p) ? 8U : ('u' == *p) ? 10U : 16U;
+      // signs are only printed for signed conversions
+      putNumber(&writer, value, base, 'X' == *p, false, flags & ~(FLAG_PLUS | FLAG_SPACE), width, precision);
+      break;
+    }
+    case 'c': {
+      const char c = (char)va_arg(args, int);
+      putField(&writer, NULL, 0U, 0U, &c, 1U, flags, width);
+      break;
+    }
+    case 's': {
+      const char *text = va_arg(args, const char *);
+      if (NULL == text) {
+        text = NullString;
+      }
+      // the precision limits the characters read, the string doesn't need to be terminated then
+      size_t textLength = 0U;
+      while ((precision < 0 || textLength < (size_t)precision) && 0 != text[textLength]) {
+        textLength++;
+      }
+      putField(&writer, NULL, 0U, 0U, text, textLength, flags, width);
+      break;
+    }
+    case 'p': {
+      const void *pointer = va_arg(args, const void *);
+      if (NULL == pointer) {
+        putField(&writer, NULL, 0U, 0U, NullPointer, sizeof(NullPointer) - 1U, flags, width);
+      } else {
+        putNumber(&writer, (uintptr_t)pointer, 16U, false, false, flags | FLAG_HASH, width, precision);
+      }
+      break;
+    }
+    case '%':
+      putChar(&writer, '%');
+      break;
+    default:
+      // not supported, the type of the argument is unknown and the following ones can't be found, so the rest of the
+      // format string is copied as it is
+      putString(&writer, start);
+      while (0 != *p) {
+        p++;
+      }
+      continue;
+    }
+    p++;
+  }
+
+  va_end(args);
+
+  buffer[writer.position] = 0;
+  return writer.position;
+}
+
+bool clog_initSignalSafe(CLogSignal *const sig,
+                         CLogContext *const ctx,
+                         CLogSignalSlot slots[],
+                         const size_t numberOfSlots,
+                         const int fd) {
+  if (NULL == sig || NULL == ctx || (NULL == slots && (0U != numberOfSlots || fd < 0)) ||
+      (NULL != slots && (0U == numberOfSlots || 0U != (numberOfSlots & (numberOfSlots - 1U))))) {
+    return false;
+  }
+
+  sig->context = ctx;
+  sig->fd = fd;
+  sig->slots = slots;
+  sig->numberOfSlots = numberOfSlots;
+  sig->tail = 0U;
+  sig->head = 0U;
+  sig->dropped = 0U;
+
+  for (size_t i = 0; i < numberOfSlots; i++) {
+    slots[i].sequence = i;
+  }
+
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return true;
+}
+
+/**
+ * Reserves the next slot of the ring, returns NULL if the ring is full.
+ */
+static CLogSignalSlot *reserveSlot(CLogSignal *sig, uint64_t *position) {
+  uint64_t tail = __atomic_load_n(&sig->tail, __ATOMIC_RELAXED);
+
+  for (;;) {
+    CLogSignalSlot *slot = &sig->slots[tail & (sig->numberOfSlots - 1U)];
+    const uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+    if (sequence == tail) {
+      if (__atomic_compare_exchange_n(&sig->tail, &tail, tail + 1U, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *position = tail;
+        return slot;
+      }
+    } else if (sequence < tail) {
+      return NULL;
+    } else {
+      tail = __atomic_load_n(&sig->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static const char *tagName(const CLogContext *ctx, const size_t tag) {
+  if (NULL == ctx->tagNames || tag >= ctx->numberOfTags) {
+    return "";
+  }
+  return ctx->tagNames[tag];
+}
+
+/**
+ * Writes the complete line to the file descriptor.
+ */
+static void writeLine(const CLogSignal *sig, const CLogSignalSlot *msg) {
+  char line[LINE_SIZE];
+  Writer writer = {line, sizeof(line), 0U};
+
+  putString(&writer, clog_getLevel(msg->level));
+  putChar(&writer, ':');
+  putString(&writer, tagName(sig->context, msg->tag));
+  putChar(&writer, ' ');
+  putString(&writer, msg->file);
+  putChar(&writer, ':');
+  putNumber(&writer, msg->line, 10U, false, false, 0U, 0U, -1);
+  putChar(&writer, '(');
+  putString(&writer, msg->function);
+  putString(&writer, ") ");
+  putString(&writer, msg->text);
+  // keep the end of line, even if the line has been truncated
+  writer.position = (writer.position + 2U < writer.size) ? writer.position : writer.size - 2U;
+  putChar(&writer, '\n');
+
+  size_t written = 0U;
+  while (written < writer.position) {
+    ssize_t result = write(sig->fd, &line[written], writer.position - written);
+    if (result < 0 && EINTR == errno) {
+      continue;
+    }
+    if (result <= 0) {
+      break;
+    }
+    written += (size_t)result;
+  }
+}
+
+void clog_logSignalSafe(CLogSignal *const sig,
+                        const CLogLevel level,
+                        const size_t tag,
+                        const char *const file,
+                        const unsigned int line,
+                        const char *const function,
+                        const char *const format,
+                        ...) {
+  if (NULL == sig || NULL == sig->context || !clog_isLevelEnabled(sig->context, tag, level)) {
+    return;
+  }
+
+  // the interrupted code might check errno after the handler returns
+  const int savedErrno = errno;
+
+  uint64_t position = 0U;
+  CLogSignalSlot *slot = (NULL != sig->slots) ? reserveSlot(sig, &position) : NULL;
+  CLogSignalSlot local;
+
+  if (NULL == slot) {
+    if (NULL != sig->slots) {
+      __atomic_fetch_add(&sig->dropped, 1U, __ATOMIC_RELAXED);
+    }
+    if (sig->fd < 0) {
+      errno = savedErrno;
+      return;
+    }
+    // the line is only written to the file descriptor
+    slot = &local;
+  }
+
+  slot->level = level;
+  slot->tag = tag;
+  slot->file = file;
+  slot->line = line;
+  slot->function = function;
+
+  va_list args;
+  va_start(args, format);
+  clog_formatSignalSafe(slot->text, sizeof(slot->text), format, args);
+  va_end(args);
+
+  if (sig->fd >= 0) {
+    writeLine(sig, slot);
+  }
+
+  if (slot != &local) {
+    __atomic_store_n(&slot->sequence, position + 1U, __ATOMIC_RELEASE);
+  }
+
+  errno = savedErrno;
+}
+
+size_t clog_drainSignalSafe(CLogSignal *const sig) {
+  if (NULL == sig || NULL == sig->slots) {
+    return 0U;
+  }
+
+  size_t count = 0U;
+
+  for (;;) {
+    const uint64_t head = sig->head;
+    CLogSignalSlot *slot = &sig->slots[head & (sig->numberOfSlots - 1U)];
+
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != head + 1U) {
+      break;
+    }
+
+    clog_logMessage(sig->context, slot->level, slot->tag, slot->file, slot->line, slot->function, "%s", slot->text);
+
+    __atomic_store_n(&slot->sequence, head + sig->numberOfSlots, __ATOMIC_RELEASE);
+    sig->head = head + 1U;
+    count++;
+  }
+
+  return count;
+}
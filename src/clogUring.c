@@ -0,0 +1,402 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief File writer submitting blocks through io_uring.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * The ring is set up with the raw system calls (there is no dependency on liburing). Every block in flight is a single
+ * IORING_OP_WRITE_FIXED request whose user_data is the index of the block.
+ */
+
+#include "clogUring.h"
+#include "clogInternal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define CLOG_HAS_IO_URING
+#endif
+#endif
+
+/**
+ * Writes a range of a block with pwrite(), see clog_writeAll().
+ */
+static void writePlain(CLogUring *uring, const char *data, size_t length, uint64_t offset) {
+  if (clog_writeAll(uring->fd, data, length, (int64_t)offset, NULL) < length) {
+    uring->errors++;
+  }
+}
+
+static char *block(CLogUring *uring, size_t index) {
+  return &uring->blocks[index * uring->blockSize];
+}
+
+#if defined(CLOG_HAS_IO_URING)
+
+static int enter(int ringFd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+  return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+/**
+ * Releases the blocks whose writes have completed. Short writes are completed with pwrite().
+ */
+static void reap(CLogUring *uring) {
+  uint32_t head = *uring->cqHead;
+  const uint32_t tail = __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE);
+  const struct io_uring_cqe *cqes = (const struct io_uring_cqe *)uring->cqes;
+
+  for (; head != tail; head++) {
+    const struct io_uring_cqe *cqe = &cqes[head & uring->cqMask];
+    const size_t index = (size_t)cqe->user_data;
+    const size_t length = uring->blockLengths[index];
+
+    if (cqe->res < 0) {
+      uring->errors++;
+    } else if ((size_t)cqe->res < length) {
+      const size_t written = (size_t)cqe->res;
+      writePlain(uring, block(uring, index) + written, length - written, uring->blockOffsets[index] + written);
+    }
+    uring->blockLengths[index] = 0U;
+    uring->inFlight--;
+  }
+
+  __atomic_store_n(uring->cqHead, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * Waits until at least one write has completed.
+ *
+ * @return true  If a block has been released.
+ * @return false If the ring has failed.
+ */
+static bool waitForCompletion(CLogUring *uring) {
+  const size_t inFlight = uring->inFlight;
+
+  for (;;) {
+    reap(uring);
+    if (uring->inFlight < inFlight) {
+      return true;
+    }
+    if (enter(uring->ringFd, 0U, 1U, IORING_ENTER_GETEVENTS) < 0 && EINTR != errno) {
+      return false;
+    }
+  }
+}
+
+/**
+ * Queues the write of a block.
+ *
+ * @return true  If the write has been submitted.
+ * @return false If the kernel refused it.
+ */
+static bool submitNative(CLogUring *uring, size_t index, size_t length, uint64_t offset) {
+  const uint32_t tail = *uring->sqTail;
+  const uint32_t slot = tail & uring->sqMask;
+  struct io_uring_sqe *sqe = &((struct io_uring_sqe *)uring->sqes)[slot];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  sqe->fd = uring->fd;
+  sqe->addr = (uint64_t)(uintptr_t)block(uring, index);
+  sqe->len = (uint32_t)length;
+  sqe->off = offset;
+  sqe->buf_index = (uint16_t)index;
+  sqe->user_data = index;
+  uring->sqArray[slot] = slot;
+  __atomic_store_n(uring->sqTail, tail + 1U, __ATOMIC_RELEASE);
+
+  int result;
+  do {
+    result = enter(uring->ringFd, 1U, 0U, 0U);
+  } while (result < 0 && EINTR == errno);
+  if (1 != result) {
+    // take the entry back, the block is written with pwrite()
+    __atomic_store_n(uring->sqTail, tail, __ATOMIC_RELEASE);
+    return false;
+  }
+  return true;
+}
+
+static void unmapRing(CLogUring *uring) {
+  if (NULL != uring->sqes) {
+    munmap(uring->sqes, uring->sqesSize);
+  }
+  if (NULL != uring->cqRing && uring->cqRing != uring->sqRing) {
+    munmap(uring->cqRing, uring->cqRingSize);
+  }
+  if (NULL != uring->sqRing) {
+    munmap(uring->sqRing, uring->sqRingSize);
+  }
+  uring->sqes = NULL;
+  uring->cqRing = NULL;
+  uring->sqRing = NULL;
+}
+
+static void *mapRing(int ringFd, size_t size, off_t offset) {
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+  return (MAP_FAILED == map) ? NULL : map;
+}
+
+/**
+ * Sets up the ring and registers the blocks.
+ *
+ * @return true  If io_uring can be used.
+ * @return false If the kernel doesn't support it, the caller falls back to pwrite().
+ */
+static bool setupRing(CLogUring *uring) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  uring->ringFd = (int)syscall(__NR_io_uring_setup, (unsigned int)uring->numberOfBlocks, &params);
+  if (uring->ringFd < 0) {
+    return false;
+  }
+
+  uring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  uring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  uring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  if (0U != (params.features & IORING_FEAT_SINGLE_MMAP)) {
+    if (uring->cqRingSize > uring->sqRingSize) {
+      uring->sqRingSize = uring->cqRingSize;
+    }
+    uring->cqRingSize = uring->sqRingSize;
+  }
+
+  uring->sqRing = mapRing(uring->ringFd, uring->sqRingSize, IORING_OFF_SQ_RING);
+  if (0U != (params.features & IORING_FEAT_SINGLE_MMAP)) {
+    uring->cqRing = uring->sqRing;
+  } else {
+    uring->cqRing = mapRing(uring->ringFd, uring->cqRingSize, IORING_OFF_CQ_RING);
+  }
+  uring->sqes = mapRing(uring->ringFd, uring->sqesSize, IORING_OFF_SQES);
+
+  struct iovec buffers[CLOG_URING_MAX_BLOCKS];
+  for (size_t i = 0; i < uring->numberOfBlocks; i++) {
+    buffers[i].iov_base = block(uring, i);
+    buffers[i].iov_len = uring->blockSize;
+  }
+
+  if (NULL == uring->sqRing || NULL == uring->cqRing || NULL == uring->sqes ||
+      0 != syscall(__NR_io_uring_register,
+                   uring->ringFd,
+                   IORING_REGISTER_BUFFERS,
+                   buffers,
+                   (unsigned int)uring->numberOfBlocks)) {
+    unmapRing(uring);
+    close(uring->ringFd);
+    uring->ringFd = -1;
+    return false;
+  }
+
+  char *sq = (char *)uring->sqRing;
+  char *cq = (char *)uring->cqRing;
+  uring->sqTail = (uint32_t *)(sq + params.sq_off.tail);
+  uring->sqMask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+  uring->sqArray = (uint32_t *)(sq + params.sq_off.array);
+  uring->cqHead = (uint32_t *)(cq + params.cq_off.head);
+  uring->cqTail = (uint32_t *)(cq + params.cq_off.tail);
+  uring->cqMask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+  uring->cqes = cq + params.cq_off.cqes;
+  return true;
+}
+
+static void teardownRing(CLogUring *uring) {
+  unmapRing(uring);
+  close(uring->ringFd);
+  uring->ringFd = -1;
+}
+
+#else
+
+static void reap(CLogUring *uring) {
+  (void)uring;
+}
+
+static bool waitForCompletion(CLogUring *uring) {
+  (void)uring;
+  return false;
+}
+
+static bool submitNative(CLogUring *uring, size_t index, size_t length, uint64_t offset) {
+  (void)uring;
+  (void)index;
+  (void)length;
+  (void)offset;
+  return false;
+}
+
+static bool setupRing(CLogUring *uring) {
+  (void)uring;
+  return false;
+}
+
+static void teardownRing(CLogUring *uring) {
+  (void)uring;
+}
+
+#endif
+
+/**
+ * Gives up a failed ring. The blocks still in flight are written again with pwrite(), as their writes might never
+ * complete, before the ring is torn down and any block is reused. All following blocks are written with pwrite().
+ */
+static void abandonRing(CLogUring *uring) {
+  for (size_t i = 0; i < uring->numberOfBlocks; i++) {
+    if (0U != uring->blockLengths[i]) {
+      writePlain(uring, block(uring, i), uring->blockLengths[i], uring->blockOffsets[i]);
+      uring->blockLengths[i] = 0U;
+    }
+  }
+  uring->inFlight = 0U;
+  teardownRing(uring);
+  uring->native = false;
+}
+
+/**
+ * Writes the current block and makes a free block the current one, waiting for one if all are being written.
+ */
+static void submit(CLogUring *uring) {
+  if (0U == uring->used) {
+    return;
+  }
+
+  const size_t index = uring->current;
+  const size_t length = uring->used;
+  const uint64_t offset = uring->offset;
+  uring->offset += length;
+  uring->used = 0U;
+  uring->writes++;
+
+  if (!uring->native || !submitNative(uring, index, length, offset)) {
+    writePlain(uring, block(uring, index), length, offset);
+    return;
+  }
+
+  uring->blockOffsets[index] = offset;
+  uring->blockLengths[index] = length;
+  uring->inFlight++;
+
+  reap(uring);
+  if (uring->inFlight == uring->numberOfBlocks) {
+    uring->waits++;
+    if (!waitForCompletion(uring)) {
+      abandonRing(uring);
+    }
+  }
+  for (size_t i = 0; i < uring->numberOfBlocks; i++) {
+    if (0U == uring->blockLengths[i]) {
+      uring->current = i;
+      return;
+    }
+  }
+}
+
+/**
+ * Copies the line of a message into the current block, submitting it first if the line might not fit.
+ */
+static void appendLine(CLogUring *uring, const CLogMessage *msg) {
+  if (uring->blockSize - uring->used < CLOG_FILE_LINE_SIZE) {
+    submit(uring);
+  }
+  if (0U == uring->used) {
+    uring->oldest = msg->timestamp;
+  }
+
+  uring->used += clog_formatFileLine(block(uring, uring->current) + uring->used, msg);
+}
+
+bool clog_uringOpen(CLogUring *const uring, const char *const path) {
+  if (NULL == uring) {
+    return false;
+  }
+
+  uring->fd = -1;
+  uring->ringFd = -1;
+  uring->native = false;
+  if (NULL == path || NULL == uring->blocks || uring->blockSize < CLOG_FILE_LINE_SIZE || uring->numberOfBlocks < 2U ||
+      uring->numberOfBlocks > CLOG_URING_MAX_BLOCKS) {
+    return false;
+  }
+
+  uring->fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (uring->fd < 0) {
+    return false;
+  }
+
+  const off_t end = lseek(uring->fd, 0, SEEK_END);
+  uring->offset = (end > 0) ? (uint64_t)end : 0U;
+  uring->current = 0U;
+  uring->used = 0U;
+  uring->inFlight = 0U;
+  uring->writes = 0U;
+  uring->waits = 0U;
+  uring->errors = 0U;
+  memset(uring->blockLengths, 0, sizeof(uring->blockLengths));
+  uring->native = !uring->plainWrites && setupRing(uring);
+  return true;
+}
+
+void clog_uringWrite(CLogUring *const uring, const CLogMessage *const msg) {
+  if (NULL == uring || uring->fd < 0 || NULL == msg) {
+    return;
+  }
+
+  appendLine(uring, msg);
+  if (clog_isFlushDue(&uring->policy, uring->used, uring->oldest, msg, 1U)) {
+    submit(uring);
+  }
+}
+
+void clog_uringWriteBatch(CLogUring *const uring, const CLogMessage messages[], const size_t count) {
+  if (NULL == uring || uring->fd < 0 || NULL == messages || 0U == count) {
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    appendLine(uring, &messages[i]);
+  }
+  if (clog_isFlushDue(&uring->policy, uring->used, uring->oldest, messages, count)) {
+    submit(uring);
+  }
+}
+
+void clog_uringFlush(CLogUring *const uring) {
+  if (NULL == uring || uring->fd < 0) {
+    return;
+  }
+
+  submit(uring);
+  while (uring->inFlight > 0U) {
+    if (!waitForCompletion(uring)) {
+      abandonRing(uring);
+    }
+  }
+}
+
+void clog_uringClose(CLogUring *const uring) {
+  if (NULL == uring || uring->fd < 0) {
+    return;
+  }
+
+  clog_uringFlush(uring);
+  if (uring->ringFd >= 0) {
+    teardownRing(uring);
+  }
+  uring->native = false;
+  close(uring->fd);
+  uring->fd = -1;
+}
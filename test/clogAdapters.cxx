@@ -0,0 +1,212 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogAdaptersTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 32;
+  char buffer[BufferSize];
+  CLogAdapter adapters[2] = {{CLogAdaptersTest::filter, CLogAdaptersTest::first, CLOG_LTRC, 0U, nullptr},
+                             {CLogAdaptersTest::filter, CLogAdaptersTest::second, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  void SetUp() override {
+    memset(buffer, 0, sizeof(buffer));
+    received.clear();
+    filtered = 0;
+  }
+
+  static std::vector<std::string> received;
+  static int filtered;
+
+  static bool filter(const CLogMessage *) {
+    filtered++;
+    return true;
+  }
+
+  static void first(const CLogMessage *message) {
+    received.push_back(std::string("1:") + clog_getMessage(message));
+  }
+
+  static void second(const CLogMessage *message) {
+    received.push_back(std::string("2:") + clog_getMessage(message));
+  }
+};
+
+std::vector<std::string> CLogAdaptersTest::received;
+int CLogAdaptersTest::filtered;
+
+TEST_F(CLogAdaptersTest, adapterMinLevel) {
+  ASSERT_TRUE(clog_setAdapterMinLevel(&ctx, &adapters[0], CLOG_LWRN));
+  ASSERT_EQ(ctx.adapterMinLevel, CLOG_LTRC);
+
+  CLOG_INF(&ctx, IO, "info")
+  CLOG_WRN(&ctx, IO, "warning")
+
+  ASSERT_THAT(received, ElementsAre("2:info", "1:warning", "2:warning"));
+  // the filter of the first adapter hasn't been asked for the info message
+  ASSERT_EQ(filtered, 3);
+}
+
+TEST_F(CLogAdaptersTest, messagesNoAdapterAcceptsAreNotFormatted) {
+  ASSERT_TRUE(clog_setAdapterMinLevel(&ctx, &adapters[0], CLOG_LERR));
+  ASSERT_TRUE(clog_setAdapterMinLevel(&ctx, &adapters[1], CLOG_LWRN));
+  ASSERT_EQ(ctx.adapterMinLevel, CLOG_LWRN);
+
+  CLOG_INF(&ctx, IO, "info")
+  clog_logMessage(&ctx, CLOG_LINF, IO, "file", 1U, "function", "direct");
+
+  ASSERT_THAT(received, IsEmpty());
+  ASSERT_EQ(filtered, 0);
+  ASSERT_THAT(std::vector<char>(buffer, buffer + BufferSize), Each(0));
+
+  CLOG_ERR(&ctx, IO, "error")
+  ASSERT_THAT(received, ElementsAre("1:error", "2:error"));
+}
+
+TEST_F(CLogAdaptersTest, excludedTags) {
+  ASSERT_TRUE(clog_setAdapterExcludedTags(&ctx, &adapters[0], 1U << IO));
+  ASSERT_TRUE(clog_setAdapterExcludedTags(&ctx, &adapters[1], (1U << IO) | (1U << COMMUNICATION)));
+  ASSERT_EQ(ctx.rejectedTags, 1U << IO);
+
+  CLOG_INF(&ctx, IO, "io")
+  CLOG_INF(&ctx, COMMUNICATION, "comm")
+  ASSERT_THAT(received, ElementsAre("1:comm"));
+  ASSERT_EQ(filtered, 1);
+
+  ASSERT_TRUE(clog_setAdapterExcludedTags(&ctx, &adapters[1], 0U));
+  ASSERT_EQ(ctx.rejectedTags, 0U);
+  CLOG_INF(&ctx, IO, "io")
+  ASSERT_THAT(received, ElementsAre("1:comm", "2:io"));
+}
+
+TEST_F(CLogAdaptersTest, loweredAdapterMinLevel) {
+  ASSERT_TRUE(clog_setAdapterMinLevel(&ctx, &adapters[0], CLOG_LERR));
+  ASSERT_TRUE(clog_setAdapterMinLevel(&ctx, &adapters[1], CLOG_LERR));
+  CLOG_INF(&ctx, IO, "dropped")
+
+  // the context follows the adapter without further calls
+  ASSERT_TRUE(clog_setAdapterMinLevel(&ctx, &adapters[1], CLOG_LINF));
+  ASSERT_EQ(ctx.adapterMinLevel, CLOG_LINF);
+  CLOG_INF(&ctx, IO, "info")
+  ASSERT_THAT(received, ElementsAre("2:info"));
+}
+
+TEST_F(CLogAdaptersTest, updateAdapters) {
+  adapters[0].minLevel = CLOG_LFTL;
+  adapters[1].minLevel = CLOG_LERR;
+  adapters[0].excludedTags = 3U;
+  adapters[1].excludedTags = 2U;
+
+  clog_updateAdapters(&ctx);
+  ASSERT_EQ(ctx.adapterMinLevel, CLOG_LERR);
+  ASSERT_EQ(ctx.rejectedTags, 2U);
+}
+
+TEST_F(CLogAdaptersTest, constAdapters) {
+  static const CLogAdapter ConstAdapters[1] = {{nullptr, CLogAdaptersTest::first, CLOG_LWRN, 1U << IO, nullptr}};
+  CLogContext constCtx = {
+      ConstAdapters, ARRAY_LENGTH(ConstAdapters), TagsNames, ARRAY_LENGTH(TagsNames), CLOG_LTRC, buffer, BufferSize};
+
+  CLOG_WRN(&constCtx, IO, "io")
+  CLOG_INF(&constCtx, COMMUNICATION, "info")
+  CLOG_WRN(&constCtx, COMMUNICATION, "comm")
+  ASSERT_THAT(received, ElementsAre("1:comm"));
+  ASSERT_EQ(constCtx.adapterMinLevel, CLOG_LWRN);
+
+  ASSERT_TRUE(clog_setAdapters(&ctx, ConstAdapters, ARRAY_LENGTH(ConstAdapters)));
+  ASSERT_EQ(ctx.rejectedTags, 1U << IO);
+}
+
+TEST_F(CLogAdaptersTest, invalidParameters) {
+  CLogAdapter other = adapters[0];
+
+  clog_updateAdapters(nullptr);
+  ASSERT_FALSE(clog_setAdapterMinLevel(nullptr, &adapters[0], CLOG_LFTL));
+  ASSERT_FALSE(clog_setAdapterMinLevel(&ctx, nullptr, CLOG_LFTL));
+  ASSERT_FALSE(clog_setAdapterMinLevel(&ctx, &other, CLOG_LFTL));
+  ASSERT_FALSE(clog_setAdapterExcludedTags(nullptr, &adapters[0], 1U));
+  ASSERT_FALSE(clog_setAdapterExcludedTags(&ctx, &other, 1U));
+
+  ASSERT_EQ(ctx.adapterMinLevel, CLOG_LTRC);
+  ASSERT_EQ(ctx.rejectedTags, 0U);
+}
+
+TEST_F(CLogAdaptersTest, initContext) {
+  ASSERT_FALSE(ctx.validated);
+  ASSERT_TRUE(clog_initContext(&ctx));
+  ASSERT_TRUE(ctx.validated);
+
+  CLogAdapter invalid[1] = {{nullptr, nullptr, CLOG_LTRC, 0U, nullptr}};
+  CLogContext invalidCtx = {
+      invalid, ARRAY_LENGTH(invalid), TagsNames, ARRAY_LENGTH(TagsNames), CLOG_LTRC, buffer, BufferSize};
+  ASSERT_FALSE(clog_initContext(&invalidCtx));
+  ASSERT_FALSE(invalidCtx.validated);
+  ASSERT_FALSE(clog_initContext(nullptr));
+}
+
+TEST_F(CLogAdaptersTest, contextIsValidatedOnFirstMessage) {
+  CLOG_INF(&ctx, IO, "first")
+  ASSERT_TRUE(ctx.validated);
+  ASSERT_THAT(received, ElementsAre("1:first", "2:first"));
+}
+
+TEST_F(CLogAdaptersTest, setAdapters) {
+  CLogAdapter others[1] = {{nullptr, CLogAdaptersTest::second, CLOG_LWRN, 0U, nullptr}};
+  CLogAdapter invalid[2] = {{nullptr, CLogAdaptersTest::first, CLOG_LTRC, 0U, nullptr},
+                            {nullptr, nullptr, CLOG_LTRC, 0U, nullptr}};
+
+  ASSERT_TRUE(clog_initContext(&ctx));
+
+  ASSERT_TRUE(clog_setAdapters(&ctx, others, ARRAY_LENGTH(others)));
+  ASSERT_EQ(ctx.adapterMinLevel, CLOG_LWRN);
+  CLOG_INF(&ctx, IO, "info")
+  CLOG_WRN(&ctx, IO, "warning")
+  ASSERT_THAT(received, ElementsAre("2:warning"));
+
+  // invalid adapters leave the context unchanged
+  ASSERT_FALSE(clog_setAdapters(&ctx, invalid, ARRAY_LENGTH(invalid)));
+  ASSERT_FALSE(clog_setAdapters(&ctx, nullptr, 1U));
+  ASSERT_FALSE(clog_setAdapters(&ctx, others, 0U));
+  ASSERT_FALSE(clog_setAdapters(nullptr, others, ARRAY_LENGTH(others)));
+  ASSERT_EQ(ctx.adapters, others);
+  ASSERT_EQ(ctx.adaptersSize, ARRAY_LENGTH(others));
+
+  ASSERT_TRUE(clog_setAdapters(&ctx, adapters, ARRAY_LENGTH(adapters)));
+  ASSERT_EQ(ctx.adapterMinLevel, CLOG_LTRC);
+  CLOG_INF(&ctx, IO, "info")
+  ASSERT_THAT(received, ElementsAre("2:warning", "1:info", "2:info"));
+}
@@ -0,0 +1,398 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clogAsync.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogAsyncTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 64;
+  static const size_t NumberOfSlots = 1024;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogAsyncTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+  std::vector<CLogAsyncSlot> slots{NumberOfSlots};
+  CLogAsync async = {};
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  CLogAsyncTest() {
+    async.slots = slots.data();
+    async.numberOfSlots = NumberOfSlots;
+  }
+
+  void SetUp() override {
+    messages.clear();
+    numbers.clear();
+    origins.clear();
+    threads.clear();
+    blocked = false;
+  }
+
+  void TearDown() override {
+    blocked = false;
+    clog_asyncStop(&ctx);
+  }
+
+  static std::vector<std::string> messages;
+  static std::vector<uint64_t> numbers;
+  static std::vector<std::string> origins;
+  static std::vector<std::thread::id> threads;
+  static std::atomic<bool> blocked;
+
+  static void printer(const CLogMessage *message) {
+    while (blocked) {
+      std::this_thread::yield();
+    }
+    messages.emplace_back(clog_getMessage(message));
+    numbers.push_back(message->sequence);
+    origins.emplace_back(std::string(message->file) + ":" + message->function);
+    threads.push_back(std::this_thread::get_id());
+  };
+};
+
+std::vector<std::string> CLogAsyncTest::messages;
+std::vector<uint64_t> CLogAsyncTest::numbers;
+std::vector<std::string> CLogAsyncTest::origins;
+std::vector<std::thread::id> CLogAsyncTest::threads;
+std::atomic<bool> CLogAsyncTest::blocked;
+
+TEST_F(CLogAsyncTest, messagesAreDispatchedByBackgroundThread) {
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+  ASSERT_EQ(ctx.async, &async);
+
+  CLOG_INF(&ctx, IO, "first %d", 1);
+  CLOG_WRN(&ctx, IO, "second %s", "message");
+
+  clog_asyncStop(&ctx);
+  ASSERT_EQ(ctx.async, nullptr);
+
+  ASSERT_THAT(messages, ElementsAre("first 1", "second message"));
+  ASSERT_THAT(threads, Each(Ne(std::this_thread::get_id())));
+  ASSERT_EQ(clog_asyncDropped(&async), 0U);
+}
+
+TEST_F(CLogAsyncTest, multipleProducers) {
+  const int NumberOfThreads = 4;
+  const int MessagesPerThread = 200;
+
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < NumberOfThreads; t++) {
+    producers.emplace_back([this, t]() {
+      for (int i = 0; i < MessagesPerThread; i++) {
+        CLOG_INF(&ctx, COMMUNICATION, "%d %d", t, i);
+        // keep the ring from overflowing
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+
+  clog_asyncStop(&ctx);
+
+  ASSERT_EQ(messages.size() + clog_asyncDropped(&async), static_cast<size_t>(NumberOfThreads * MessagesPerThread));
+
+  // messages of each producer keep their order
+  std::vector<int> next(NumberOfThreads, 0);
+  for (const auto &message : messages) {
+    int t = 0;
+    int i = 0;
+    ASSERT_EQ(sscanf(message.c_str(), "%d %d", &t, &i), 2);
+    ASSERT_GE(i, next[t]);
+    next[t] = i + 1;
+  }
+}
+
+TEST_F(CLogAsyncTest, fullRingDropsMessages) {
+  std::vector<CLogAsyncSlot> smallSlots{4};
+  CLogAsync smallAsync = {};
+  smallAsync.slots = smallSlots.data();
+  smallAsync.numberOfSlots = smallSlots.size();
+
+  blocked = true;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &smallAsync));
+
+  for (int i = 0; i < 10; i++) {
+    CLOG_INF(&ctx, IO, "%d", i);
+  }
+
+  ASSERT_GE(clog_asyncDropped(&smallAsync), 5U);
+
+  blocked = false;
+  clog_asyncStop(&ctx);
+
+  ASSERT_EQ(messages.size() + clog_asyncDropped(&smallAsync), 10U);
+  ASSERT_EQ(messages.front(), "0");
+  // the dropped messages take no number
+  for (size_t i = 0; i < messages.size(); i++) {
+    ASSERT_EQ(numbers[i], i + 1U);
+  }
+}
+
+TEST_F(CLogAsyncTest, sharedRingContinuesNumbersOfContext) {
+  CLOG_INF(&ctx, IO, "synchronous");
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+  CLOG_INF(&ctx, IO, "first");
+  CLOG_INF(&ctx, IO, "second");
+  clog_asyncStop(&ctx);
+  CLOG_INF(&ctx, IO, "synchronous again");
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+  CLOG_INF(&ctx, IO, "third");
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(numbers, ElementsAre(1U, 2U, 3U, 4U, 5U));
+}
+
+TEST_F(CLogAsyncTest, deferredFormatting) {
+  ctx.deferredFormatting = true;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  std::string text = "gone";
+  CLOG_INF(&ctx, IO, "%s %d", text.c_str(), 42);
+  text = "changed";
+
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(messages, ElementsAre("gone 42"));
+}
+
+TEST_F(CLogAsyncTest, temporaryCallSitesAreCopied) {
+  blocked = true;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  {
+    // e.g. names passed by a language binding and a format string built at runtime
+    char file[] = "binding.py";
+    char function[] = "handler";
+    char format[] = "%s: %d";
+    char text[] = "value";
+    clog_logMessage(&ctx, CLOG_LINF, IO, file, 7, function, format, text, 42);
+
+    memset(file, 'x', sizeof(file) - 1U);
+    memset(function, 'x', sizeof(function) - 1U);
+    memset(format, 'x', sizeof(format) - 1U);
+    memset(text, 'x', sizeof(text) - 1U);
+  }
+
+  blocked = false;
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(messages, ElementsAre("value: 42"));
+  ASSERT_THAT(origins, ElementsAre("binding.py:handler"));
+}
+
+TEST_F(CLogAsyncTest, adaptersAreKeptWhileRunning) {
+  CLogAdapter others[1] = {{nullptr, CLogAsyncTest::printer, CLOG_LTRC, 0U, nullptr}};
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+  ASSERT_FALSE(clog_setAdapters(&ctx, others, ARRAY_LENGTH(others)));
+  ASSERT_EQ(ctx.adapters, adapters);
+
+  // the levels of the adapters can still be changed
+  ASSERT_TRUE(clog_setAdapterMinLevel(&ctx, &adapters[0], CLOG_LWRN));
+  CLOG_INF(&ctx, IO, "dropped");
+  CLOG_WRN(&ctx, IO, "kept");
+  clog_asyncStop(&ctx);
+
+  ASSERT_TRUE(clog_setAdapters(&ctx, others, ARRAY_LENGTH(others)));
+  ASSERT_THAT(messages, ElementsAre("kept"));
+}
+
+TEST_F(CLogAsyncTest, perThreadRings) {
+  const int NumberOfThreads = 4;
+  const int MessagesPerThread = 200;
+  std::vector<CLogAsyncRing> rings{NumberOfThreads};
+  CLogAsync perThread = {};
+  perThread.slots = slots.data();
+  perThread.numberOfSlots = NumberOfSlots;
+  perThread.rings = rings.data();
+  perThread.numberOfRings = rings.size();
+
+  ASSERT_TRUE(clog_asyncStart(&ctx, &perThread));
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < NumberOfThreads; t++) {
+    producers.emplace_back([this, t]() {
+      for (int i = 0; i < MessagesPerThread; i++) {
+        CLOG_INF(&ctx, COMMUNICATION, "%d %d", t, i);
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+
+  clog_asyncStop(&ctx);
+
+  ASSERT_EQ(messages.size() + clog_asyncDropped(&perThread), static_cast<size_t>(NumberOfThreads * MessagesPerThread));
+  ASSERT_EQ(clog_asyncDropped(&perThread), 0U);
+
+  // messages of each producer keep their order
+  std::vector<int> next(NumberOfThreads, 0);
+  for (const auto &message : messages) {
+    int t = 0;
+    int i = 0;
+    ASSERT_EQ(sscanf(message.c_str(), "%d %d", &t, &i), 2);
+    ASSERT_EQ(i, next[t]);
+    next[t] = i + 1;
+  }
+}
+
+TEST_F(CLogAsyncTest, perThreadRingsAreMergedByTime) {
+  std::vector<CLogAsyncRing> rings{2};
+  CLogAsync perThread = {};
+  perThread.slots = slots.data();
+  perThread.numberOfSlots = NumberOfSlots;
+  perThread.rings = rings.data();
+  perThread.numberOfRings = rings.size();
+
+  blocked = true;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &perThread));
+
+  // keep the dispatcher busy, so the following messages are merged from both rings
+  CLOG_INF(&ctx, IO, "start");
+  std::thread other([this]() {
+    CLOG_INF(&ctx, IO, "1");
+    CLOG_INF(&ctx, IO, "2");
+  });
+  other.join();
+  CLOG_INF(&ctx, IO, "3");
+
+  blocked = false;
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(messages, ElementsAre("start", "1", "2", "3"));
+}
+
+TEST_F(CLogAsyncTest, tiedTimestampsAreMergedByRing) {
+  std::vector<CLogAsyncRing> rings{2};
+  CLogAsync perThread = {};
+  perThread.slots = slots.data();
+  perThread.numberOfSlots = NumberOfSlots;
+  perThread.rings = rings.data();
+  perThread.numberOfRings = rings.size();
+
+  ctx.clock = []() -> uint64_t { return 1000U; };
+  blocked = true;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &perThread));
+
+  // the main thread claims the first ring, the other thread the second one
+  CLOG_INF(&ctx, IO, "start");
+  std::thread other([this]() {
+    CLOG_INF(&ctx, IO, "1");
+    CLOG_INF(&ctx, IO, "2");
+  });
+  other.join();
+  CLOG_INF(&ctx, IO, "3");
+
+  blocked = false;
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(messages, ElementsAre("start", "3", "1", "2"));
+  ASSERT_THAT(numbers, ElementsAre(1U, 2U, 1U, 2U));
+}
+
+TEST_F(CLogAsyncTest, ringsOfExitedThreadsAreReused) {
+  std::vector<CLogAsyncRing> rings{1};
+  CLogAsync perThread = {};
+  perThread.slots = slots.data();
+  perThread.numberOfSlots = NumberOfSlots;
+  perThread.rings = rings.data();
+  perThread.numberOfRings = rings.size();
+
+  blocked = true;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &perThread));
+
+  // the only ring is taken by the first thread until its message has been dispatched, so the message of the main
+  // thread is dropped
+  std::thread first([this]() { CLOG_INF(&ctx, IO, "first"); });
+  first.join();
+  CLOG_INF(&ctx, IO, "dropped");
+  ASSERT_EQ(clog_asyncDropped(&perThread), 1U);
+  blocked = false;
+
+  // once the message of the exited thread has been dispatched, its ring can be claimed again
+  for (int i = 0; i < 100 && __atomic_load_n(&rings[0].owner, __ATOMIC_ACQUIRE) != 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::thread second([this]() { CLOG_INF(&ctx, IO, "second"); });
+  second.join();
+
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(messages, ElementsAre("first", "second"));
+  ASSERT_EQ(clog_asyncDropped(&perThread), 1U);
+}
+
+TEST_F(CLogAsyncTest, invalidParameters) {
+  std::vector<CLogAsyncSlot> oddSlots{3};
+  CLogAsync oddAsync = {};
+  oddAsync.slots = oddSlots.data();
+  oddAsync.numberOfSlots = oddSlots.size();
+  CLogAsync noSlots = {};
+  noSlots.slots = nullptr;
+  noSlots.numberOfSlots = 4;
+
+  ASSERT_FALSE(clog_asyncStart(nullptr, &async));
+  ASSERT_FALSE(clog_asyncStart(&ctx, nullptr));
+  ASSERT_FALSE(clog_asyncStart(&ctx, &oddAsync));
+  ASSERT_FALSE(clog_asyncStart(&ctx, &noSlots));
+
+  std::vector<CLogAsyncRing> rings{3};
+  CLogAsync oddRings = {};
+  oddRings.slots = slots.data();
+  oddRings.numberOfSlots = NumberOfSlots;
+  oddRings.rings = rings.data();
+  oddRings.numberOfRings = rings.size();
+  CLogAsync noRings = {};
+  noRings.slots = slots.data();
+  noRings.numberOfSlots = NumberOfSlots;
+  noRings.rings = rings.data();
+  noRings.numberOfRings = 0;
+  ASSERT_FALSE(clog_asyncStart(&ctx, &oddRings));
+  ASSERT_FALSE(clog_asyncStart(&ctx, &noRings));
+
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+  ASSERT_FALSE(clog_asyncStart(&ctx, &async));
+
+  clog_asyncStop(nullptr);
+  ASSERT_EQ(clog_asyncDropped(nullptr), 0U);
+}
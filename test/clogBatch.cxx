@@ -0,0 +1,214 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <atomic>
+#include <cctype>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clogAsync.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogBatchTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 64;
+  static const size_t NumberOfSlots = 256;
+  char buffer[BufferSize];
+  CLogAdapter adapters[2] = {{nullptr, nullptr, CLOG_LTRC, 0U, CLogBatchTest::batchPrinter},
+                             {nullptr, CLogBatchTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      1U,
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+  std::vector<CLogAsyncSlot> slots{NumberOfSlots};
+  std::vector<CLogAsyncRing> rings{4};
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  void SetUp() override {
+    batches.clear();
+    batchMessages.clear();
+    messages.clear();
+    blocked = false;
+    entered = false;
+  }
+
+  void TearDown() override {
+    blocked = false;
+    clog_asyncStop(&ctx);
+  }
+
+  /**
+   * Logs a message and blocks the dispatcher in the batch adapter until release() is called, so the following
+   * messages pile up in the ring.
+   */
+  void block() {
+    blocked = true;
+    CLOG_INF(&ctx, IO, "blocking")
+    while (!entered) {
+      std::this_thread::yield();
+    }
+  }
+
+  void release() {
+    blocked = false;
+  }
+
+  static std::vector<size_t> batches;
+  static std::vector<std::string> batchMessages;
+  static std::vector<std::string> messages;
+  static std::atomic<bool> blocked;
+  static std::atomic<bool> entered;
+
+  static void batchPrinter(const CLogMessage messages[], size_t count) {
+    entered = true;
+    while (blocked) {
+      std::this_thread::yield();
+    }
+    batches.push_back(count);
+    for (size_t i = 0; i < count; i++) {
+      batchMessages.emplace_back(clog_getMessage(&messages[i]));
+    }
+  }
+
+  static void printer(const CLogMessage *message) {
+    messages.emplace_back(clog_getMessage(message));
+  }
+
+  static bool skipOdd(const CLogMessage *message) {
+    const char last = std::string(clog_getMessage(message)).back();
+    return !isdigit(last) || (last - '0') % 2 == 0;
+  }
+};
+
+std::vector<size_t> CLogBatchTest::batches;
+std::vector<std::string> CLogBatchTest::batchMessages;
+std::vector<std::string> CLogBatchTest::messages;
+std::atomic<bool> CLogBatchTest::blocked;
+std::atomic<bool> CLogBatchTest::entered;
+
+TEST_F(CLogBatchTest, dispatcherPassesBatches) {
+  CLogAsync async = {};
+  async.slots = slots.data();
+  async.numberOfSlots = NumberOfSlots;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  block();
+  for (int i = 0; i < 100; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+  }
+  release();
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(batches, ElementsAre(1U, CLOG_ASYNC_BATCH_SIZE, 100U - CLOG_ASYNC_BATCH_SIZE));
+  ASSERT_EQ(batchMessages.size(), 101U);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(batchMessages[i + 1], "message " + std::to_string(i));
+  }
+}
+
+TEST_F(CLogBatchTest, perThreadRingsPassBatches) {
+  CLogAsync async = {};
+  async.slots = slots.data();
+  async.numberOfSlots = NumberOfSlots;
+  async.rings = rings.data();
+  async.numberOfRings = rings.size();
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  block();
+  for (int i = 0; i < 50; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+  }
+  release();
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(batches, ElementsAre(1U, 50U));
+  ASSERT_EQ(batchMessages.back(), "message 49");
+}
+
+TEST_F(CLogBatchTest, filtersSplitBatches) {
+  CLogAsync async = {};
+  async.slots = slots.data();
+  async.numberOfSlots = NumberOfSlots;
+  adapters[0].messageFilter = skipOdd;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  block();
+  for (int i = 0; i < 4; i++) {
+    CLOG_INF(&ctx, IO, "message %d", 2 * i)
+    CLOG_INF(&ctx, IO, "message %d", 2 * i + 2)
+    CLOG_INF(&ctx, IO, "message %d", 2 * i + 1)
+  }
+  release();
+  clog_asyncStop(&ctx);
+
+  // the text formatted by the filter is formatted again for the adapter
+  ASSERT_THAT(batches, ElementsAre(1U, 2U, 2U, 2U, 2U));
+  ASSERT_THAT(batchMessages,
+              ElementsAre("blocking",
+                          "message 0",
+                          "message 2",
+                          "message 2",
+                          "message 4",
+                          "message 4",
+                          "message 6",
+                          "message 6",
+                          "message 8"));
+}
+
+TEST_F(CLogBatchTest, singleAndBatchAdapters) {
+  CLogAsync async = {};
+  async.slots = slots.data();
+  async.numberOfSlots = NumberOfSlots;
+  ASSERT_TRUE(clog_setAdapters(&ctx, adapters, ARRAY_LENGTH(adapters)));
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  block();
+  for (int i = 0; i < 3; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+  }
+  release();
+  clog_asyncStop(&ctx);
+
+  ASSERT_THAT(batches, ElementsAre(1U, 3U));
+  ASSERT_THAT(batchMessages, ElementsAre("blocking", "message 0", "message 1", "message 2"));
+  ASSERT_THAT(messages, ElementsAre("blocking", "message 0", "message 1", "message 2"));
+}
+
+TEST_F(CLogBatchTest, synchronousContextPassesSingleMessages) {
+  CLOG_INF(&ctx, IO, "first")
+  CLOG_INF(&ctx, IO, "second")
+
+  ASSERT_THAT(batches, ElementsAre(1U, 1U));
+  ASSERT_THAT(batchMessages, ElementsAre("first", "second"));
+}
+
+TEST_F(CLogBatchTest, adapterNeedsBackend) {
+  CLogAdapter invalid[1] = {{nullptr, nullptr, CLOG_LTRC, 0U, nullptr}};
+
+  ASSERT_FALSE(clog_setAdapters(&ctx, invalid, ARRAY_LENGTH(invalid)));
+}
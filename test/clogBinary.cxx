@@ -0,0 +1,217 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "clogBinary.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogBinaryTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 64;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogBinaryTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+      true,
+  };
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  FILE *file = nullptr;
+
+  void SetUp() override {
+    file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    ASSERT_TRUE(clog_binaryOpen(&writer, file));
+    written.clear();
+    formatted.clear();
+  }
+
+  void TearDown() override {
+    clog_binaryClose(&writer);
+    fclose(file);
+  }
+
+  static CLogBinaryWriter writer;
+  static std::vector<std::string> written;
+  static std::vector<std::string> formatted;
+
+  static std::string format(const CLogMessage *message) {
+    char line[256];
+    int lineLength = sizeof(line);
+    clog_formatMessage(line, &lineLength, message);
+    return line;
+  }
+
+  static void printer(const CLogMessage *message) {
+    ASSERT_TRUE(clog_binaryWrite(&writer, message));
+    // the raw arguments are written, the message is only formatted for the comparison
+    ASSERT_EQ(message->message, nullptr);
+    written.push_back(format(message));
+  };
+
+  static void collect(const CLogMessage *message, uint64_t, void *) {
+    formatted.push_back(format(message));
+  }
+
+  bool read() {
+    rewind(file);
+    return clog_binaryRead(file, collect, nullptr);
+  }
+};
+
+CLogBinaryWriter CLogBinaryTest::writer;
+std::vector<std::string> CLogBinaryTest::written;
+std::vector<std::string> CLogBinaryTest::formatted;
+
+TEST_F(CLogBinaryTest, decodesToTheSameText) {
+  for (int i = 0; i < 3; i++) {
+    CLOG_WRN(&ctx, IO, "i=%d %s %5.2f %c %lu", i, "text", 3.14159, 'x', 123456789UL)
+  }
+  CLOG_ERR(&ctx, COMMUNICATION, "%s", std::string(100, 'y').c_str())
+  CLOG_INF(&ctx, IO, "no arguments")
+
+  ASSERT_TRUE(read());
+  ASSERT_EQ(written.size(), 5U);
+  ASSERT_EQ(formatted, written);
+}
+
+TEST_F(CLogBinaryTest, callSitesAreWrittenOnce) {
+  long start = ftell(file);
+  long firstMessage = 0;
+  for (int i = 0; i <= 10; i++) {
+    CLOG_INF(&ctx, IO, "a rather long format string that is only stored once %d", i)
+    if (0 == i) {
+      firstMessage = ftell(file);
+    }
+  }
+  long messages = ftell(file) - firstMessage;
+
+  // the following messages only add message records, much smaller than the text
+  ASSERT_LT(messages / 10 * 4, firstMessage - start);
+  ASSERT_LT(messages / 10 * 5, static_cast<long>(written[0].size()));
+  ASSERT_TRUE(read());
+  ASSERT_EQ(formatted, written);
+}
+
+TEST_F(CLogBinaryTest, formattedMessages) {
+  ctx.deferredFormatting = false;
+  adapters[0].onMessage = [](const CLogMessage *message) {
+    clog_binaryWrite(&writer, message);
+    written.push_back(format(message));
+  };
+
+  CLOG_WRN(&ctx, IO, "x=%d", 5)
+  CLOG_WRN(&ctx, IO, "%s", std::string(100, 'z').c_str())
+  clog_logMessage(&ctx, CLOG_LERR, COMMUNICATION, "file.c", 12, "function", "temporary %d", 7);
+
+  ASSERT_TRUE(read());
+  ASSERT_EQ(written.size(), 3U);
+  ASSERT_EQ(formatted, written);
+}
+
+TEST_F(CLogBinaryTest, shortestFloats) {
+  ctx.shortestFloats = true;
+  CLOG_WRN(&ctx, IO, "%f %g %e", 0.1, 1.0 / 3.0, 2.5e-10)
+  ctx.shortestFloats = false;
+  CLOG_WRN(&ctx, IO, "%f %g", 0.1, 1.0 / 3.0)
+
+  ASSERT_TRUE(read());
+  ASSERT_EQ(written.size(), 2U);
+  ASSERT_EQ(formatted, written);
+  ASSERT_NE(written[0].find("0.1 0.3333333333333333 2.5e-10"), std::string::npos);
+  ASSERT_NE(written[1].find("0.100000 0.333333"), std::string::npos);
+}
+
+TEST_F(CLogBinaryTest, timestamps) {
+  static std::vector<uint64_t> timestamps;
+  timestamps.clear();
+
+  CLOG_INF(&ctx, IO, "first")
+  CLOG_INF(&ctx, IO, "second")
+
+  rewind(file);
+  ASSERT_TRUE(clog_binaryRead(
+      file, [](const CLogMessage *, uint64_t timestamp, void *) { timestamps.push_back(timestamp); }, nullptr));
+
+  ASSERT_EQ(timestamps.size(), 2U);
+  ASSERT_GT(timestamps[0], 1500000000ULL * 1000000000ULL);
+  ASSERT_GE(timestamps[1], timestamps[0]);
+}
+
+TEST_F(CLogBinaryTest, timestampsOfTheMessages) {
+  static std::vector<uint64_t> timestamps;
+  static uint64_t time;
+  timestamps.clear();
+  time = 1600000000ULL * 1000000000ULL;
+  // the timestamps of clocks other than the monotonic ones are taken as time since the epoch
+  ctx.clock = []() -> uint64_t { return time += 1000U; };
+
+  CLOG_INF(&ctx, IO, "first")
+  CLOG_INF(&ctx, IO, "second")
+
+  rewind(file);
+  ASSERT_TRUE(clog_binaryRead(
+      file, [](const CLogMessage *, uint64_t timestamp, void *) { timestamps.push_back(timestamp); }, nullptr));
+
+  ASSERT_EQ(timestamps.size(), 2U);
+  ASSERT_EQ(timestamps[0], 1600000000ULL * 1000000000ULL + 1000U);
+  ASSERT_EQ(timestamps[1], 1600000000ULL * 1000000000ULL + 2000U);
+}
+
+TEST_F(CLogBinaryTest, invalid) {
+  ASSERT_FALSE(clog_binaryOpen(nullptr, file));
+  ASSERT_FALSE(clog_binaryOpen(&writer, nullptr));
+  ASSERT_FALSE(clog_binaryWrite(nullptr, nullptr));
+  ASSERT_FALSE(clog_binaryWrite(&writer, nullptr));
+  ASSERT_FALSE(clog_binaryRead(nullptr, collect, nullptr));
+  ASSERT_FALSE(clog_binaryRead(file, nullptr, nullptr));
+}
+
+TEST_F(CLogBinaryTest, corruptedFiles) {
+  CLOG_INF(&ctx, IO, "x=%d", 1)
+  CLOG_INF(&ctx, IO, "x=%d", 2)
+  fflush(file);
+  long size = ftell(file);
+
+  // a truncated file delivers the complete messages
+  ASSERT_EQ(ftruncate(fileno(file), size - 1), 0);
+  ASSERT_FALSE(read());
+  ASSERT_EQ(formatted.size(), 1U);
+  ASSERT_EQ(formatted[0], written[0]);
+
+  // not a binary log
+  formatted.clear();
+  rewind(file);
+  fputs("text", file);
+  ASSERT_FALSE(read());
+  ASSERT_TRUE(formatted.empty());
+}
@@ -0,0 +1,289 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clogCallSite.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+static const char *ThisFile = "*clogCallSite.cxx";
+
+static void logTrace(CLogContext *ctx) {
+  CLOG_TRC(ctx, IO, "trace")
+}
+
+static void logTwice(CLogContext *ctx) {
+  CLOG_INF(ctx, IO, "first")
+  CLOG_INF(ctx, COMMUNICATION, "second")
+}
+
+static void logLater(CLogContext *ctx) {
+  CLOG_DBG(ctx, IO, "later")
+}
+
+static void logCounted(CLogContext *ctx, int *evaluated) {
+  CLOG_DBG(ctx, IO, "counted %d", ++*evaluated)
+}
+
+static void logAt(CLogContext *ctx, CLogLevel level, size_t tag) {
+  CLOG_MESSAGE(ctx, level, tag, "at %d", static_cast<int>(level))
+}
+
+static void logFormat(CLogContext *ctx, const char *format, int value) {
+  CLOG_INF(ctx, IO, format, value)
+}
+
+class CLogCallSiteTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 32;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogCallSiteTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  void SetUp() override {
+    messages.clear();
+    levels.clear();
+    tags.clear();
+  }
+
+  void TearDown() override {
+    clog_resetCallSites();
+  }
+
+  static std::vector<std::string> messages;
+  static std::vector<CLogLevel> levels;
+  static std::vector<std::string> tags;
+
+  static void printer(const CLogMessage *message) {
+    messages.emplace_back(clog_getMessage(message));
+    levels.push_back(message->level);
+    tags.emplace_back(message->tag);
+  };
+};
+
+std::vector<std::string> CLogCallSiteTest::messages;
+std::vector<CLogLevel> CLogCallSiteTest::levels;
+std::vector<std::string> CLogCallSiteTest::tags;
+
+TEST_F(CLogCallSiteTest, disableByFunction) {
+  CLogCallSiteQuery query = {ThisFile, "logTwice", 0U, 0U, 0U, 0U};
+
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_DISABLE));
+  logTwice(&ctx);
+  logTrace(&ctx);
+
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_DEFAULT));
+  logTwice(&ctx);
+
+  ASSERT_THAT(messages, ElementsAre("trace", "first", "second"));
+}
+
+TEST_F(CLogCallSiteTest, disableByLineRange) {
+  logTwice(&ctx);
+
+  const CLogCallSite *sites[2] = {};
+  CLogCallSiteQuery query = {ThisFile, "logTwice", 0U, 0U, 0U, 0U};
+  ASSERT_EQ(clog_findCallSites(&query, sites, ARRAY_LENGTH(sites)), 2U);
+
+  const CLogCallSite *first = (sites[0]->line < sites[1]->line) ? sites[0] : sites[1];
+  query.firstLine = first->line;
+  query.lastLine = first->line;
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_DISABLE));
+
+  messages.clear();
+  logTwice(&ctx);
+  ASSERT_THAT(messages, ElementsAre("second"));
+}
+
+TEST_F(CLogCallSiteTest, disableByLevelAndTag) {
+  CLogCallSiteQuery byTag = {ThisFile, nullptr, 0U, 0U, 0U, CLOG_TAG_MASK(COMMUNICATION)};
+  ASSERT_TRUE(clog_setCallSites(&byTag, CLOG_SITE_DISABLE));
+  logTwice(&ctx);
+  ASSERT_THAT(messages, ElementsAre("first"));
+
+  clog_resetCallSites();
+  messages.clear();
+
+  CLogCallSiteQuery byLevel = {
+      ThisFile, nullptr, 0U, 0U, CLOG_LEVEL_MASK(CLOG_LTRC) | CLOG_LEVEL_MASK(CLOG_LINF), 0U};
+  ASSERT_TRUE(clog_setCallSites(&byLevel, CLOG_SITE_DISABLE));
+  logTwice(&ctx);
+  logTrace(&ctx);
+  ASSERT_THAT(messages, IsEmpty());
+}
+
+TEST_F(CLogCallSiteTest, enableBelowMinLevel) {
+  ctx.minLevel = CLOG_LERR;
+  CLogCallSiteQuery query = {ThisFile, "logTrace", 0U, 0U, 0U, 0U};
+
+  logTrace(&ctx);
+  logTwice(&ctx);
+  ASSERT_THAT(messages, IsEmpty());
+
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_ENABLE));
+  logTrace(&ctx);
+  logTwice(&ctx);
+  ASSERT_THAT(messages, ElementsAre("trace"));
+}
+
+TEST_F(CLogCallSiteTest, rulesApplyToNewCallSites) {
+  ctx.minLevel = CLOG_LERR;
+  CLogCallSiteQuery query = {ThisFile, "log?ate*", 0U, 0U, 0U, 0U};
+
+  // logLater has not been executed yet, so it's not registered
+  ASSERT_EQ(clog_findCallSites(&query, nullptr, 0U), 0U);
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_ENABLE));
+
+  logLater(&ctx);
+  ASSERT_THAT(messages, ElementsAre("later"));
+  ASSERT_EQ(clog_findCallSites(&query, nullptr, 0U), 1U);
+}
+
+TEST_F(CLogCallSiteTest, newDisabledCallSitesDontEvaluateArguments) {
+  ctx.minLevel = CLOG_LERR;
+  CLogCallSiteQuery query = {ThisFile, "logCounted", 0U, 0U, 0U, 0U};
+  int evaluated = 0;
+
+  // the first execution registers the call site without evaluating the arguments
+  logCounted(&ctx, &evaluated);
+  ASSERT_EQ(evaluated, 0);
+  ASSERT_EQ(clog_findCallSites(&query, nullptr, 0U), 1U);
+
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_ENABLE));
+  logCounted(&ctx, &evaluated);
+  ASSERT_EQ(evaluated, 1);
+  ASSERT_THAT(messages, ElementsAre("counted 1"));
+}
+
+TEST_F(CLogCallSiteTest, runtimeLevelAndTag) {
+  ctx.minLevel = CLOG_LINF;
+
+  for (CLogLevel level : {CLOG_LDBG, CLOG_LERR, CLOG_LWRN}) {
+    logAt(&ctx, level, IO);
+  }
+  logAt(&ctx, CLOG_LERR, COMMUNICATION);
+
+  ASSERT_THAT(messages, ElementsAre("at 4", "at 3", "at 4"));
+  ASSERT_THAT(levels, ElementsAre(CLOG_LERR, CLOG_LWRN, CLOG_LERR));
+  ASSERT_THAT(tags, ElementsAre("IO", "IO", "COMMUNICATION"));
+}
+
+TEST_F(CLogCallSiteTest, runtimeFormat) {
+  CLogCallSiteQuery query = {ThisFile, "logFormat", 0U, 0U, 0U, 0U};
+
+  logFormat(&ctx, "first %d", 1);
+  logFormat(&ctx, "second %d", 2);
+  ASSERT_THAT(messages, ElementsAre("first 1", "second 2"));
+
+  // the call site is still registered and follows the rules
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_DISABLE));
+  logFormat(&ctx, "third %d", 3);
+  ASSERT_THAT(messages, ElementsAre("first 1", "second 2"));
+}
+
+TEST_F(CLogCallSiteTest, toggleCallSiteRepeatedly) {
+  ctx.minLevel = CLOG_LERR;
+  const std::string function = "logTrace";
+
+  for (size_t i = 0; i < 2U * CLOG_CALL_SITE_RULES; i++) {
+    // equal patterns select the same call sites, wherever they are stored
+    CLogCallSiteQuery query = {ThisFile, function.c_str(), 0U, 0U, 0U, 0U};
+    ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_ENABLE)) << i;
+    logTrace(&ctx);
+    ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_DEFAULT)) << i;
+    logTrace(&ctx);
+  }
+
+  ASSERT_EQ(messages.size(), 2U * CLOG_CALL_SITE_RULES);
+}
+
+TEST_F(CLogCallSiteTest, defaultOverridesOtherRules) {
+  CLogCallSiteQuery all = {ThisFile, nullptr, 0U, 0U, 0U, 0U};
+  CLogCallSiteQuery one = {ThisFile, "logTwice", 0U, 0U, 0U, 0U};
+  ASSERT_TRUE(clog_setCallSites(&all, CLOG_SITE_DISABLE));
+
+  for (size_t i = 0; i < 2U * CLOG_CALL_SITE_RULES; i++) {
+    ASSERT_TRUE(clog_setCallSites(&one, CLOG_SITE_DISABLE)) << i;
+    ASSERT_TRUE(clog_setCallSites(&one, CLOG_SITE_DEFAULT)) << i;
+  }
+  logTwice(&ctx);
+  logTrace(&ctx);
+  ASSERT_THAT(messages, ElementsAre("first", "second"));
+
+  // without the other rule the default rules are dropped
+  ASSERT_TRUE(clog_setCallSites(&all, CLOG_SITE_DEFAULT));
+  messages.clear();
+  logTrace(&ctx);
+  ASSERT_THAT(messages, ElementsAre("trace"));
+}
+
+TEST_F(CLogCallSiteTest, tooManyRules) {
+  CLogCallSiteQuery query = {ThisFile, "none", 0U, 0U, 0U, 0U};
+
+  for (unsigned int i = 0; i < CLOG_CALL_SITE_RULES; i++) {
+    query.firstLine = i;
+    ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_DISABLE));
+  }
+  // replacing a rule needs no space
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_ENABLE));
+  query.firstLine = CLOG_CALL_SITE_RULES;
+  ASSERT_FALSE(clog_setCallSites(&query, CLOG_SITE_DISABLE));
+
+  clog_resetCallSites();
+  ASSERT_TRUE(clog_setCallSites(&query, CLOG_SITE_DISABLE));
+}
+
+TEST_F(CLogCallSiteTest, invalidParameters) {
+  CLogCallSiteQuery query = {};
+
+  ASSERT_FALSE(clog_setCallSites(nullptr, CLOG_SITE_DISABLE));
+  ASSERT_FALSE(clog_setCallSites(&query, static_cast<CLogCallSiteMode>(42)));
+  ASSERT_EQ(clog_findCallSites(nullptr, nullptr, 0U), 0U);
+  ASSERT_EQ(clog_findCallSites(&query, nullptr, 1U), 0U);
+}
+
+TEST(testMatchGlob, patterns) {
+  ASSERT_TRUE(clog_matchGlob("abc", "abc"));
+  ASSERT_FALSE(clog_matchGlob("abc", "abcd"));
+  ASSERT_FALSE(clog_matchGlob("abcd", "abc"));
+  ASSERT_TRUE(clog_matchGlob("a?c", "abc"));
+  ASSERT_FALSE(clog_matchGlob("a?c", "ac"));
+  ASSERT_TRUE(clog_matchGlob("*", ""));
+  ASSERT_TRUE(clog_matchGlob("*.c", "src/clog.c"));
+  ASSERT_FALSE(clog_matchGlob("*.c", "src/clog.cxx"));
+  ASSERT_TRUE(clog_matchGlob("src/*/*.c", "src/a/b.c"));
+  ASSERT_TRUE(clog_matchGlob("*a*b*", "xxaxxbxx"));
+  ASSERT_FALSE(clog_matchGlob("*a*b*", "xxbxxaxx"));
+  ASSERT_TRUE(clog_matchGlob("**x", "abx"));
+  ASSERT_FALSE(clog_matchGlob(nullptr, "abc"));
+  ASSERT_FALSE(clog_matchGlob("abc", nullptr));
+}
@@ -0,0 +1,253 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.hpp"
+#include "clogAsync.h"
+#include "clogClock.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+/**
+ * The stamp of a message as seen by the adapter.
+ */
+struct Stamp {
+  uint64_t timestamp;
+  uint64_t sequence;
+  uint32_t threadId;
+};
+
+class CLogClockTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 64;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogClockTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  void SetUp() override {
+    stamps.clear();
+    fakeTime = 1000U;
+  }
+
+  static std::mutex lock;
+  static std::vector<Stamp> stamps;
+  static uint64_t fakeTime;
+
+  static void printer(const CLogMessage *message) {
+    std::lock_guard<std::mutex> guard(lock);
+    stamps.push_back({message->timestamp, message->sequence, message->threadId});
+  };
+
+  static uint64_t fakeClock() {
+    return fakeTime += 10U;
+  }
+};
+
+std::mutex CLogClockTest::lock;
+std::vector<Stamp> CLogClockTest::stamps;
+uint64_t CLogClockTest::fakeTime;
+
+TEST_F(CLogClockTest, messagesAreStamped) {
+  const uint64_t before = clog_clockMonotonic();
+  CLOG_INF(&ctx, IO, "eager %d", 1)
+  ctx.deferredFormatting = true;
+  CLOG_INF(&ctx, IO, "deferred %d", 2)
+  CLOGXX_INF(&ctx, IO, "typed %d", 3);
+  clog_logMessage(&ctx, CLOG_LINF, IO, CLOG_FILE, CLOG_LINE, CLOG_FUNC, "temporary");
+  const uint64_t after = clog_clockMonotonic();
+
+  ASSERT_EQ(stamps.size(), 4U);
+  for (size_t i = 0; i < stamps.size(); i++) {
+    EXPECT_EQ(stamps[i].sequence, stamps[0].sequence + i);
+    EXPECT_EQ(stamps[i].threadId, static_cast<uint32_t>(syscall(SYS_gettid)));
+    EXPECT_GE(stamps[i].timestamp, (0U == i) ? before : stamps[i - 1U].timestamp);
+    EXPECT_LE(stamps[i].timestamp, after);
+  }
+}
+
+TEST_F(CLogClockTest, filteredMessagesAreNotStamped) {
+  ctx.minLevel = CLOG_LWRN;
+  CLOG_WRN(&ctx, IO, "first")
+  CLOG_INF(&ctx, IO, "dropped")
+  CLOG_WRN(&ctx, IO, "passed")
+
+  ASSERT_EQ(stamps.size(), 2U);
+  ASSERT_EQ(stamps[1].sequence, stamps[0].sequence + 1U);
+}
+
+TEST_F(CLogClockTest, sequenceIsCountedPerContext) {
+  CLogContext other = ctx;
+  other.sequence = 0U;
+
+  CLOG_INF(&ctx, IO, "first")
+  CLOG_INF(&other, IO, "other")
+  CLOG_INF(&ctx, IO, "second")
+
+  ASSERT_EQ(stamps.size(), 3U);
+  ASSERT_EQ(stamps[0].sequence, 1U);
+  ASSERT_EQ(stamps[1].sequence, 1U);
+  ASSERT_EQ(stamps[2].sequence, 2U);
+}
+
+TEST_F(CLogClockTest, pluggableClock) {
+  ctx.clock = fakeClock;
+  for (int i = 0; i < 3; i++) {
+    CLOG_INF(&ctx, IO, "%d", i)
+  }
+
+  ASSERT_EQ(stamps.size(), 3U);
+  ASSERT_EQ(stamps[0].timestamp, 1010U);
+  ASSERT_EQ(stamps[1].timestamp, 1020U);
+  ASSERT_EQ(stamps[2].timestamp, 1030U);
+}
+
+TEST_F(CLogClockTest, asynchronousContextKeepsStampOfProducer) {
+  static const size_t NumberOfThreads = 4;
+  static const size_t Messages = 100;
+  std::vector<CLogAsyncSlot> slots{1024};
+  std::vector<CLogAsyncRing> rings{NumberOfThreads};
+  CLogAsync async = {};
+  async.slots = slots.data();
+  async.numberOfSlots = slots.size();
+  async.rings = rings.data();
+  async.numberOfRings = rings.size();
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  std::vector<std::thread> threads;
+  std::set<uint32_t> producers;
+  std::mutex producersLock;
+  for (size_t t = 0; t < NumberOfThreads; t++) {
+    threads.emplace_back([&]() {
+      {
+        std::lock_guard<std::mutex> guard(producersLock);
+        producers.insert(clog_threadId());
+      }
+      for (size_t i = 0; i < Messages; i++) {
+        CLOG_INF(&ctx, IO, "%zu", i)
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  clog_asyncStop(&ctx);
+
+  ASSERT_EQ(stamps.size(), NumberOfThreads * Messages);
+  ASSERT_EQ(producers.size(), NumberOfThreads);
+
+  std::map<uint32_t, Stamp> lastOfThread;
+  for (const Stamp &stamp : stamps) {
+    ASSERT_EQ(producers.count(stamp.threadId), 1U);
+    // the stamps are taken by the producers, in the order of their messages
+    auto last = lastOfThread.find(stamp.threadId);
+    if (last != lastOfThread.end()) {
+      ASSERT_EQ(stamp.sequence, last->second.sequence + 1U);
+      ASSERT_GE(stamp.timestamp, last->second.timestamp);
+    } else {
+      ASSERT_EQ(stamp.sequence, 1U);
+    }
+    lastOfThread[stamp.threadId] = stamp;
+  }
+}
+
+TEST_F(CLogClockTest, sharedRingNumbersTheMessagesOfTheContext) {
+  static const size_t NumberOfThreads = 4;
+  static const size_t Messages = 100;
+  std::vector<CLogAsyncSlot> slots{1024};
+  CLogAsync async = {};
+  async.slots = slots.data();
+  async.numberOfSlots = slots.size();
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < NumberOfThreads; t++) {
+    threads.emplace_back([&]() {
+      for (size_t i = 0; i < Messages; i++) {
+        CLOG_INF(&ctx, IO, "%zu", i)
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  clog_asyncStop(&ctx);
+
+  std::set<uint64_t> numbers;
+  for (const Stamp &stamp : stamps) {
+    numbers.insert(stamp.sequence);
+  }
+  ASSERT_EQ(stamps.size(), NumberOfThreads * Messages);
+  ASSERT_EQ(numbers.size(), NumberOfThreads * Messages);
+  ASSERT_EQ(*numbers.begin(), 1U);
+  ASSERT_EQ(*numbers.rbegin(), NumberOfThreads * Messages);
+}
+
+TEST(CLogClock, builtInClocks) {
+  const uint64_t monotonic = clog_clockMonotonic();
+  const uint64_t tsc = clog_clockTsc();
+  const uint64_t coarse = clog_clockMonotonicCoarse();
+  const uint64_t realtime = clog_clockRealtime();
+
+  // the TSC is calibrated against CLOCK_MONOTONIC (taking a few ms on the first call)
+  EXPECT_GE(tsc + 1000000U, monotonic);
+  EXPECT_LE(tsc, clog_clockMonotonic() + 1000000U);
+  // coarse clocks lag behind by up to a scheduler tick
+  EXPECT_LE(coarse, clog_clockMonotonic());
+  EXPECT_GE(coarse + 50000000U, monotonic);
+  // some time after 2019
+  EXPECT_GT(realtime, 1546300800ULL * 1000000000U);
+
+  uint64_t last = clog_clockTsc();
+  for (int i = 0; i < 1000; i++) {
+    const uint64_t now = clog_clockTsc();
+    ASSERT_GE(now, last);
+    last = now;
+  }
+}
+
+TEST(CLogClock, threadIds) {
+  const uint32_t id = clog_threadId();
+  uint32_t otherId = 0U;
+  std::thread other([&otherId]() { otherId = clog_threadId(); });
+  other.join();
+
+  ASSERT_EQ(clog_threadId(), id);
+  ASSERT_NE(otherId, id);
+  ASSERT_NE(otherId, 0U);
+}
@@ -0,0 +1,323 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clogBinary.h"
+#include "clogCompress.h"
+#include "clogFile.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogCompressTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 128;
+  static const size_t BlockSize = 4096;
+  static const size_t NumberOfBlocks = 2;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogCompressTest::writer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+  std::vector<char> blocks = std::vector<char>(BlockSize * NumberOfBlocks);
+  std::vector<char> frame = std::vector<char>(CLOG_COMPRESS_FRAME_SIZE(BlockSize));
+  CLogCompressor compressor = {};
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  std::string path;
+
+  CLogCompressTest() {
+    compressor.blocks = blocks.data();
+    compressor.blockSize = BlockSize;
+    compressor.numberOfBlocks = NumberOfBlocks;
+    compressor.frame = frame.data();
+  }
+
+  void SetUp() override {
+    path = makeTempFile("clogCompress");
+    ASSERT_FALSE(path.empty());
+    ASSERT_TRUE(clog_fileOpen(&file, path.c_str(), nullptr));
+  }
+
+  void TearDown() override {
+    clog_fileClose(&file);
+    unlink(path.c_str());
+  }
+
+  static std::string roundTrip(const std::string &data) {
+    std::vector<char> compressed(CLOG_COMPRESS_BOUND(data.size()));
+    std::vector<char> decompressed(data.size() + 1U);
+    size_t length = 0U;
+
+    const size_t size = clog_compress(data.data(), data.size(), compressed.data(), compressed.size());
+    EXPECT_GT(size, 0U);
+    EXPECT_TRUE(clog_decompress(compressed.data(), size, decompressed.data(), decompressed.size(), &length));
+    return std::string(decompressed.data(), length);
+  }
+
+  // reads the file through a decompressing stream
+  std::string read() {
+    FILE *compressed = fopen(path.c_str(), "rb");
+    EXPECT_NE(compressed, nullptr);
+    FILE *stream = clog_decompressStream(compressed);
+    std::string content;
+    char chunk[1000];
+    size_t size;
+    while ((size = fread(chunk, 1U, sizeof(chunk), stream)) > 0U) {
+      content.append(chunk, size);
+    }
+    EXPECT_FALSE(ferror(stream));
+    fclose(stream);
+    fclose(compressed);
+    return content;
+  }
+
+  static CLogFile file;
+
+  static void writer(const CLogMessage *message) {
+    clog_fileWrite(&file, message);
+  }
+};
+
+CLogFile CLogCompressTest::file;
+
+TEST_F(CLogCompressTest, roundTrip) {
+  std::mt19937 random(42);
+  std::string noise(100000U, ' ');
+  for (auto &c : noise) {
+    c = static_cast<char>(random());
+  }
+  std::string lines;
+  for (int i = 0; i < 1000; i++) {
+    lines += "INF:IO file.c:" + std::to_string(i % 7) + "(main) message " + std::to_string(i) + "\n";
+  }
+
+  for (const std::string &data : {std::string(),
+                                   std::string("x"),
+                                   std::string("abcd"),
+                                   std::string(100000U, 'a'),
+                                   std::string("abcabcabcabcabcabcabc"),
+                                   noise,
+                                   lines,
+                                   noise + lines + noise}) {
+    ASSERT_EQ(roundTrip(data), data);
+  }
+}
+
+TEST_F(CLogCompressTest, tooSmall) {
+  const std::string data(1000U, 'a');
+  const std::string noise = "0123456789abcdefghijklmnopqrstuvwxyz";
+  std::vector<char> compressed(CLOG_COMPRESS_BOUND(data.size()));
+  char decompressed[100];
+  size_t length = 0U;
+
+  ASSERT_EQ(clog_compress(noise.data(), noise.size(), compressed.data(), noise.size()), 0U);
+  const size_t size = clog_compress(data.data(), data.size(), compressed.data(), compressed.size());
+  ASSERT_FALSE(clog_decompress(compressed.data(), size, decompressed, sizeof(decompressed), &length));
+}
+
+TEST_F(CLogCompressTest, corruptedData) {
+  std::string data;
+  for (int i = 0; i < 100; i++) {
+    data += "message " + std::to_string(i) + "\n";
+  }
+  std::vector<char> compressed(CLOG_COMPRESS_BOUND(data.size()));
+  std::vector<char> decompressed(data.size());
+  size_t length = 0U;
+  const size_t size = clog_compress(data.data(), data.size(), compressed.data(), compressed.size());
+
+  // a truncated block is detected or decompresses to less data, a damaged one must not overrun the buffer
+  for (size_t i = 0; i < size; i++) {
+    length = data.size();
+    ASSERT_TRUE(!clog_decompress(compressed.data(), i, decompressed.data(), decompressed.size(), &length) ||
+                length < data.size());
+    std::vector<char> damaged = compressed;
+    damaged[i] = static_cast<char>(damaged[i] ^ 0x5A);
+    clog_decompress(damaged.data(), size, decompressed.data(), decompressed.size(), &length);
+  }
+  const char badOffset[] = {0x10, 'a', 0x02, 0x00};
+  ASSERT_FALSE(clog_decompress(badOffset, sizeof(badOffset), decompressed.data(), decompressed.size(), &length));
+}
+
+TEST_F(CLogCompressTest, compressesFile) {
+  static const int Messages = 5000;
+  ASSERT_TRUE(clog_fileCompress(&file, &compressor));
+
+  for (int i = 0; i < Messages; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+    CLOG_WRN(&ctx, COMMUNICATION, "retrying connection %d of %d", i % 3, 3)
+  }
+  clog_fileFlush(&file);
+  // every line is written once per message to the compressor, none to the file
+  ASSERT_EQ(file.writes, 2U * Messages);
+  ASSERT_GT(compressor.frames, 1U);
+  const uint64_t bytesIn = compressor.bytesIn;
+  const uint64_t bytesOut = compressor.bytesOut;
+  clog_fileClose(&file);
+
+  ASSERT_EQ(compressor.errors, 0U);
+  ASSERT_GE(bytesIn, 5U * bytesOut);
+  auto content = read();
+  ASSERT_EQ(content.size(), bytesIn);
+  ASSERT_THAT(content.substr(0, 100U), HasSubstr("INF:IO"));
+  ASSERT_THAT(content, EndsWith(" retrying connection " + std::to_string((Messages - 1) % 3) + " of 3\n"));
+  ASSERT_EQ(std::count(content.begin(), content.end(), '\n'), 2 * Messages);
+}
+
+TEST_F(CLogCompressTest, flushPolicyCompressesPartialBlock) {
+  const CLogFilePolicy policy = {0U, 0U, CLOG_LERR};
+  clog_fileClose(&file);
+  ASSERT_TRUE(clog_fileOpen(&file, path.c_str(), &policy));
+  ASSERT_TRUE(clog_fileCompress(&file, &compressor));
+
+  // the size of the policy only fills the current block
+  CLOG_INF(&ctx, IO, "collected")
+  ASSERT_GT(compressor.used, 0U);
+  ASSERT_EQ(compressor.frames, 0U);
+
+  // the level of the policy compresses and writes it
+  CLOG_ERR(&ctx, IO, "written")
+  ASSERT_EQ(compressor.used, 0U);
+  clog_fileFlush(&file);
+  ASSERT_EQ(compressor.frames, 1U);
+
+  auto content = read();
+  ASSERT_THAT(content, HasSubstr(" collected\n"));
+  ASSERT_THAT(content, EndsWith(" written\n"));
+}
+
+TEST_F(CLogCompressTest, compressesBinaryLog) {
+  static const int Messages = 2000;
+  CLogBinaryWriter binaryWriter;
+  std::vector<std::string> decoded;
+  ASSERT_TRUE(clog_compressorOpen(&compressor, file.fd));
+  ASSERT_TRUE(clog_binaryOpen(&binaryWriter, clog_compressorStream(&compressor)));
+  ASSERT_EQ(clog_compressorStream(&compressor), clog_compressorStream(&compressor));
+
+  for (int i = 0; i < Messages; i++) {
+    CLogMessage message = {"file.c", 1, "main", "compressed", CLOG_LINF, "IO"};
+    ASSERT_TRUE(clog_binaryWrite(&binaryWriter, &message));
+  }
+  clog_binaryClose(&binaryWriter);
+  clog_compressorClose(&compressor);
+  ASSERT_EQ(clog_compressorStream(&compressor), nullptr);
+
+  FILE *compressed = fopen(path.c_str(), "rb");
+  ASSERT_NE(compressed, nullptr);
+  FILE *stream = clog_decompressStream(compressed);
+  ASSERT_TRUE(clog_binaryRead(
+      stream,
+      [](const CLogMessage *message, uint64_t, void *userData) {
+        static_cast<std::vector<std::string> *>(userData)->push_back(clog_getMessage(message));
+      },
+      &decoded));
+  fclose(stream);
+  fclose(compressed);
+
+  ASSERT_EQ(decoded.size(), static_cast<size_t>(Messages));
+  ASSERT_EQ(decoded.back(), "compressed");
+}
+
+TEST_F(CLogCompressTest, readsUncompressedFiles) {
+  CLOG_INF(&ctx, IO, "plain")
+  CLOG_INF(&ctx, IO, "text")
+
+  auto content = read();
+  ASSERT_EQ(std::count(content.begin(), content.end(), '\n'), 2);
+  ASSERT_THAT(content, HasSubstr(" plain\n"));
+  ASSERT_THAT(content, EndsWith(" text\n"));
+}
+
+TEST_F(CLogCompressTest, detectsCorruptedFrames) {
+  ASSERT_TRUE(clog_fileCompress(&file, &compressor));
+  for (int i = 0; i < 1000; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+  }
+  clog_fileClose(&file);
+
+  // damage the second frame, the first one is still read
+  FILE *damaged = fopen(path.c_str(), "r+b");
+  ASSERT_NE(damaged, nullptr);
+  unsigned char header[CLOG_COMPRESS_FRAME_HEADER_SIZE];
+  ASSERT_EQ(fread(header, 1U, sizeof(header), damaged), sizeof(header));
+  const long stored = header[9] | header[10] << 8 | header[11] << 16 | header[12] << 24;
+  fseek(damaged, stored + CLOG_COMPRESS_FRAME_HEADER_SIZE, SEEK_SET);
+  fputc('X', damaged);
+  fclose(damaged);
+
+  FILE *compressed = fopen(path.c_str(), "rb");
+  FILE *stream = clog_decompressStream(compressed);
+  std::vector<char> content(10U * BlockSize);
+  ASSERT_EQ(fread(content.data(), 1U, content.size(), stream), static_cast<size_t>(BlockSize));
+  ASSERT_TRUE(ferror(stream));
+  fclose(stream);
+  fclose(compressed);
+}
+
+TEST_F(CLogCompressTest, invalid) {
+  CLogCompressor oneBlock = {};
+  oneBlock.blocks = blocks.data();
+  oneBlock.blockSize = BlockSize;
+  oneBlock.numberOfBlocks = 1U;
+  oneBlock.frame = frame.data();
+  CLogCompressor noFrame = {};
+  noFrame.blocks = blocks.data();
+  noFrame.blockSize = BlockSize;
+  noFrame.numberOfBlocks = NumberOfBlocks;
+  noFrame.frame = nullptr;
+  CLogCompressor noBlocks = {};
+  noBlocks.blocks = nullptr;
+  noBlocks.blockSize = BlockSize;
+  noBlocks.numberOfBlocks = NumberOfBlocks;
+  noBlocks.frame = frame.data();
+  size_t length = 0U;
+
+  ASSERT_FALSE(clog_compressorOpen(&oneBlock, file.fd));
+  ASSERT_FALSE(clog_compressorOpen(&noFrame, file.fd));
+  ASSERT_FALSE(clog_compressorOpen(&noBlocks, file.fd));
+  ASSERT_FALSE(clog_compressorOpen(&compressor, -1));
+  ASSERT_FALSE(clog_compressorOpen(nullptr, file.fd));
+  ASSERT_EQ(clog_compressorStream(nullptr), nullptr);
+  ASSERT_EQ(clog_decompressStream(nullptr), nullptr);
+  ASSERT_EQ(clog_compress(nullptr, 0U, buffer, sizeof(buffer)), 0U);
+  ASSERT_FALSE(clog_decompress(nullptr, 0U, buffer, sizeof(buffer), &length));
+  clog_compressorWrite(nullptr, nullptr, 0U);
+  clog_compressorFlush(nullptr);
+  clog_compressorClose(nullptr);
+
+  // compression and rotation exclude each other
+  const CLogFileRotation rotation = {1U, 0U, 1U, nullptr};
+  ASSERT_TRUE(clog_fileCompress(&file, &compressor));
+  ASSERT_FALSE(clog_fileCompress(&file, &compressor));
+  ASSERT_FALSE(clog_fileStartRotation(&file, &rotation));
+}
@@ -0,0 +1,243 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.hpp"
+#include "clogAsync.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+using clogxx::checkFormat;
+using clogxx::FormatError;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+enum Color { RED, GREEN };
+enum class Scoped { ONE };
+
+// matching arguments
+static_assert(FormatError::NONE == checkFormat<>("no arguments, 100%% sure"), "");
+static_assert(FormatError::NONE == checkFormat<int, unsigned, short, char, bool, Color>("%d %u %hd %c %d %x"), "");
+static_assert(FormatError::NONE == checkFormat<long, unsigned long long, size_t, ptrdiff_t>("%ld %llu %zu %td"), "");
+static_assert(FormatError::NONE == checkFormat<intmax_t, int64_t>("%jd %" PRId64), "");
+static_assert(FormatError::NONE == checkFormat<float, double, long double>("%f %.3e %Lg"), "");
+static_assert(FormatError::NONE == checkFormat<const char *, char[4], std::string, wchar_t *>("%s %s %s %ls"), "");
+static_assert(FormatError::NONE == checkFormat<void *, const int *, std::nullptr_t>("%p %p %p"), "");
+static_assert(FormatError::NONE == checkFormat<int, int, const char *>("%-*.*s|"), "");
+
+// mismatches
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<size_t>("%d"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<long long>("%ld"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<double>("%d"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<int>("%f"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<long double>("%f"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<int>("%s"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<const char *>("%p"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<std::string>("%ls"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<Scoped>("%d"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<std::vector<int>>("%p"), "");
+static_assert(FormatError::TYPE_MISMATCH == checkFormat<size_t, const char *>("%*s"), "");
+static_assert(FormatError::TOO_FEW_ARGUMENTS == checkFormat<int>("%d %d"), "");
+static_assert(FormatError::TOO_FEW_ARGUMENTS == checkFormat<>("%.*f"), "");
+static_assert(FormatError::TOO_MANY_ARGUMENTS == checkFormat<int, int>("%d"), "");
+static_assert(FormatError::UNSUPPORTED == checkFormat<int *>("%n"), "");
+static_assert(FormatError::UNSUPPORTED == checkFormat<int>("%1$d"), "");
+static_assert(FormatError::UNSUPPORTED == checkFormat<int>("%Ld"), "");
+static_assert(FormatError::UNSUPPORTED == checkFormat<>("trailing %"), "");
+
+class CLogCppTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 128;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogCppTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  void SetUp() override {
+    messages.clear();
+    levels.clear();
+  }
+
+  static std::vector<std::string> messages;
+  static std::vector<CLogLevel> levels;
+
+  static void printer(const CLogMessage *message) {
+    messages.emplace_back(clog_getMessage(message));
+    levels.push_back(message->level);
+  };
+};
+
+std::vector<std::string> CLogCppTest::messages;
+std::vector<CLogLevel> CLogCppTest::levels;
+
+static bool captureC(CLogArgs *args, const char *format, ...) {
+  va_list list;
+  va_start(list, format);
+  bool result = clog_captureArgs(args, format, list);
+  va_end(list);
+  return result;
+}
+
+// the C++ serializers must produce the records clog_captureArgs() produces
+#define EXPECT_SAME_RECORD(FORMAT, ...)                                                                                \
+  {                                                                                                                    \
+    CLogArgs cRecord;                                                                                                  \
+    CLogArgs cppRecord;                                                                                                \
+    const bool cResult = captureC(&cRecord, FORMAT, __VA_ARGS__);                                                      \
+    EXPECT_EQ(clogxx::captureArgs(cppRecord, FORMAT, __VA_ARGS__), cResult);                                           \
+    EXPECT_EQ(cppRecord.size, cRecord.size);                                                                           \
+    EXPECT_EQ(cppRecord.truncated, cRecord.truncated);                                                                 \
+    EXPECT_EQ(0, memcmp(cppRecord.data, cRecord.data, cRecord.size)) << FORMAT;                                        \
+  }
+
+TEST_F(CLogCppTest, sameRecordsAsC) {
+  const std::string longText(300U, 'x');
+  const char *nullText = nullptr;
+  int value = 5;
+
+  EXPECT_SAME_RECORD("%d %hhd %c %u %x", -7, 300, 'a', 42U, 0xbeef);
+  EXPECT_SAME_RECORD("%ld %lld %zu %td %jd", -1L, 1LL << 40, sizeof(value), (ptrdiff_t)-3, (intmax_t)9);
+  EXPECT_SAME_RECORD("%f %e %Lg", 1.5, 2.25, 3.5L);
+  EXPECT_SAME_RECORD("%s|%-*.*s|%s", "text", 6, 2, "abc", nullText);
+  EXPECT_SAME_RECORD("%5.1s|%.*ls|%.9s|%.*s", "abc", 2, L"wide", "abc", -1, "text");
+  EXPECT_SAME_RECORD("%p %ls %lc", (void *)&value, L"wide", (wint_t)L'w');
+  EXPECT_SAME_RECORD("%s %d", longText.c_str(), 1);
+}
+
+TEST_F(CLogCppTest, precisionBoundsStrings) {
+  // the strings are not terminated within the precision, printf doesn't read beyond it
+  struct {
+    char raw[4];
+    char more[4];
+    char end;
+    wchar_t wide[3];
+    wchar_t wideMore[4];
+    wchar_t wideEnd;
+  } unterminated = {{'a', 'b', 'c', 'd'}, {'e', 'f', 'g', 'h'}, 0, {L'x', L'y', L'z'}, {L'!', L'!', L'!', L'!'}, 0};
+  CLogArgs record;
+
+  ASSERT_TRUE(clogxx::captureArgs(record, "%.4s", unterminated.raw));
+  ASSERT_EQ(record.size, sizeof(uint32_t) + 4U);
+  ASSERT_TRUE(clogxx::captureArgs(record, "%-6.*s|", 4, unterminated.raw));
+  ASSERT_EQ(record.size, sizeof(int) + sizeof(uint32_t) + 4U);
+  ASSERT_TRUE(clogxx::captureArgs(record, "%.3ls", unterminated.wide));
+  ASSERT_EQ(record.size, sizeof(uint32_t) + 3U * sizeof(wchar_t));
+  ASSERT_TRUE(clogxx::captureArgs(record, "%*.*ls", 5, 3, unterminated.wide));
+  ASSERT_EQ(record.size, 2U * sizeof(int) + sizeof(uint32_t) + 3U * sizeof(wchar_t));
+
+  CLOGXX_INF(&ctx, IO, "%d%% %.4s %.*s %.*ls", 100, unterminated.raw, 2, unterminated.raw, 3, unterminated.wide);
+  ASSERT_THAT(messages, ElementsAre("100% abcd ab xyz"));
+}
+
+TEST_F(CLogCppTest, typedArguments) {
+  const std::string name = "file.txt";
+  const std::wstring wide = L"wide";
+  const size_t bytes = 1234U;
+  const float ratio = 0.5F;
+  const char *nullText = nullptr;
+
+  CLOGXX_INF(&ctx, IO, "read %zu bytes from %s", bytes, name);
+  CLOGXX_WRN(&ctx, IO, "%c%c %hhu %d %.1f%%", 'o', 'k', 257, GREEN, ratio);
+  CLOGXX_ERR(&ctx, IO, "[%*s] [%-8.3s] %s %ls", 6, "abc", name, nullText, wide);
+  CLOGXX_DBG(&ctx, COMMUNICATION, "no arguments");
+  CLOGXX_FTL(&ctx, COMMUNICATION, "%lld %lx %p", -(1LL << 40), 255UL, nullptr);
+
+  ASSERT_THAT(messages,
+              ElementsAre("read 1234 bytes from file.txt",
+                          "ok 1 1 0.5%",
+                          "[   abc] [fil     ] (null) wide",
+                          "no arguments",
+                          "-1099511627776 ff (nil)"));
+}
+
+TEST_F(CLogCppTest, disabledMessagesDontEvaluateArguments) {
+  int evaluated = 0;
+  auto count = [&evaluated]() { return ++evaluated; };
+
+  ctx.minLevel = CLOG_LWRN;
+  // the first execution registers the call site without evaluating the arguments
+  for (int i = 0; i < 3; i++) {
+    CLOGXX_INF(&ctx, IO, "%d", count());
+  }
+  CLOGXX_WRN(&ctx, IO, "%d", count());
+
+  ASSERT_EQ(evaluated, 1);
+  ASSERT_THAT(messages, ElementsAre("1"));
+}
+
+TEST_F(CLogCppTest, runtimeLevel) {
+  ctx.minLevel = CLOG_LINF;
+
+  for (CLogLevel level : {CLOG_LDBG, CLOG_LERR, CLOG_LINF}) {
+    CLOGXX_MESSAGE(&ctx, level, IO, "%d", static_cast<int>(level));
+  }
+
+  ASSERT_THAT(messages, ElementsAre("4", "2"));
+  ASSERT_THAT(levels, ElementsAre(CLOG_LERR, CLOG_LINF));
+}
+
+TEST_F(CLogCppTest, truncatedArguments) {
+  const std::string longText(CLOG_ARGS_SIZE, 'x');
+
+  CLOGXX_INF(&ctx, IO, "%d %s %d", 1, longText, 2);
+
+  ASSERT_EQ(messages.size(), 1U);
+  ASSERT_EQ(messages[0].substr(0, 10), "1 xxxxxxxx");
+  ASSERT_EQ(messages[0].size(), BufferSize - 1U);
+}
+
+TEST_F(CLogCppTest, deferredFormatting) {
+  ctx.deferredFormatting = true;
+  const std::string text = "deferred";
+
+  CLOGXX_INF(&ctx, IO, "%s %d %g", text, 3, 0.25);
+
+  ASSERT_THAT(messages, ElementsAre("deferred 3 0.25"));
+}
+
+TEST_F(CLogCppTest, asynchronousContext) {
+  static const size_t NumberOfSlots = 16;
+  std::vector<CLogAsyncSlot> slots{NumberOfSlots};
+  CLogAsync async = {};
+  async.slots = slots.data();
+  async.numberOfSlots = NumberOfSlots;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  for (int i = 0; i < 3; i++) {
+    // the string does not have to outlive the log statement
+    std::string text = "message " + std::to_string(i);
+    CLOGXX_INF(&ctx, IO, "%s of %u", text, 3U);
+  }
+
+  clog_asyncStop(&ctx);
+  ASSERT_THAT(messages, ElementsAre("message 0 of 3", "message 1 of 3", "message 2 of 3"));
+}
@@ -0,0 +1,269 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <cstdarg>
+#include <cstdint>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogDeferredTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 12;
+  static const size_t GuardSize = 3;
+  char buffer[BufferSize + GuardSize];
+  CLogAdapter adapters[1] = {{CLogDeferredTest::filter, CLogDeferredTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+      true,
+  };
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  void SetUp() override {
+    memset(buffer, 0, ARRAY_LENGTH(buffer));
+    for (size_t i = 0; i < GuardSize; i++) {
+      buffer[BufferSize + i] = '\xFF';
+    }
+    mock = new MockAdapter();
+  }
+
+  void TearDown() override {
+    delete mock;
+    mock = nullptr;
+  }
+
+  bool isGuardOk() {
+    for (size_t i = 0; i < GuardSize; i++) {
+      if (buffer[BufferSize + i] != '\xFF') {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static MockAdapter *mock;
+
+  static bool filter(const CLogMessage *message) {
+    return mock->filter(message);
+  };
+
+  static void printer(const CLogMessage *message) {
+    mock->printer(message);
+  };
+};
+
+MockAdapter *CLogDeferredTest::mock;
+
+static std::string messageText(const CLogMessage *message) {
+  return clog_getMessage(message);
+}
+
+static std::string captureAndFormat(const char *format, ...) {
+  CLogArgs args;
+  va_list list;
+  va_start(list, format);
+  clog_captureArgs(&args, format, list);
+  va_end(list);
+
+  char text[512];
+  clog_formatArgs(text, sizeof(text), &args);
+  return text;
+}
+
+TEST_F(CLogDeferredTest, filteredMessageIsNotFormatted) {
+  EXPECT_CALL(*mock, filter(AllOf(Field(&CLogMessage::message, IsNull()), Field(&CLogMessage::args, NotNull()))))
+      .Times(1)
+      .WillRepeatedly(Return(false));
+  EXPECT_CALL(*mock, printer(_)).Times(0);
+
+  CLOG_TRC(&ctx, IO, "%d, %s", 1, "abc")
+
+  ASSERT_TRUE(isGuardOk());
+  ASSERT_THAT(std::vector<char>(buffer, buffer + BufferSize), Each(0));
+}
+
+TEST_F(CLogDeferredTest, messageIsFormattedOnRequest) {
+  EXPECT_CALL(*mock, filter(_)).Times(1).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock, printer(ResultOf(messageText, StrEq("1, 2.5, abc")))).Times(1);
+
+  CLOG_TRC(&ctx, IO, "%d, %2.1f, %s", 1, 2.5F, "abc")
+  ASSERT_TRUE(isGuardOk());
+}
+
+TEST_F(CLogDeferredTest, messageIsFormattedOnce) {
+  EXPECT_CALL(*mock, filter(_)).Times(1).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock, printer(_)).WillOnce(Invoke([](const CLogMessage *message) {
+    const char *first = clog_getMessage(message);
+    ASSERT_STREQ(first, "abc 12");
+    ASSERT_EQ(first, message->message);
+    ASSERT_EQ(first, clog_getMessage(message));
+  }));
+
+  CLOG_TRC(&ctx, IO, "abc %d", 12)
+  ASSERT_TRUE(isGuardOk());
+}
+
+TEST_F(CLogDeferredTest, printTestOverflow) {
+  EXPECT_CALL(*mock, filter(_)).Times(1).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock, printer(ResultOf(messageText, StrEq("123456789..")))).Times(1);
+
+  CLOG_TRC(&ctx, IO, "%s%s", "123456789", "ABC")
+  ASSERT_TRUE(isGuardOk());
+}
+
+TEST_F(CLogDeferredTest, uncapturableMessageIsFormattedEagerly) {
+  EXPECT_CALL(*mock, filter(Field(&CLogMessage::args, NotNull()))).Times(1).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock, printer(ResultOf(messageText, StrEq("1 abc")))).Times(1);
+
+  CLOG_TRC(&ctx, IO, "%'d %s", 1, "abc")
+  ASSERT_TRUE(isGuardOk());
+}
+
+TEST_F(CLogDeferredTest, formatMessageUsesDeferredText) {
+  EXPECT_CALL(*mock, filter(_)).Times(1).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock, printer(_)).WillOnce(Invoke([](const CLogMessage *message) {
+    char line[128];
+    int lineLength = sizeof(line);
+    clog_formatMessage(line, &lineLength, message);
+    ASSERT_THAT(line, EndsWith(" x=5\n"));
+  }));
+
+  CLOG_WRN(&ctx, COMMUNICATION, "x=%d", 5)
+  ASSERT_TRUE(isGuardOk());
+}
+
+TEST(testCaptureArgs, matchesPrintf) {
+  int value = 0;
+
+  ASSERT_EQ(captureAndFormat("no args"), "no args");
+  ASSERT_EQ(captureAndFormat("%d %i %u %x %X %o %%", -12, 34, 56U, 0xabU, 0xCDU, 8U),
+            formatPrintf("%d %i %u %x %X %o %%", -12, 34, 56U, 0xabU, 0xCDU, 8U));
+  ASSERT_EQ(captureAndFormat("%hhd %hd %ld %lld %jd %zu %td", 1, 2, 3L, 4LL, (intmax_t)5, (size_t)6, (ptrdiff_t)7),
+            formatPrintf("%hhd %hd %ld %lld %jd %zu %td", 1, 2, 3L, 4LL, (intmax_t)5, (size_t)6, (ptrdiff_t)7));
+  ASSERT_EQ(captureAndFormat("[%-8s|%8.2s|%c]", "left", "right", 'c'),
+            formatPrintf("[%-8s|%8.2s|%c]", "left", "right", 'c'));
+  ASSERT_EQ(captureAndFormat("[%*d|%-*.*f]", 6, 42, 9, 3, 3.14159), formatPrintf("[%*d|%-*.*f]", 6, 42, 9, 3, 3.14159));
+  ASSERT_EQ(captureAndFormat("[%*d]", -6, 42), formatPrintf("[%*d]", -6, 42));
+  ASSERT_EQ(captureAndFormat("%e %g %Lf %a", 1.5e10, 0.0001, 2.5L, 1.0),
+            formatPrintf("%e %g %Lf %a", 1.5e10, 0.0001, 2.5L, 1.0));
+  ASSERT_EQ(captureAndFormat("%p %s", &value, (const char *)nullptr),
+            formatPrintf("%p %s", &value, (const char *)nullptr));
+  ASSERT_EQ(captureAndFormat("%ls", L"wide"), "wide");
+}
+
+TEST(testCaptureArgs, uncapturableSpecsAreFormattedEagerly) {
+  ASSERT_EQ(captureAndFormat("%'d %s", 1234567, "abc"), formatPrintf("%'d %s", 1234567, "abc"));
+
+  std::string longString(CLOG_ARGS_SIZE * 2, 'x');
+  std::string text = captureAndFormat("%'d %s", 1, longString.c_str());
+  ASSERT_LT(text.size(), longString.size());
+  ASSERT_THAT(text, EndsWith(".."));
+}
+
+TEST(testCaptureArgs, stringsAreCopied) {
+  CLogArgs args;
+  char text[16];
+  char value[] = "before";
+
+  auto capture = [&args](const char *format, ...) {
+    va_list list;
+    va_start(list, format);
+    ASSERT_TRUE(clog_captureArgs(&args, format, list));
+    va_end(list);
+  };
+  capture("%s", value);
+  strcpy(value, "after!");
+
+  clog_formatArgs(text, sizeof(text), &args);
+  ASSERT_STREQ(text, "before");
+}
+
+TEST(testCaptureArgs, precisionBoundsStrings) {
+  // the strings are not terminated within the precision, printf doesn't read beyond it
+  struct {
+    char raw[4];
+    char more[4];
+    char end;
+    wchar_t wide[3];
+    wchar_t wideMore[4];
+    wchar_t wideEnd;
+  } unterminated = {{'a', 'b', 'c', 'd'}, {'e', 'f', 'g', 'h'}, 0, {L'x', L'y', L'z'}, {L'!', L'!', L'!', L'!'}, 0};
+  CLogArgs args;
+  char text[16];
+
+  auto capture = [&args](const char *format, ...) {
+    va_list list;
+    va_start(list, format);
+    ASSERT_TRUE(clog_captureArgs(&args, format, list));
+    va_end(list);
+  };
+
+  capture("%.4s", unterminated.raw);
+  ASSERT_EQ(args.size, sizeof(uint32_t) + 4U);
+  clog_formatArgs(text, sizeof(text), &args);
+  ASSERT_STREQ(text, "abcd");
+
+  capture("%.*s", 4, unterminated.raw);
+  ASSERT_EQ(args.size, sizeof(int) + sizeof(uint32_t) + 4U);
+  clog_formatArgs(text, sizeof(text), &args);
+  ASSERT_STREQ(text, "abcd");
+
+  capture("%.3ls", unterminated.wide);
+  ASSERT_EQ(args.size, sizeof(uint32_t) + 3U * sizeof(wchar_t));
+  clog_formatArgs(text, sizeof(text), &args);
+  ASSERT_STREQ(text, "xyz");
+
+  capture("%.*ls", 3, unterminated.wide);
+  ASSERT_EQ(args.size, sizeof(int) + sizeof(uint32_t) + 3U * sizeof(wchar_t));
+  clog_formatArgs(text, sizeof(text), &args);
+  ASSERT_STREQ(text, "xyz");
+
+  // shorter strings and a negative precision stop at the terminator
+  ASSERT_EQ(captureAndFormat("[%.8s|%.*s]", "ab", -1, "cd"), "[ab|cd]");
+}
+
+TEST(testCaptureArgs, truncatedArguments) {
+  std::string longString(CLOG_ARGS_SIZE * 2, 'x');
+
+  std::string text = captureAndFormat("%s %d", longString.c_str(), 1);
+
+  ASSERT_LT(text.size(), longString.size());
+  ASSERT_THAT(text, EndsWith(".."));
+}
+
+TEST(testCaptureArgs, invalidParameters) {
+  CLogArgs args = {};
+  char text[4] = {'a', 'b', 'c', 0};
+
+  ASSERT_EQ(clog_formatArgs(nullptr, sizeof(text), &args), 0U);
+  ASSERT_EQ(clog_formatArgs(text, 0U, &args), 0U);
+  ASSERT_STREQ(text, "abc");
+  ASSERT_EQ(clog_formatArgs(text, sizeof(text), nullptr), 0U);
+  ASSERT_STREQ(text, "");
+  ASSERT_EQ(clog_getMessage(nullptr), nullptr);
+}
@@ -0,0 +1,424 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clogAsync.h"
+#include "clogFile.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogFileTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 64;
+  static const size_t NumberOfSlots = 1024;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, nullptr, CLOG_LTRC, 0U, CLogFileTest::batchWriter}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+  std::vector<CLogAsyncSlot> slots{NumberOfSlots};
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  std::string path;
+
+  void SetUp() override {
+    path = makeTempFile("clogFile");
+    ASSERT_FALSE(path.empty());
+    blocked = false;
+    entered = false;
+    ASSERT_TRUE(clog_fileOpen(&file, path.c_str(), nullptr));
+  }
+
+  void TearDown() override {
+    blocked = false;
+    clog_asyncStop(&ctx);
+    clog_fileClose(&file);
+    unlink(path.c_str());
+    for (int i = 1; i <= 5; i++) {
+      unlink(rotated(i).c_str());
+      unlink((path + "-" + std::to_string(i) + ".old").c_str());
+    }
+  }
+
+  std::string rotated(int index) const {
+    return path + "." + std::to_string(index);
+  }
+
+  bool exists(const std::string &name) const {
+    return 0 == access(name.c_str(), F_OK);
+  }
+
+  void startRotation(const CLogFileRotation &rotation) {
+    adapters[0].onMessage = writer;
+    ASSERT_TRUE(clog_fileStartRotation(&file, &rotation));
+    waitForNextFile();
+  }
+
+  // the next file is opened after the rotated files have been renamed
+  static void waitForNextFile() {
+    while (__atomic_load_n(&file.spare, __ATOMIC_ACQUIRE) < 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::vector<std::string> read() {
+    return read(path);
+  }
+
+  std::vector<std::string> read(const std::string &name) {
+    std::vector<std::string> lines;
+    std::ifstream stream(name);
+    std::string line;
+    while (std::getline(stream, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  static CLogFile file;
+  static std::atomic<bool> blocked;
+  static std::atomic<bool> entered;
+  static uint64_t now;
+
+  static uint64_t fakeClock() {
+    return now;
+  }
+
+  static void writer(const CLogMessage *message) {
+    clog_fileWrite(&file, message);
+  }
+
+  static void batchWriter(const CLogMessage messages[], size_t count) {
+    entered = true;
+    while (blocked) {
+      std::this_thread::yield();
+    }
+    clog_fileWriteBatch(&file, messages, count);
+  }
+};
+
+CLogFile CLogFileTest::file;
+std::atomic<bool> CLogFileTest::blocked;
+std::atomic<bool> CLogFileTest::entered;
+uint64_t CLogFileTest::now;
+
+TEST_F(CLogFileTest, singleMessages) {
+  adapters[0].onMessage = writer;
+
+  CLOG_INF(&ctx, IO, "first")
+  CLOG_WRN(&ctx, COMMUNICATION, "second %d", 2)
+
+  ASSERT_EQ(file.writes, 2U);
+  auto lines = read();
+  ASSERT_EQ(lines.size(), 2U);
+  ASSERT_THAT(lines[0], EndsWith(" first"));
+  ASSERT_THAT(lines[0], HasSubstr("INF:IO"));
+  ASSERT_THAT(lines[1], EndsWith(" second 2"));
+}
+
+TEST_F(CLogFileTest, oneWritePerBatch) {
+  static const int Messages = 1000;
+  CLogAsync async = {};
+  async.slots = slots.data();
+  async.numberOfSlots = NumberOfSlots;
+  ASSERT_TRUE(clog_asyncStart(&ctx, &async));
+
+  // keep the dispatcher busy until all messages are queued
+  blocked = true;
+  CLOG_INF(&ctx, IO, "blocking")
+  while (!entered) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < Messages; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+  }
+  blocked = false;
+  clog_asyncStop(&ctx);
+
+  ASSERT_EQ(file.writes, 1U + (Messages + CLOG_ASYNC_BATCH_SIZE - 1U) / CLOG_ASYNC_BATCH_SIZE);
+  ASSERT_EQ(file.errors, 0U);
+  auto lines = read();
+  ASSERT_EQ(lines.size(), Messages + 1U);
+  for (int i = 0; i < Messages; i++) {
+    ASSERT_THAT(lines[i + 1], EndsWith(" message " + std::to_string(i)));
+  }
+}
+
+TEST_F(CLogFileTest, batchLargerThanBuffer) {
+  static const size_t Messages = 200;
+  const std::string text(2U * CLOG_FILE_LINE_SIZE, 'x');
+  std::vector<CLogMessage> messages;
+  for (size_t i = 0; i < Messages; i++) {
+    messages.push_back({"file.c", 1, "main", text.c_str(), CLOG_LINF, "IO"});
+  }
+
+  clog_fileWriteBatch(&file, messages.data(), messages.size());
+
+  // the buffer holds CLOG_FILE_BUFFER_SIZE / CLOG_FILE_LINE_SIZE complete lines
+  const size_t linesPerWrite = CLOG_FILE_BUFFER_SIZE / CLOG_FILE_LINE_SIZE;
+  ASSERT_EQ(file.writes, (Messages + linesPerWrite - 1U) / linesPerWrite);
+  auto lines = read();
+  ASSERT_EQ(lines.size(), Messages);
+  for (const auto &line : lines) {
+    ASSERT_EQ(line.size(), CLOG_FILE_LINE_SIZE - 2U);
+  }
+}
+
+TEST_F(CLogFileTest, longLinesAreTruncated) {
+  char longBuffer[2U * CLOG_FILE_LINE_SIZE];
+  CLogContext longCtx = {adapters, 1U, TagsNames, ARRAY_LENGTH(TagsNames), CLOG_LTRC, longBuffer, sizeof(longBuffer)};
+  const std::string text(CLOG_FILE_LINE_SIZE, 'x');
+
+  CLOG_INF(&longCtx, IO, "%s", text.c_str())
+  CLOG_INF(&longCtx, IO, "short")
+
+  auto lines = read();
+  ASSERT_EQ(lines.size(), 2U);
+  ASSERT_EQ(lines[0].size(), CLOG_FILE_LINE_SIZE - 2U);
+  ASSERT_THAT(lines[1], EndsWith(" short"));
+}
+
+TEST_F(CLogFileTest, flushBySize) {
+  const CLogFilePolicy policy = {200U, 0U, CLOG_LOFF};
+  adapters[0].onMessage = writer;
+  clog_fileClose(&file);
+  ASSERT_TRUE(clog_fileOpen(&file, path.c_str(), &policy));
+
+  int messages = 0;
+  while (0U == file.writes) {
+    CLOG_INF(&ctx, IO, "message %d", messages++)
+    ASSERT_EQ(read().size(), (0U == file.writes) ? 0U : static_cast<size_t>(messages));
+  }
+  ASSERT_GT(messages, 1);
+  ASSERT_EQ(file.used, 0U);
+
+  CLOG_INF(&ctx, IO, "buffered")
+  ASSERT_EQ(read().size(), static_cast<size_t>(messages));
+  clog_fileClose(&file);
+  ASSERT_EQ(read().size(), messages + 1U);
+}
+
+TEST_F(CLogFileTest, flushByLevel) {
+  const CLogFilePolicy policy = {CLOG_FILE_BUFFER_SIZE, 0U, CLOG_LERR};
+  adapters[0].onMessage = writer;
+  clog_fileClose(&file);
+  ASSERT_TRUE(clog_fileOpen(&file, path.c_str(), &policy));
+
+  CLOG_INF(&ctx, IO, "info")
+  CLOG_WRN(&ctx, IO, "warning")
+  ASSERT_EQ(file.writes, 0U);
+  CLOG_ERR(&ctx, IO, "error")
+  ASSERT_EQ(file.writes, 1U);
+  ASSERT_EQ(read().size(), 3U);
+
+  // a batch is written at once if any of its messages is urgent
+  std::vector<CLogMessage> messages = {{"file.c", 1, "main", "first", CLOG_LINF, "IO"},
+                                       {"file.c", 2, "main", "second", CLOG_LFTL, "IO"},
+                                       {"file.c", 3, "main", "third", CLOG_LDBG, "IO"}};
+  clog_fileWriteBatch(&file, messages.data(), messages.size());
+  ASSERT_EQ(file.writes, 2U);
+  ASSERT_EQ(read().size(), 6U);
+}
+
+TEST_F(CLogFileTest, flushByInterval) {
+  const CLogFilePolicy policy = {CLOG_FILE_BUFFER_SIZE, 1000U, CLOG_LOFF};
+  adapters[0].onMessage = writer;
+  ctx.clock = fakeClock;
+  now = 5000U;
+  clog_fileClose(&file);
+  ASSERT_TRUE(clog_fileOpen(&file, path.c_str(), &policy));
+
+  CLOG_INF(&ctx, IO, "first")
+  now += 500U;
+  CLOG_INF(&ctx, IO, "second")
+  now += 499U;
+  CLOG_INF(&ctx, IO, "third")
+  ASSERT_EQ(file.writes, 0U);
+  now += 1U;
+  CLOG_INF(&ctx, IO, "fourth")
+  ASSERT_EQ(file.writes, 1U);
+  ASSERT_EQ(read().size(), 4U);
+
+  // the interval starts with the first line buffered after a write
+  now += 999U;
+  CLOG_FTL(&ctx, IO, "fifth")
+  ASSERT_EQ(file.writes, 1U);
+  clog_fileFlush(&file);
+  ASSERT_EQ(file.writes, 2U);
+  ASSERT_EQ(read().size(), 5U);
+  clog_fileFlush(&file);
+  ASSERT_EQ(file.writes, 2U);
+}
+
+TEST_F(CLogFileTest, rotateBySize) {
+  startRotation({1000U, 0U, 5U, nullptr});
+
+  int messages = 0;
+  for (uint64_t rotations = 1U; rotations <= 3U; rotations++) {
+    while (file.rotations < rotations) {
+      CLOG_INF(&ctx, IO, "message %d", messages++)
+    }
+    waitForNextFile();
+  }
+  CLOG_INF(&ctx, IO, "message %d", messages++)
+  clog_fileClose(&file);
+
+  ASSERT_EQ(file.postponed, 0U);
+  ASSERT_FALSE(exists(path + CLOG_FILE_SPARE_SUFFIX));
+  ASSERT_FALSE(exists(rotated(4)));
+  std::vector<std::string> lines;
+  for (int i = 3; i >= 1; i--) {
+    auto part = read(rotated(i));
+    ASSERT_GE(part.size() * (part.front().size() + 1U), 1000U);
+    lines.insert(lines.end(), part.begin(), part.end());
+  }
+  auto current = read();
+  ASSERT_EQ(current.size(), 1U);
+  lines.insert(lines.end(), current.begin(), current.end());
+
+  // no line is lost or duplicated
+  ASSERT_EQ(lines.size(), static_cast<size_t>(messages));
+  for (int i = 0; i < messages; i++) {
+    ASSERT_THAT(lines[i], EndsWith(" message " + std::to_string(i)));
+  }
+}
+
+TEST_F(CLogFileTest, rotateByInterval) {
+  ctx.clock = fakeClock;
+  now = 5000U;
+  startRotation({0U, 1000U, 1U, nullptr});
+
+  CLOG_INF(&ctx, IO, "first")
+  now += 999U;
+  CLOG_INF(&ctx, IO, "second")
+  ASSERT_EQ(file.rotations, 0U);
+  now += 1U;
+  CLOG_INF(&ctx, IO, "third")
+  ASSERT_EQ(file.rotations, 1U);
+  waitForNextFile();
+
+  // the interval starts with the first line of the new file
+  now += 5000U;
+  CLOG_INF(&ctx, IO, "fourth")
+  now += 999U;
+  CLOG_INF(&ctx, IO, "fifth")
+  ASSERT_EQ(file.rotations, 1U);
+  clog_fileClose(&file);
+
+  ASSERT_EQ(read(rotated(1)).size(), 3U);
+  ASSERT_EQ(read().size(), 2U);
+}
+
+TEST_F(CLogFileTest, rotationWritesBufferedLinesToRotatedFile) {
+  clog_fileClose(&file);
+  const CLogFilePolicy policy = {CLOG_FILE_BUFFER_SIZE, 0U, CLOG_LOFF};
+  ASSERT_TRUE(clog_fileOpen(&file, path.c_str(), &policy));
+  ctx.clock = fakeClock;
+  now = 5000U;
+  startRotation({0U, 1000U, 1U, nullptr});
+
+  CLOG_INF(&ctx, IO, "first")
+  now += 1000U;
+  CLOG_INF(&ctx, IO, "second")
+  ASSERT_EQ(file.rotations, 1U);
+  ASSERT_EQ(file.used, 0U);
+  ASSERT_EQ(file.size, 0U);
+  waitForNextFile();
+  CLOG_INF(&ctx, IO, "third")
+  clog_fileClose(&file);
+
+  ASSERT_THAT(read(rotated(1)), ElementsAre(EndsWith(" first"), EndsWith(" second")));
+  ASSERT_THAT(read(), ElementsAre(EndsWith(" third")));
+}
+
+TEST_F(CLogFileTest, rotationKeepsFiles) {
+  startRotation({1U, 0U, 2U, "%s-%u.old"});
+
+  for (int i = 0; i < 5; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+    waitForNextFile();
+  }
+  clog_fileClose(&file);
+
+  ASSERT_EQ(file.rotations, 5U);
+  ASSERT_TRUE(read().empty());
+  ASSERT_THAT(read(path + "-1.old"), ElementsAre(EndsWith(" message 4")));
+  ASSERT_THAT(read(path + "-2.old"), ElementsAre(EndsWith(" message 3")));
+  ASSERT_FALSE(exists(path + "-3.old"));
+}
+
+TEST_F(CLogFileTest, rotationDropsFiles) {
+  startRotation({1U, 0U, 0U, nullptr});
+
+  CLOG_INF(&ctx, IO, "first")
+  waitForNextFile();
+  CLOG_INF(&ctx, IO, "second")
+  waitForNextFile();
+  clog_fileClose(&file);
+
+  ASSERT_EQ(file.rotations, 2U);
+  ASSERT_TRUE(exists(path));
+  ASSERT_TRUE(read().empty());
+  ASSERT_FALSE(exists(rotated(1)));
+}
+
+TEST_F(CLogFileTest, invalidRotation) {
+  const std::string longPattern = "%s." + std::string(CLOG_FILE_PATH_SIZE, 'x') + "%u";
+  const CLogFileRotation noThreshold = {0U, 0U, 1U, nullptr};
+
+  ASSERT_FALSE(clog_fileStartRotation(&file, nullptr));
+  ASSERT_FALSE(clog_fileStartRotation(nullptr, &noThreshold));
+  ASSERT_FALSE(clog_fileStartRotation(&file, &noThreshold));
+  for (const char *pattern : {"%s", "%u.%s", "%s.%u%d", "%s.%u%", "%d.%u", longPattern.c_str()}) {
+    const CLogFileRotation rotation = {1U, 0U, 1U, pattern};
+    ASSERT_FALSE(clog_fileStartRotation(&file, &rotation)) << pattern;
+  }
+  const CLogFileRotation rotation = {1U, 0U, 1U, "%%%s.%u"};
+  ASSERT_TRUE(clog_fileStartRotation(&file, &rotation));
+  ASSERT_FALSE(clog_fileStartRotation(&file, &rotation));
+  clog_fileClose(&file);
+  ASSERT_FALSE(clog_fileStartRotation(&file, &rotation));
+}
+
+TEST_F(CLogFileTest, invalid) {
+  CLogFile other;
+
+  ASSERT_FALSE(clog_fileOpen(&other, "/nonexistent/directory/file.log", nullptr));
+  ASSERT_FALSE(clog_fileOpen(nullptr, path.c_str(), nullptr));
+  ASSERT_FALSE(clog_fileOpen(&other, nullptr, nullptr));
+  clog_fileWrite(&other, nullptr);
+  clog_fileWriteBatch(nullptr, nullptr, 0U);
+  clog_fileFlush(&other);
+  clog_fileClose(&other);
+}
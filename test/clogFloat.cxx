@@ -0,0 +1,241 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+static std::string format(const char *format, ...) {
+  char buffer[1024];
+  va_list list;
+  va_start(list, format);
+  clog_vformat(buffer, sizeof(buffer), format, list);
+  va_end(list);
+  return buffer;
+}
+
+static const char *const Formats[] = {"%f",     "%.0f",   "%.1f",   "%.2f",   "%.3f",   "%.9f",  "%.17f", "%.25f",
+                                      "%.40f",  "%e",     "%.0e",   "%.1e",   "%.3e",   "%.16e", "%.30e", "%E",
+                                      "%g",     "%.0g",   "%.1g",   "%.3g",   "%.10g",  "%.17g", "%.25g", "%G",
+                                      "%#.0f",  "%#.0e",  "%#g",    "%#.3g",  "%+f",    "% e",   "%12.3f", "%-12.3e|",
+                                      "%012.3g", "%+015.4f", "%-+10g|", "%F",   "%lf",    "%.128f", "%.100e"};
+
+static void expectLikePrintf(const double value) {
+  for (const char *spec : Formats) {
+    ASSERT_EQ(format(spec, value), formatPrintf(spec, value)) << spec << " of " << formatPrintf("%a", value);
+  }
+}
+
+TEST(CLogFloat, specialValues) {
+  const double values[] = {0.0,
+                           -0.0,
+                           1.0,
+                           -1.0,
+                           0.5,
+                           0.125,
+                           2.5,
+                           0.05,
+                           9.5,
+                           99.5,
+                           999999.5,
+                           0.1,
+                           1e-5,
+                           123456789.0,
+                           1e15,
+                           1e22,
+                           1e23,
+                           9.999999e-5,
+                           0.00009999995,
+                           DBL_MAX,
+                           DBL_MIN,
+                           std::numeric_limits<double>::denorm_min(),
+                           std::nextafter(DBL_MIN, 0.0),
+                           std::ldexp(1.0, 63),
+                           std::ldexp(1.0, 64),
+                           std::ldexp(1.0, 127),
+                           std::ldexp(1.0, -126),
+                           M_PI,
+                           -M_E};
+
+  for (double value : values) {
+    expectLikePrintf(value);
+  }
+
+  ASSERT_EQ(format("%f|%F|%e|%G|%5.1f|%-6f|%06f", INFINITY, INFINITY, -INFINITY, NAN, NAN, INFINITY, -INFINITY),
+            formatPrintf("%f|%F|%e|%G|%5.1f|%-6f|%06f", INFINITY, INFINITY, -INFINITY, NAN, NAN, INFINITY, -INFINITY));
+}
+
+TEST(CLogFloat, randomValues) {
+  std::mt19937_64 random(42U);
+
+  for (int i = 0; i < 3000; i++) {
+    uint64_t bits = random();
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (std::isfinite(value)) {
+      expectLikePrintf(value);
+    }
+  }
+
+  // the magnitudes seen in log messages
+  std::uniform_real_distribution<double> distribution(-1e6, 1e6);
+  for (int i = 0; i < 3000; i++) {
+    expectLikePrintf(distribution(random));
+    expectLikePrintf(distribution(random) * 1e-9);
+  }
+}
+
+TEST(CLogFloat, tiesRoundToEven) {
+  // exactly representable halves
+  ASSERT_EQ(format("%.0f %.0f %.0f %.0f %.1f %.2f", 0.5, 1.5, 2.5, -3.5, 0.25, 1.125), "0 2 2 -4 0.2 1.12");
+  ASSERT_EQ(format("%.0e %.1e", 2.5, 1.25), "2e+00 1.2e+00");
+}
+
+TEST(CLogFloat, mixedWithOtherConversions) {
+  ASSERT_EQ(format("%s=%.3f (%d%%) %*.*f", "ratio", 0.4567, 45, 8, 2, 3.14159), "ratio=0.457 (45%)     3.14");
+
+  // long doubles and hexadecimal floats are left to vsnprintf
+  ASSERT_EQ(format("%Lf %a %f", 1.5L, 1.0, 2.0), formatPrintf("%Lf %a %f", 1.5L, 1.0, 2.0));
+  ASSERT_EQ(format("%.200f", 0.1), formatPrintf("%.200f", 0.1));
+}
+
+class CLogFloatShortestTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 128;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogFloatShortestTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  void SetUp() override {
+    ctx.shortestFloats = true;
+    messages.clear();
+  }
+
+  static std::vector<std::string> messages;
+
+  static void printer(const CLogMessage *message) {
+    messages.emplace_back(clog_getMessage(message));
+  };
+
+  std::string shortest(const char *format, double value) {
+    messages.clear();
+    clog_logMessage(&ctx, CLOG_LINF, IO, CLOG_FILE, CLOG_LINE, CLOG_FUNC, format, value);
+    return messages.empty() ? std::string() : messages[0];
+  }
+};
+
+std::vector<std::string> CLogFloatShortestTest::messages;
+
+TEST_F(CLogFloatShortestTest, shortestDigits) {
+  ASSERT_EQ(shortest("%g", 0.1), "0.1");
+  ASSERT_EQ(shortest("%g", 1.0 / 3.0), "0.3333333333333333");
+  ASSERT_EQ(shortest("%g", 100.0), "100");
+  ASSERT_EQ(shortest("%g", 1e16), "10000000000000000");
+  ASSERT_EQ(shortest("%g", 1e17), "1e+17");
+  ASSERT_EQ(shortest("%g", 1.5e-5), "1.5e-05");
+  ASSERT_EQ(shortest("%g", 0.0001), "0.0001");
+  ASSERT_EQ(shortest("%g", -0.0), "-0");
+  ASSERT_EQ(shortest("%g", 5e-324), "5e-324");
+  ASSERT_EQ(shortest("%g", DBL_MAX), "1.7976931348623157e+308");
+  ASSERT_EQ(shortest("%e", 123.0), "1.23e+02");
+  ASSERT_EQ(shortest("%f", 0.3), "0.3");
+  ASSERT_EQ(shortest("%f", 1e21), "1000000000000000000000");
+  ASSERT_EQ(shortest("%#f", 2.0), "2.");
+  ASSERT_EQ(shortest("%8g", 0.5), "     0.5");
+  ASSERT_EQ(shortest("%+g", 0.5), "+0.5");
+  ASSERT_EQ(shortest("%g", INFINITY), "inf");
+
+  // an explicit precision is still honored
+  ASSERT_EQ(shortest("%.3f", 0.1), "0.100");
+  ASSERT_EQ(shortest("%.6e", 0.1), "1.000000e-01");
+}
+
+TEST_F(CLogFloatShortestTest, nextToConversionsOfTheLibrary) {
+  // long doubles and wide characters are formatted by the C library, the other conversions are not affected
+  clog_logMessage(
+      &ctx, CLOG_LINF, IO, CLOG_FILE, CLOG_LINE, CLOG_FUNC, "%g %Lg %lc %g", 0.1, 0.25L, (wint_t)L'x', 1.0 / 3.0);
+  ASSERT_THAT(messages, ElementsAre("0.1 0.25 x 0.3333333333333333"));
+}
+
+TEST_F(CLogFloatShortestTest, roundTrip) {
+  std::mt19937_64 random(7U);
+  std::uniform_real_distribution<double> mantissa(1.0, 10.0);
+  std::uniform_int_distribution<int> exponent(-20, 35);
+
+  for (int i = 0; i < 10000; i++) {
+    double value;
+    if (0 == i % 2) {
+      // all magnitudes, mostly generated with big integers
+      uint64_t bits = random();
+      memcpy(&value, &bits, sizeof(value));
+      if (!std::isfinite(value)) {
+        continue;
+      }
+    } else {
+      // the usual magnitudes of log messages, mostly generated with 128 bit integers
+      value = mantissa(random) * std::pow(10.0, exponent(random));
+    }
+
+    const std::string text = shortest("%e", value);
+    ASSERT_EQ(strtod(text.c_str(), nullptr), value) << text;
+
+    // no shorter text reads back as the same double
+    const auto digits = std::count_if(text.begin(), text.begin() + text.find('e'), ::isdigit);
+    if (digits > 1) {
+      const std::string shorter = formatPrintf("%.*e", static_cast<int>(digits) - 2, value);
+      ASSERT_NE(strtod(shorter.c_str(), nullptr), value) << text << " " << shorter;
+    }
+  }
+}
+
+TEST_F(CLogFloatShortestTest, deferredFormatting) {
+  ctx.deferredFormatting = true;
+  ASSERT_EQ(shortest("%g", 0.1), "0.1");
+
+  ctx.shortestFloats = false;
+  ASSERT_EQ(shortest("%g", 0.1), "0.1");
+  ASSERT_EQ(shortest("%f", 0.1), "0.100000");
+  ASSERT_EQ(shortest("%.20f", 0.1), formatPrintf("%.20f", 0.1));
+}
@@ -11,6 +11,8 @@
  * @file
  */
 
+#include <array>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -0,0 +1,321 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clogBinary.h"
+#include "clogCompress.h"
+#include "clogFile.h"
+#include "clogIndex.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogIndexTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 128;
+  static const size_t BlockSize = 1024;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogIndexTest::writer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  std::string path;
+  std::string indexPath;
+  CLogIndex index;
+
+  void SetUp() override {
+    path = makeTempFile("clogIndex");
+    ASSERT_FALSE(path.empty());
+    indexPath = path + ".idx";
+    binaryWriter = nullptr;
+    ASSERT_TRUE(clog_fileOpen(&file, path.c_str(), nullptr));
+  }
+
+  void TearDown() override {
+    clog_fileClose(&file);
+    unlink(path.c_str());
+    unlink(indexPath.c_str());
+  }
+
+  std::vector<CLogIndexEntry> entries() {
+    std::vector<CLogIndexEntry> result;
+    FILE *indexFile = fopen(indexPath.c_str(), "rb");
+    EXPECT_NE(indexFile, nullptr);
+    EXPECT_TRUE(clog_indexRead(
+        indexFile,
+        [](const CLogIndexEntry *entry, void *userData) {
+          static_cast<std::vector<CLogIndexEntry> *>(userData)->push_back(*entry);
+        },
+        &result));
+    fclose(indexFile);
+    return result;
+  }
+
+  // reads the (decompressed) log
+  std::string read(long offset = 0, size_t length = SIZE_MAX) {
+    FILE *log = fopen(path.c_str(), "rb");
+    EXPECT_NE(log, nullptr);
+    FILE *stream = clog_decompressStream(log);
+    EXPECT_EQ(fseek(stream, offset, SEEK_SET), 0);
+    std::string content;
+    char chunk[1000];
+    size_t size;
+    while (content.size() < length &&
+           (size = fread(chunk, 1U, std::min(sizeof(chunk), length - content.size()), stream)) > 0U) {
+      content.append(chunk, size);
+    }
+    EXPECT_FALSE(ferror(stream));
+    fclose(stream);
+    fclose(log);
+    return content;
+  }
+
+  static size_t matchingBlocks(const std::vector<CLogIndexEntry> &entries, const CLogIndexQuery &query) {
+    size_t count = 0U;
+    for (const auto &entry : entries) {
+      count += clog_indexMayMatch(&entry, &query) ? 1U : 0U;
+    }
+    return count;
+  }
+
+  static CLogFile file;
+  static CLogBinaryWriter *binaryWriter;
+
+  static void writer(const CLogMessage *message) {
+    if (nullptr != binaryWriter) {
+      clog_binaryWrite(binaryWriter, message);
+    } else {
+      clog_fileWrite(&file, message);
+    }
+  }
+};
+
+CLogFile CLogIndexTest::file;
+CLogBinaryWriter *CLogIndexTest::binaryWriter;
+
+TEST_F(CLogIndexTest, skipsBlocks) {
+  static const int Messages = 500;
+  ASSERT_TRUE(clog_indexOpen(&index, indexPath.c_str(), BlockSize));
+  ASSERT_TRUE(clog_fileIndex(&file, &index));
+
+  for (int i = 0; i < Messages; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+  }
+  const unsigned int errorLine = __LINE__ + 1;
+  CLOG_ERR(&ctx, COMMUNICATION, "connection lost")
+  for (int i = 0; i < Messages; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+  }
+  clog_fileClose(&file);
+
+  // the blocks cover the whole file at line boundaries
+  auto indexed = entries();
+  auto content = read();
+  ASSERT_GT(indexed.size(), 10U);
+  uint64_t offset = 0U;
+  uint32_t messages = 0U;
+  for (size_t i = 0; i < indexed.size(); i++) {
+    const auto &entry = indexed[i];
+    ASSERT_EQ(entry.offset, offset);
+    // only the last block, closed with the file, may be shorter
+    if (i + 1U < indexed.size()) {
+      ASSERT_GE(entry.length, static_cast<uint64_t>(BlockSize));
+    }
+    ASSERT_EQ(content[entry.offset + entry.length - 1U], '\n');
+    ASSERT_LE(entry.first, entry.last);
+    offset += entry.length;
+    messages += entry.counts[CLOG_LINF] + entry.counts[CLOG_LERR];
+  }
+  ASSERT_EQ(offset, content.size());
+  ASSERT_EQ(messages, 2U * Messages + 1U);
+
+  // only the block of the error is read
+  const char *communication[] = {"COMMUNICATION"};
+  const char *io[] = {"IO"};
+  CLogIndexQuery byLevel = {0U, 0U, CLOG_LERR, nullptr, 0U, nullptr, 0U};
+  CLogIndexQuery byTag = {0U, 0U, CLOG_LTRC, communication, 1U, nullptr, 0U};
+  CLogIndexQuery bySite = {0U, 0U, CLOG_LTRC, nullptr, 0U, __FILE__, errorLine};
+  CLogIndexQuery all = {0U, 0U, CLOG_LTRC, io, 1U, nullptr, 0U};
+  CLogIndexQuery later = {indexed.back().last + 1U, 0U, CLOG_LTRC, nullptr, 0U, nullptr, 0U};
+  CLogIndexQuery earlier = {0U, indexed.front().first, CLOG_LTRC, nullptr, 0U, nullptr, 0U};
+  ASSERT_EQ(matchingBlocks(indexed, byLevel), 1U);
+  ASSERT_EQ(matchingBlocks(indexed, byTag), 1U);
+  ASSERT_EQ(matchingBlocks(indexed, bySite), 1U);
+  ASSERT_EQ(matchingBlocks(indexed, all), indexed.size());
+  ASSERT_EQ(matchingBlocks(indexed, later), 0U);
+  ASSERT_EQ(matchingBlocks(indexed, earlier), 0U);
+
+  for (const auto &entry : indexed) {
+    if (clog_indexMayMatch(&entry, &byLevel)) {
+      ASSERT_THAT(content.substr(entry.offset, entry.length), HasSubstr(" connection lost\n"));
+    }
+  }
+}
+
+TEST_F(CLogIndexTest, matchesMessages) {
+  const char *tags[] = {"IO", "COMMUNICATION"};
+  const CLogMessage message = {"file.c", 10, "main", "text", CLOG_LWRN, "IO"};
+  const CLogMessage info = {"file.c", 10, "main", "text", CLOG_LINF, "IO"};
+  const CLogMessage otherLine = {"file.c", 11, "main", "text", CLOG_LWRN, "IO"};
+  const CLogMessage otherTag = {"file.c", 10, "main", "text", CLOG_LWRN, "OTHER"};
+  const CLogMessage noTag = {"file.c", 10, "main", "text", CLOG_LWRN, nullptr};
+  CLogIndexQuery query = {100U, 200U, CLOG_LWRN, tags, 2U, "file.c", 10U};
+
+  ASSERT_TRUE(clog_indexMatches(&query, &message, 100U));
+  ASSERT_FALSE(clog_indexMatches(&query, &message, 99U));
+  ASSERT_FALSE(clog_indexMatches(&query, &message, 200U));
+  ASSERT_FALSE(clog_indexMatches(&query, &info, 150U));
+  ASSERT_FALSE(clog_indexMatches(&query, &otherLine, 150U));
+  ASSERT_FALSE(clog_indexMatches(&query, &otherTag, 150U));
+  ASSERT_FALSE(clog_indexMatches(&query, &noTag, 150U));
+  query.numberOfTags = 0U;
+  ASSERT_TRUE(clog_indexMatches(&query, &noTag, 150U));
+}
+
+TEST_F(CLogIndexTest, existingContentMatchesAll) {
+  CLOG_INF(&ctx, IO, "before the index")
+  ASSERT_TRUE(clog_indexOpen(&index, indexPath.c_str(), BlockSize));
+  ASSERT_TRUE(clog_fileIndex(&file, &index));
+  CLOG_INF(&ctx, IO, "indexed")
+  clog_fileClose(&file);
+
+  auto indexed = entries();
+  ASSERT_EQ(indexed.size(), 2U);
+  const char *tags[] = {"COMMUNICATION"};
+  CLogIndexQuery query = {1U, 2U, CLOG_LFTL, tags, 1U, "unknown.c", 1U};
+  ASSERT_TRUE(clog_indexMayMatch(&indexed[0], &query));
+  ASSERT_FALSE(clog_indexMayMatch(&indexed[1], &query));
+  ASSERT_THAT(read(0, indexed[0].length), EndsWith(" before the index\n"));
+  ASSERT_THAT(read(static_cast<long>(indexed[1].offset)), EndsWith(" indexed\n"));
+}
+
+TEST_F(CLogIndexTest, binaryBlocksDecodeOnTheirOwn) {
+  static const int Messages = 300;
+  CLogBinaryWriter binary;
+  FILE *log = fopen(path.c_str(), "wb");
+  ASSERT_NE(log, nullptr);
+  ASSERT_TRUE(clog_binaryOpen(&binary, log));
+  ASSERT_TRUE(clog_indexOpen(&index, indexPath.c_str(), BlockSize));
+  ASSERT_TRUE(clog_binaryIndex(&binary, &index));
+  ASSERT_FALSE(clog_binaryIndex(&binary, &index));
+
+  binaryWriter = &binary;
+  for (int i = 0; i < Messages; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+    CLOG_WRN(&ctx, COMMUNICATION, "retry %d", i)
+  }
+  binaryWriter = nullptr;
+  clog_binaryClose(&binary);
+  fclose(log);
+
+  auto content = read();
+  auto indexed = entries();
+  ASSERT_GT(indexed.size(), 5U);
+  ASSERT_EQ(indexed.back().offset + indexed.back().length, content.size());
+
+  // the whole log and every single block are readable
+  auto count = [](const CLogMessage *, uint64_t, void *userData) { (*static_cast<size_t *>(userData))++; };
+  size_t total = 0U;
+  FILE *whole = fmemopen(&content[0], content.size(), "rb");
+  ASSERT_TRUE(clog_binaryRead(whole, count, &total));
+  fclose(whole);
+  ASSERT_EQ(total, 2U * Messages);
+
+  total = 0U;
+  for (const auto &entry : indexed) {
+    size_t messages = 0U;
+    FILE *block = fmemopen(&content[entry.offset], entry.length, "rb");
+    ASSERT_TRUE(clog_binaryRead(block, count, &messages));
+    fclose(block);
+    ASSERT_EQ(messages, entry.counts[CLOG_LINF] + entry.counts[CLOG_LWRN]);
+    total += messages;
+  }
+  ASSERT_EQ(total, 2U * Messages);
+}
+
+TEST_F(CLogIndexTest, seeksInCompressedLog) {
+  std::vector<char> blocks(4096U * 2U);
+  std::vector<char> frame(CLOG_COMPRESS_FRAME_SIZE(4096U));
+  CLogCompressor compressor = {};
+  compressor.blocks = blocks.data();
+  compressor.blockSize = 4096U;
+  compressor.numberOfBlocks = 2U;
+  compressor.frame = frame.data();
+  ASSERT_TRUE(clog_fileCompress(&file, &compressor));
+  ASSERT_TRUE(clog_indexOpen(&index, indexPath.c_str(), BlockSize));
+  ASSERT_TRUE(clog_fileIndex(&file, &index));
+
+  for (int i = 0; i < 2000; i++) {
+    CLOG_INF(&ctx, IO, "message %d", i)
+  }
+  clog_fileClose(&file);
+  ASSERT_GT(compressor.frames, 1U);
+
+  // the offsets refer to the decompressed log
+  auto content = read();
+  auto indexed = entries();
+  ASSERT_EQ(indexed.back().offset + indexed.back().length, content.size());
+  for (size_t i = indexed.size(); i-- > 0U;) {
+    const auto &entry = indexed[i];
+    ASSERT_EQ(read(static_cast<long>(entry.offset), entry.length), content.substr(entry.offset, entry.length));
+  }
+}
+
+TEST_F(CLogIndexTest, invalid) {
+  const CLogFileRotation rotation = {1U, 0U, 1U, nullptr};
+  CLogIndex closed = {-1, 0U, 0U, 0U, {}};
+  FILE *garbage = tmpfile();
+  fputs("not an index", garbage);
+  rewind(garbage);
+
+  ASSERT_FALSE(clog_indexOpen(nullptr, indexPath.c_str(), BlockSize));
+  ASSERT_FALSE(clog_indexOpen(&index, nullptr, BlockSize));
+  ASSERT_FALSE(clog_indexOpen(&index, indexPath.c_str(), 0U));
+  ASSERT_FALSE(clog_indexOpen(&index, "/nonexistent/index", BlockSize));
+  ASSERT_FALSE(clog_indexRead(garbage, [](const CLogIndexEntry *, void *) {}, nullptr));
+  ASSERT_FALSE(clog_indexRead(nullptr, [](const CLogIndexEntry *, void *) {}, nullptr));
+  ASSERT_FALSE(clog_indexMayMatch(nullptr, nullptr));
+  ASSERT_FALSE(clog_indexMatches(nullptr, nullptr, 0U));
+  ASSERT_FALSE(clog_fileIndex(&file, &closed));
+  ASSERT_FALSE(clog_binaryIndex(nullptr, &index));
+  clog_indexAdd(nullptr, nullptr, 0U, 0U);
+  clog_indexAddUnknown(nullptr, 0U);
+  clog_indexClose(nullptr);
+  fclose(garbage);
+
+  // an indexed file cannot be rotated
+  ASSERT_TRUE(clog_indexOpen(&index, indexPath.c_str(), BlockSize));
+  ASSERT_TRUE(clog_fileIndex(&file, &index));
+  ASSERT_FALSE(clog_fileIndex(&file, &index));
+  ASSERT_FALSE(clog_fileStartRotation(&file, &rotation));
+}
@@ -0,0 +1,220 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <climits>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "clogClock.h"
+#include "clogLayout.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+static std::string format(const CLogLayout &layout, const CLogMessage &message, size_t size = 256) {
+  std::vector<char> buffer(size);
+  size_t length = clog_formatLayout(buffer.data(), buffer.size(), &layout, &message);
+  std::string text(buffer.data());
+  if (length < size) {
+    EXPECT_EQ(length, text.size());
+  }
+  return text;
+}
+
+TEST(CLogLayout, compile) {
+  CLogLayout layout;
+
+  ASSERT_TRUE(clog_compileLayout(&layout, "%L %T %F:%l(%f) %m"));
+  ASSERT_EQ(layout.numberOfOps, 11U);
+  ASSERT_TRUE(clog_compileLayout(&layout, ""));
+  ASSERT_EQ(layout.numberOfOps, 0U);
+  ASSERT_TRUE(clog_compileLayout(&layout, "100%%"));
+  ASSERT_EQ(layout.numberOfOps, 1U);
+
+  ASSERT_FALSE(clog_compileLayout(&layout, "%x"));
+  ASSERT_EQ(layout.numberOfOps, 0U);
+  ASSERT_FALSE(clog_compileLayout(&layout, "trailing %"));
+  ASSERT_FALSE(clog_compileLayout(&layout, std::string(CLOG_LAYOUT_TEXT + 1, 'x').c_str()));
+  std::string conversions;
+  for (size_t i = 0; i <= CLOG_LAYOUT_OPS; i++) {
+    conversions += "%m";
+  }
+  ASSERT_FALSE(clog_compileLayout(&layout, conversions.c_str()));
+  ASSERT_FALSE(clog_compileLayout(&layout, nullptr));
+  ASSERT_FALSE(clog_compileLayout(nullptr, "%m"));
+}
+
+TEST(CLogLayout, format) {
+  CLogLayout layout;
+  CLogMessage message = {"file.c", 42, "main", "text", CLOG_LWRN, "IO"};
+
+  ASSERT_TRUE(clog_compileLayout(&layout, "%L %T %F:%l(%f) %m 100%%"));
+  ASSERT_EQ(format(layout, message), "WRN IO file.c:42(main) text 100%");
+
+  ASSERT_TRUE(clog_compileLayout(&layout, "%C%L"));
+  ASSERT_EQ(format(layout, message), std::string(clog_getColor(CLOG_LWRN)) + "WRN");
+
+  CLogMessage maxLine = {"file.c", INT_MAX, "main", "text", CLOG_LWRN, nullptr};
+  CLogMessage zeroLine = {"file.c", 0, "main", "text", CLOG_LWRN, nullptr};
+  ASSERT_TRUE(clog_compileLayout(&layout, "%l %T"));
+  ASSERT_EQ(format(layout, maxLine), std::to_string(INT_MAX) + " (null)");
+  ASSERT_EQ(format(layout, zeroLine), "0 (null)");
+}
+
+TEST(CLogLayout, truncation) {
+  CLogLayout layout;
+  CLogMessage message = {"file.c", 1234, "main", "text", CLOG_LINF, "IO"};
+  char buffer[8];
+
+  ASSERT_TRUE(clog_compileLayout(&layout, "%F:%l %m"));
+  ASSERT_EQ(clog_formatLayout(buffer, sizeof(buffer), &layout, &message), 16U);
+  ASSERT_STREQ(buffer, "file.c:");
+  ASSERT_EQ(clog_formatLayout(buffer, 1U, &layout, &message), 16U);
+  ASSERT_STREQ(buffer, "");
+  ASSERT_EQ(clog_formatLayout(buffer, 0U, &layout, &message), 0U);
+  ASSERT_EQ(clog_formatLayout(buffer, sizeof(buffer), nullptr, &message), 0U);
+  ASSERT_STREQ(buffer, "");
+}
+
+TEST(CLogLayout, defaultHeaderMatchesPrintf) {
+  CLogMessage message = {"some/file.c", 1234, "function", "text", CLOG_LERR, "IO"};
+  char expected[128];
+  char header[128];
+  int length = sizeof(header);
+
+  int expectedLength = snprintf(expected,
+                                sizeof(expected),
+                                "%s%s:%s\x1b[0m \x1b[90m%s:%d(%s)\x1b[0m",
+                                clog_getColor(message.level),
+                                clog_getLevel(message.level),
+                                message.tag,
+                                message.file,
+                                message.line,
+                                message.function);
+
+  clog_formatLineHeader(header, &length, &message);
+  ASSERT_STREQ(header, expected);
+  ASSERT_EQ(length, expectedLength);
+}
+
+TEST(CLogLayout, wallClockTime) {
+  CLogLayout layout;
+  CLogMessage message = {"file.c", 42, "main", "text", CLOG_LINF, "IO"};
+  const char *timeZone = getenv("TZ");
+  const std::string previousTimeZone = (nullptr != timeZone) ? timeZone : "";
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  // without a context the timestamps are taken as time since the epoch
+  message.timestamp = 1568635200123456789ULL;
+  ASSERT_TRUE(clog_compileLayout(&layout, "%d|%D %m"));
+  ASSERT_EQ(format(layout, message), "2019-09-16 12:00:00.123|2019-09-16 12:00:00.123456 text");
+  message.timestamp = 1568635200999999999ULL;
+  ASSERT_EQ(format(layout, message), "2019-09-16 12:00:00.999|2019-09-16 12:00:00.999999 text");
+
+  // the cached prefix is rendered again when the second changes
+  message.timestamp = 1568635201000000000ULL;
+  ASSERT_EQ(format(layout, message), "2019-09-16 12:00:01.000|2019-09-16 12:00:01.000000 text");
+  message.timestamp = 1568635199000000007ULL;
+  ASSERT_EQ(format(layout, message), "2019-09-16 11:59:59.000|2019-09-16 11:59:59.000000 text");
+  message.timestamp = 1568678400000000000ULL;
+  ASSERT_EQ(format(layout, message), "2019-09-17 00:00:00.000|2019-09-17 00:00:00.000000 text");
+
+  // monotonic timestamps are converted into the wall-clock time
+  CLogContext ctx = {};
+  message.context = &ctx;
+  message.timestamp = clog_clockMonotonic();
+  const uint64_t now = clog_clockRealtime();
+  ASSERT_TRUE(clog_compileLayout(&layout, "%d"));
+  const std::string text = format(layout, message);
+  CLogMessage wallClock = message;
+  wallClock.context = nullptr;
+  wallClock.timestamp = now;
+  ASSERT_EQ(text.substr(0, 19), format(layout, wallClock).substr(0, 19));
+  // the timestamps of other clocks are taken as time since the epoch
+  ctx.clock = clog_clockRealtime;
+  CLogMessage realtime = wallClock;
+  realtime.context = &ctx;
+  ASSERT_EQ(format(layout, realtime), format(layout, wallClock));
+
+  if (nullptr != timeZone) {
+    setenv("TZ", previousTimeZone.c_str(), 1);
+  } else {
+    unsetenv("TZ");
+  }
+  tzset();
+}
+
+class CLogLayoutTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 128;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogLayoutTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+  CLogLayout layout;
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  void SetUp() override {
+    lines.clear();
+  }
+
+  static std::vector<std::string> lines;
+
+  static void printer(const CLogMessage *message) {
+    char line[64];
+    int lineLength = sizeof(line);
+    clog_formatMessage(line, &lineLength, message);
+    lines.emplace_back(line);
+  };
+};
+
+std::vector<std::string> CLogLayoutTest::lines;
+
+TEST_F(CLogLayoutTest, contextLayout) {
+  ASSERT_TRUE(clog_compileLayout(&layout, "[%L] %T: %m"));
+  ctx.layout = &layout;
+
+  CLOG_WRN(&ctx, IO, "x=%d", 5)
+  CLOG_INF(&ctx, COMMUNICATION, "%s", std::string(100, 'y').c_str())
+
+  // the layout can be changed at runtime
+  ASSERT_TRUE(clog_compileLayout(&layout, "%m"));
+  CLOG_INF(&ctx, IO, "plain")
+
+  ctx.layout = nullptr;
+  CLOG_INF(&ctx, IO, "default")
+
+  ASSERT_EQ(lines.size(), 4U);
+  ASSERT_EQ(lines[0], "[WRN] IO: x=5\n");
+  // truncated lines still end with an end of line
+  ASSERT_EQ(lines[1], "[INF] COMMUNICATION: " + std::string(41, 'y') + "\n");
+  ASSERT_EQ(lines[2], "plain\n");
+  ASSERT_THAT(lines[3], StartsWith(std::string(clog_getColor(CLOG_LINF)) + "INF:IO"));
+}
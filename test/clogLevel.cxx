@@ -10,6 +10,7 @@
  *
  * @file
  */
+#include <array>
 #include <memory>
 
 #include <gmock/gmock.h>
@@ -58,3 +59,41 @@ TEST(testMinLevel, testNoContext) {
   ASSERT_EQ(CLOG_LTRC, clog_getMinLevel(nullptr));
 
 }
+
+TEST(testMinLevel, testTagMinLevels) {
+  const size_t BufferSize = 1000;
+  std::array<char, BufferSize> buffer{};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+  CLOG_ENUM_WITH_NAMES(DefaultTags, DEFAULT_TAGS);
+#pragma GCC diagnostic pop
+
+  CLogLevel tagLevels[ARRAY_LENGTH(DefaultTagsNames)] = {};
+  CLogContext ctx = {nullptr, 0U, DefaultTagsNames, ARRAY_LENGTH(DefaultTagsNames), CLOG_LOFF, buffer.data(), 1000};
+
+  // without per-tag levels the level of the context is used
+  ASSERT_FALSE(clog_setTagMinLevel(&ctx, IO, CLOG_LWRN));
+  ASSERT_EQ(CLOG_LOFF, clog_getTagMinLevel(&ctx, IO));
+
+  ctx.tagMinLevels = tagLevels;
+  clog_setMinLevel(&ctx, CLOG_LINF);
+  ASSERT_EQ(CLOG_LINF, clog_getTagMinLevel(&ctx, COMMUNICATION));
+  ASSERT_EQ(CLOG_LINF, clog_getTagMinLevel(&ctx, IO));
+
+  ASSERT_TRUE(clog_setTagMinLevel(&ctx, IO, CLOG_LERR));
+  ASSERT_EQ(CLOG_LINF, clog_getTagMinLevel(&ctx, COMMUNICATION));
+  ASSERT_EQ(CLOG_LERR, clog_getTagMinLevel(&ctx, IO));
+  ASSERT_TRUE(clog_isLevelEnabled(&ctx, COMMUNICATION, CLOG_LINF));
+  ASSERT_FALSE(clog_isLevelEnabled(&ctx, IO, CLOG_LWRN));
+  ASSERT_TRUE(clog_isLevelEnabled(&ctx, IO, CLOG_LERR));
+
+  // unknown tags fall back to the level of the context
+  ASSERT_FALSE(clog_setTagMinLevel(&ctx, 5U, CLOG_LERR));
+  ASSERT_EQ(CLOG_LINF, clog_getTagMinLevel(&ctx, 5U));
+  ASSERT_TRUE(clog_isLevelEnabled(&ctx, 5U, CLOG_LINF));
+
+  ASSERT_EQ(CLOG_LTRC, clog_getTagMinLevel(nullptr, IO));
+  ASSERT_TRUE(clog_isLevelEnabled(nullptr, IO, CLOG_LTRC));
+  ASSERT_FALSE(clog_setTagMinLevel(nullptr, IO, CLOG_LERR));
+}
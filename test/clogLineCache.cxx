@@ -0,0 +1,129 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogLineCacheTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 256;
+  static const size_t LineBufferSize = 192;
+  char buffer[BufferSize];
+  char lineBuffer[LineBufferSize];
+  CLogAdapter adapters[3] = {{nullptr, CLogLineCacheTest::printer, CLOG_LTRC, 0U, nullptr},
+                             {nullptr, CLogLineCacheTest::printer, CLOG_LTRC, 0U, nullptr},
+                             {nullptr, CLogLineCacheTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  void SetUp() override {
+    lines.clear();
+    cached.clear();
+    ctx.lineBuffer = lineBuffer;
+    ctx.lineBufferSize = sizeof(lineBuffer);
+  }
+
+  static std::vector<std::string> lines;
+  static std::vector<const char *> cached;
+
+  static void printer(const CLogMessage *message) {
+    char line[512];
+    int lineLength = sizeof(line);
+    clog_formatMessage(line, &lineLength, message);
+    lines.emplace_back(line, lineLength);
+    cached.push_back(message->formattedLine);
+  };
+};
+
+std::vector<std::string> CLogLineCacheTest::lines;
+std::vector<const char *> CLogLineCacheTest::cached;
+
+static std::string formatDirectly(const CLogMessage *message, int size) {
+  CLogMessage copy = *message;
+  copy.context = nullptr;
+  copy.formattedLine = nullptr;
+  std::vector<char> line(size);
+  clog_formatMessage(line.data(), &size, &copy);
+  return line.data();
+}
+
+TEST_F(CLogLineCacheTest, lineIsFormattedOnce) {
+  CLOG_WRN(&ctx, IO, "x=%d", 5)
+
+  ASSERT_EQ(lines.size(), 3U);
+  ASSERT_THAT(lines, Each(Eq(lines[0])));
+  ASSERT_THAT(lines[0], EndsWith(" x=5\n"));
+  ASSERT_THAT(cached, Each(Eq(lineBuffer)));
+}
+
+TEST_F(CLogLineCacheTest, laterAdaptersReuseTheLine) {
+  adapters[0].onMessage = [](const CLogMessage *message) {
+    int length = 0;
+    ASSERT_EQ(clog_getLine(message, &length), message->context->lineBuffer);
+    ASSERT_EQ(length, static_cast<int>(strlen(message->formattedLine)));
+    // mark the cached line, the others must see the mark
+    message->context->lineBuffer[0] = '#';
+  };
+
+  CLOG_INF(&ctx, IO, "abc")
+
+  ASSERT_EQ(lines.size(), 2U);
+  ASSERT_EQ(lines[0][0], '#');
+  ASSERT_EQ(lines[1][0], '#');
+}
+
+TEST_F(CLogLineCacheTest, sameResultAsWithoutCache) {
+  adapters[0].onMessage = [](const CLogMessage *message) {
+    for (int size = 2; size < 300; size++) {
+      std::vector<char> line(size);
+      int length = size;
+      clog_formatMessage(line.data(), &length, message);
+      ASSERT_EQ(std::string(line.data()), formatDirectly(message, size)) << size;
+    }
+    ASSERT_EQ(std::string(clog_getLine(message, nullptr)), formatDirectly(message, LineBufferSize));
+  };
+
+  CLOG_INF(&ctx, IO, "%s %d", std::string(150, 'x').c_str(), 42)
+  CLOG_INF(&ctx, IO, "short")
+}
+
+TEST_F(CLogLineCacheTest, noLineBuffer) {
+  ctx.lineBuffer = nullptr;
+
+  CLOG_INF(&ctx, IO, "abc")
+
+  ASSERT_EQ(lines.size(), 3U);
+  ASSERT_THAT(lines, Each(Eq(lines[0])));
+  ASSERT_THAT(cached, Each(IsNull()));
+  ASSERT_EQ(clog_getLine(nullptr, nullptr), nullptr);
+}
@@ -12,11 +12,14 @@
  */
 #include <cstddef>
 #include <cstring>
+#include <ctime>
+#include <string>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 #include "clog.h"
+#include "clogClock.h"
 #include "testUtils.h"
 
 using namespace ::testing;
@@ -54,6 +57,36 @@ TEST(testLineHeader, testFormatHeader) {
   ASSERT_STREQ(buffer, "\033[33mWRN:IO\x1b[0m \x1b[90mmyFile.c:123(foo())\x1b[0m");
 }
 
+TEST(testLineHeader, testFormatHeaderWithTime) {
+  char buffer[128];
+  int bufferLength = sizeof(buffer);
+  CLogContext ctx = {};
+  ctx.headerTime = true;
+  // the timestamps of the realtime clock are the time since the epoch
+  ctx.clock = clog_clockRealtime;
+  CLogMessage msg = {"myFile.c", 123, "foo()", "the message", CLOG_LWRN, "IO"};
+  msg.context = &ctx;
+  msg.timestamp = 1568637296789000000ULL;
+
+  const time_t seconds = 1568637296;
+  struct tm local;
+  char expected[64];
+  localtime_r(&seconds, &local);
+  strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S.789 ", &local);
+
+  clog_formatLineHeader(buffer, &bufferLength, &msg);
+
+  ASSERT_EQ(bufferLength, 44 + 24);
+  ASSERT_EQ(std::string(buffer),
+            std::string(expected) + "\033[33mWRN:IO\x1b[0m \x1b[90mmyFile.c:123(foo())\x1b[0m");
+
+  // without the flag the header has no time
+  ctx.headerTime = false;
+  bufferLength = sizeof(buffer);
+  clog_formatLineHeader(buffer, &bufferLength, &msg);
+  ASSERT_EQ(bufferLength, 44);
+}
+
 TEST(testLineHeader, testFormatHeaderNoBuffer) {
   const size_t BufferLength = 128;
   const size_t GuardLength = 3;
@@ -231,3 +231,55 @@ TEST_F(CLogMacroTest, printTestOverflow) {
   CLOG_TRC(&ctx, IO, "123456789ABC")
   ASSERT_TRUE(isGuardOk());
 }
+
+TEST_F(CLogMacroTest, callSiteDescribesStatement) {
+  ctx.minLevel = CLOG_LTRC;
+  const unsigned int line = __LINE__ + 12;
+
+  EXPECT_CALL(*mock, filter(_)).Times(1).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock,
+              printer(Field(&CLogMessage::site,
+                            Pointee(AllOf(Field(&CLogCallSite::file, StrEq(__FILE__)),
+                                          Field(&CLogCallSite::line, Eq(line)),
+                                          Field(&CLogCallSite::function, StrEq(__func__)),
+                                          Field(&CLogCallSite::level, Eq(CLOG_LWRN)),
+                                          Field(&CLogCallSite::tag, Eq(IO)),
+                                          Field(&CLogCallSite::format, StrEq("x=%d")))))))
+      .Times(1);
+  CLOG_WRN(&ctx, IO, "x=%d", 1)
+  ASSERT_TRUE(isGuardOk());
+}
+
+TEST_F(CLogMacroTest, callSiteIsStable) {
+  ctx.minLevel = CLOG_LTRC;
+  std::vector<const CLogCallSite *> sites;
+
+  EXPECT_CALL(*mock, filter(_)).Times(3).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock, printer(_)).Times(3).WillRepeatedly(Invoke([&sites](const CLogMessage *message) {
+    sites.push_back(message->site);
+  }));
+
+  for (int i = 0; i < 2; i++) {
+    CLOG_INF(&ctx, IO, "%d", i)
+  }
+  CLOG_INF(&ctx, IO, "%d", 2)
+
+  ASSERT_EQ(sites.size(), 3U);
+  ASSERT_NE(sites[0], nullptr);
+  ASSERT_EQ(sites[0], sites[1]);
+  ASSERT_NE(sites[0], sites[2]);
+}
+
+TEST_F(CLogMacroTest, tagMinLevels) {
+  CLogLevel tagLevels[ARRAY_LENGTH(TagsNames)] = {};
+  ctx.tagMinLevels = tagLevels;
+  clog_setMinLevel(&ctx, CLOG_LTRC);
+  clog_setTagMinLevel(&ctx, IO, CLOG_LERR);
+
+  // the disabled tag doesn't even reach the filter
+  EXPECT_CALL(*mock, filter(_)).Times(1).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock, printer(Field(&CLogMessage::tag, StrEq("COMMUNICATION")))).Times(1);
+  CLOG_WRN(&ctx, IO, "IO")
+  CLOG_WRN(&ctx, COMMUNICATION, "Comm")
+  ASSERT_TRUE(isGuardOk());
+}
@@ -94,7 +94,8 @@ TEST_F(CLogMessageTest, logMsgParamsAllSet) {
                             Field(&CLogMessage::level, Eq(CLOG_LWRN)),
                             Field(&CLogMessage::line, Eq(line)),
                             Field(&CLogMessage::message, StrEq(message)),
-                            Field(&CLogMessage::tag, StrEq(ctx.tagNames[0])))))
+                            Field(&CLogMessage::tag, StrEq(ctx.tagNames[0])),
+                            Field(&CLogMessage::site, IsNull()))))
       .Times(1);
 
   clog_logMessage(pCtx, level, tag, file, line, function, message);
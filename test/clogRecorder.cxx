@@ -0,0 +1,221 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <csignal>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "clogRecorder.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogRecorderTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 64;
+  static const size_t SlotSize = 128;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogRecorderTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  std::string path;
+
+  void SetUp() override {
+    path = makeTempFile("clogRecorder");
+    ASSERT_FALSE(path.empty());
+    lines.clear();
+    sequences.clear();
+  }
+
+  void TearDown() override {
+    clog_recorderClose(&recorder);
+    unlink(path.c_str());
+  }
+
+  static CLogRecorder recorder;
+  static std::vector<std::string> lines;
+  static std::vector<uint64_t> sequences;
+
+  static void printer(const CLogMessage *message) {
+    clog_recorderWrite(&recorder, message);
+  };
+
+  static void collect(const char *line, size_t length, uint64_t sequence, void *) {
+    EXPECT_EQ(strlen(line), length);
+    lines.emplace_back(line, length);
+    sequences.push_back(sequence);
+  }
+
+  bool read() {
+    lines.clear();
+    sequences.clear();
+    return clog_recorderRead(path.c_str(), collect, nullptr);
+  }
+};
+
+CLogRecorder CLogRecorderTest::recorder;
+std::vector<std::string> CLogRecorderTest::lines;
+std::vector<uint64_t> CLogRecorderTest::sequences;
+
+TEST_F(CLogRecorderTest, lastLinesInOrder) {
+  ASSERT_TRUE(clog_recorderOpen(&recorder, path.c_str(), 8U, SlotSize));
+
+  for (int i = 0; i < 20; i++) {
+    CLOG_INF(&ctx, IO, "line %d", i)
+  }
+
+  ASSERT_TRUE(read());
+  ASSERT_EQ(lines.size(), 8U);
+  for (size_t i = 0; i < lines.size(); i++) {
+    ASSERT_THAT(lines[i], EndsWith(" line " + std::to_string(12 + i) + "\n"));
+    ASSERT_EQ(sequences[i], 12U + i);
+  }
+}
+
+TEST_F(CLogRecorderTest, longLinesAreTruncated) {
+  ASSERT_TRUE(clog_recorderOpen(&recorder, path.c_str(), 8U, SlotSize));
+
+  CLOG_INF(&ctx, IO, "%s", std::string(200, 'x').c_str())
+
+  ASSERT_TRUE(read());
+  ASSERT_EQ(lines.size(), 1U);
+  ASSERT_EQ(lines[0].size(), SlotSize - 24U - 1U);
+  ASSERT_THAT(lines[0], EndsWith("\n"));
+}
+
+TEST_F(CLogRecorderTest, survivesKilledProcess) {
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+
+  if (0 == child) {
+    if (clog_recorderOpen(&recorder, path.c_str(), 16U, SlotSize)) {
+      for (int i = 0; i < 5; i++) {
+        CLOG_ERR(&ctx, COMMUNICATION, "before crash %d", i)
+      }
+    }
+    raise(SIGKILL);
+    _exit(0);
+  }
+
+  int status = 0;
+  ASSERT_EQ(waitpid(child, &status, 0), child);
+  ASSERT_TRUE(WIFSIGNALED(status));
+
+  ASSERT_TRUE(read());
+  ASSERT_EQ(lines.size(), 5U);
+  ASSERT_THAT(lines[4], EndsWith(" before crash 4\n"));
+}
+
+TEST_F(CLogRecorderTest, tornSlotsAreSkipped) {
+  ASSERT_TRUE(clog_recorderOpen(&recorder, path.c_str(), 8U, SlotSize));
+
+  for (int i = 0; i < 4; i++) {
+    CLOG_INF(&ctx, IO, "line %d", i)
+  }
+  clog_recorderClose(&recorder);
+
+  // damage the line in the second slot
+  int fd = open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(pwrite(fd, "#", 1U, 64 + SlotSize + 24 + 2), 1);
+  close(fd);
+
+  ASSERT_TRUE(read());
+  ASSERT_THAT(sequences, ElementsAre(0U, 2U, 3U));
+}
+
+TEST_F(CLogRecorderTest, reopen) {
+  ASSERT_TRUE(clog_recorderOpen(&recorder, path.c_str(), 8U, SlotSize));
+  CLOG_INF(&ctx, IO, "first")
+  clog_recorderClose(&recorder);
+
+  // the same settings continue the file
+  ASSERT_TRUE(clog_recorderOpen(&recorder, path.c_str(), 8U, SlotSize));
+  CLOG_INF(&ctx, IO, "second")
+  clog_recorderClose(&recorder);
+
+  ASSERT_TRUE(read());
+  ASSERT_THAT(sequences, ElementsAre(0U, 1U));
+
+  // other settings start from scratch
+  ASSERT_TRUE(clog_recorderOpen(&recorder, path.c_str(), 4U, 2U * SlotSize));
+  CLOG_INF(&ctx, IO, "third")
+
+  ASSERT_TRUE(read());
+  ASSERT_EQ(lines.size(), 1U);
+  ASSERT_THAT(lines[0], EndsWith(" third\n"));
+}
+
+TEST_F(CLogRecorderTest, concurrentWriters) {
+  const size_t Threads = 4;
+  const size_t Messages = 1000;
+  ASSERT_TRUE(clog_recorderOpen(&recorder, path.c_str(), Threads * Messages, SlotSize));
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < Threads; t++) {
+    threads.emplace_back([this, t]() {
+      for (size_t i = 0; i < Messages; i++) {
+        CLOG_INF(&ctx, IO, "thread %zu line %zu", t, i)
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_TRUE(read());
+  ASSERT_EQ(lines.size(), Threads * Messages);
+  for (size_t i = 0; i < sequences.size(); i++) {
+    ASSERT_EQ(sequences[i], i);
+  }
+}
+
+TEST_F(CLogRecorderTest, invalid) {
+  ASSERT_FALSE(clog_recorderOpen(nullptr, path.c_str(), 8U, SlotSize));
+  ASSERT_FALSE(clog_recorderOpen(&recorder, nullptr, 8U, SlotSize));
+  ASSERT_FALSE(clog_recorderOpen(&recorder, path.c_str(), 0U, SlotSize));
+  ASSERT_FALSE(clog_recorderOpen(&recorder, path.c_str(), 8U, 32U));
+  ASSERT_FALSE(clog_recorderOpen(&recorder, path.c_str(), 8U, SlotSize + 1U));
+  ASSERT_FALSE(clog_recorderOpen(&recorder, "/nonexistent/dir/file", 8U, SlotSize));
+
+  // not a flight recorder file
+  ASSERT_FALSE(read());
+  ASSERT_FALSE(clog_recorderRead(nullptr, collect, nullptr));
+  ASSERT_FALSE(clog_recorderRead(path.c_str(), nullptr, nullptr));
+
+  clog_recorderWrite(&recorder, nullptr);
+  clog_recorderWrite(nullptr, nullptr);
+}
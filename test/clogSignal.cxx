@@ -0,0 +1,211 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "clogSignal.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+static std::string formatSafe(size_t size, const char *format, ...) {
+  std::vector<char> buffer(size);
+  va_list list;
+  va_start(list, format);
+  size_t length = clog_formatSignalSafe(buffer.data(), buffer.size(), format, list);
+  va_end(list);
+  EXPECT_EQ(length, strlen(buffer.data()));
+  return buffer.data();
+}
+
+#define ASSERT_LIKE_PRINTF(FORMAT, ...) ASSERT_EQ(formatSafe(256, FORMAT, __VA_ARGS__), formatPrintf(FORMAT, __VA_ARGS__))
+
+TEST(CLogSignalFormat, likePrintf) {
+  int local = 0;
+
+  ASSERT_LIKE_PRINTF("%d %i %d %d", 0, 42, -17, INT_MIN);
+  ASSERT_LIKE_PRINTF("%u %x %X", UINT_MAX, 0xDEADBEEFU, 0xABCU);
+  ASSERT_LIKE_PRINTF("%ld %lu %lld %llu %zu %zd", LONG_MIN, ULONG_MAX, LLONG_MIN, ULLONG_MAX, SIZE_MAX, (ssize_t)-5);
+  ASSERT_LIKE_PRINTF("%5d|%05d|%08x|%3c", 42, -42, 0x1FU, 'a');
+  ASSERT_LIKE_PRINTF("%s|%8s|%s", "text", "right", (const char *)nullptr);
+  ASSERT_LIKE_PRINTF("%p %p", (void *)&local, (void *)nullptr);
+  ASSERT_LIKE_PRINTF("100%% %c", 'x');
+}
+
+TEST(CLogSignalFormat, flagsPrecisionAndLength) {
+  int local = 0;
+
+  ASSERT_LIKE_PRINTF("[%-5d|%+d|% d|%+d|%-+6d]", 42, 42, 42, -42, 7);
+  ASSERT_LIKE_PRINTF("[%#x|%#X|%#o|%#x|%#08x|%#08o|%o]", 0xABU, 0xABU, 8U, 0U, 0x1FU, 0123U, 8U);
+  ASSERT_LIKE_PRINTF("[%.3d|%8.3d|%08.3d|%.0d|%.0x|%#.0o]", 7, -7, 7, 0, 0U, 0U);
+  ASSERT_LIKE_PRINTF("[%*d|%-*d|%.*d|%*s|%.*s]", 5, 1, 5, 2, 3, 3, -6, "ab", 2, "abcdef");
+  ASSERT_LIKE_PRINTF("[%-4c|%-8s|%.2s|%5.1s]", 'a', "left", "abc", "xyz");
+  ASSERT_LIKE_PRINTF("%hhd %hhu %hd %hu %jd %ju %td %zx", 300, 300U, 70000, 70000U, (intmax_t)-9, (uintmax_t)9,
+                     (ptrdiff_t)-3, (size_t)0xFF);
+  ASSERT_LIKE_PRINTF("[%20p|%-20p|%10p]", (void *)&local, (void *)&local, (void *)nullptr);
+}
+
+TEST(CLogSignalFormat, unsupportedSpecStopsFormatting) {
+  // the argument of %f can't be skipped, so %s must not take it
+  ASSERT_EQ(formatSafe(64, "%d %f %s", 1, 2.5, "text"), "1 %f %s");
+  ASSERT_EQ(formatSafe(64, "%Lf %s", 2.5L, "text"), "%Lf %s");
+}
+
+TEST(CLogSignalFormat, unsupportedAndTruncated) {
+  ASSERT_EQ(formatSafe(64, "%f %d", 3.0, 3), "%f %d");
+  ASSERT_EQ(formatSafe(64, "end %"), "end %");
+  ASSERT_EQ(formatSafe(8, "%s", "0123456789"), "0123456");
+  ASSERT_EQ(formatSafe(1, "%d", 5), "");
+  ASSERT_EQ(formatSafe(8, nullptr), "");
+}
+
+class CLogSignalTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 128;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogSignalTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+  CLogSignalSlot slots[4];
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  void SetUp() override {
+    lines.clear();
+  }
+
+  static CLogSignal sig;
+  static std::vector<std::string> lines;
+
+  static void printer(const CLogMessage *message) {
+    char line[256];
+    int lineLength = sizeof(line);
+    clog_formatMessage(line, &lineLength, message);
+    lines.emplace_back(line);
+  };
+
+  static void handler(int signal) {
+    CLOG_SIGNAL_SAFE(&sig, CLOG_LERR, IO, "signal %d at %p", signal, (void *)&sig);
+  }
+};
+
+CLogSignal CLogSignalTest::sig;
+std::vector<std::string> CLogSignalTest::lines;
+
+TEST_F(CLogSignalTest, fromSignalHandler) {
+  ASSERT_TRUE(clog_initSignalSafe(&sig, &ctx, slots, ARRAY_LENGTH(slots), -1));
+
+  struct sigaction action = {};
+  struct sigaction previous = {};
+  action.sa_handler = handler;
+  ASSERT_EQ(sigaction(SIGUSR1, &action, &previous), 0);
+
+  errno = EAGAIN;
+  raise(SIGUSR1);
+  ASSERT_EQ(errno, EAGAIN);
+  sigaction(SIGUSR1, &previous, nullptr);
+
+  // the adapters are only called by the drain
+  ASSERT_TRUE(lines.empty());
+  ASSERT_EQ(clog_drainSignalSafe(&sig), 1U);
+  ASSERT_EQ(lines.size(), 1U);
+  ASSERT_THAT(lines[0], EndsWith(formatPrintf(" signal %d at %p\n", SIGUSR1, (void *)&sig)));
+  ASSERT_EQ(clog_drainSignalSafe(&sig), 0U);
+}
+
+TEST_F(CLogSignalTest, fullRingDrops) {
+  ASSERT_TRUE(clog_initSignalSafe(&sig, &ctx, slots, ARRAY_LENGTH(slots), -1));
+
+  for (int i = 0; i < 6; i++) {
+    CLOG_SIGNAL_SAFE(&sig, CLOG_LINF, IO, "message %d", i);
+  }
+  ASSERT_EQ(sig.dropped, 2U);
+  ASSERT_EQ(clog_drainSignalSafe(&sig), 4U);
+
+  // the slots can be reused after draining
+  CLOG_SIGNAL_SAFE(&sig, CLOG_LINF, IO, "message %d", 6);
+  ASSERT_EQ(clog_drainSignalSafe(&sig), 1U);
+
+  ASSERT_EQ(lines.size(), 5U);
+  ASSERT_THAT(lines[3], EndsWith(" message 3\n"));
+  ASSERT_THAT(lines[4], EndsWith(" message 6\n"));
+}
+
+TEST_F(CLogSignalTest, minLevel) {
+  ASSERT_TRUE(clog_initSignalSafe(&sig, &ctx, slots, ARRAY_LENGTH(slots), -1));
+  clog_setMinLevel(&ctx, CLOG_LWRN);
+
+  CLOG_SIGNAL_SAFE(&sig, CLOG_LINF, IO, "dropped");
+  CLOG_SIGNAL_SAFE(&sig, CLOG_LWRN, IO, "passed");
+
+  ASSERT_EQ(clog_drainSignalSafe(&sig), 1U);
+}
+
+TEST_F(CLogSignalTest, writeToFileDescriptor) {
+  int pipeFds[2];
+  ASSERT_EQ(pipe(pipeFds), 0);
+
+  // without ring, only write(2) is used
+  ASSERT_TRUE(clog_initSignalSafe(&sig, &ctx, nullptr, 0U, pipeFds[1]));
+  clog_logSignalSafe(&sig, CLOG_LWRN, COMMUNICATION, "file.c", 12U, "function", "x=%d", 5);
+  clog_logSignalSafe(&sig, CLOG_LERR, IO, "file.c", 13U, "function", "%s", std::string(300, 'y').c_str());
+
+  char text[1024] = {};
+  close(pipeFds[1]);
+  ssize_t length = 0;
+  ssize_t result;
+  while ((result = read(pipeFds[0], &text[length], sizeof(text) - 1 - length)) > 0) {
+    length += result;
+  }
+  close(pipeFds[0]);
+
+  std::string expected = "WRN:COMMUNICATION file.c:12(function) x=5\n";
+  expected += "ERR:IO file.c:13(function) " + std::string(CLOG_SIGNAL_TEXT - 1U, 'y') + "\n";
+  ASSERT_EQ(std::string(text), expected);
+  ASSERT_EQ(clog_drainSignalSafe(&sig), 0U);
+  ASSERT_TRUE(lines.empty());
+}
+
+TEST_F(CLogSignalTest, invalid) {
+  ASSERT_FALSE(clog_initSignalSafe(nullptr, &ctx, slots, ARRAY_LENGTH(slots), -1));
+  ASSERT_FALSE(clog_initSignalSafe(&sig, nullptr, slots, ARRAY_LENGTH(slots), -1));
+  ASSERT_FALSE(clog_initSignalSafe(&sig, &ctx, slots, 3U, -1));
+  ASSERT_FALSE(clog_initSignalSafe(&sig, &ctx, slots, 0U, -1));
+  ASSERT_FALSE(clog_initSignalSafe(&sig, &ctx, nullptr, 0U, -1));
+  ASSERT_FALSE(clog_initSignalSafe(&sig, &ctx, nullptr, 4U, 1));
+
+  clog_logSignalSafe(nullptr, CLOG_LERR, IO, "file.c", 1U, "function", "text");
+  ASSERT_EQ(clog_drainSignalSafe(nullptr), 0U);
+}
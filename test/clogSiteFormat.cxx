@@ -0,0 +1,174 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+static void logValues(CLogContext *ctx, int value, const char *text) {
+  CLOG_INF(ctx, IO, "value %5d text '%s' %.1f%% %p", value, text, value / 4.0, (void *)nullptr)
+}
+
+static void logMany(CLogContext *ctx, int value) {
+  CLOG_INF(ctx, IO, "%d %d %d %d %d %d %d %d %d", value, value + 1, 2, 3, 4, 5, 6, 7, value + 8)
+}
+
+static void logThread(CLogContext *ctx, size_t thread, size_t message) {
+  CLOG_INF(ctx, COMMUNICATION, "thread %zu message %zu", thread, message)
+}
+
+static void logDynamic(CLogContext *ctx, int width, const char *text) {
+  CLOG_INF(ctx, IO, "[%*s|%-*.*s] trailing %", width, text, width, 2, text)
+}
+
+class CLogSiteFormatTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 128;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogSiteFormatTest::printer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+
+  void SetUp() override {
+    messages.clear();
+    sites.clear();
+  }
+
+  static std::mutex lock;
+  static std::vector<std::string> messages;
+  static std::vector<const CLogCallSite *> sites;
+
+  static void printer(const CLogMessage *message) {
+    std::lock_guard<std::mutex> guard(lock);
+    messages.emplace_back(clog_getMessage(message));
+    sites.push_back(message->site);
+  };
+};
+
+std::mutex CLogSiteFormatTest::lock;
+std::vector<std::string> CLogSiteFormatTest::messages;
+std::vector<const CLogCallSite *> CLogSiteFormatTest::sites;
+
+TEST_F(CLogSiteFormatTest, parsedOnce) {
+  logValues(&ctx, 42, "first");
+  logValues(&ctx, -7, "second");
+
+  ASSERT_THAT(messages,
+              ElementsAre(formatPrintf("value %5d text '%s' %.1f%% %p", 42, "first", 10.5, nullptr),
+                          formatPrintf("value %5d text '%s' %.1f%% %p", -7, "second", -1.75, nullptr)));
+
+  const CLogSiteFormat *cache = sites[0]->formatCache;
+  ASSERT_NE(cache, nullptr);
+  ASSERT_EQ(cache->numberOfSpecs, 5U);
+  ASSERT_EQ(cache->length, strlen(sites[0]->format));
+  ASSERT_EQ(cache->specs[0].conversion, 'd');
+  ASSERT_EQ(cache->specs[0].width, 5);
+  ASSERT_EQ(cache->specs[1].conversion, 's');
+  ASSERT_EQ(cache->specs[2].precision, 1);
+  ASSERT_EQ(cache->specs[3].conversion, '%');
+  ASSERT_EQ(cache->specs[4].conversion, 'p');
+  ASSERT_EQ(&sites[0]->format[cache->specs[1].start], strstr(sites[0]->format, "%s"));
+}
+
+TEST_F(CLogSiteFormatTest, tooManySpecs) {
+  logMany(&ctx, 1);
+  logMany(&ctx, 10);
+
+  // not cached, but formatted all the same
+  ASSERT_THAT(messages, ElementsAre("1 2 2 3 4 5 6 7 9", "10 11 2 3 4 5 6 7 18"));
+  ASSERT_EQ(sites[0]->formatCache->numberOfSpecs, CLOG_SITE_SPECS);
+}
+
+TEST_F(CLogSiteFormatTest, dynamicWidthAndMalformedEnd) {
+  logDynamic(&ctx, 6, "abcdef");
+  logDynamic(&ctx, 3, "xy");
+
+  ASSERT_EQ(messages[0], formatPrintf("[%*s|%-*.*s] trailing %", 6, "abcdef", 6, 2, "abcdef"));
+  ASSERT_EQ(messages[1], formatPrintf("[%*s|%-*.*s] trailing %", 3, "xy", 3, 2, "xy"));
+}
+
+TEST_F(CLogSiteFormatTest, deferredFormatting) {
+  logValues(&ctx, 1, "eager");
+  ctx.deferredFormatting = true;
+  logValues(&ctx, 2, "deferred");
+  logDynamic(&ctx, 4, "text");
+
+  ASSERT_EQ(messages[0], formatPrintf("value %5d text '%s' %.1f%% %p", 1, "eager", 0.25, nullptr));
+  ASSERT_EQ(messages[1], formatPrintf("value %5d text '%s' %.1f%% %p", 2, "deferred", 0.5, nullptr));
+  // a malformed specification is printed as it is when formatting captured arguments
+  ASSERT_EQ(messages[2], "[text|te  ] trailing %");
+}
+
+TEST_F(CLogSiteFormatTest, concurrentFirstCall) {
+  static const size_t Threads = 8;
+  static const size_t Messages = 200;
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < Threads; t++) {
+    threads.emplace_back([this, t]() {
+      // the message buffer of a context must not be shared between threads
+      char threadBuffer[BufferSize];
+      CLogContext threadCtx = {
+          adapters, ARRAY_LENGTH(adapters), TagsNames, ARRAY_LENGTH(TagsNames), CLOG_LTRC, threadBuffer, BufferSize};
+      for (size_t i = 0; i < Messages; i++) {
+        logThread(&threadCtx, t, i);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(messages.size(), Threads * Messages);
+  std::sort(messages.begin(), messages.end());
+  for (size_t t = 0; t < Threads; t++) {
+    const std::string last = formatPrintf("thread %zu message %zu", t, Messages - 1);
+    ASSERT_TRUE(std::binary_search(messages.begin(), messages.end(), last)) << last;
+  }
+  ASSERT_EQ(sites[0]->formatCache->numberOfSpecs, 2U);
+  ASSERT_EQ(sites[0]->formatCache->specs[1].end, strlen(sites[0]->format));
+}
+
+TEST_F(CLogSiteFormatTest, temporarySites) {
+  // clog_logMessage() has no static call site, its format string is parsed on every call
+  for (int i = 0; i < 2; i++) {
+    clog_logMessage(&ctx, CLOG_LINF, IO, __FILE__, __LINE__, __func__, "value %d", i);
+  }
+  ASSERT_THAT(messages, ElementsAre("value 0", "value 1"));
+  ASSERT_THAT(sites, ElementsAre(nullptr, nullptr));
+}
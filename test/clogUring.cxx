@@ -0,0 +1,204 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clogUring.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+#define DEFAULT_TAGS(F) \
+  F(COMMUNICATION)      \
+  F(IO)
+
+class CLogUringTest : public ::testing::Test {
+protected:
+  static const size_t BufferSize = 64;
+  static const size_t BlockSize = 4096;
+  static const size_t NumberOfBlocks = 4;
+  char buffer[BufferSize];
+  CLogAdapter adapters[1] = {{nullptr, CLogUringTest::writer, CLOG_LTRC, 0U, nullptr}};
+  CLogContext ctx = {
+      adapters,
+      ARRAY_LENGTH(adapters),
+      TagsNames,
+      ARRAY_LENGTH(TagsNames),
+      CLOG_LTRC,
+      buffer,
+      BufferSize,
+  };
+  std::vector<char> blocks = std::vector<char>(BlockSize * NumberOfBlocks);
+
+  CLOG_ENUM_WITH_NAMES(Tags, DEFAULT_TAGS)
+
+  std::string path;
+
+  void SetUp() override {
+    path = makeTempFile("clogUring");
+    ASSERT_FALSE(path.empty());
+  }
+
+  void TearDown() override {
+    if (uring) {
+      clog_uringClose(uring.get());
+    }
+    unlink(path.c_str());
+  }
+
+  void open(bool plainWrites, const CLogFilePolicy &policy = {BlockSize, 0U, CLOG_LOFF}) {
+    uring.reset(new CLogUring());
+    uring->blocks = blocks.data();
+    uring->blockSize = BlockSize;
+    uring->numberOfBlocks = NumberOfBlocks;
+    uring->policy = policy;
+    uring->plainWrites = plainWrites;
+    current = uring.get();
+    ASSERT_TRUE(clog_uringOpen(uring.get(), path.c_str()));
+  }
+
+  std::vector<std::string> read() {
+    std::vector<std::string> lines;
+    std::ifstream stream(path);
+    std::string line;
+    while (std::getline(stream, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  void writeInOrder(bool plainWrites) {
+    static const int Messages = 5000;
+    open(plainWrites);
+
+    for (int i = 0; i < Messages; i++) {
+      CLOG_INF(&ctx, IO, "message %d", i)
+    }
+    clog_uringClose(uring.get());
+
+    ASSERT_GT(uring->writes, static_cast<uint64_t>(Messages) * 30U / BlockSize);
+    ASSERT_EQ(uring->errors, 0U);
+    auto lines = read();
+    ASSERT_EQ(lines.size(), static_cast<size_t>(Messages));
+    for (int i = 0; i < Messages; i++) {
+      ASSERT_THAT(lines[i], EndsWith(" message " + std::to_string(i)));
+    }
+  }
+
+  std::unique_ptr<CLogUring> uring;
+  static CLogUring *current;
+
+  static void writer(const CLogMessage *message) {
+    clog_uringWrite(current, message);
+  }
+};
+
+CLogUring *CLogUringTest::current;
+
+TEST_F(CLogUringTest, writesInOrder) {
+  writeInOrder(false);
+}
+
+TEST_F(CLogUringTest, fallbackWritesInOrder) {
+  writeInOrder(true);
+  ASSERT_FALSE(uring->native);
+  ASSERT_EQ(uring->waits, 0U);
+}
+
+TEST_F(CLogUringTest, appendsToExistingFile) {
+  {
+    std::ofstream stream(path);
+    stream << "existing line\n";
+  }
+  open(false);
+
+  CLOG_INF(&ctx, IO, "new line")
+  clog_uringFlush(uring.get());
+
+  auto lines = read();
+  ASSERT_EQ(lines.size(), 2U);
+  ASSERT_EQ(lines[0], "existing line");
+  ASSERT_THAT(lines[1], EndsWith(" new line"));
+}
+
+TEST_F(CLogUringTest, flushPolicy) {
+  open(false, {BlockSize, 0U, CLOG_LERR});
+
+  CLOG_INF(&ctx, IO, "info")
+  ASSERT_EQ(uring->writes, 0U);
+  CLOG_ERR(&ctx, IO, "error")
+  ASSERT_EQ(uring->writes, 1U);
+  CLOG_INF(&ctx, IO, "buffered")
+  clog_uringFlush(uring.get());
+  ASSERT_EQ(uring->writes, 2U);
+  ASSERT_EQ(uring->inFlight, 0U);
+
+  auto lines = read();
+  ASSERT_EQ(lines.size(), 3U);
+  ASSERT_THAT(lines[2], EndsWith(" buffered"));
+}
+
+TEST_F(CLogUringTest, batches) {
+  open(false);
+  const std::string text(2U * CLOG_FILE_LINE_SIZE, 'x');
+  std::vector<CLogMessage> messages;
+  for (size_t i = 0; i < 3U * NumberOfBlocks * BlockSize / CLOG_FILE_LINE_SIZE; i++) {
+    messages.push_back({"file.c", 1, "main", text.c_str(), CLOG_LINF, "IO"});
+  }
+
+  clog_uringWriteBatch(uring.get(), messages.data(), messages.size());
+  clog_uringFlush(uring.get());
+
+  auto lines = read();
+  ASSERT_EQ(lines.size(), messages.size());
+  for (const auto &line : lines) {
+    ASSERT_EQ(line.size(), CLOG_FILE_LINE_SIZE - 2U);
+  }
+}
+
+TEST_F(CLogUringTest, invalid) {
+  CLogUring tooFewBlocks = {};
+  tooFewBlocks.blocks = blocks.data();
+  tooFewBlocks.blockSize = BlockSize;
+  tooFewBlocks.numberOfBlocks = 1U;
+  CLogUring tooSmallBlocks = {};
+  tooSmallBlocks.blocks = blocks.data();
+  tooSmallBlocks.blockSize = CLOG_FILE_LINE_SIZE - 1U;
+  tooSmallBlocks.numberOfBlocks = NumberOfBlocks;
+  CLogUring noBlocks = {};
+  noBlocks.blocks = nullptr;
+  noBlocks.blockSize = BlockSize;
+  noBlocks.numberOfBlocks = NumberOfBlocks;
+  CLogUring valid = {};
+  valid.blocks = blocks.data();
+  valid.blockSize = BlockSize;
+  valid.numberOfBlocks = NumberOfBlocks;
+
+  ASSERT_FALSE(clog_uringOpen(&tooFewBlocks, path.c_str()));
+  ASSERT_FALSE(clog_uringOpen(&tooSmallBlocks, path.c_str()));
+  ASSERT_FALSE(clog_uringOpen(&noBlocks, path.c_str()));
+  ASSERT_FALSE(clog_uringOpen(&valid, "/nonexistent/directory/file.log"));
+  ASSERT_FALSE(clog_uringOpen(&valid, nullptr));
+  ASSERT_FALSE(clog_uringOpen(nullptr, path.c_str()));
+  clog_uringWrite(nullptr, nullptr);
+  clog_uringWriteBatch(nullptr, nullptr, 0U);
+  clog_uringFlush(nullptr);
+  clog_uringClose(nullptr);
+}
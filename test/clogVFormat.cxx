@@ -0,0 +1,127 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief
+ * @date 2019-09-16
+ *
+ * @file
+ */
+#include <climits>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "clog.h"
+#include "testUtils.h"
+
+using namespace ::testing;
+
+/**
+ * Formats with clog_vformat() and vsnprintf() into buffers of all sizes up to the length of the text and compares
+ * the results.
+ */
+static ::testing::AssertionResult formatsLikePrintf(const char *format, ...) {
+  va_list list;
+  va_start(list, format);
+
+  va_list copy;
+  va_copy(copy, list);
+  char expected[512];
+  int expectedLength = vsnprintf(expected, sizeof(expected), format, copy);
+  va_end(copy);
+
+  for (size_t size = 1; size <= static_cast<size_t>(expectedLength) + 1U; size++) {
+    std::vector<char> buffer(size + 1U, '\x7F');
+    std::vector<char> reference(size + 1U, '\x7F');
+
+    va_copy(copy, list);
+    size_t length = clog_vformat(buffer.data(), size, format, copy);
+    va_end(copy);
+    va_copy(copy, list);
+    vsnprintf(reference.data(), size, format, copy);
+    va_end(copy);
+
+    if (length != static_cast<size_t>(expectedLength) || buffer != reference) {
+      va_end(list);
+      return ::testing::AssertionFailure() << "format \"" << format << "\", size " << size << ": \"" << buffer.data()
+                                           << "\" (" << length << ") instead of \"" << reference.data() << "\" ("
+                                           << expectedLength << ")";
+    }
+  }
+
+  va_end(list);
+  return ::testing::AssertionSuccess();
+}
+
+TEST(CLogVFormat, integers) {
+  ASSERT_TRUE(formatsLikePrintf("%d %i %d %d %d", 0, 7, -7, INT_MAX, INT_MIN));
+  ASSERT_TRUE(formatsLikePrintf("%u %u %x %X %o", 0U, UINT_MAX, 0xDEADBEEFU, 0xABCDEFU, 0755U));
+  ASSERT_TRUE(formatsLikePrintf("%ld %lu %lx", LONG_MIN, ULONG_MAX, LONG_MAX));
+  ASSERT_TRUE(formatsLikePrintf("%lld %llu %llX", LLONG_MIN, ULLONG_MAX, 0x123456789ABCDEFULL));
+  ASSERT_TRUE(formatsLikePrintf("%zu %zd %zx", SIZE_MAX, (ssize_t)-3, (size_t)4096));
+  ASSERT_TRUE(formatsLikePrintf("%jd %ju %td %tu", INTMAX_MIN, UINTMAX_MAX, (ptrdiff_t)-9, (ptrdiff_t)9));
+  ASSERT_TRUE(formatsLikePrintf("%hhd %hhu %hd %hu %hhx", 300, 300, 70000, 70000, -1));
+  for (int value : {0, 1, 9, 10, 99, 100, 999, 1000, 12345, 99999, 100000, 1234567890}) {
+    ASSERT_TRUE(formatsLikePrintf("%d|%d", value, -value));
+  }
+}
+
+TEST(CLogVFormat, integerFlags) {
+  for (int value : {0, 5, -5, 123456}) {
+    ASSERT_TRUE(formatsLikePrintf("[%8d|%-8d|%08d|%+d|% d|%+08d|%-+8d]", value, value, value, value, value, value, value));
+    ASSERT_TRUE(formatsLikePrintf("[%.3d|%.0d|%8.3d|%-8.3d|%08.3d|%+.3d]", value, value, value, value, value, value));
+    ASSERT_TRUE(formatsLikePrintf("[%#x|%#X|%#o|%#.0o|%#08x|%#-8x|%.0x]",
+                                  (unsigned)value,
+                                  (unsigned)value,
+                                  (unsigned)value,
+                                  (unsigned)value,
+                                  (unsigned)value,
+                                  (unsigned)value,
+                                  (unsigned)value));
+    ASSERT_TRUE(formatsLikePrintf("[%*d|%-*d|%*d|%.*d|%.*d]", 6, value, 6, value, -6, value, 4, value, -1, value));
+  }
+  for (unsigned value : {0U, 5U, 0123U, 012345670U}) {
+    ASSERT_TRUE(formatsLikePrintf("[%#08o|%#03o|%#012o|%#-8o|%#8.3o|%#08.5o]", value, value, value, value, value, value));
+  }
+}
+
+TEST(CLogVFormat, stringsAndPointers) {
+  int local = 0;
+
+  ASSERT_TRUE(formatsLikePrintf("%s|%10s|%-10s|%.3s|%10.3s|%.*s", "text", "text", "text", "text", "text", 2, "text"));
+  ASSERT_TRUE(formatsLikePrintf("%.10s|%s", "short", static_cast<const char *>(nullptr)));
+  ASSERT_TRUE(formatsLikePrintf("%.2s|%.8s", static_cast<const char *>(nullptr), static_cast<const char *>(nullptr)));
+  ASSERT_TRUE(formatsLikePrintf("%c|%3c|%-3c|%%|%5%", 'a', 'b', 'c'));
+  ASSERT_TRUE(formatsLikePrintf("%p|%20p|%-20p|%p|%8p", (void *)&local, (void *)&local, (void *)&local, nullptr, nullptr));
+  ASSERT_TRUE(formatsLikePrintf("%+p|%.20p", (void *)&local, (void *)&local));
+}
+
+TEST(CLogVFormat, fallback) {
+  ASSERT_TRUE(formatsLikePrintf("%d %f %s", 1, 3.25, "x"));
+  ASSERT_TRUE(formatsLikePrintf("%e|%g|%a|%Lf", 1e10, 0.5, 1.0, 2.5L));
+  ASSERT_TRUE(formatsLikePrintf("%ls|%lc", L"wide", (wint_t)L'w'));
+  ASSERT_TRUE(formatsLikePrintf("%2$d %1$d", 1, 2));
+  ASSERT_TRUE(formatsLikePrintf("unknown %y and trailing %"));
+  ASSERT_TRUE(formatsLikePrintf("no conversion at all"));
+  ASSERT_TRUE(formatsLikePrintf(""));
+}
+
+TEST(CLogVFormat, invalid) {
+  char buffer[8] = "xxxxxxx";
+  va_list list{};
+
+  ASSERT_EQ(clog_vformat(nullptr, sizeof(buffer), "%d", list), 0U);
+  ASSERT_EQ(clog_vformat(buffer, 0U, "abc", list), 0U);
+  ASSERT_EQ(buffer[0], 'x');
+  ASSERT_EQ(clog_vformat(buffer, sizeof(buffer), nullptr, list), 0U);
+  ASSERT_STREQ(buffer, "");
+}
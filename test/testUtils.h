@@ -13,7 +13,12 @@
 #ifndef TESTUTILS_H
 #define TESTUTILS_H
 
+#include <cstdarg>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -33,6 +38,37 @@ template <typename T>::testing::AssertionResult ArraysEqual(T expected[], T actu
   return ::testing::AssertionSuccess();
 }
 
+// Creates an empty file in /tmp with the given prefix and returns its path, the caller removes it with unlink(). The
+// path is empty if the file could not be created.
+inline std::string makeTempFile(const char *prefix) {
+  std::string name = std::string("/tmp/") + prefix + "XXXXXX";
+  const int fd = mkstemp(&name[0]);
+  if (fd < 0) {
+    return std::string();
+  }
+  close(fd);
+  return name;
+}
+
+// Formats like printf as the reference for the formatters of the library, long texts are not truncated.
+inline std::string formatPrintf(const char *format, ...) {
+  char buffer[1024];
+  va_list list;
+  va_start(list, format);
+  va_list copy;
+  va_copy(copy, list);
+  // a malformed format is an error for vsnprintf, but what it printed is still the reference
+  const int length = vsnprintf(buffer, sizeof(buffer), format, copy);
+  va_end(copy);
+  std::string text(buffer);
+  if (length >= static_cast<int>(sizeof(buffer))) {
+    text.resize(static_cast<size_t>(length));
+    vsnprintf(&text[0], text.size() + 1U, format, list);
+  }
+  va_end(list);
+  return text;
+}
+
 class Adapter {
 public:
   virtual ~Adapter() = default;
@@ -0,0 +1,104 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Turns binary log files (see clogBinary.h) back into text.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * Usage: `clog-decode [-t] [-r] [file...]`
+ *
+ * Prints the lines of all given files (or of stdin if no file is given) as clog_formatMessage() produces them. With
+ * `-t` every line is prefixed by its timestamp (seconds and nanoseconds since the epoch).
+ *
+ * Compressed files (see clogCompress.h) are decompressed on the fly. With `-r` the (decompressed) content is printed
+ * as is instead of being decoded, e.g. for the compressed text logs of the file adapter.
+ */
+
+#include "clogBinary.h"
+#include "clogCompress.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// The size of the line buffer
+#define LineSize (4096U)
+
+static void printLine(const CLogMessage *msg, uint64_t timestamp, void *userData) {
+  const bool *printTimestamps = (const bool *)userData;
+  char line[LineSize];
+  int lineLength = sizeof(line);
+
+  clog_formatMessage(line, &lineLength, msg);
+
+  if (*printTimestamps) {
+    printf("%llu.%09llu ",
+           (unsigned long long)(timestamp / 1000000000U),
+           (unsigned long long)(timestamp % 1000000000U));
+  }
+  fputs(line, stdout);
+}
+
+static bool copy(FILE *file) {
+  char buffer[LineSize];
+  size_t size;
+
+  while ((size = fread(buffer, 1U, sizeof(buffer), file)) > 0U) {
+    fwrite(buffer, 1U, size, stdout);
+  }
+  return !ferror(file);
+}
+
+static bool decode(FILE *file, const char *name, bool *printTimestamps, bool raw) {
+  FILE *stream = clog_decompressStream(file);
+  if (NULL == stream) {
+    fprintf(stderr, "clog-decode: %s: out of memory\n", name);
+    return false;
+  }
+
+  bool ok = raw ? copy(stream) : clog_binaryRead(stream, printLine, printTimestamps);
+  fclose(stream);
+  if (!ok) {
+    fprintf(stderr, "clog-decode: %s: not a readable %s or corrupted\n", name, raw ? "file" : "binary log");
+  }
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  bool printTimestamps = false;
+  bool raw = false;
+  bool ok = true;
+  int first = 1;
+
+  for (; first < argc; first++) {
+    if (0 == strcmp(argv[first], "-t")) {
+      printTimestamps = true;
+    } else if (0 == strcmp(argv[first], "-r")) {
+      raw = true;
+    } else {
+      break;
+    }
+  }
+
+  if (first >= argc) {
+    return decode(stdin, "stdin", &printTimestamps, raw) ? 0 : 1;
+  }
+
+  for (int i = first; i < argc; i++) {
+    FILE *file = fopen(argv[i], "rb");
+    if (NULL == file) {
+      perror(argv[i]);
+      ok = false;
+      continue;
+    }
+
+    ok = decode(file, argv[i], &printTimestamps, raw) && ok;
+    fclose(file);
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,316 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Prints the messages of an indexed log selected by a query.
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * Usage: `clog-query [-l LEVEL] [-t TAG]... [-s FILE:LINE] [-f FROM] [-u UNTIL] [-i INDEX] [-v] LOG`
+ *
+ * Reads the index of LOG (`LOG.idx` unless given with `-i`, see clogIndex.h) and only reads the blocks of LOG that
+ * might contain messages
+ * - of at least LEVEL (`-l`, e.g. `WRN`),
+ * - with one of the tags (`-t`, may be repeated),
+ * - of the call site FILE:LINE (`-s`),
+ * - written from FROM (`-f`) until before UNTIL (`-u`). The times are seconds since the epoch, `YYYY-MM-DD HH:MM[:SS]`
+ *   or `HH:MM[:SS]` (on the day of the first indexed message), in local time.
+ *
+ * Blocks of binary logs (see clogBinary.h) are decoded and only the matching messages are printed, prefixed by their
+ * timestamp like `clog-decode -t` does. Blocks of text logs are printed as a whole, so they might contain further
+ * lines. Compressed logs (see clogCompress.h) are decompressed on the fly. With `-v` the number of read and skipped
+ * blocks is printed to stderr.
+ */
+
+#define _GNU_SOURCE
+#include "clogBinary.h"
+#include "clogCompress.h"
+#include "clogIndex.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+// The size of the line and copy buffers
+#define LineSize (4096U)
+// The maximum number of tags of a query
+#define MaxTags (16U)
+
+static const char BinaryMagic[] = {CLOG_BINARY_MAGIC};
+
+/**
+ * The entries of an index file.
+ */
+typedef struct _Entries {
+  CLogIndexEntry *entries;
+  size_t count;
+  bool ok;
+} Entries;
+
+static void addEntry(const CLogIndexEntry *entry, void *userData) {
+  Entries *entries = (Entries *)userData;
+  CLogIndexEntry *resized = realloc(entries->entries, (entries->count + 1U) * sizeof(CLogIndexEntry));
+  if (NULL == resized) {
+    entries->ok = false;
+    return;
+  }
+  entries->entries = resized;
+  entries->entries[entries->count++] = *entry;
+}
+
+static bool parseLevel(const char *text, CLogLevel *level) {
+  for (unsigned int i = CLOG_LTRC; i < CLOG_LOFF; i++) {
+    if (0 == strcasecmp(text, clog_getLevel((CLogLevel)i))) {
+      *level = (CLogLevel)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool parseSite(char *text, CLogIndexQuery *query) {
+  char *colon = strrchr(text, ':');
+  char *end = NULL;
+  if (NULL == colon || colon == text) {
+    return false;
+  }
+
+  unsigned long line = strtoul(colon + 1, &end, 10);
+  if (end == colon + 1 || '\0' != *end) {
+    return false;
+  }
+  *colon = '\0';
+  query->file = text;
+  query->line = (unsigned int)line;
+  return true;
+}
+
+/**
+ * Parses a local time, a time of day is taken on the day of reference.
+ *
+ * @return The time in ns since the epoch, 0 if text is no valid time.
+ */
+static uint64_t parseTime(const char *text, uint64_t reference) {
+  static const char *const DateFormats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M"};
+  static const char *const TimeFormats[] = {"%H:%M:%S", "%H:%M"};
+  char *end = NULL;
+
+  unsigned long long seconds = strtoull(text, &end, 10);
+  if (end != text && '\0' == *end) {
+    return (uint64_t)seconds * 1000000000U;
+  }
+
+  struct tm tm;
+  for (size_t i = 0; i < sizeof(DateFormats) / sizeof(DateFormats[0]); i++) {
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(text, DateFormats[i], &tm);
+    if (NULL != end && '\0' == *end) {
+      tm.tm_isdst = -1;
+      return (uint64_t)mktime(&tm) * 1000000000U;
+    }
+  }
+
+  const time_t day = (time_t)(reference / 1000000000U);
+  for (size_t i = 0; i < sizeof(TimeFormats) / sizeof(TimeFormats[0]); i++) {
+    localtime_r(&day, &tm);
+    tm.tm_sec = 0;
+    end = strptime(text, TimeFormats[i], &tm);
+    if (NULL != end && '\0' == *end) {
+      tm.tm_isdst = -1;
+      return (uint64_t)mktime(&tm) * 1000000000U;
+    }
+  }
+  return 0U;
+}
+
+static void printMessage(const CLogMessage *msg, uint64_t timestamp, void *userData) {
+  const CLogIndexQuery *query = (const CLogIndexQuery *)userData;
+  char line[LineSize];
+  int lineLength = sizeof(line);
+
+  if (!clog_indexMatches(query, msg, timestamp)) {
+    return;
+  }
+
+  clog_formatMessage(line, &lineLength, msg);
+  printf("%llu.%09llu ",
+         (unsigned long long)(timestamp / 1000000000U),
+         (unsigned long long)(timestamp % 1000000000U));
+  fputs(line, stdout);
+}
+
+/**
+ * Prints the matching messages of a block of a binary log or the whole block of a text log.
+ */
+static bool printBlock(FILE *stream, const CLogIndexEntry *entry, const CLogIndexQuery *query) {
+  char buffer[LineSize];
+  uint64_t left = entry->length;
+
+  if (0 != fseeko(stream, (off_t)entry->offset, SEEK_SET)) {
+    return false;
+  }
+
+  size_t size = fread(buffer, 1U, (left < sizeof(buffer)) ? (size_t)left : sizeof(buffer), stream);
+  if (size < sizeof(BinaryMagic) || 0 != memcmp(buffer, BinaryMagic, sizeof(BinaryMagic))) {
+    while (size > 0U) {
+      fwrite(buffer, 1U, size, stdout);
+      left -= size;
+      size = fread(buffer, 1U, (left < sizeof(buffer)) ? (size_t)left : sizeof(buffer), stream);
+    }
+    return 0U == left;
+  }
+
+  // every block of an indexed binary log can be decoded on its own
+  char *block = malloc((size_t)entry->length);
+  if (NULL == block) {
+    return false;
+  }
+  memcpy(block, buffer, size);
+  bool ok = (fread(&block[size], 1U, (size_t)(left - size), stream) == left - size);
+  FILE *records = ok ? fmemopen(block, (size_t)entry->length, "rb") : NULL;
+  ok = (NULL != records) && clog_binaryRead(records, printMessage, (void *)query);
+  if (NULL != records) {
+    fclose(records);
+  }
+  free(block);
+  return ok;
+}
+
+static void usage(void) {
+  fputs("usage: clog-query [-l LEVEL] [-t TAG]... [-s FILE:LINE] [-f FROM] [-u UNTIL] [-i INDEX] [-v] LOG\n",
+        stderr);
+}
+
+int main(int argc, char *argv[]) {
+  const char *tags[MaxTags];
+  CLogIndexQuery query = {0U, 0U, CLOG_LTRC, tags, 0U, NULL, 0U};
+  const char *from = NULL;
+  const char *until = NULL;
+  const char *indexPath = NULL;
+  bool verbose = false;
+  int option;
+
+  while (-1 != (option = getopt(argc, argv, "l:t:s:f:u:i:v"))) {
+    switch (option) {
+    case 'l':
+      if (!parseLevel(optarg, &query.level)) {
+        fprintf(stderr, "clog-query: unknown level %s\n", optarg);
+        return 2;
+      }
+      break;
+    case 't':
+      if (query.numberOfTags >= MaxTags) {
+        fprintf(stderr, "clog-query: more than %u tags\n", MaxTags);
+        return 2;
+      }
+      tags[query.numberOfTags++] = optarg;
+      break;
+    case 's':
+      if (!parseSite(optarg, &query)) {
+        fprintf(stderr, "clog-query: call site %s is not FILE:LINE\n", optarg);
+        return 2;
+      }
+      break;
+    case 'f':
+      from = optarg;
+      break;
+    case 'u':
+      until = optarg;
+      break;
+    case 'i':
+      indexPath = optarg;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (optind + 1 != argc) {
+    usage();
+    return 2;
+  }
+
+  const char *logPath = argv[optind];
+  char defaultPath[LineSize];
+  if (NULL == indexPath) {
+    snprintf(defaultPath, sizeof(defaultPath), "%s.idx", logPath);
+    indexPath = defaultPath;
+  }
+
+  FILE *indexFile = fopen(indexPath, "rb");
+  if (NULL == indexFile) {
+    perror(indexPath);
+    return 1;
+  }
+  Entries entries = {NULL, 0U, true};
+  bool ok = clog_indexRead(indexFile, addEntry, &entries) && entries.ok;
+  fclose(indexFile);
+  if (!ok) {
+    // a truncated index (e.g. of a log still being written) is used as far as it goes
+    fprintf(stderr, "clog-query: %s: not a readable index or truncated\n", indexPath);
+  }
+
+  // times of day refer to the day of the first message
+  uint64_t reference = (uint64_t)time(NULL) * 1000000000U;
+  for (size_t i = 0; i < entries.count; i++) {
+    if (0U != entries.entries[i].first && UINT64_MAX != entries.entries[i].first) {
+      reference = entries.entries[i].first;
+      break;
+    }
+  }
+  if ((NULL != from && 0U == (query.from = parseTime(from, reference))) ||
+      (NULL != until && 0U == (query.until = parseTime(until, reference)))) {
+    fprintf(stderr, "clog-query: invalid time %s\n", (0U == query.from && NULL != from) ? from : until);
+    free(entries.entries);
+    return 2;
+  }
+
+  FILE *log = fopen(logPath, "rb");
+  FILE *stream = (NULL != log) ? clog_decompressStream(log) : NULL;
+  if (NULL == stream) {
+    perror(logPath);
+    if (NULL != log) {
+      fclose(log);
+    }
+    free(entries.entries);
+    return 1;
+  }
+
+  size_t readBlocks = 0U;
+  for (size_t i = 0; i < entries.count; i++) {
+    if (!clog_indexMayMatch(&entries.entries[i], &query)) {
+      continue;
+    }
+    readBlocks++;
+    if (!printBlock(stream, &entries.entries[i], &query)) {
+      fprintf(stderr,
+              "clog-query: %s: block at %llu is not readable\n",
+              logPath,
+              (unsigned long long)entries.entries[i].offset);
+      ok = false;
+    }
+  }
+
+  if (verbose) {
+    fprintf(stderr,
+            "clog-query: read %zu of %zu blocks, skipped %zu\n",
+            readBlocks,
+            entries.count,
+            entries.count - readBlocks);
+  }
+
+  fclose(stream);
+  fclose(log);
+  free(entries.entries);
+  return ok ? 0 : 1;
+}
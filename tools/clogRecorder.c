@@ -0,0 +1,56 @@
+/**
+ * @copyright (c) 2019 mrab
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ *
+ * @author Melchior Rabe (oss@mrab.de)
+ * @brief Prints the lines kept by a flight recorder (see clogRecorder.h).
+ * @date 2019-09-16
+ *
+ * @file
+ *
+ * Usage: `clog-recorder [-s] file...`
+ *
+ * Prints the valid lines of the given flight recorder files in the order they have been written. With `-s` every line
+ * is prefixed by its sequence number.
+ */
+
+#include "clogRecorder.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static void printLine(const char *line, size_t length, uint64_t sequence, void *userData) {
+  const bool *printSequence = (const bool *)userData;
+
+  if (*printSequence) {
+    printf("%llu ", (unsigned long long)sequence);
+  }
+  fwrite(line, 1U, length, stdout);
+}
+
+int main(int argc, char *argv[]) {
+  bool printSequence = false;
+  bool ok = true;
+  int first = 1;
+
+  if (first < argc && 0 == strcmp(argv[first], "-s")) {
+    printSequence = true;
+    first++;
+  }
+
+  if (first >= argc) {
+    fprintf(stderr, "usage: clog-recorder [-s] file...\n");
+    return 2;
+  }
+
+  for (int i = first; i < argc; i++) {
+    if (!clog_recorderRead(argv[i], printLine, &printSequence)) {
+      fprintf(stderr, "clog-recorder: %s: not a readable flight recorder file\n", argv[i]);
+      ok = false;
+    }
+  }
+
+  return ok ? 0 : 1;
+}